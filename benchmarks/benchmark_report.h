@@ -0,0 +1,108 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_BENCHMARK_REPORT_H
+#define FSM_BENCHMARK_REPORT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench
+{
+using Clock = std::chrono::steady_clock;
+
+/// \return Nanoseconds on the steady clock
+inline std::int64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+//=====================================================================================================================
+/// Outcome of one benchmark case
+struct Result
+{
+  std::string name;
+  std::vector<std::pair<std::string, std::string>> params;  //!< what was measured
+  std::vector<std::pair<std::string, double>> values;       //!< measurements
+  bool verified = true;                                     //!< false if the machines misbehaved under load
+};
+
+//=====================================================================================================================
+/// Collects results and writes them as a JSON document, so runs can be compared across releases
+class Report
+{
+public:
+  void add(Result result)
+  {
+    results_.push_back(std::move(result));
+  }
+
+  bool allVerified() const
+  {
+    return std::all_of(results_.begin(), results_.end(), [](const Result& r) { return r.verified; });
+  }
+
+  void write(std::ostream& out, const std::string& version, const std::string& build) const
+  {
+    out << "{\n  \"library_version\": " << quote(version) << ",\n  \"build\": " << quote(build)
+        << ",\n  \"results\": [";
+    for (std::size_t i = 0; i < results_.size(); ++i)
+    {
+      const auto& r = results_[i];
+      out << (i == 0 ? "\n" : ",\n") << "    {\"name\": " << quote(r.name) << ", \"verified\": "
+          << (r.verified ? "true" : "false") << ", \"params\": {";
+      for (std::size_t j = 0; j < r.params.size(); ++j)
+      {
+        out << (j == 0 ? "" : ", ") << quote(r.params[j].first) << ": " << quote(r.params[j].second);
+      }
+      out << "}, \"values\": {";
+      for (std::size_t j = 0; j < r.values.size(); ++j)
+      {
+        out << (j == 0 ? "" : ", ") << quote(r.values[j].first) << ": " << r.values[j].second;
+      }
+      out << "}}";
+    }
+    out << "\n  ]\n}\n";
+  }
+
+private:
+  static std::string quote(const std::string& s)
+  {
+    std::string q = "\"";
+    for (const auto c : s)
+    {
+      if ((c == '"') || (c == '\\'))
+      {
+        q += '\\';
+      }
+      q += c;
+    }
+    return q + "\"";
+  }
+
+private:
+  std::vector<Result> results_;
+};
+
+//=====================================================================================================================
+/// \return The value at fraction p (0 to 1) of sorted samples
+inline double percentile(const std::vector<std::int64_t>& sorted, double p)
+{
+  if (sorted.empty())
+  {
+    return 0.0;
+  }
+  const auto index = std::min(sorted.size() - 1, static_cast<std::size_t>(p * static_cast<double>(sorted.size())));
+  return static_cast<double>(sorted[index]);
+}
+
+}  // namespace bench
+
+#endif  // FSM_BENCHMARK_REPORT_H
@@ -0,0 +1,894 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+// Throughput, latency and scaling benchmarks of the fsm library. Results are written as JSON to stdout, or to the
+// file given with --output. Each case also checks that no event was lost or processed twice under load, and the
+// program exits with an error if one was, so it doubles as a stress test. Pass --quick for a short smoke run.
+
+#include "benchmark_report.h"
+#include "fsm/event_bus.h"
+#include "fsm/executor.h"
+#include "fsm/fsm.h"
+#include "fsm/shared_event_queue.h"
+#include "fsm/simulation.h"
+#include "fsm/version.h"
+
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
+
+namespace
+{
+//=====================================================================================================================
+/// State that counts how often it is entered
+class CountingState : public fsm::State
+{
+public:
+  CountingState(fsm::Fsm& fsm, const Id& id, std::atomic<std::uint64_t>& entries)
+    : fsm::State(fsm, id), entries_(entries)
+  {
+  }
+  void onEntry() final
+  {
+    entries_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void onExit() final
+  {
+  }
+
+private:
+  std::atomic<std::uint64_t>& entries_;
+};
+
+//=====================================================================================================================
+/// State that measures the time since the event that entered it was raised. The raise timestamp is the payload.
+class LatencyState : public fsm::State
+{
+public:
+  LatencyState(fsm::Fsm& fsm, const Id& id, std::vector<std::int64_t>& samples, std::atomic<std::uint64_t>& entries)
+    : fsm::State(fsm, id), samples_(samples), entries_(entries)
+  {
+  }
+  void onEntry() final
+  {
+    const auto* raised_at = getFsm().getEventPayload().get<std::int64_t>();
+    if (raised_at != nullptr)
+    {
+      samples_.push_back(bench::now() - *raised_at);
+    }
+    entries_.fetch_add(1, std::memory_order_release);
+  }
+  void onExit() final
+  {
+  }
+
+private:
+  std::vector<std::int64_t>& samples_;
+  std::atomic<std::uint64_t>& entries_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/// Define a machine that flips between two states on one event
+/// \return The event
+fsm::Fsm::EventHandle defineToggle(fsm::Fsm& fsm, std::atomic<std::uint64_t>& entries)
+//---------------------------------------------------------------------------------------------------------------------
+{
+  fsm.addState(std::make_shared<CountingState>(fsm, "a", entries));
+  fsm.addState(std::make_shared<CountingState>(fsm, "b", entries));
+  fsm.addTransitionRule("a", "toggle", "b");
+  fsm.addTransitionRule("b", "toggle", "a");
+  return fsm.getEventHandle("toggle");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/// Define a machine with the shape of the MotorController example
+void defineMotor(fsm::Fsm& fsm, std::atomic<std::uint64_t>& entries)
+//---------------------------------------------------------------------------------------------------------------------
+{
+  for (const auto* id : { "idle", "power_up", "power_down", "speed_control" })
+  {
+    fsm.addState(std::make_shared<CountingState>(fsm, id, entries));
+  }
+  fsm.addTransitionRule("idle", "on", "power_up");
+  fsm.addTransitionRule("power_up", "maintain_speed", "speed_control");
+  fsm.addTransitionRule("speed_control", "off", "power_down");
+  fsm.addTransitionRule("power_up", "off", "power_down");
+  fsm.addTransitionRule("power_down", "on", "power_up");
+  fsm.addTransitionRule("power_down", "has_shutdown", "idle");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void waitIdle(const fsm::Fsm& fsm)
+//---------------------------------------------------------------------------------------------------------------------
+{
+  while (fsm.hasPendingEvents())
+  {
+    std::this_thread::yield();
+  }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+const char* toString(fsm::QueueType type)
+//---------------------------------------------------------------------------------------------------------------------
+{
+  return (type == fsm::QueueType::Locked) ? "locked" : "lock_free";
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+double perSecond(std::uint64_t count, std::int64_t elapsed_ns)
+//---------------------------------------------------------------------------------------------------------------------
+{
+  return (elapsed_ns > 0) ? static_cast<double>(count) * 1e9 / static_cast<double>(elapsed_ns) : 0.0;
+}
+
+//=====================================================================================================================
+/// Events per second raised by one thread and processed by the machine's own handler thread, and raised and
+/// processed inline by one thread
+void benchSingleProducer(bench::Report& report, std::uint64_t num_events)
+//=====================================================================================================================
+{
+  struct Variant
+  {
+    fsm::QueueType queue;
+    fsm::DispatchMode dispatch;
+    const char* dispatch_name;
+  };
+  const Variant variants[] = { { fsm::QueueType::Locked, fsm::DispatchMode::Background, "background" },
+                               { fsm::QueueType::LockFree, fsm::DispatchMode::Background, "background" },
+                               { fsm::QueueType::Locked, fsm::DispatchMode::Inline, "inline" } };
+  for (const auto& v : variants)
+  {
+    std::atomic<std::uint64_t> entries{ 0 };
+    fsm::Fsm::Config config;
+    config.queue_type = v.queue;
+    config.dispatch_mode = v.dispatch;
+    fsm::Fsm machine(config);
+    const auto toggle = defineToggle(machine, entries);
+    machine.start("a");
+    entries = 0;
+
+    const auto t0 = bench::now();
+    for (std::uint64_t i = 0; i < num_events; ++i)
+    {
+      machine.raise(toggle);
+    }
+    const auto raised = bench::now();
+    waitIdle(machine);
+    const auto t1 = bench::now();
+
+    bench::Result r;
+    r.name = "single_producer_throughput";
+    r.params = { { "queue", toString(v.queue) }, { "dispatch", v.dispatch_name },
+                 { "events", std::to_string(num_events) } };
+    r.values = { { "events_per_second", perSecond(num_events, t1 - t0) },
+                 { "raise_ns_per_event", static_cast<double>(raised - t0) / static_cast<double>(num_events) } };
+    r.verified = (entries.load() == num_events);
+    report.add(std::move(r));
+  }
+}
+
+//=====================================================================================================================
+/// Events per second raised concurrently by several threads into one machine
+void benchMultiProducer(bench::Report& report, std::uint64_t num_events)
+//=====================================================================================================================
+{
+  for (const auto queue : { fsm::QueueType::Locked, fsm::QueueType::LockFree })
+  {
+    for (const std::uint64_t producers : { 2U, 4U, 8U })
+    {
+      std::atomic<std::uint64_t> entries{ 0 };
+      fsm::Fsm::Config config;
+      config.queue_type = queue;
+      fsm::Fsm machine(config);
+      const auto toggle = defineToggle(machine, entries);
+      machine.start("a");
+      entries = 0;
+
+      const auto per_producer = num_events / producers;
+      std::atomic<bool> go{ false };
+      std::vector<std::thread> threads;
+      for (std::uint64_t p = 0; p < producers; ++p)
+      {
+        threads.emplace_back([&]() {
+          while (!go.load(std::memory_order_acquire))
+          {
+            std::this_thread::yield();
+          }
+          for (std::uint64_t i = 0; i < per_producer; ++i)
+          {
+            machine.raise(toggle);
+          }
+        });
+      }
+      const auto t0 = bench::now();
+      go.store(true, std::memory_order_release);
+      for (auto& t : threads)
+      {
+        t.join();
+      }
+      waitIdle(machine);
+      const auto t1 = bench::now();
+
+      const auto total = per_producer * producers;
+      bench::Result r;
+      r.name = "multi_producer_throughput";
+      r.params = { { "queue", toString(queue) }, { "producers", std::to_string(producers) },
+                   { "events", std::to_string(total) } };
+      r.values = { { "events_per_second", perSecond(total, t1 - t0) } };
+      r.verified = (entries.load() == total);
+      report.add(std::move(r));
+    }
+  }
+}
+
+//=====================================================================================================================
+/// Events per second raised in bursts by one thread, one at a time with Fsm::raise() and all at once with
+/// Fsm::raiseBatch(), and processed by the machine's own handler thread
+void benchBurst(bench::Report& report, std::uint64_t num_events)
+//=====================================================================================================================
+{
+  for (const auto queue : { fsm::QueueType::Locked, fsm::QueueType::LockFree })
+  {
+    for (const std::uint64_t burst_size : { 8U, 256U })
+    {
+      for (const bool batched : { false, true })
+      {
+        std::atomic<std::uint64_t> entries{ 0 };
+        fsm::Fsm::Config config;
+        config.queue_type = queue;
+        fsm::Fsm machine(config);
+        const auto toggle = defineToggle(machine, entries);
+        machine.start("a");
+        entries = 0;
+
+        const std::vector<fsm::Fsm::EventHandle> burst(burst_size, toggle);
+        const auto num_bursts = num_events / burst_size;
+        const auto t0 = bench::now();
+        for (std::uint64_t i = 0; i < num_bursts; ++i)
+        {
+          if (batched)
+          {
+            machine.raiseBatch(burst.data(), burst.data() + burst.size());
+          }
+          else
+          {
+            for (const auto event : burst)
+            {
+              machine.raise(event);
+            }
+          }
+        }
+        waitIdle(machine);
+        const auto t1 = bench::now();
+
+        const auto total = num_bursts * burst_size;
+        bench::Result r;
+        r.name = "burst_throughput";
+        r.params = { { "queue", toString(queue) }, { "burst", std::to_string(burst_size) },
+                     { "raise", batched ? "batch" : "single" }, { "events", std::to_string(total) } };
+        r.values = { { "events_per_second", perSecond(total, t1 - t0) } };
+        r.verified = (entries.load() == total);
+        report.add(std::move(r));
+      }
+    }
+  }
+}
+
+//=====================================================================================================================
+/// Distribution of the time from Fsm::raise() to the start of State::onEntry() of the target state, one event in
+/// flight at a time
+void benchLatency(bench::Report& report, std::uint64_t num_events)
+//=====================================================================================================================
+{
+  struct Variant
+  {
+    fsm::QueueType queue;
+    fsm::DispatchMode dispatch;
+    bool executor;
+    const char* dispatch_name;
+  };
+  const Variant variants[] = { { fsm::QueueType::Locked, fsm::DispatchMode::Background, false, "thread" },
+                               { fsm::QueueType::LockFree, fsm::DispatchMode::Background, false, "thread" },
+                               { fsm::QueueType::Locked, fsm::DispatchMode::Background, true, "executor" },
+                               { fsm::QueueType::Locked, fsm::DispatchMode::Inline, false, "inline" } };
+  for (const auto& v : variants)
+  {
+    std::vector<std::int64_t> samples;
+    samples.reserve(num_events);
+    std::atomic<std::uint64_t> entries{ 0 };
+    fsm::Fsm::Config config;
+    config.queue_type = v.queue;
+    config.dispatch_mode = v.dispatch;
+    if (v.executor)
+    {
+      config.executor = std::make_shared<fsm::Executor>(1);
+    }
+    fsm::Fsm machine(config);
+    machine.addState(std::make_shared<LatencyState>(machine, "a", samples, entries));
+    machine.addState(std::make_shared<LatencyState>(machine, "b", samples, entries));
+    machine.addTransitionRule("a", "toggle", "b");
+    machine.addTransitionRule("b", "toggle", "a");
+    const auto toggle = machine.getEventHandle("toggle");
+    machine.start("a");
+
+    for (std::uint64_t i = 0; i < num_events; ++i)
+    {
+      const auto expected = entries.load(std::memory_order_relaxed) + 1;
+      machine.raise(toggle, bench::now());
+      while (entries.load(std::memory_order_acquire) < expected)
+      {
+        std::this_thread::yield();
+      }
+    }
+    waitIdle(machine);
+
+    std::sort(samples.begin(), samples.end());
+    bench::Result r;
+    r.name = "raise_to_entry_latency";
+    r.params = { { "queue", toString(v.queue) }, { "dispatch", v.dispatch_name },
+                 { "events", std::to_string(num_events) } };
+    r.values = { { "p50_ns", bench::percentile(samples, 0.5) },
+                 { "p90_ns", bench::percentile(samples, 0.9) },
+                 { "p99_ns", bench::percentile(samples, 0.99) },
+                 { "p999_ns", bench::percentile(samples, 0.999) },
+                 { "max_ns", samples.empty() ? 0.0 : static_cast<double>(samples.back()) } };
+    r.verified = (samples.size() == num_events);
+    report.add(std::move(r));
+  }
+}
+
+//=====================================================================================================================
+/// Cost of dispatch as the transition table grows. Every state has a rule for every event, so every event causes a
+/// transition, to targets spread over the table.
+void benchTableSize(bench::Report& report, std::uint64_t num_events, bool quick)
+//=====================================================================================================================
+{
+  const std::vector<std::uint32_t> state_counts = quick ? std::vector<std::uint32_t>{ 4, 64 }
+                                                        : std::vector<std::uint32_t>{ 4, 64, 512 };
+  const std::vector<std::uint32_t> event_counts = quick ? std::vector<std::uint32_t>{ 4, 64 }
+                                                        : std::vector<std::uint32_t>{ 4, 64, 256 };
+  for (const auto num_states : state_counts)
+  {
+    for (const auto num_events_defined : event_counts)
+    {
+      std::atomic<std::uint64_t> entries{ 0 };
+      fsm::Fsm::Config config;
+      config.dispatch_mode = fsm::DispatchMode::Inline;
+      fsm::Fsm machine(config);
+      std::vector<fsm::Fsm::StateHandle> states;
+      std::vector<fsm::Fsm::EventHandle> events;
+      for (std::uint32_t s = 0; s < num_states; ++s)
+      {
+        states.push_back(machine.addState(std::make_shared<CountingState>(machine, "s" + std::to_string(s), entries)));
+      }
+      for (std::uint32_t e = 0; e < num_events_defined; ++e)
+      {
+        events.push_back(machine.addEvent("e" + std::to_string(e)));
+      }
+      for (std::uint32_t s = 0; s < num_states; ++s)
+      {
+        for (std::uint32_t e = 0; e < num_events_defined; ++e)
+        {
+          machine.addTransitionRule(states[s], events[e], states[(s * 7U + e + 1U) % num_states]);
+        }
+      }
+
+      const auto t_start = bench::now();
+      machine.start("s0");
+      const auto t0 = bench::now();
+      entries = 0;
+      for (std::uint64_t i = 0; i < num_events; ++i)
+      {
+        machine.raise(events[(i * 31U) % num_events_defined]);
+      }
+      const auto t1 = bench::now();
+
+      bench::Result r;
+      r.name = "table_size_scaling";
+      r.params = { { "states", std::to_string(num_states) }, { "events", std::to_string(num_events_defined) },
+                   { "dispatched", std::to_string(num_events) } };
+      r.values = { { "ns_per_transition", static_cast<double>(t1 - t0) / static_cast<double>(num_events) },
+                   { "start_us", static_cast<double>(t0 - t_start) / 1e3 } };
+      r.verified = (entries.load() == num_events);
+      report.add(std::move(r));
+    }
+  }
+}
+
+//=====================================================================================================================
+/// Dispatch in a generated machine where a few states cycle through a few events, and many more states, with rules
+/// for events of their own, cannot be reached from the initial state. Fsm::start() drops those states and events
+/// from the table. Verified by the transitions taken and by the unreachable states Fsm::getAnalysis() reports.
+void benchPrunedTable(bench::Report& report, std::uint64_t num_events, bool quick)
+//=====================================================================================================================
+{
+  constexpr std::uint32_t NUM_LIVE = 8;
+  const std::uint32_t num_dead = quick ? 512 : 4096;
+  const std::uint32_t num_dead_events = 64;
+
+  std::atomic<std::uint64_t> entries{ 0 };
+  fsm::Fsm::Config config;
+  config.dispatch_mode = fsm::DispatchMode::Inline;
+  fsm::Fsm machine(config);
+  std::vector<fsm::Fsm::StateHandle> states;
+  for (std::uint32_t s = 0; s < NUM_LIVE + num_dead; ++s)
+  {
+    states.push_back(machine.addState(std::make_shared<CountingState>(machine, "s" + std::to_string(s), entries)));
+  }
+  std::vector<fsm::Fsm::EventHandle> events;
+  for (std::uint32_t e = 0; e < NUM_LIVE + num_dead_events; ++e)
+  {
+    events.push_back(machine.addEvent("e" + std::to_string(e)));
+  }
+  for (std::uint32_t s = 0; s < NUM_LIVE; ++s)
+  {
+    for (std::uint32_t e = 0; e < NUM_LIVE; ++e)
+    {
+      machine.addTransitionRule(states[s], events[e], states[(s + e + 1U) % NUM_LIVE]);
+    }
+  }
+  for (std::uint32_t s = 0; s < num_dead; ++s)
+  {
+    for (std::uint32_t e = 0; e < num_dead_events; ++e)
+    {
+      machine.addTransitionRule(states[NUM_LIVE + s], events[NUM_LIVE + e],
+                                states[NUM_LIVE + (s * 7U + e + 1U) % num_dead]);
+    }
+  }
+
+  const auto t_start = bench::now();
+  machine.start("s0");
+  const auto t0 = bench::now();
+  entries = 0;
+  for (std::uint64_t i = 0; i < num_events; ++i)
+  {
+    machine.raise(events[(i * 3U) % NUM_LIVE]);
+  }
+  const auto t1 = bench::now();
+  const auto analysis = machine.getAnalysis();
+
+  bench::Result r;
+  r.name = "pruned_table";
+  r.params = { { "live_states", std::to_string(NUM_LIVE) }, { "dead_states", std::to_string(num_dead) },
+               { "dispatched", std::to_string(num_events) } };
+  r.values = { { "ns_per_transition", static_cast<double>(t1 - t0) / static_cast<double>(num_events) },
+               { "start_us", static_cast<double>(t0 - t_start) / 1e3 },
+               { "table_entries", static_cast<double>(analysis.table_size) },
+               { "unpruned_entries", static_cast<double>(states.size() * events.size()) } };
+  r.verified = (entries.load() == num_events) && (analysis.unreachable_states.size() == num_dead) &&
+               (analysis.unhandled_events.size() == num_dead_events);
+  report.add(std::move(r));
+}
+
+//=====================================================================================================================
+/// Time to bring up a machine by defining and starting it, against restoring it from an image saved with
+/// Fsm::saveImage(). Verified by driving both through the same events.
+void benchRestore(bench::Report& report, bool quick)
+//=====================================================================================================================
+{
+  const std::vector<std::uint32_t> state_counts = quick ? std::vector<std::uint32_t>{ 4, 64 }
+                                                        : std::vector<std::uint32_t>{ 4, 64, 512 };
+  const std::uint32_t num_events_defined = 32;
+  for (const auto num_states : state_counts)
+  {
+    std::atomic<std::uint64_t> entries{ 0 };
+    fsm::Fsm::Config config;
+    config.dispatch_mode = fsm::DispatchMode::Inline;
+
+    const auto t0 = bench::now();
+    fsm::Fsm built(config);
+    for (std::uint32_t s = 0; s < num_states; ++s)
+    {
+      built.addState(std::make_shared<CountingState>(built, "s" + std::to_string(s), entries));
+    }
+    for (std::uint32_t s = 0; s < num_states; ++s)
+    {
+      for (std::uint32_t e = 0; e < num_events_defined; ++e)
+      {
+        built.addTransitionRule("s" + std::to_string(s), "e" + std::to_string(e),
+                                "s" + std::to_string((s * 7U + e + 1U) % num_states));
+      }
+    }
+    built.start("s0");
+    const auto t1 = bench::now();
+    const auto image = built.saveImage();
+    const auto t2 = bench::now();
+    fsm::Fsm restored(config);
+    restored.restore(image.data(), image.size(), [&entries](fsm::Fsm& fsm, const fsm::State::Id& id) {
+      return std::make_shared<CountingState>(fsm, id, entries);
+    });
+    const auto t3 = bench::now();
+
+    bool same = true;
+    for (std::uint32_t i = 0; i < 100; ++i)
+    {
+      const auto event = "e" + std::to_string((i * 13U) % num_events_defined);
+      built.raise(event);
+      restored.raise(event);
+      same = same && (built.getActiveState()->getId() == restored.getActiveState()->getId());
+    }
+
+    bench::Result r;
+    r.name = "restore";
+    r.params = { { "states", std::to_string(num_states) }, { "events", std::to_string(num_events_defined) } };
+    r.values = { { "build_us", static_cast<double>(t1 - t0) / 1e3 },
+                 { "save_us", static_cast<double>(t2 - t1) / 1e3 },
+                 { "restore_us", static_cast<double>(t3 - t2) / 1e3 },
+                 { "image_bytes", static_cast<double>(image.size()) } };
+    r.verified = same;
+    report.add(std::move(r));
+  }
+}
+
+//=====================================================================================================================
+/// Aggregate throughput of many MotorController shaped machines driven through their power cycle
+void benchManyInstances(bench::Report& report, std::uint64_t num_cycles, bool quick)
+//=====================================================================================================================
+{
+  struct Variant
+  {
+    fsm::DispatchMode dispatch;
+    bool executor;
+    const char* dispatch_name;
+    std::size_t max_instances;  //!< skip larger populations, e.g. to bound the number of threads
+  };
+  const Variant variants[] = { { fsm::DispatchMode::Background, true, "executor", SIZE_MAX },
+                               { fsm::DispatchMode::Background, false, "thread", 100 },
+                               { fsm::DispatchMode::Inline, false, "inline", SIZE_MAX } };
+  const std::vector<std::size_t> populations = quick ? std::vector<std::size_t>{ 10, 100 }
+                                                     : std::vector<std::size_t>{ 10, 100, 1000, 10000 };
+  const auto executor = std::make_shared<fsm::Executor>();
+  for (const auto& v : variants)
+  {
+    for (const auto num_instances : populations)
+    {
+      if (num_instances > v.max_instances)
+      {
+        continue;
+      }
+      std::atomic<std::uint64_t> entries{ 0 };
+      fsm::Fsm::Config config;
+      config.dispatch_mode = v.dispatch;
+      if (v.executor)
+      {
+        config.executor = executor;
+      }
+      const auto t_create = bench::now();
+      std::vector<std::unique_ptr<fsm::Fsm>> machines;
+      for (std::size_t i = 0; i < num_instances; ++i)
+      {
+        machines.emplace_back(new fsm::Fsm(config));
+        defineMotor(*machines.back(), entries);
+        machines.back()->start("idle");
+      }
+      const auto t0 = bench::now();
+      entries = 0;
+      const auto on = machines.front()->getEventHandle("on");
+      const auto maintain_speed = machines.front()->getEventHandle("maintain_speed");
+      const auto off = machines.front()->getEventHandle("off");
+      const auto has_shutdown = machines.front()->getEventHandle("has_shutdown");
+      for (std::uint64_t c = 0; c < num_cycles; ++c)
+      {
+        for (auto& m : machines)
+        {
+          m->raise(on);
+          m->raise(maintain_speed);
+          m->raise(off);
+          m->raise(has_shutdown);
+        }
+      }
+      for (const auto& m : machines)
+      {
+        waitIdle(*m);
+      }
+      const auto t1 = bench::now();
+      machines.clear();
+      const auto t2 = bench::now();
+
+      const auto total = num_cycles * 4U * num_instances;
+      bench::Result r;
+      r.name = "many_instances";
+      r.params = { { "dispatch", v.dispatch_name }, { "instances", std::to_string(num_instances) },
+                   { "events", std::to_string(total) } };
+      r.values = { { "events_per_second", perSecond(total, t1 - t0) },
+                   { "create_us_per_instance", static_cast<double>(t0 - t_create) / 1e3 / num_instances },
+                   { "destroy_us_per_instance", static_cast<double>(t2 - t1) / 1e3 / num_instances } };
+      r.verified = (entries.load() == total);
+      report.add(std::move(r));
+    }
+  }
+}
+
+//=====================================================================================================================
+/// Cost of raising one event in a population of machines of which one in ten has a rule for it, by looping over all
+/// the machines, and by publishing it on an EventBus
+void benchBroadcast(bench::Report& report, std::uint64_t num_broadcasts, bool quick)
+//=====================================================================================================================
+{
+  const std::vector<std::size_t> populations = quick ? std::vector<std::size_t>{ 100, 1000 }
+                                                     : std::vector<std::size_t>{ 100, 1000, 10000 };
+  const auto executor = std::make_shared<fsm::Executor>();
+  for (const auto num_instances : populations)
+  {
+    for (const bool use_bus : { false, true })
+    {
+      std::atomic<std::uint64_t> entries{ 0 };
+      fsm::Fsm::Config config;
+      config.executor = executor;
+      fsm::EventBus bus(executor);
+      std::vector<std::unique_ptr<fsm::Fsm>> machines;
+      std::size_t num_interested = 0;
+      for (std::size_t i = 0; i < num_instances; ++i)
+      {
+        machines.emplace_back(new fsm::Fsm(config));
+        if (i % 10 == 0)
+        {
+          defineToggle(*machines.back(), entries);
+          machines.back()->start("a");
+          ++num_interested;
+        }
+        else
+        {
+          defineMotor(*machines.back(), entries);
+          machines.back()->start("idle");
+        }
+        bus.subscribe(*machines.back());
+      }
+      entries = 0;
+
+      const auto t0 = bench::now();
+      for (std::uint64_t b = 0; b < num_broadcasts; ++b)
+      {
+        if (use_bus)
+        {
+          bus.publish("toggle");
+        }
+        else
+        {
+          for (auto& m : machines)
+          {
+            m->raise("toggle");
+          }
+        }
+      }
+      for (const auto& m : machines)
+      {
+        waitIdle(*m);
+      }
+      const auto t1 = bench::now();
+      for (auto& m : machines)
+      {
+        bus.unsubscribe(*m);
+      }
+
+      bench::Result r;
+      r.name = "broadcast";
+      r.params = { { "method", use_bus ? "bus" : "loop" },
+                   { "instances", std::to_string(num_instances) },
+                   { "interested", std::to_string(num_interested) },
+                   { "broadcasts", std::to_string(num_broadcasts) } };
+      r.values = { { "us_per_broadcast", static_cast<double>(t1 - t0) / 1e3 / static_cast<double>(num_broadcasts) } };
+      r.verified = (entries.load() == num_broadcasts * num_interested);
+      report.add(std::move(r));
+    }
+  }
+}
+
+
+//=====================================================================================================================
+/// Events raised through a SharedEventQueue by a SharedEventProducer: events per second, one at a time and in
+/// batches, and the distribution of the round trip from raising an event to its target state being entered, one
+/// event in flight at a time. Producer and machine share the process here, but not the address of the ring
+void benchSharedQueue(bench::Report& report, std::uint64_t num_events)
+//=====================================================================================================================
+{
+  const auto name = "/fsm_benchmark_" + std::to_string(::getpid());
+  for (const bool batched : { false, true })
+  {
+    std::atomic<std::uint64_t> entries{ 0 };
+    fsm::Fsm::Config config;
+    config.queue_type = fsm::QueueType::LockFree;
+    fsm::Fsm machine(config);
+    defineToggle(machine, entries);
+    machine.start("a");
+    entries = 0;
+    fsm::SharedEventQueue queue(machine, name, 4096);
+    fsm::SharedEventProducer producer(name);
+    const auto toggle = producer.getEventId("toggle");
+
+    const std::vector<fsm::SharedEventProducer::EventId> burst(64, toggle);
+    const auto t0 = bench::now();
+    std::uint64_t raised = 0;
+    while (raised < num_events)
+    {
+      if (batched)
+      {
+        const auto count = std::min<std::uint64_t>(burst.size(), num_events - raised);
+        raised += producer.raiseBatch(burst.data(), burst.data() + count);
+      }
+      else if (producer.raise(toggle))
+      {
+        ++raised;
+      }
+    }
+    while (queue.getForwardedCount() < num_events)
+    {
+      std::this_thread::yield();
+    }
+    waitIdle(machine);
+    const auto t1 = bench::now();
+
+    bench::Result r;
+    r.name = "shared_queue_throughput";
+    r.params = { { "raise", batched ? "batch" : "single" }, { "events", std::to_string(num_events) } };
+    r.values = { { "events_per_second", perSecond(num_events, t1 - t0) } };
+    r.verified = (entries.load() == num_events) && (queue.getRejectedCount() == 0);
+    report.add(std::move(r));
+  }
+
+  std::atomic<std::uint64_t> entries{ 0 };
+  fsm::Fsm machine;
+  defineToggle(machine, entries);
+  machine.start("a");
+  fsm::SharedEventQueue queue(machine, name);
+  fsm::SharedEventProducer producer(name);
+  const auto toggle = producer.getEventId("toggle");
+  const auto num_samples = num_events / 50;
+  std::vector<std::int64_t> samples;
+  samples.reserve(num_samples);
+  for (std::uint64_t i = 0; i < num_samples; ++i)
+  {
+    const auto expected = entries.load(std::memory_order_relaxed) + 1;
+    const auto t0 = bench::now();
+    producer.raise(toggle);
+    while (entries.load(std::memory_order_acquire) < expected)
+    {
+      std::this_thread::yield();
+    }
+    samples.push_back(bench::now() - t0);
+  }
+  waitIdle(machine);
+
+  std::sort(samples.begin(), samples.end());
+  bench::Result r;
+  r.name = "shared_queue_round_trip";
+  r.params = { { "events", std::to_string(num_samples) } };
+  r.values = { { "p50_ns", bench::percentile(samples, 0.5) },
+               { "p99_ns", bench::percentile(samples, 0.99) },
+               { "max_ns", samples.empty() ? 0.0 : static_cast<double>(samples.back()) } };
+  r.verified = (queue.getForwardedCount() == num_samples) && (samples.size() == num_samples);
+  report.add(std::move(r));
+}
+
+//=====================================================================================================================
+/// Transitions per second of machines driven by state timeouts, run by a Simulation on a virtual clock. Machine i
+/// flips between two states every i % 7 + 1 milliseconds of virtual time
+void benchSimulation(bench::Report& report, bool quick)
+//=====================================================================================================================
+{
+  const std::chrono::milliseconds duration(quick ? 10000 : 600000);
+  for (const std::size_t num_machines : { std::size_t{ 1 }, std::size_t{ 100 } })
+  {
+    std::atomic<std::uint64_t> entries{ 0 };
+    fsm::Simulation simulation;
+    std::vector<std::unique_ptr<fsm::Fsm>> machines;
+    std::uint64_t expected = 0;
+    for (std::size_t i = 0; i < num_machines; ++i)
+    {
+      machines.emplace_back(new fsm::Fsm(simulation.makeConfig()));
+      auto& machine = *machines.back();
+      const std::chrono::milliseconds period(i % 7 + 1);
+      defineToggle(machine, entries);
+      machine.addStateTimeout("a", period, "toggle");
+      machine.addStateTimeout("b", period, "toggle");
+      machine.start("a");
+      simulation.add(machine);
+      expected += static_cast<std::uint64_t>(duration / period);
+    }
+    entries = 0;
+
+    const auto t0 = bench::now();
+    simulation.advance(duration);
+    const auto t1 = bench::now();
+    for (auto& machine : machines)
+    {
+      simulation.remove(*machine);
+    }
+
+    bench::Result r;
+    r.name = "simulation";
+    r.params = { { "machines", std::to_string(num_machines) },
+                 { "virtual_seconds", std::to_string(duration.count() / 1000) } };
+    r.values = { { "transitions_per_second", perSecond(entries.load(), t1 - t0) },
+                 { "speedup", static_cast<double>(std::chrono::nanoseconds(duration).count()) /
+                                  static_cast<double>(std::max<std::int64_t>(t1 - t0, 1)) } };
+    r.verified = (entries.load() == expected) && (simulation.getTime() == duration);
+    report.add(std::move(r));
+  }
+}
+}  // namespace
+
+//=====================================================================================================================
+int main(int argc, char** argv)
+//=====================================================================================================================
+{
+  bool quick = false;
+  std::string output;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strcmp(argv[i], "--quick") == 0)
+    {
+      quick = true;
+    }
+    else if ((std::strcmp(argv[i], "--output") == 0) && (i + 1 < argc))
+    {
+      output = argv[++i];
+    }
+    else
+    {
+      std::cerr << "Usage: " << argv[0] << " [--quick] [--output <file.json>]\n";
+      return 1;
+    }
+  }
+
+  const std::uint64_t scale = quick ? 1 : 20;
+  bench::Report report;
+  try
+  {
+    std::cerr << "single producer throughput..\n";
+    benchSingleProducer(report, 50000 * scale);
+    std::cerr << "multi producer throughput..\n";
+    benchMultiProducer(report, 50000 * scale);
+    std::cerr << "burst throughput..\n";
+    benchBurst(report, 50000 * scale);
+    std::cerr << "raise to entry latency..\n";
+    benchLatency(report, 1000 * scale);
+    std::cerr << "table size scaling..\n";
+    benchTableSize(report, 50000 * scale, quick);
+    std::cerr << "pruned table..\n";
+    benchPrunedTable(report, 50000 * scale, quick);
+    std::cerr << "restore..\n";
+    benchRestore(report, quick);
+    std::cerr << "many instances..\n";
+    benchManyInstances(report, quick ? 2 : 10, quick);
+    std::cerr << "broadcast..\n";
+    benchBroadcast(report, quick ? 100 : 1000, quick);
+    std::cerr << "shared memory queue..\n";
+    benchSharedQueue(report, 50000 * scale);
+    std::cerr << "simulation..\n";
+    benchSimulation(report, quick);
+  }
+  catch (const std::exception& ex)
+  {
+    std::cerr << ex.what() << "\n";
+    return 1;
+  }
+
+  std::stringstream version;
+  version << fsm::FSM_VERSION_MAJOR << "." << fsm::FSM_VERSION_MINOR << "." << fsm::FSM_VERSION_PATCH;
+  const std::string build_type = FSM_BENCHMARK_BUILD_TYPE;
+  const std::string build = (build_type.empty() ? "unspecified" : build_type) + " " + fsm::FSM_BUILD_TIMESTAMP;
+  if (output.empty())
+  {
+    report.write(std::cout, version.str(), build);
+  }
+  else
+  {
+    std::ofstream file(output);
+    report.write(file, version.str(), build);
+  }
+
+  if (!report.allVerified())
+  {
+    std::cerr << "Some machines lost or duplicated events. See \"verified\" in the results.\n";
+    return 2;
+  }
+  return 0;
+}
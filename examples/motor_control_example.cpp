@@ -7,6 +7,7 @@
 
 #include <csignal>
 #include <iostream>
+#include <thread>
 
 static int s_stopFlag = 0;
 
@@ -32,6 +33,8 @@ int main(int argc, char** argv)
     MotorController controller;
     std::this_thread::sleep_for(std::chrono::seconds(1));
     controller.trigger("on");
+    std::this_thread::sleep_for(std::chrono::seconds(4));
+    controller.setSpeed(3000.0);
 
     while (0 == s_stopFlag)
     {
@@ -27,6 +27,26 @@ void IdleState::onExit()
   std::cout << "[" << getId() << "::onExit]\n";
 }
 
+//=====================================================================================================================
+PoweredState::PoweredState(fsm::Fsm& ctx) : fsm::State(ctx, "powered")
+//=====================================================================================================================
+{
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void PoweredState::onEntry()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::cout << "[" << getId() << "::onEntry]\n";
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void PoweredState::onExit()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::cout << "[" << getId() << "::onExit]\n";
+}
+
 //=====================================================================================================================
 PowerUpState::PowerUpState(fsm::Fsm& ctx) : fsm::State(ctx, "power_up")
 //=====================================================================================================================
@@ -37,10 +57,20 @@ PowerUpState::PowerUpState(fsm::Fsm& ctx) : fsm::State(ctx, "power_up")
 void PowerUpState::onEntry()
 //----------------------------------------------------------------------------------------------------------------------
 {
-  std::cout << "[" << getId() << "::onEntry] entered\n";
-  std::this_thread::sleep_for(std::chrono::seconds(2));
-  getFsm().raise("maintain_speed");
-  std::cout << "[" << getId() << "::onEntry] exited\n";
+  std::cout << "[" << getId() << "::onEntry] spinning up\n";
+
+  // ramp up the power in steps, without holding up the machine. Switching off abandons the ramp
+  power_percent_ = 0;
+  getFsm().startAction([this]() {
+    power_percent_ += 25;
+    std::cout << "[" << getId() << "] power " << power_percent_ << "%\n";
+    if (power_percent_ < 100)
+    {
+      return fsm::ActionResult::resumeAfter(std::chrono::milliseconds(500));
+    }
+    getFsm().raise("spun_up");
+    return fsm::ActionResult::done();
+  });
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -60,10 +90,7 @@ PowerDownState::PowerDownState(fsm::Fsm& ctx) : fsm::State(ctx, "power_down")
 void PowerDownState::onEntry()
 //----------------------------------------------------------------------------------------------------------------------
 {
-  std::cout << "[" << getId() << "::onEntry] entered\n";
-  std::this_thread::sleep_for(std::chrono::seconds(2));
-  getFsm().raise("has_shutdown");
-  std::cout << "[" << getId() << "::onEntry] exited\n";
+  std::cout << "[" << getId() << "::onEntry] spinning down\n";
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -83,7 +110,12 @@ SpeedControlState::SpeedControlState(fsm::Fsm& ctx) : State(ctx, "speed_control"
 void SpeedControlState::onEntry()
 //----------------------------------------------------------------------------------------------------------------------
 {
-  std::cout << "[" << getId() << "::onEntry]\n";
+  const auto* setpoint = getFsm().getEventPayload().get<SpeedSetpoint>();
+  if (setpoint != nullptr)
+  {
+    target_rpm_ = setpoint->rpm;
+  }
+  std::cout << "[" << getId() << "::onEntry] target " << target_rpm_ << " rpm\n";
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -93,21 +125,55 @@ void SpeedControlState::onExit()
   std::cout << "[" << getId() << "::onExit]\n";
 }
 
+//=====================================================================================================================
+FanState::FanState(fsm::Fsm& ctx, const fsm::State::Id& id) : State(ctx, id)
+//=====================================================================================================================
+{
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void FanState::onEntry()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::cout << "[" << getId() << "::onEntry]\n";
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void FanState::onExit()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::cout << "[" << getId() << "::onExit]\n";
+}
+
 //=====================================================================================================================
 MotorController::MotorController()
 //=====================================================================================================================
 {
   controller_fsm_.addState(std::make_shared<IdleState>(controller_fsm_));
-  controller_fsm_.addState(std::make_shared<PowerUpState>(controller_fsm_));
+  controller_fsm_.addState(std::make_shared<PoweredState>(controller_fsm_));
+  controller_fsm_.addState(std::make_shared<PowerUpState>(controller_fsm_), "powered");
   controller_fsm_.addState(std::make_shared<PowerDownState>(controller_fsm_));
-  controller_fsm_.addState(std::make_shared<SpeedControlState>(controller_fsm_));
+  controller_fsm_.addState(std::make_shared<SpeedControlState>(controller_fsm_), "powered");
+
+  // the fan runs independently of the motor states, while the motor is spinning
+  const auto cooling = controller_fsm_.addRegion("cooling", "fan_off");
+  controller_fsm_.addState(std::make_shared<FanState>(controller_fsm_, "fan_off"), cooling);
+  controller_fsm_.addState(std::make_shared<FanState>(controller_fsm_, "fan_on"), cooling);
+
+  // switching off must not wait behind speed setpoints
+  controller_fsm_.setEventPriority("off", fsm::EventPriority::Urgent);
+
+  // spin down takes two seconds
+  controller_fsm_.addStateTimeout("power_down", std::chrono::seconds(2), "has_shutdown");
 
   controller_fsm_.addTransitionRule("idle", "on", "power_up");
-  controller_fsm_.addTransitionRule("power_up", "maintain_speed", "speed_control");
-  controller_fsm_.addTransitionRule("speed_control", "off", "power_down");
-  controller_fsm_.addTransitionRule("power_up", "off", "power_down");
+  controller_fsm_.addTransitionRule("power_up", "spun_up", "speed_control");
+  controller_fsm_.addTransitionRule("speed_control", "maintain_speed", "speed_control");
+  controller_fsm_.addTransitionRule("powered", "off", "power_down");  // from power_up and speed_control
   controller_fsm_.addTransitionRule("power_down", "on", "power_up");
   controller_fsm_.addTransitionRule("power_down", "has_shutdown", "idle");
+  controller_fsm_.addTransitionRule("fan_off", "spun_up", "fan_on");
+  controller_fsm_.addTransitionRule("fan_on", "has_shutdown", "fan_off");
 
   controller_fsm_.start("idle");
 }
@@ -124,9 +190,10 @@ MotorController::~MotorController()
     }
     controller_fsm_.raise("off");
     std::cout << "Waiting for \"idle\" state..\n" << std::flush;
-    while (getActiveState() != "idle")
+    if (!controller_fsm_.waitForState("idle", std::chrono::seconds(10)))
     {
-      std::this_thread::sleep_for(std::chrono::seconds(1));
+      std::cerr << "[" << __FUNCTION__ << "] Timed out waiting for \"idle\" state\n";  // NOLINT
+      return;
     }
     std::cout << "State \"idle\" reached\n" << std::flush;
   }
@@ -143,6 +210,13 @@ void MotorController::trigger(const fsm::Fsm::Event& signal)
   controller_fsm_.raise(signal);
 }
 
+//----------------------------------------------------------------------------------------------------------------------
+void MotorController::setSpeed(double rpm)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  controller_fsm_.raise("maintain_speed", SpeedSetpoint{ rpm });
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 fsm::State::Id MotorController::getActiveState() const
 //----------------------------------------------------------------------------------------------------------------------
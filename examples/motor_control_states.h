@@ -5,6 +5,13 @@
 
 #include "fsm/fsm.h"
 
+//=====================================================================================================================
+/// Payload of the "maintain_speed" event
+struct SpeedSetpoint
+{
+  double rpm;
+};
+
 //=====================================================================================================================
 /// do nothing state
 class IdleState : public fsm::State
@@ -15,6 +22,16 @@ public:
   void onExit() final;
 };
 
+//=====================================================================================================================
+/// motor is energised. Parent of power_up and speed_control
+class PoweredState : public fsm::State
+{
+public:
+  explicit PoweredState(fsm::Fsm& ctx);
+  void onEntry() final;
+  void onExit() final;
+};
+
 //=====================================================================================================================
 /// powering up
 class PowerUpState : public fsm::State
@@ -23,6 +40,9 @@ public:
   explicit PowerUpState(fsm::Fsm& ctx);
   void onEntry() final;
   void onExit() final;
+
+private:
+  int power_percent_{ 0 };
 };
 
 //=====================================================================================================================
@@ -43,6 +63,19 @@ public:
   explicit SpeedControlState(fsm::Fsm& ctx);
   void onEntry() final;
   void onExit() final;
+
+private:
+  double target_rpm_{ 1500.0 };
+};
+
+//=====================================================================================================================
+/// cooling fan, in a region of its own alongside the motor states
+class FanState : public fsm::State
+{
+public:
+  FanState(fsm::Fsm& ctx, const fsm::State::Id& id);
+  void onEntry() final;
+  void onExit() final;
 };
 
 //=====================================================================================================================
@@ -53,6 +86,7 @@ public:
   MotorController();
   ~MotorController();
   void trigger(const fsm::Fsm::Event& signal);
+  void setSpeed(double rpm);
   fsm::State::Id getActiveState() const;
 
   MotorController(const MotorController&) = delete;
@@ -0,0 +1,67 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_DEFINITION_H
+#define FSM_DEFINITION_H
+
+#include "fsm/fsm.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fsm
+{
+//======================================================================================================================
+/// Topology of a machine written as text: its states, events, transition rules and timeouts. The text is parsed,
+/// validated and compiled once, and any number of machines are then built from the result with
+/// Fsm::start(const Definition&, const Fsm::StateFactory&), without repeating the work for each of them.
+///
+/// The text has one declaration per line, with words separated by blanks. A # starts a comment. States and regions
+/// must be declared before they are referred to. Events are declared by their first use.
+///
+///     state <id>                          a top-level state
+///     state <id> in <parent>              a state nested in another
+///     state <id> region <region>          a top-level state of an orthogonal region
+///     region <name> <initial state>       an orthogonal region. See Fsm::addRegion()
+///     event <name> urgent|normal|low      the priority of an event. See Fsm::setEventPriority()
+///     transition <from> <event> <to>      a transition rule
+///     timeout <state> <delay> <event>     a state timeout, with the delay in ns, us, ms or s, as in 250ms
+///     initial <state>                     the initial state of the main region. Required
+class Definition
+{
+public:
+  /// Parse a definition. Throws FsmException naming the offending line if the text is not a valid definition.
+  explicit Definition(const std::string& text);
+  ~Definition();
+
+  Definition(const Definition&) = delete;
+  Definition(Definition&&) noexcept;
+  Definition& operator=(const Definition&) = delete;
+  Definition& operator=(Definition&&) noexcept;
+
+  /// \return Ids of the states, in the order they were declared
+  const std::vector<State::Id>& getStates() const;
+
+  /// \return The compiled definition, in the format of Fsm::saveImage()
+  const std::vector<std::uint8_t>& getImage() const;
+
+  /// Write the transition graph, with the initial states in bold. See Fsm::exportDot()
+  void exportDot(std::ostream& out) const;
+
+private:
+  std::unique_ptr<Fsm> machine_;     //!< built from the text, with placeholder states
+  std::vector<State::Id> states_;    //!< in order of declaration
+  std::vector<std::uint8_t> image_;  //!< saved from machine_
+};
+
+/// Read a definition from a file. See Definition
+Definition readDefinitionFile(const std::string& path);
+
+}  // namespace fsm
+
+#endif  // FSM_DEFINITION_H
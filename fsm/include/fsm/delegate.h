@@ -0,0 +1,149 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_DELEGATE_H
+#define FSM_DELEGATE_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace fsm
+{
+template <typename Signature>
+class Delegate;
+
+//======================================================================================================================
+/// Move-only callable wrapper that never allocates. See Fsm::TransitionDelegate and Fsm::GuardDelegate.
+///
+/// A delegate holds one callable of any type that fits in Delegate::CAPACITY bytes, stored inline, and calls it
+/// through a single function pointer. Unlike std::function, creating one does not allocate and the callable need not
+/// be copyable. Construction from a callable is explicit, so that it never competes with std::function in overload
+/// resolution.
+template <typename R, typename... Args>
+class Delegate<R(Args...)>
+{
+public:
+  static constexpr std::size_t CAPACITY = 6 * sizeof(void*);  //!< maximum size of a callable. Fits a std::function
+  static constexpr std::size_t ALIGNMENT = alignof(void*);     //!< maximum alignment of a callable
+
+public:
+  /// Create an empty delegate
+  Delegate() noexcept : ops_(nullptr), storage_()
+  {
+  }
+
+  /// Create an empty delegate
+  Delegate(std::nullptr_t) noexcept : ops_(nullptr), storage_()  // NOLINT: implicit by design
+  {
+  }
+
+  /// Create a delegate holding callable
+  template <typename F, typename D = std::decay_t<F>, typename = std::enable_if_t<!std::is_same<D, Delegate>::value>>
+  explicit Delegate(F&& callable) : ops_(&Ops<D>::TABLE), storage_()
+  {
+    static_assert(sizeof(D) <= CAPACITY, "Callable is too large for inline storage");
+    static_assert(alignof(D) <= ALIGNMENT, "Callable is over-aligned for inline storage");
+    static_assert(std::is_nothrow_move_constructible<D>::value, "Callable must be nothrow move constructible");
+    new (&storage_) D(std::forward<F>(callable));
+  }
+
+  Delegate(Delegate&& other) noexcept : ops_(nullptr), storage_()
+  {
+    *this = std::move(other);
+  }
+
+  Delegate& operator=(Delegate&& other) noexcept
+  {
+    if (this != &other)
+    {
+      reset();
+      if (other.ops_ != nullptr)
+      {
+        other.ops_->move(&other.storage_, &storage_);
+        ops_ = other.ops_;
+        other.reset();
+      }
+    }
+    return *this;
+  }
+
+  ~Delegate()
+  {
+    reset();
+  }
+
+  Delegate(const Delegate&) = delete;
+  Delegate& operator=(const Delegate&) = delete;
+
+  /// \return true if the delegate holds a callable
+  explicit operator bool() const noexcept
+  {
+    return ops_ != nullptr;
+  }
+
+  /// Call the callable. The delegate must not be empty.
+  R operator()(Args... args) const
+  {
+    return ops_->invoke(&storage_, std::forward<Args>(args)...);
+  }
+
+  /// Destroy the callable, if any
+  void reset() noexcept
+  {
+    if (ops_ != nullptr)
+    {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
+  }
+
+private:
+  /// Type-specific operations
+  struct Operations
+  {
+    R (*invoke)(void* callable, Args&&... args);
+    void (*move)(void* from, void* to);
+    void (*destroy)(void* callable);
+  };
+
+  template <typename T>
+  struct Ops
+  {
+    static R invoke(void* callable, Args&&... args)
+    {
+      return (*static_cast<T*>(callable))(std::forward<Args>(args)...);
+    }
+    static void move(void* from, void* to)
+    {
+      new (to) T(std::move(*static_cast<T*>(from)));
+    }
+    static void destroy(void* callable)
+    {
+      static_cast<T*>(callable)->~T();
+    }
+    static const Operations TABLE;
+  };
+
+private:
+  const Operations* ops_;
+  mutable std::aligned_storage_t<CAPACITY, ALIGNMENT> storage_;
+};
+
+template <typename R, typename... Args>
+constexpr std::size_t Delegate<R(Args...)>::CAPACITY;
+
+template <typename R, typename... Args>
+constexpr std::size_t Delegate<R(Args...)>::ALIGNMENT;
+
+template <typename R, typename... Args>
+template <typename T>
+const typename Delegate<R(Args...)>::Operations Delegate<R(Args...)>::Ops<T>::TABLE = { &Ops<T>::invoke, &Ops<T>::move,
+                                                                                       &Ops<T>::destroy };
+
+}  // namespace fsm
+
+#endif  // FSM_DELEGATE_H
@@ -0,0 +1,107 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_EVENT_BUS_H
+#define FSM_EVENT_BUS_H
+
+#include "fsm/fsm.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace fsm
+{
+//======================================================================================================================
+/// Broadcasts events to many machines. See EventBus::publish().
+///
+/// Machines subscribe once they are started. The bus indexes them by the events they have transition rules for (see
+/// Fsm::getHandledEvents()), so publishing an event costs in proportion to the machines that handle it, however many
+/// are subscribed, and each of them is raised the event by handle. Large fan-outs are split into batches that an
+/// executor raises concurrently with the publisher. publish() returns once every machine has been raised the event,
+/// so the events of one publisher reach each machine in the order published. The machines are raised the event
+/// without holding the lock of the bus, so that their state callbacks may subscribe and unsubscribe machines.
+class EventBus
+{
+public:
+  /// Create the bus
+  /// \param executor Raises batches of a fan-out alongside the publisher. If not set, the publisher raises the event
+  /// in every machine itself
+  /// \param batch_size Number of machines in a batch
+  explicit EventBus(std::shared_ptr<Executor> executor = nullptr, std::size_t batch_size = 256);
+  ~EventBus();
+
+  EventBus(const EventBus&) = delete;
+  EventBus(EventBus&&) = delete;
+  EventBus& operator=(const EventBus&) = delete;
+  EventBus& operator=(EventBus&&) = delete;
+
+  /// Subscribe a machine to the events it has transition rules for. The machine must be running, and must be
+  /// unsubscribed before it is destroyed. Subscribing a machine again has no effect.
+  void subscribe(Fsm& fsm);
+
+  /// Unsubscribe a machine. Machines that are not subscribed are quietly ignored. Waits for the publications in
+  /// progress, which may still raise their event in the machine, unless called from a state callback that one of them
+  /// runs. Destroy a machine unsubscribed that way only once the publications under way have returned.
+  void unsubscribe(Fsm& fsm);
+
+  /// Raise an event in every subscribed machine that has a transition rule for it. Safe to call from any thread.
+  /// If raising the event throws for a machine, the other machines still get it and the first exception is
+  /// rethrown once all have been raised.
+  /// \return Number of machines the event was raised in
+  std::size_t publish(const Fsm::Event& event);
+
+  /// \return Number of subscribed machines
+  std::size_t getSubscriberCount() const;
+
+  /// \return Number of subscribed machines that have a transition rule for an event
+  std::size_t getSubscriberCount(const Fsm::Event& event) const;
+
+private:
+  /// A machine and its handle of the event of a topic
+  struct Subscriber
+  {
+    Fsm* fsm;
+    Fsm::EventHandle event;
+  };
+
+  /// Subscribers to one event
+  struct Topic
+  {
+    std::vector<Subscriber> subscribers;
+  };
+
+  /// Position of a machine in a topic
+  struct Membership
+  {
+    Topic* topic;
+    std::size_t index;  //!< in Topic::subscribers
+  };
+
+  struct Fanout;
+  static void raiseBatches(Fanout& fanout);
+  bool isPublishingOnThisThread() const;
+
+private:
+  std::shared_ptr<Executor> executor_;
+  std::size_t batch_size_;
+  mutable std::shared_timed_mutex guard_;                             //!< shared by publishers
+  std::unordered_map<Fsm::Event, Topic> topics_;                      //!< by event. Topics are never removed
+  std::unordered_map<const Fsm*, std::vector<Membership>> members_;  //!< topics of each subscribed machine
+
+  std::mutex publish_guard_;
+  std::condition_variable published_;      //!< signals the end of a publication
+  std::uint64_t num_publications_ = 0;     //!< tickets handed out. Guarded by publish_guard_
+  std::vector<std::uint64_t> publishing_;  //!< tickets of publications in progress. Guarded by publish_guard_
+};
+
+}  // namespace fsm
+
+#endif  // FSM_EVENT_BUS_H
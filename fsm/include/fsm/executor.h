@@ -0,0 +1,76 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_EXECUTOR_H
+#define FSM_EXECUTOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace fsm
+{
+namespace detail
+{
+class EventCount;
+}  // namespace detail
+
+//======================================================================================================================
+/// A work-stealing thread pool that runs the event handlers of many Fsm instances on a fixed set of threads.
+///
+/// Each worker owns a task queue. Tasks posted from a worker go to its own queue, other tasks are spread round
+/// robin. A worker that runs out of work steals from the others before going to sleep. An Fsm attached to an
+/// executor (see Fsm::Config::executor) is only scheduled when it has events pending, and is never run by more
+/// than one worker at a time, so events of one machine are still processed in order and to completion.
+class Executor
+{
+public:
+  using Task = std::function<void()>;
+
+public:
+  /// Create the pool
+  /// \param num_threads Number of worker threads. 0 selects the number of hardware threads.
+  explicit Executor(std::size_t num_threads = 0);
+
+  /// Runs all tasks already posted, then stops the workers
+  ~Executor();
+
+  Executor(const Executor&) = delete;
+  Executor(Executor&&) = delete;
+  Executor& operator=(const Executor&) = delete;
+  Executor& operator=(Executor&&) = delete;
+
+  /// Queue a task for execution on one of the workers. Exceptions escaping a task are discarded.
+  void post(Task task);
+
+  /// \return Number of worker threads
+  std::size_t getThreadCount() const;
+
+  /// \return true if the caller is a worker thread of this executor
+  bool isWorkerThread() const;
+
+  /// \return A process-wide executor sized to the number of hardware threads, created on first use
+  static std::shared_ptr<Executor> getDefault();
+
+private:
+  struct Worker;
+  void run(std::size_t index);
+  bool tryPop(std::size_t index, Task& task);
+
+private:
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::unique_ptr<detail::EventCount> work_signal_;  //!< wakes up idle workers
+  std::atomic<std::size_t> queued_tasks_;
+  std::atomic<std::size_t> next_worker_;  //!< round robin cursor for tasks posted from outside
+  std::atomic<bool> exit_flag_;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace fsm
+
+#endif  // FSM_EXECUTOR_H
@@ -6,17 +6,42 @@
 #ifndef FSM_H
 #define FSM_H
 
+#include "fsm/delegate.h"
+#include "fsm/memory_resource.h"
+#include "fsm/metrics.h"
+#include "fsm/payload.h"
+#include "fsm/timer_wheel.h"
+
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
 #include <future>
-#include <map>
+#include <iosfwd>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace fsm
 {
 class Fsm;
+class Executor;
+class TraceRecorder;
+class Definition;
+enum class TraceOutcome : std::uint8_t;
+
+namespace detail
+{
+class EventQueue;
+class EventCount;
+struct MetricsRecorder;
+struct QueuedEvent;
+class EventBatch;
+}  // namespace detail
 
 //====================================================================================================================
 /// Exception raised by FSM
@@ -45,7 +70,8 @@ public:
   Fsm& getFsm();
 
   /// Method gets called on entry into state.
-  /// \note This method should not block or else state transitions will not occur
+  /// \note This method should not block or else state transitions will not occur. Start long actions with
+  /// Fsm::startAction()
   virtual void onEntry() = 0;
 
   /// Method gets called on exit from state
@@ -61,6 +87,104 @@ protected:
   Id id_;
 };
 
+//======================================================================================================================
+/// Event queue implementations. See Fsm::Config
+enum class QueueType
+{
+  Locked,   //!< Mutex protected queue. Producers briefly contend with each other and with the event handler
+  LockFree  //!< Lock-free multi-producer single-consumer queue. Fsm::raise() is lock-free, except that an
+            //!< unbounded queue takes a lock and allocates when it runs out of nodes
+};
+
+//======================================================================================================================
+/// What Fsm::raise() does when the event queue is at capacity. See Fsm::Config
+enum class OverflowPolicy
+{
+  Block,       //!< Wait for space. Raising from a state callback of the same machine drops the event instead.
+               //!< With DispatchMode::Manual, do not raise from the thread that calls Fsm::processPending()
+  DropNewest,  //!< Discard the event being raised
+  DropOldest,  //!< Discard the oldest pending event to make space
+  Coalesce     //!< Merge with an identical pending event, whether full or not. Else discard the newest. Locked only
+};
+
+//======================================================================================================================
+/// Where and when raised events are processed. See Fsm::Config
+enum class DispatchMode
+{
+  Background,  //!< On the machine's own handler thread, or on Fsm::Config::executor if one is set
+  Inline,      //!< On the caller of Fsm::raise(), before it returns. Timeouts, delayed events and resumed action
+               //!< steps wait for the next Fsm::raise() or Fsm::processPending()
+  Manual       //!< Only when the owner calls Fsm::processPending()
+};
+
+//======================================================================================================================
+/// Order in which pending events are processed. See Fsm::setEventPriority()
+enum class EventPriority : std::uint8_t
+{
+  Urgent,  //!< Processed before pending events of lower priority
+  Normal,  //!< The default
+  Low      //!< Processed when no events of higher priority are pending
+};
+
+//======================================================================================================================
+/// Lifetime of a timer started with Fsm::raiseAfter()
+enum class TimerScope
+{
+  Machine,  //!< Raises its event unless cancelled with Fsm::cancelTimer()
+  State     //!< Also cancelled when the state that was active when it was started is exited
+};
+
+//======================================================================================================================
+/// What an asynchronous state action does after a step. See Fsm::startAction()
+class ActionResult
+{
+public:
+  enum class Kind
+  {
+    Done,           //!< the action has finished
+    ResumeAfter,    //!< run the next step after a delay
+    ResumeWhenIdle  //!< run the next step when no events are pending
+  };
+
+  /// The action has finished
+  static ActionResult done()
+  {
+    return ActionResult(Kind::Done, std::chrono::nanoseconds(0));
+  }
+
+  /// Run the next step after a delay. The machine processes other events meanwhile.
+  static ActionResult resumeAfter(std::chrono::nanoseconds delay)
+  {
+    return ActionResult(Kind::ResumeAfter, delay);
+  }
+
+  /// Run the next step once the machine has processed all pending events. Lets a long computation give way to
+  /// events. In DispatchMode::Inline and DispatchMode::Manual, one step runs each time events are processed.
+  static ActionResult resumeWhenIdle()
+  {
+    return ActionResult(Kind::ResumeWhenIdle, std::chrono::nanoseconds(0));
+  }
+
+  Kind getKind() const
+  {
+    return kind_;
+  }
+
+  std::chrono::nanoseconds getDelay() const
+  {
+    return delay_;
+  }
+
+private:
+  ActionResult(Kind kind, std::chrono::nanoseconds delay) : kind_(kind), delay_(delay)
+  {
+  }
+
+private:
+  Kind kind_;
+  std::chrono::nanoseconds delay_;
+};
+
 //======================================================================================================================
 /// A finite state machine.
 ///
@@ -69,17 +193,178 @@ protected:
 /// - Define and add state transition rules (see Fsm::addTransitionRule)
 /// - Initialise and start (see Fsm::start)
 /// - Raise event to change state (see Fsm::raise)
-class Fsm
+///
+/// States and events are interned into dense integer handles as they are defined. On Fsm::start the
+/// transition rules are compiled into a flat [state][event] table, so that dispatching an event is a single
+/// array lookup. The table only has rows for the states that can become active and columns for the events they
+/// handle (see Fsm::getAnalysis). The definition is frozen once the machine is running. Time-critical producers
+/// can resolve handles once (see Fsm::getEventHandle) and raise events by handle to avoid string hashing
+/// altogether.
+///
+/// Events are processed in the order raised, one at a time, each to completion. By default this happens on a
+/// background thread. See DispatchMode for running the machine on the caller's thread or inside an existing loop.
+class Fsm : private TimerWheel::Target
 {
 public:
   using Event = std::string;
 
+  /// Dense integer handle of a state within this machine
+  using StateHandle = std::uint32_t;
+
+  /// Dense integer handle of an event within this machine
+  using EventHandle = std::uint32_t;
+
+  /// Dense integer handle of an orthogonal region within this machine. See Fsm::addRegion()
+  using RegionHandle = std::uint32_t;
+
+  /// The region of states not placed in another one. Fsm::start() names its initial state.
+  static constexpr RegionHandle MAIN_REGION = 0;
+
+  /// Identifies a timer started with Fsm::raiseAfter()
+  using TimerId = TimerWheel::TimerId;
+
+  /// The active state, as any thread can read it. See Fsm::getStateVersion()
+  struct StateVersion
+  {
+    StateHandle state;      //!< handle of the active state
+    std::uint32_t version;  //!< number of transitions completed since the machine was started, wrapping around
+  };
+
+  /// Signature of the functions called when the active state changes. See Fsm::onStateChanged()
+  /// \param from Handle of the state that was active. Invalid for the initial state entered by Fsm::start()
+  /// \param to Handle of the state that is now active
+  using StateChangeHandler = std::function<void(StateHandle from, StateHandle to)>;
+
+  /// What Fsm::start() found out about the transition graph. See Fsm::getAnalysis()
+  struct Analysis
+  {
+    /// States that no sequence of events leads to from the initial states, in the order they were added. Entering
+    /// a state enters its ancestors, and the target of a transition function may be any state of its region
+    std::vector<State::Id> unreachable_states;
+
+    /// Events that none of the states that can become active has a rule for, in the order they were registered.
+    /// Raising them has no effect
+    std::vector<Event> unhandled_events;
+
+    std::size_t num_active_states;         //!< states that can become active, which have a row in the table
+    std::size_t num_handled_events;        //!< events with a column in the table
+    std::size_t num_compiled_transitions;  //!< rules resolved for the states that can become active
+    std::size_t table_size;                //!< entries in the dispatch table, including a row and a column for no rule
+  };
+
+  /// Construction options
+  struct Config
+  {
+    QueueType queue_type = QueueType::Locked;           //!< event queue implementation
+    DispatchMode dispatch_mode = DispatchMode::Background;  //!< where events are processed
+
+    /// Maximum number of pending events. 0 for unbounded. A lock-free queue rounds this up to a power of two and
+    /// preallocates it. Applies to events of EventPriority::Normal. Under OverflowPolicy::Block and
+    /// OverflowPolicy::DropNewest, the machine takes up to 32 events off the queue at a time, and their room in the
+    /// queue is free again. So up to 31 events may wait besides the capacity, in storage allocated with the machine.
+    std::size_t queue_capacity = 0;
+
+    /// Maximum number of pending events of EventPriority::Urgent and EventPriority::Low, which wait in queues of
+    /// their own of the same type and overflow policy. 0 for unbounded. The queues are only created if events of
+    /// their priority are defined.
+    std::size_t urgent_queue_capacity = 0;
+    std::size_t low_queue_capacity = 0;
+
+    OverflowPolicy overflow_policy = OverflowPolicy::Block;  //!< behaviour when the queue is at capacity
+
+    /// Instrument the dispatch path. See Fsm::getMetrics(). Has no effect unless the library is built with
+    /// FSM_ENABLE_METRICS, in which case machines without this flag pay one predictable branch per event.
+    bool collect_metrics = false;
+
+    /// Record every processed event into this flight recorder. See TraceRecorder. Recorders must not be shared
+    /// between machines.
+    std::shared_ptr<TraceRecorder> trace_recorder;
+
+    /// Executor to process events on in DispatchMode::Background. If not set, the machine runs its own event
+    /// handler thread. Attach many machines to one executor to keep the number of threads constant. See
+    /// Executor::getDefault().
+    /// An exception thrown by a state callback or transition function ends dispatch, as it ends the handler thread.
+    std::shared_ptr<Executor> executor;
+
+    /// Runs the timers of Fsm::raiseAfter() and Fsm::addStateTimeout(). TimerWheel::getDefault() if not set. A wheel
+    /// on a virtual clock runs them in simulated time. See Simulation
+    std::shared_ptr<TimerWheel> timer_wheel;
+
+    /// Run the transitions that one event triggers in different regions concurrently on this executor, and wait
+    /// for all of them before the next event. If not set, they run one after another on the dispatch context. The
+    /// dispatch context takes on transitions the executor has not started, so it may be the executor the machine
+    /// runs on. See Fsm::addRegion()
+    std::shared_ptr<Executor> region_executor;
+
+    /// Memory for the definition and bookkeeping of the machine: its tables, compiled transitions, timers and
+    /// actions. If not set, the heap. A MonotonicArena suits a machine defined once and run for the life of the
+    /// process. Names of states and events too long for the small string buffer of std::string, and callables too
+    /// large for that of std::function, still come from the heap.
+    std::shared_ptr<MemoryResource> memory_resource;
+
+    /// Memory for the event queues: buffers of locked queues, rings of bounded lock-free queues and nodes of
+    /// unbounded ones. If not set, the heap. A PoolResource recycles queue storage among machines that come and go.
+    std::shared_ptr<MemoryResource> queue_memory_resource;
+  };
+
 public:
   Fsm();
+  explicit Fsm(const Config& config);
+
+  /// Stops the machine. In DispatchMode::Background, the events already queued are processed first, on the event
+  /// handler thread or on Config::executor. No timers start from then on
   virtual ~Fsm();
 
-  /// Add a state in the machine. Also see Fsm::addTransitionRule().
-  void addState(std::shared_ptr<State> state);
+  /// Add a state in the machine. Also see Fsm::addTransitionRule(). Adding a state with the ID of an existing
+  /// state replaces it.
+  /// \return Handle of the state
+  StateHandle addState(std::shared_ptr<State> state);
+
+  /// Add a state nested in a parent state. Events the state has no transition rule for are handled by the rules of
+  /// its parent, and then of the parent's ancestors. A transition exits the states from the active state up to the
+  /// least common proper ancestor of the rule's state and the target state, then enters the states from there down
+  /// to the target. A parent state may itself be the target of a transition and the active state; it has no implicit
+  /// initial child. Adding a state with the ID of an existing state replaces it, together with its parent.
+  /// \param state The state to add
+  /// \param parent ID of an existing state to nest it in
+  /// \return Handle of the state
+  StateHandle addState(std::shared_ptr<State> state, const State::Id& parent);
+
+  /// Add a top-level state in an orthogonal region. States nested in it belong to the same region. See
+  /// Fsm::addRegion()
+  /// \param state The state to add
+  /// \param region The region
+  /// \return Handle of the state
+  StateHandle addState(std::shared_ptr<State> state, RegionHandle region);
+
+  /// Add an orthogonal region: a part of the machine with an active state of its own. Each event is delivered to
+  /// every region whose active state, or one of its ancestors, has a rule for it, main region first. Transition
+  /// rules cannot cross regions. The callbacks of a region see their own region's state under way, and other
+  /// regions as they were before the event. See Config::region_executor to run regions concurrently.
+  /// \param name Name of the region
+  /// \param initial_state State of the region that Fsm::start() enters, after the main region's initial state
+  /// \return Handle of the region
+  RegionHandle addRegion(const std::string& name, const State::Id& initial_state);
+
+  /// Register an event with the machine. Events are also registered implicitly by Fsm::addTransitionRule().
+  /// \return Handle of the event. Registering an existing event returns its existing handle.
+  EventHandle addEvent(const Event& event);
+
+  /// Set the priority of an event, registering it if needed. Events of each priority wait in a queue of their own.
+  /// The queues are served in order of priority, each in the order its events were raised. An urgent event waits
+  /// at most for the event being processed and earlier urgent events, whatever the backlog of other events.
+  /// \param event The event
+  /// \param priority Its priority. EventPriority::Normal by default
+  void setEventPriority(const Event& event, EventPriority priority);
+
+  /// \return Handle of an existing state. Throws if the state does not exist.
+  StateHandle getStateHandle(const State::Id& state) const;
+
+  /// \return Handle of a registered event. Throws if the event is not known to the machine.
+  EventHandle getEventHandle(const Event& event) const;
+
+  /// \return Events that at least one state has a transition rule for, in the order they were registered
+  std::vector<Event> getHandledEvents() const;
 
   /// Define state transition rule. The corresponding states must already exist. See Fsm::addState().
   /// \param from_state The name of state to transition from
@@ -87,6 +372,9 @@ public:
   /// \param to_state The name of state to transition to.
   void addTransitionRule(const State::Id& from_state, const Event& event, const State::Id& to_state);
 
+  /// Define state transition rule using handles. See Fsm::addState() and Fsm::addEvent().
+  void addTransitionRule(StateHandle from_state, EventHandle event, StateHandle to_state);
+
   /// Signature for state transition function. See addTransitionRule().
   using TransitionFunction = std::function<State::Id()>;
 
@@ -98,47 +386,383 @@ public:
   /// \param func Function returns ID of resulting state.
   void addTransitionRule(const State::Id& from_state, const Event& event, TransitionFunction&& func);
 
-  /// Set the initial state and start the state machine
+  /// Define state transition rule as a function using handles. See Fsm::addState() and Fsm::addEvent().
+  void addTransitionRule(StateHandle from_state, EventHandle event, TransitionFunction&& func);
+
+  /// Signature for state transition function that returns the handle of the resulting state. Unlike
+  /// TransitionFunction, the callable is stored inline without allocating and no state name is looked up when the
+  /// rule is taken. See Delegate::CAPACITY.
+  using TransitionDelegate = Delegate<StateHandle()>;
+
+  /// Define state transition rule as a function returning a state handle. See Fsm::getStateHandle().
+  /// \param from_state The state to transition from
+  /// \param event The signal that causes the state transition
+  /// \param func Function returns handle of resulting state
+  void addTransitionRule(StateHandle from_state, EventHandle event, TransitionDelegate&& func);
+
+  /// Signature for transition guard. Returns false to veto the transition, which leaves the event ignored.
+  using GuardDelegate = Delegate<bool()>;
+
+  /// Define state transition rule that is taken only if a guard allows it. The target is fixed, so the states to
+  /// exit and enter are worked out when the machine starts, as they are for unconditional rules.
+  /// \param from_state The name of state to transition from
+  /// \param event The signal that causes the state transition
+  /// \param to_state The name of state to transition to
+  /// \param guard Called before any state is exited. The transition is taken if it returns true
+  void addTransitionRule(const State::Id& from_state, const Event& event, const State::Id& to_state,
+                         GuardDelegate&& guard);
+
+  /// Define guarded state transition rule using handles. See Fsm::addState() and Fsm::addEvent().
+  void addTransitionRule(StateHandle from_state, EventHandle event, StateHandle to_state, GuardDelegate&& guard);
+
+  /// Raise an event when a state has been active for some time. The timer starts when State::onEntry() returns and
+  /// is cancelled when the state is exited. Add a transition rule for the event to make this a timeout transition.
+  /// A state has at most one timeout. Adding another replaces it.
+  /// \param state The state
+  /// \param timeout Time the state must be active for
+  /// \param event The event to raise
+  void addStateTimeout(const State::Id& state, std::chrono::nanoseconds timeout, const Event& event);
+
+  /// Set the initial state, compile the transition table and start the state machine. Throws if a rule crosses
+  /// regions, or if an initial state is not a state of its region. States that cannot be reached from the initial
+  /// states and events that no reachable state handles are left out of the table. See Fsm::getAnalysis()
   void start(const State::Id& state);
 
+  /// \return Unreachable states and unhandled events of the started machine, and the size of its dispatch table.
+  /// Throws if the machine has not been started. Machines rebuilt from an image report on the machine that was saved
+  Analysis getAnalysis() const;
+
   /// Raise an event. This will kick of a state transition if one is defined for this event and current state.
   /// The event is quietly ignored otherwise.
   void raise(const Event& event);
 
+  /// Raise an event by handle. This is the fast path for Fsm::raise(const Event&). See Fsm::getEventHandle().
+  void raise(EventHandle event);
+
+  /// Raise an event carrying data. The payload is moved into the event queue without allocating, and is available
+  /// through Fsm::getEventPayload() to the transition function and the state callbacks that process the event.
+  void raise(const Event& event, Payload payload);
+
+  /// Raise an event carrying data, by handle. See Fsm::raise(const Event&, Payload).
+  void raise(EventHandle event, Payload payload);
+
+  /// Raise a burst of events by handle, in order. Cheaper than raising them one at a time: the events go into the
+  /// queue in chunks, each with one synchronisation and one wakeup of the dispatch context. If any handle is not
+  /// known, throws before raising any event.
+  /// \param first First event of the burst
+  /// \param last One past the last event of the burst
+  void raiseBatch(const EventHandle* first, const EventHandle* last);
+
+  /// Raise a burst of events, in order. Unknown events are quietly ignored, as by Fsm::raise(). See
+  /// Fsm::raiseBatch(const EventHandle*, const EventHandle*).
+  void raiseBatch(const std::vector<Event>& events);
+
+  /// Raise an event after a delay, without blocking. The timers of all machines sharing a TimerWheel run on its one
+  /// thread. If the event queue is full when the timer expires, the event is dropped even under
+  /// OverflowPolicy::Block. Can be called once the machine is started, including from State::onEntry() of the
+  /// initial state.
+  /// \param event Event to raise. Unknown events are quietly ignored, as by Fsm::raise(), and give an invalid id.
+  /// \param delay Time until the event is raised
+  /// \param scope With TimerScope::State, the timer is also cancelled when the active state is exited. Start such
+  /// timers from the state callbacks and transition functions.
+  /// \return Id of the timer. See Fsm::cancelTimer(). Invalid once the machine is being destroyed, when no timers
+  /// start
+  TimerId raiseAfter(const Event& event, std::chrono::nanoseconds delay, TimerScope scope = TimerScope::Machine);
+
+  /// Raise an event after a delay, by handle. See Fsm::raiseAfter(const Event&, std::chrono::nanoseconds,
+  /// TimerScope)
+  TimerId raiseAfter(EventHandle event, std::chrono::nanoseconds delay, TimerScope scope = TimerScope::Machine);
+
+  /// Cancel a timer started with Fsm::raiseAfter()
+  /// \return true if the timer was pending
+  bool cancelTimer(TimerId id);
+
+  /// One step of an asynchronous state action. Keep its progress in captured variables. See Fsm::startAction()
+  using Action = std::function<ActionResult()>;
+
+  /// Run a long action of the active state in steps, without blocking the dispatch context. Each step runs where
+  /// events are processed, in order with them, and says when to run the next one. The machine processes other
+  /// events between steps. The action is cancelled when the active state is exited, whichever step it is at. Raise
+  /// an event from the last step to report completion. Call from the state callbacks and transition functions. The
+  /// first step runs after the callback returns, ahead of pending events.
+  /// \param action The steps
+  void startAction(Action action);
+
+  /// \return Payload of the event being processed. Only meaningful when called from a transition function or guard,
+  /// or from State::onExit()/State::onEntry() during a transition. Empty at any other time or if the event carried
+  /// none.
+  const Payload& getEventPayload() const;
+
+  /// Process events queued so far on the calling thread. Only available in DispatchMode::Inline and
+  /// DispatchMode::Manual. Events raised by the state callbacks while processing are processed in the same call.
+  /// Returns immediately if another thread, or a state callback further up the stack, is already processing.
+  /// \param max_events Maximum number of events to process
+  /// \return Number of events processed
+  std::size_t processPending(std::size_t max_events = SIZE_MAX);
+
   /// \return true if not all events have been processed yet.
   bool hasPendingEvents() const;
 
-  /// \return A pointer to current state. Use this do perform operations on this state.
+  /// \return Number of events discarded or coalesced so far because of the queue capacity. See Config.
+  std::uint64_t getDroppedEventCount() const;
+
+  /// \return Snapshot of the dispatch path instrumentation. Cheap enough to call periodically from another thread.
+  /// See Config::collect_metrics.
+  FsmMetrics getMetrics() const;
+
+  /// \return A pointer to current state. Use this do perform operations on this state. Safe to call from any thread.
+  /// Other threads see a transition once it has completed, the state callbacks see its target while it is under way.
   const std::shared_ptr<State>& getActiveState() const;
 
+  /// \return Active state of a region. See Fsm::getActiveState() and Fsm::addRegion()
+  const std::shared_ptr<State>& getActiveState(RegionHandle region) const;
+
+  /// \return true if the state is the active state, or one of its ancestors. See addState(std::shared_ptr<State>,
+  /// const State::Id&) and Fsm::getActiveState()
+  bool isInState(const State::Id& state) const;
+
+  /// Wait-free read of the active state and the number of transitions so far, published together when a transition
+  /// completes. Compare versions to detect transitions that returned to the same state.
+  StateVersion getStateVersion() const;
+
+  /// \return Active state and version of a region. See Fsm::getStateVersion()
+  StateVersion getStateVersion(RegionHandle region) const;
+
+  /// \return ID of a state. Throws if the handle is not valid.
+  State::Id getStateId(StateHandle state) const;
+
+  /// Block until the machine is in a state, as by Fsm::isInState(). Waiters are woken as the transition into the
+  /// state completes. In DispatchMode::Inline and DispatchMode::Manual, another thread must be processing events.
+  /// \param state The state to wait for
+  /// \param timeout Maximum time to wait
+  /// \return true if the machine is in the state, false on timeout
+  bool waitForState(const State::Id& state, std::chrono::nanoseconds timeout) const;
+
+  /// Subscribe to changes of the active state. The handler is called on the dispatch context each time a
+  /// transition completes, including transitions back into the same state, and once Fsm::start() has entered the
+  /// initial state. Subscribe before the machine is started.
+  void onStateChanged(StateChangeHandler handler);
+
   /// \return true if the FSM is running
   bool isRunning() const;
 
+  /// \return Configuration the machine was created with
+  const Config& getConfig() const;
+
+  /// Creates the states of a machine rebuilt by Fsm::restore(). Returns the state with the given id, constructed for
+  /// the given machine.
+  using StateFactory = std::function<std::shared_ptr<State>(Fsm& fsm, const State::Id& id)>;
+
+  /// Save the machine to a compact binary image: its definition, as compiled by Fsm::start(), and its active states
+  /// and pending events. Restore it with Fsm::restore(). The image records state ids rather than State objects, and
+  /// cannot capture transition functions, guards, payloads, timers or actions:
+  /// - machines with transition functions or guards cannot be saved, and throw
+  /// - pending events are saved without their payloads
+  /// - timers and actions in progress are not saved
+  /// The machine must be running and between events. In DispatchMode::Manual, the pending events are saved, and no
+  /// other thread may process or raise events while the image is taken. In other modes, the machine must have no
+  /// pending events.
+  /// \return The image. Its layout is versioned and native to the platform, and it can be restored in place from a
+  /// memory-mapped file.
+  std::vector<std::uint8_t> saveImage() const;
+
+  /// Rebuild a machine saved with Fsm::saveImage(), and resume it. Only for a machine with nothing defined yet. The
+  /// tables compiled by the saved machine are taken over as they are, with only a check that they stay in bounds.
+  /// The saved active states are resumed without calling State::onEntry(), and state timeouts start over. Saved
+  /// pending events are raised again, and dropped if the queues cannot take them.
+  /// \param image The image. Need not be aligned
+  /// \param size Size of the image in bytes
+  /// \param make_state Creates the states
+  void restore(const void* image, std::size_t size, const StateFactory& make_state);
+
+  /// Build the machine from a shared definition and start it in the definition's initial states, calling
+  /// State::onEntry() as Fsm::start(const State::Id&) does. Only for a machine with nothing defined yet. The
+  /// definition was validated and compiled once when it was parsed, and is taken over as it is.
+  /// \param definition The definition. See Definition
+  /// \param make_state Creates the states
+  void start(const Definition& definition, const StateFactory& make_state);
+
+  /// Write the transition graph in the DOT language of Graphviz. States nested in others are drawn inside them, and
+  /// regions side by side. Rules with a transition function are drawn to a point, as their target is only known when
+  /// the rule is taken. Once the machine is started, the active states are drawn in bold. Call from the dispatch
+  /// context, or while no events are processed.
+  /// \param out Stream to write to
+  void exportDot(std::ostream& out) const;
+
+private:
+  /// Containers that draw on Config::memory_resource
+  template <typename T>
+  using Vector = std::vector<T, Allocator<T>>;
+  template <typename K, typename V>
+  using Map = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, Allocator<std::pair<const K, V>>>;
+
 private:
   void stop();
-  bool hasTransitionRule(const State::Id& state_name, const Event& event);
+  void waitForTasks();
+  bool isDispatching() const;
+  void assertNotRunning(const char* caller) const;
+  bool hasTransitionRule(StateHandle state, EventHandle event) const;
+  void addRule(StateHandle from_state, EventHandle event, StateHandle to_state, TransitionDelegate&& func,
+               GuardDelegate&& guard);
+  void compile(Vector<StateHandle>& initial_states);
+  void loadImage(const void* image, std::size_t size, const StateFactory& make_state,
+                 Vector<StateHandle>& active_states, std::vector<EventHandle>& pending);
+  void enterInitialStates(const Vector<StateHandle>& initial_states);
+  void setUpDispatch();
+  void launch();
+  std::size_t appendPath(StateHandle active, StateHandle source, StateHandle target,
+                         Vector<StateHandle>& path) const;
   void eventHandler();
-  void changeState(const Event& event);
+  void schedule();
+  void runScheduled();
+  std::size_t dispatchInline(std::size_t max_events);
+  std::size_t processEvents(std::size_t max_events);
+  void changeState(EventHandle event);
+  void transit(RegionHandle region, EventHandle event);
+  void transitConcurrently(EventHandle event);
+  void transitClaimed(RegionHandle region, std::uint64_t batch, EventHandle event);
+  void recordTrace(EventHandle event, StateHandle from, StateHandle to, TraceOutcome outcome);
+  void enterState(StateHandle state);
+  void exitState(StateHandle state);
+  void enqueue(detail::QueuedEvent&& item, bool can_block, bool notify);
+  void enqueueBatch(detail::QueuedEvent* items, std::size_t count, bool can_block);
+  void enqueueEvents(const EventHandle* first, const EventHandle* last, bool can_block, bool notify);
+  TimerId startTimer(EventHandle event, StateHandle scope, std::chrono::nanoseconds delay);
+  void onTimer(std::uint64_t tag) final;
+  void notifyDispatcher();
+  bool popEvent(detail::QueuedEvent& item);
+  bool hasQueuedEvents() const;
+  void resumeAction(std::uint32_t index, std::uint16_t generation, bool notify);
+  std::size_t runActions();
+  void cancelActions(StateHandle state);
+  StateHandle currentState() const;
+  StateHandle visibleState(RegionHandle region) const;
+  void publishState(RegionHandle region, StateHandle from);
 
 private:
+  static constexpr StateHandle INVALID_STATE = UINT32_MAX;
+  static constexpr std::uint32_t NO_TRANSITION = UINT32_MAX;
+  static constexpr EventHandle INVALID_EVENT = UINT32_MAX;
+
   /// Defines an FSM transition from one state to another.
   struct Transition
   {
-    State::Id from_state;        //!< state active at the time of event
-    Event event;                 //!< signal that triggers state transition
-    TransitionFunction transit;  //!< Functional that returns state to transition into next
+    StateHandle from_state;      //!< state active at the time of event
+    EventHandle event;           //!< signal that triggers state transition
+    StateHandle to_state;        //!< state to transition into next, if transit is not set
+    TransitionDelegate transit;  //!< Functional that returns state to transition into next
+    GuardDelegate guard;         //!< Functional that vetoes the transition, if set
+  };
+
+  /// Event raised when a state has been active for some time. See addStateTimeout()
+  struct StateTimeout
+  {
+    std::chrono::nanoseconds delay;
+    EventHandle event;  //!< INVALID_EVENT if the state has no timeout
+  };
+
+  /// An action started with startAction()
+  struct RunningAction
+  {
+    Action step;               //!< moved out while a step runs
+    StateHandle state;         //!< state whose exit cancels the action. INVALID_STATE if the slot is free
+    std::uint16_t generation;  //!< changes each time the slot is freed
+    TimerId timer;             //!< pending resumption after a delay
+  };
+
+  /// Slot and generation of a RunningAction
+  using ActionRef = std::pair<std::uint32_t, std::uint16_t>;
+
+  /// An orthogonal region. See addRegion()
+  struct Region
+  {
+    std::string name;
+    State::Id initial_state;           //!< entered by start(). Given to start() for the main region
+    StateHandle active;                //!< INVALID_STATE until started
+    Vector<StateHandle> dynamic_path;  //!< scratch for computed transition targets
+    StateHandle from;                  //!< state active before the event being processed
+    bool transitioned;                 //!< the event being processed changed the state
+    std::exception_ptr error;          //!< thrown while transiting concurrently
+  };
+
+  /// A transition rule as it applies to one active state, with the states it exits and enters
+  struct CompiledTransition
+  {
+    std::uint32_t rule;         //!< index in transitions_. The rule may belong to an ancestor of the state
+    std::uint32_t path;         //!< index in path_states_ of the states to exit, then the states to enter
+    std::uint16_t num_exits;    //!< 0 if the target is computed by a transition function
+    std::uint16_t num_entries;  //!< 0 if the target is computed by a transition function
   };
 
 private:
-  std::map<State::Id, std::shared_ptr<State>> states_;
-  std::multimap<State::Id, Transition> transitions_;
-  std::shared_ptr<State> active_state_;
-
-  mutable std::recursive_mutex event_guard_;
-  bool exit_flag_;
-  std::condition_variable_any event_condition_;
-  std::queue<Event> event_queue_;
+  Config config_;  //!< declared first, to outlive the containers that allocate from its memory resources
+
+  Vector<std::shared_ptr<State>> states_;                 //!< states, indexed by handle
+  Vector<StateHandle> parents_;                           //!< parent by state handle. INVALID_STATE if none
+  Map<State::Id, StateHandle> state_handles_;             //!< state ID to handle
+  Vector<Event> events_;                                  //!< events, indexed by handle
+  Map<Event, EventHandle> event_handles_;                 //!< event to handle
+  Vector<Transition> transitions_;                        //!< rules, in order of definition
+  Map<std::uint64_t, std::uint32_t> rules_;               //!< (state, event) to index in transitions_
+  Vector<std::uint32_t> transition_table_;                //!< [row][column] to index in compiled_
+  Vector<std::uint32_t> table_rows_;                      //!< offset of the row by state handle. 0 if never active
+  Vector<std::uint32_t> event_columns_;                   //!< column by event handle. 0 if never handled
+  Vector<CompiledTransition> compiled_;                   //!< rules per active state, resolved by start()
+  Vector<StateHandle> path_states_;                       //!< exit and entry sequences of compiled_
+  std::size_t num_events_;                                //!< events known to the tables
+  Vector<Region> regions_;                                //!< by region handle
+  Vector<RegionHandle> state_regions_;                    //!< region by state handle. See compile()
+  Vector<RegionHandle> dispatched_regions_;               //!< with a rule for the event being processed
+  Vector<StateTimeout> timeouts_;                         //!< by state handle
+  Vector<std::uint16_t> state_epochs_;                    //!< by state handle. Changes on each exit
+  Vector<std::pair<StateHandle, TimerId>> state_timers_;  //!< TimerScope::State timers and their state
+  Vector<RunningAction> actions_;                         //!< slots of actions
+  std::size_t num_actions_;                               //!< slots in use
+  std::mutex ready_guard_;
+  Vector<ActionRef> ready_actions_;     //!< due to resume. Guarded by ready_guard_
+  std::atomic<bool> actions_ready_;     //!< ready_actions_ is not empty
+  Vector<ActionRef> idle_actions_;      //!< to resume when no events are pending
+  Vector<ActionRef> resuming_actions_;  //!< scratch of runActions()
+  const Payload* event_payload_;  //!< payload of the event being processed
+  Vector<StateChangeHandler> state_change_handlers_;
+
+  /// Active state by region for threads other than the dispatch context. Version in the upper half, handle in the
+  /// lower
+  std::unique_ptr<std::atomic<std::uint64_t>[]> published_states_;
+  mutable std::mutex state_guard_;
+  mutable std::condition_variable state_changed_;  //!< signals waitForState()
+  mutable std::atomic<unsigned> state_waiters_;    //!< threads in waitForState()
+
+  Vector<EventPriority> event_priorities_;            //!< by event handle
+  std::unique_ptr<detail::EventQueue> event_queue_;   //!< EventPriority::Normal events
+  std::unique_ptr<detail::EventBatch> event_batch_;   //!< taken off event_queue_ and not yet processed
+  std::unique_ptr<detail::EventQueue> urgent_queue_;  //!< EventPriority::Urgent events, if any are defined
+  std::unique_ptr<detail::EventQueue> low_queue_;     //!< EventPriority::Low events, if any are defined
+  std::atomic<std::size_t> urgent_events_;            //!< in urgent_queue_, counted before they are pushed
+  std::atomic<std::size_t> low_events_;               //!< in low_queue_, counted before they are pushed
+  std::unique_ptr<detail::EventCount> event_signal_;  //!< wakes up the event handler
+  std::atomic<std::size_t> pending_events_;           //!< raised and not yet fully processed
+  std::atomic<std::uint64_t> dropped_events_;         //!< discarded due to queue capacity
+  std::unique_ptr<detail::MetricsRecorder> metrics_;  //!< null unless instrumentation is enabled
+  std::atomic<bool> running_;
+  std::atomic<bool> exit_flag_;
   std::future<void> event_handler_;
+  std::atomic<bool> scheduled_;           //!< a run is queued or active on the executor, or inline
+  std::atomic<unsigned> scheduled_runs_;  //!< runs posted to the executor and not yet finished
+  std::exception_ptr dispatch_error_;     //!< ended a run on the executor. Written and read under scheduled_
+
+  // transitions of regions running concurrently. See transitConcurrently()
+  bool concurrent_;                                              //!< region transitions are under way concurrently
+  std::mutex concurrent_guard_;                                  //!< serialises shared bookkeeping while concurrent_
+  std::unique_ptr<std::atomic<std::uint64_t>[]> region_claims_;  //!< by region. Batch to claim, 0 once claimed
+  std::uint64_t region_batch_;                                   //!< number of concurrent dispatches so far
+  std::atomic<std::size_t> regions_left_;                        //!< transitions of the batch not yet finished
+  std::unique_ptr<detail::EventCount> regions_done_;             //!< signals regions_left_ reaching 0
+  std::atomic<unsigned> region_tasks_;  //!< posted to Config::region_executor and not yet finished
+
+  /// Signals the end of a scheduled run or a region task. The tasks hold a reference, so that they can signal it
+  /// after their last access to the machine
+  std::shared_ptr<detail::EventCount> tasks_done_;
 };
 
 }  // namespace fsm
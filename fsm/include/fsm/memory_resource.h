@@ -0,0 +1,225 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_MEMORY_RESOURCE_H
+#define FSM_MEMORY_RESOURCE_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace fsm
+{
+//======================================================================================================================
+/// Source of memory for the containers of a Fsm. See Fsm::Config::memory_resource and
+/// Fsm::Config::queue_memory_resource.
+///
+/// Modelled on std::pmr::memory_resource, which needs C++17. Resources are not owned by the allocators that draw on
+/// them, and must outlive everything allocated from them.
+class MemoryResource
+{
+public:
+  static constexpr std::size_t MAX_ALIGNMENT = alignof(std::max_align_t);  //!< default alignment of allocations
+
+public:
+  virtual ~MemoryResource();
+
+  /// Allocate memory. Throws std::bad_alloc if the request cannot be met.
+  void* allocate(std::size_t bytes, std::size_t alignment = MAX_ALIGNMENT)
+  {
+    return doAllocate(bytes, alignment);
+  }
+
+  /// Return memory obtained from allocate() with the same size and alignment
+  void deallocate(void* ptr, std::size_t bytes, std::size_t alignment = MAX_ALIGNMENT)
+  {
+    doDeallocate(ptr, bytes, alignment);
+  }
+
+  /// \return true if memory allocated from one resource can be deallocated by the other
+  bool isEqual(const MemoryResource& other) const noexcept
+  {
+    return this == &other;
+  }
+
+  /// \return The process-wide resource that allocates from the heap with operator new
+  static std::shared_ptr<MemoryResource> getDefault();
+
+protected:
+  virtual void* doAllocate(std::size_t bytes, std::size_t alignment) = 0;
+  virtual void doDeallocate(void* ptr, std::size_t bytes, std::size_t alignment) = 0;
+};
+
+//======================================================================================================================
+/// Standard allocator that draws on a MemoryResource, for use with the standard containers. Modelled on
+/// std::pmr::polymorphic_allocator. Containers that are copied or moved keep the resource they were created with.
+template <typename T>
+class Allocator
+{
+public:
+  using value_type = T;
+
+public:
+  /// Allocate from the heap. See MemoryResource::getDefault()
+  Allocator() noexcept : resource_(MemoryResource::getDefault().get())
+  {
+  }
+
+  /// Allocate from a resource. nullptr selects the heap
+  Allocator(MemoryResource* resource) noexcept  // NOLINT: implicit by design
+    : resource_((resource != nullptr) ? resource : MemoryResource::getDefault().get())
+  {
+  }
+
+  template <typename U>
+  Allocator(const Allocator<U>& other) noexcept : resource_(other.getResource())  // NOLINT: implicit by design
+  {
+  }
+
+  T* allocate(std::size_t n)
+  {
+    if (n > SIZE_MAX / sizeof(T))
+    {
+      throw std::bad_array_new_length();
+    }
+    return static_cast<T*>(resource_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* ptr, std::size_t n) noexcept
+  {
+    resource_->deallocate(ptr, n * sizeof(T), alignof(T));
+  }
+
+  MemoryResource* getResource() const noexcept
+  {
+    return resource_;
+  }
+
+private:
+  MemoryResource* resource_;
+};
+
+template <typename T, typename U>
+bool operator==(const Allocator<T>& lhs, const Allocator<U>& rhs) noexcept
+{
+  return lhs.getResource()->isEqual(*rhs.getResource());
+}
+
+template <typename T, typename U>
+bool operator!=(const Allocator<T>& lhs, const Allocator<U>& rhs) noexcept
+{
+  return !(lhs == rhs);
+}
+
+//======================================================================================================================
+/// Resource that hands out memory by bumping a pointer and only reclaims it all at once. Suits data that is built
+/// once and lives as long as the resource, such as the definition of a machine.
+///
+/// Memory comes from a caller supplied buffer and, once that is used up, from blocks obtained from an upstream
+/// resource, each twice the size of the previous one. Without an upstream resource, running out of buffer throws
+/// std::bad_alloc. Thread-safe.
+class MonotonicArena : public MemoryResource
+{
+public:
+  /// Allocate from a buffer, which must outlive the arena
+  /// \param buffer Memory to allocate from
+  /// \param size Size of the buffer in bytes
+  /// \param upstream Resource to take more memory from once the buffer is used up. nullptr for none
+  MonotonicArena(void* buffer, std::size_t size, std::shared_ptr<MemoryResource> upstream = nullptr);
+
+  /// Allocate from blocks obtained from an upstream resource
+  /// \param initial_size Size of the first block in bytes
+  /// \param upstream Resource to take blocks from
+  explicit MonotonicArena(std::size_t initial_size, std::shared_ptr<MemoryResource> upstream = getDefault());
+
+  /// Returns all blocks to the upstream resource
+  ~MonotonicArena() override;
+
+  MonotonicArena(const MonotonicArena&) = delete;
+  MonotonicArena(MonotonicArena&&) = delete;
+  MonotonicArena& operator=(const MonotonicArena&) = delete;
+  MonotonicArena& operator=(MonotonicArena&&) = delete;
+
+  /// Reclaim everything allocated so far. Blocks go back to the upstream resource and allocation starts over at the
+  /// beginning of the buffer. Nothing allocated from the arena may be in use.
+  void release();
+
+  /// \return Number of bytes handed out since construction or the last release(), including alignment padding
+  std::size_t getBytesUsed() const;
+
+protected:
+  void* doAllocate(std::size_t bytes, std::size_t alignment) override;
+  void doDeallocate(void* ptr, std::size_t bytes, std::size_t alignment) override;
+
+private:
+  struct Block;
+  void addBlock(std::size_t min_size);
+
+private:
+  mutable std::mutex guard_;
+  char* buffer_;                               //!< caller supplied buffer, if any
+  std::size_t buffer_size_;                    //!< size of buffer_
+  std::shared_ptr<MemoryResource> upstream_;   //!< source of blocks. May be null
+  Block* blocks_;                              //!< most recent block first
+  char* cursor_;                               //!< next free byte
+  std::size_t remaining_;                      //!< bytes from cursor_ to the end of the current buffer or block
+  std::size_t next_block_size_;                //!< size of the next block to take from upstream_
+  std::size_t used_;                           //!< bytes handed out
+};
+
+//======================================================================================================================
+/// Resource that keeps pools of fixed size blocks and reuses deallocated blocks. Suits storage that comes and goes at
+/// run time, such as the event queues of machines that are created and destroyed.
+///
+/// There is a pool for each power of two size from 8 bytes up to the largest block size. A request is served by the
+/// smallest pool whose blocks fit it, and its block goes back to that pool on deallocation. Pools take chunks of
+/// blocks from an upstream resource as they grow, and return them only when the resource is destroyed. Requests
+/// larger than the largest block size go straight to the upstream resource. Thread-safe.
+class PoolResource : public MemoryResource
+{
+public:
+  /// Create the pools
+  /// \param largest_block Size of the blocks of the largest pool in bytes, rounded up to a power of two
+  /// \param upstream Resource to take chunks from
+  explicit PoolResource(std::size_t largest_block = 64 * 1024, std::shared_ptr<MemoryResource> upstream = getDefault());
+
+  /// Returns all chunks to the upstream resource
+  ~PoolResource() override;
+
+  PoolResource(const PoolResource&) = delete;
+  PoolResource(PoolResource&&) = delete;
+  PoolResource& operator=(const PoolResource&) = delete;
+  PoolResource& operator=(PoolResource&&) = delete;
+
+  /// Grow the pool for requests of a given size, so that as many requests are served without going upstream
+  /// \param bytes Size of the requests
+  /// \param count Number of blocks to add
+  void reserve(std::size_t bytes, std::size_t count);
+
+protected:
+  void* doAllocate(std::size_t bytes, std::size_t alignment) override;
+  void doDeallocate(void* ptr, std::size_t bytes, std::size_t alignment) override;
+
+private:
+  struct FreeBlock;
+  struct Chunk;
+  std::size_t poolIndex(std::size_t bytes, std::size_t alignment) const;
+  void addChunk(std::size_t pool, std::size_t num_blocks);
+
+private:
+  static constexpr std::size_t MIN_BLOCK_SIZE = 8;
+
+  std::mutex guard_;
+  std::shared_ptr<MemoryResource> upstream_;
+  std::vector<FreeBlock*> free_lists_;  //!< by pool
+  std::vector<std::size_t> chunk_blocks_;  //!< by pool. Number of blocks in the next chunk
+  Chunk* chunks_;                          //!< most recent chunk first
+};
+
+}  // namespace fsm
+
+#endif  // FSM_MEMORY_RESOURCE_H
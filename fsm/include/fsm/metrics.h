@@ -0,0 +1,79 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_METRICS_H
+#define FSM_METRICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fsm
+{
+//======================================================================================================================
+/// Snapshot of a distribution of durations in nanoseconds.
+///
+/// Values are counted in log-linear buckets: each power of two range is split into 2^SUB_BUCKET_BITS linear
+/// sub-buckets, so any recorded value is known to within 25% while the whole 64 bit range fits in a few hundred
+/// counters.
+class Histogram
+{
+public:
+  static constexpr unsigned SUB_BUCKET_BITS = 2;
+  static constexpr std::size_t NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+  /// \return Index of the bucket counting value
+  static std::size_t bucketOf(std::uint64_t value);
+
+  /// \return Largest value counted by a bucket
+  static std::uint64_t bucketUpperBound(std::size_t bucket);
+
+  /// \return Value at or below which the fraction p (0 to 1) of recorded values fall. Reported as the upper bound
+  /// of the bucket holding it. 0 if nothing was recorded.
+  std::uint64_t percentile(double p) const;
+
+  /// \return Arithmetic mean of recorded values
+  double mean() const;
+
+public:
+  std::vector<std::uint64_t> buckets;  //!< counts per bucket. Empty if nothing was recorded
+  std::uint64_t count = 0;             //!< number of recorded values
+  std::uint64_t sum = 0;               //!< sum of recorded values
+  std::uint64_t max = 0;               //!< largest recorded value
+};
+
+//======================================================================================================================
+/// Time spent in the callbacks of one state. See FsmMetrics
+struct StateMetrics
+{
+  std::string id;      //!< state identifier
+  Histogram on_entry;  //!< duration of State::onEntry()
+  Histogram on_exit;   //!< duration of State::onExit()
+};
+
+//======================================================================================================================
+/// Snapshot of the instrumentation of one Fsm. See Fsm::getMetrics().
+///
+/// Metrics are only collected when the library is built with FSM_ENABLE_METRICS and the machine is created with
+/// Fsm::Config::collect_metrics set. Otherwise all values are zero.
+struct FsmMetrics
+{
+  std::uint64_t events_raised = 0;      //!< events raised, including those dropped due to the queue capacity
+  std::uint64_t events_processed = 0;   //!< events taken off the queue and dispatched
+  std::uint64_t transitions = 0;        //!< events that caused a state transition
+  std::uint64_t ignored_events = 0;     //!< events that caused no transition: no rule, vetoed or invalid target
+  std::uint64_t dropped_events = 0;     //!< events discarded due to the queue capacity
+  std::size_t queue_high_water = 0;     //!< largest number of events pending at once
+  double transitions_per_second = 0.0;  //!< average rate since Fsm::start()
+
+  Histogram queue_latency;        //!< time from Fsm::raise() to the start of dispatch
+  Histogram transition_function;  //!< duration of transition function and guard calls
+  std::vector<StateMetrics> states;
+};
+
+}  // namespace fsm
+
+#endif  // FSM_METRICS_H
@@ -0,0 +1,142 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_PAYLOAD_H
+#define FSM_PAYLOAD_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace fsm
+{
+//======================================================================================================================
+/// Typed data accompanying an event. See Fsm::raise() and Fsm::getEventPayload().
+///
+/// A payload holds one value of any type that fits in Payload::CAPACITY bytes, stored inline so that queueing an
+/// event with a payload never allocates. Payloads are move-only: the value is moved from the producer into the
+/// event queue and on to the dispatcher, never copied.
+class Payload
+{
+public:
+  static constexpr std::size_t CAPACITY = 32;  //!< maximum size of a payload value
+  static constexpr std::size_t ALIGNMENT = 8;  //!< maximum alignment of a payload value
+
+public:
+  /// Create an empty payload
+  Payload() noexcept : ops_(nullptr), storage_()
+  {
+  }
+
+  /// Create a payload holding value
+  template <typename T, typename D = std::decay_t<T>,
+            typename = std::enable_if_t<!std::is_same<D, Payload>::value>>
+  Payload(T&& value) : ops_(&Ops<D>::TABLE), storage_()  // NOLINT: implicit by design
+  {
+    static_assert(sizeof(D) <= CAPACITY, "Payload type is too large for inline storage");
+    static_assert(alignof(D) <= ALIGNMENT, "Payload type is over-aligned for inline storage");
+    static_assert(std::is_nothrow_move_constructible<D>::value, "Payload type must be nothrow move constructible");
+    new (&storage_) D(std::forward<T>(value));
+  }
+
+  Payload(Payload&& other) noexcept : ops_(nullptr), storage_()
+  {
+    *this = std::move(other);
+  }
+
+  Payload& operator=(Payload&& other) noexcept
+  {
+    if (this != &other)
+    {
+      reset();
+      if (other.ops_ != nullptr)
+      {
+        other.ops_->move(&other.storage_, &storage_);
+        ops_ = other.ops_;
+        other.reset();
+      }
+    }
+    return *this;
+  }
+
+  ~Payload()
+  {
+    reset();
+  }
+
+  Payload(const Payload&) = delete;
+  Payload& operator=(const Payload&) = delete;
+
+  /// \return true if the payload holds no value
+  bool empty() const noexcept
+  {
+    return ops_ == nullptr;
+  }
+
+  /// \return true if the payload holds a value of type T
+  template <typename T>
+  bool holds() const noexcept
+  {
+    return ops_ == &Ops<std::decay_t<T>>::TABLE;
+  }
+
+  /// \return Pointer to the value if it is of type T, nullptr otherwise
+  template <typename T>
+  const T* get() const noexcept
+  {
+    return holds<T>() ? reinterpret_cast<const T*>(&storage_) : nullptr;  // NOLINT
+  }
+
+  /// \return Pointer to the value if it is of type T, nullptr otherwise
+  template <typename T>
+  T* get() noexcept
+  {
+    return holds<T>() ? reinterpret_cast<T*>(&storage_) : nullptr;  // NOLINT
+  }
+
+  /// Destroy the value, if any
+  void reset() noexcept
+  {
+    if (ops_ != nullptr)
+    {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
+  }
+
+private:
+  /// Type-specific operations. The address of the table for a type also identifies the type.
+  struct Operations
+  {
+    void (*move)(void* from, void* to);
+    void (*destroy)(void* value);
+  };
+
+  template <typename T>
+  struct Ops
+  {
+    static void move(void* from, void* to)
+    {
+      new (to) T(std::move(*static_cast<T*>(from)));
+    }
+    static void destroy(void* value)
+    {
+      static_cast<T*>(value)->~T();
+    }
+    static const Operations TABLE;
+  };
+
+private:
+  const Operations* ops_;
+  std::aligned_storage_t<CAPACITY, ALIGNMENT> storage_;
+};
+
+template <typename T>
+const Payload::Operations Payload::Ops<T>::TABLE = { &Payload::Ops<T>::move, &Payload::Ops<T>::destroy };
+
+}  // namespace fsm
+
+#endif  // FSM_PAYLOAD_H
@@ -0,0 +1,137 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_SHARED_EVENT_QUEUE_H
+#define FSM_SHARED_EVENT_QUEUE_H
+
+#include "fsm/fsm.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fsm
+{
+namespace detail
+{
+class SharedSegment;
+}
+
+//======================================================================================================================
+/// Lets other processes on the host raise events in a machine, through a lock-free ring in POSIX shared memory. See
+/// SharedEventProducer for the other end.
+///
+/// The queue creates the shared memory object and publishes the names of the events the machine has transition
+/// rules for (see Fsm::getHandledEvents()). Producers map the object and put 32 bit event ids in the ring, without
+/// a system call unless the queue is asleep. A thread of the queue takes the events off the ring in batches and
+/// raises them with Fsm::raiseBatch(), so they are queued, prioritised and dispatched as the machine's own events
+/// are. It spins for a while when the ring runs dry, then sleeps on a futex in the shared memory (Linux), or polls
+/// (elsewhere).
+///
+/// Events carry no payload. A producer that dies between claiming a slot of the ring and filling it stalls the
+/// queue.
+class SharedEventQueue
+{
+public:
+  /// Create the shared memory object and start taking events from it. Throws FsmException if an object of the same
+  /// name exists, unless it is reclaimed.
+  /// \param fsm The machine. Must be running, and outlive the queue
+  /// \param name Name of the shared memory object, a slash followed by up to 254 characters other than slashes
+  /// \param capacity Number of events the ring holds. Rounded up to a power of two. Producers cannot raise events
+  /// while it is full
+  /// \param spin How long the queue polls the ring before going to sleep when it is empty. Longer spins trade a
+  /// busy core for the latency of waking up. Hosts with a single core do not spin
+  /// \param permissions Access to the object for other users, as in open(2)
+  /// \param reclaim_stale Replace an object of the same name left behind by a queue whose process no longer exists,
+  /// as after a crash. Objects of live queues, of another version or of other programs are never replaced. Process
+  /// ids are checked in the pid namespace of the caller
+  SharedEventQueue(Fsm& fsm, const std::string& name, std::size_t capacity = 1024,
+                   std::chrono::nanoseconds spin = std::chrono::microseconds(50), unsigned permissions = 0600,
+                   bool reclaim_stale = false);
+
+  /// Stop taking events, and remove the name of the shared memory object. Producers that have it mapped can still
+  /// raise events until the ring is full, but the events are not processed.
+  ~SharedEventQueue();
+
+  SharedEventQueue(const SharedEventQueue&) = delete;
+  SharedEventQueue(SharedEventQueue&&) = delete;
+  SharedEventQueue& operator=(const SharedEventQueue&) = delete;
+  SharedEventQueue& operator=(SharedEventQueue&&) = delete;
+
+  /// \return Name of the shared memory object
+  const std::string& getName() const;
+
+  /// \return Number of events taken off the ring and raised in the machine
+  std::uint64_t getForwardedCount() const;
+
+  /// \return Number of events taken off the ring and discarded, because their id was not valid or raising them
+  /// threw an exception
+  std::uint64_t getRejectedCount() const;
+
+private:
+  void forward();
+
+private:
+  Fsm& fsm_;
+  std::string name_;
+  std::chrono::nanoseconds spin_;
+  std::vector<Fsm::EventHandle> events_;  //!< event handles in the machine, by event id
+  std::unique_ptr<detail::SharedSegment> segment_;
+  std::atomic<bool> exit_flag_;
+  std::atomic<std::uint64_t> forwarded_;
+  std::atomic<std::uint64_t> rejected_;
+  std::thread forwarder_;
+};
+
+//======================================================================================================================
+/// Raises events in a machine of another process through its SharedEventQueue. Safe to use from many threads and
+/// processes at once.
+class SharedEventProducer
+{
+public:
+  /// Id of an event in the machine. See getEventId()
+  using EventId = std::uint32_t;
+
+  /// Map the shared memory object of a SharedEventQueue
+  /// \param name Name the queue was created with
+  explicit SharedEventProducer(const std::string& name);
+  ~SharedEventProducer();
+
+  SharedEventProducer(const SharedEventProducer&) = delete;
+  SharedEventProducer(SharedEventProducer&&) = delete;
+  SharedEventProducer& operator=(const SharedEventProducer&) = delete;
+  SharedEventProducer& operator=(SharedEventProducer&&) = delete;
+
+  /// \return Id of an event, to raise it without looking up its name. Throws FsmException if the machine has no
+  /// transition rule for the event
+  EventId getEventId(const Fsm::Event& event) const;
+
+  /// Raise an event. Lock-free: producers that race for the same slots of the ring retry. The events of a producer
+  /// that stalls mid-raise hold up those raised after them
+  /// \return false if the ring is full
+  bool raise(EventId event);
+
+  /// Raise an event by name. Throws FsmException if the machine has no transition rule for the event
+  /// \return false if the ring is full
+  bool raise(const Fsm::Event& event);
+
+  /// Raise events in order, as far as the ring has space
+  /// \return Number of events raised, from the first
+  std::size_t raiseBatch(const EventId* first, const EventId* last);
+
+private:
+  std::unique_ptr<detail::SharedSegment> segment_;
+  std::unordered_map<Fsm::Event, EventId> event_ids_;
+};
+
+}  // namespace fsm
+
+#endif  // FSM_SHARED_EVENT_QUEUE_H
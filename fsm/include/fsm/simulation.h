@@ -0,0 +1,84 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_SIMULATION_H
+#define FSM_SIMULATION_H
+
+#include "fsm/fsm.h"
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace fsm
+{
+//======================================================================================================================
+/// Runs a group of machines on one thread against a virtual clock, for tests that would otherwise wait for timeouts in
+/// real time.
+///
+/// Machines of the simulation are created with a configuration from makeConfig(), which processes their events only
+/// when the simulation says so, and runs their timers (see Fsm::addStateTimeout(), Fsm::raiseAfter() and
+/// ActionResult::resumeAfter()) on a wheel whose clock stands still until the simulation advances it. Advancing
+/// jumps from one timer expiry to the next, and processes the events each of them causes before the clock moves on,
+/// so that an hour of timeouts takes as long to simulate as the transitions it triggers. The machines are processed
+/// in the order they were added, and each run with the same inputs visits the same states in the same order.
+///
+/// All calls, to the simulation and to its machines, must come from one thread.
+class Simulation
+{
+public:
+  /// \param resolution Tick of the virtual clock. Timers expire on ticks
+  explicit Simulation(std::chrono::nanoseconds resolution = std::chrono::milliseconds(1));
+
+  Simulation(const Simulation&) = delete;
+  Simulation(Simulation&&) = delete;
+  Simulation& operator=(const Simulation&) = delete;
+  Simulation& operator=(Simulation&&) = delete;
+
+  /// \return Configuration for machines of the simulation: DispatchMode::Manual, on the timer wheel of the
+  /// simulation. Other options may be changed, except for executors, which bring in threads of their own
+  Fsm::Config makeConfig() const;
+
+  /// Add a machine. Its events are processed by processPending() and advance()
+  /// \param fsm The machine. Created with makeConfig(). Must be removed before it is destroyed
+  void add(Fsm& fsm);
+
+  /// Remove a machine. Machines that are not part of the simulation are quietly ignored
+  void remove(Fsm& fsm);
+
+  /// \return Virtual time since the simulation was created
+  std::chrono::nanoseconds getTime() const;
+
+  /// \return The timer wheel on the virtual clock
+  const std::shared_ptr<TimerWheel>& getTimerWheel() const;
+
+  /// Process the pending events of every machine, and the events they raise in turn, until none are left. The clock
+  /// does not move
+  /// \return Number of events processed
+  std::size_t processPending();
+
+  /// Move the clock forward, firing the timers that expire on the way in order of expiry. The events raised by the
+  /// timers of each tick are processed before the clock moves on
+  /// \param duration How far to move the clock
+  /// \return Number of events processed
+  std::size_t advance(std::chrono::nanoseconds duration);
+
+  /// Move the clock forward to the next timer expiry, firing the timers that expire then and processing the events
+  /// they cause. Does nothing if no timer is pending
+  /// \return Number of events processed
+  std::size_t step();
+
+private:
+  std::size_t advanceTo(std::chrono::nanoseconds time);
+
+private:
+  std::shared_ptr<TimerWheel> timer_wheel_;
+  std::vector<Fsm*> machines_;  //!< in order of processing
+};
+
+}  // namespace fsm
+
+#endif  // FSM_SIMULATION_H
@@ -0,0 +1,245 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_STATIC_FSM_H
+#define FSM_STATIC_FSM_H
+
+#include "fsm/fsm.h"
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace fsm
+{
+//======================================================================================================================
+/// Transition guard that always allows the transition. See fsm::Row
+struct Always
+{
+  template <typename S, typename E>
+  constexpr bool operator()(const S& /*state*/, const E& /*event*/) const
+  {
+    return true;
+  }
+};
+
+//======================================================================================================================
+/// A rule in a TransitionTable: when in state From, event Event causes a transition to state To.
+/// Guard is a default constructible callable `bool(From&, const Event&)`. It plays the part of
+/// Fsm::TransitionFunction: it runs before any exit/entry action, may do user-defined processing, and vetoes
+/// the transition by returning false. Several rows may share From and Event; the first one whose guard passes
+/// is taken, which gives conditional transitions with compile-time targets.
+template <typename From, typename Event, typename To, typename Guard = Always>
+struct Row
+{
+  using FromState = From;
+  using EventType = Event;
+  using ToState = To;
+  using GuardType = Guard;
+};
+
+//======================================================================================================================
+/// Set of transition rules. See fsm::Row
+template <typename... Rows>
+struct TransitionTable
+{
+};
+
+namespace detail
+{
+/// Index of type T in the pack Ts
+template <typename T, typename... Ts>
+struct IndexOf;
+
+template <typename T, typename... Ts>
+struct IndexOf<T, T, Ts...> : std::integral_constant<std::size_t, 0>
+{
+};
+
+template <typename T, typename U, typename... Ts>
+struct IndexOf<T, U, Ts...> : std::integral_constant<std::size_t, 1 + IndexOf<T, Ts...>::value>
+{
+};
+
+/// Whether type T is in the pack Ts
+template <typename T, typename... Ts>
+struct Contains : std::false_type
+{
+};
+
+template <typename T, typename U, typename... Ts>
+struct Contains<T, U, Ts...> : std::conditional_t<std::is_same<T, U>::value, std::true_type, Contains<T, Ts...>>
+{
+};
+}  // namespace detail
+
+template <typename Table, typename... States>
+class StaticFsm;
+
+//======================================================================================================================
+/// A finite state machine resolved at compile time.
+///
+/// This is the counterpart of fsm::Fsm for realtime loops. States are plain types with non-virtual `onEntry()`
+/// and `onExit()` methods, events are plain types, and the transition rules are a TransitionTable. All state
+/// objects live inside the machine for its lifetime (no heap allocation), and dispatching an event is one
+/// indexed call into code generated for the (active state, event type) pair. There are no strings, no virtual
+/// calls and no queue: StaticFsm::raise() runs the transition to completion on the caller's thread. The
+/// semantics otherwise follow Fsm: the guard runs first, then onExit() of the current state, then onEntry() of
+/// the next. Events with no matching rule are quietly ignored.
+///
+/// \code
+/// using Table = fsm::TransitionTable<fsm::Row<Idle, On, PowerUp>, fsm::Row<PowerUp, Off, Idle>>;
+/// fsm::StaticFsm<Table, Idle, PowerUp> machine;
+/// machine.start<Idle>();
+/// machine.raise(On{});
+/// \endcode
+///
+/// \note onEntry()/onExit() must not raise events into the same machine
+template <typename... Rows, typename... States>
+class StaticFsm<TransitionTable<Rows...>, States...>
+{
+  static_assert(sizeof...(States) > 0, "A state machine needs at least one state");
+
+public:
+  StaticFsm() = default;
+
+  /// Construct with initial values of the state objects
+  explicit StaticFsm(States... states) : states_(std::move(states)...)
+  {
+  }
+
+  /// Set the initial state and start the state machine
+  template <typename S>
+  void start()
+  {
+    static_assert(detail::Contains<S, States...>::value, "Not a state of this machine");
+    if (isRunning())
+    {
+      throw FsmException("[StaticFsm::start] Re-initialisation is forbidden");
+    }
+    active_ = detail::IndexOf<S, States...>::value;
+    get<S>().onEntry();
+  }
+
+  /// Raise an event. This will run a state transition if one is defined for this event and current state.
+  /// \return true if a state transition took place
+  template <typename E>
+  bool raise(const E& event)
+  {
+    if (!isRunning())
+    {
+      throw FsmException("[StaticFsm::raise] Got event when FSM is not running");
+    }
+    if (dispatching_)
+    {
+      throw FsmException("[StaticFsm::raise] Re-entrant events are not supported");
+    }
+    using Handler = bool (StaticFsm::*)(const E&);
+    static constexpr Handler handlers[] = { &StaticFsm::template handle<States, E>... };
+    dispatching_ = true;
+    try
+    {
+      const auto changed = (this->*handlers[active_])(event);  // NOLINT
+      dispatching_ = false;
+      return changed;
+    }
+    catch (...)
+    {
+      dispatching_ = false;
+      throw;
+    }
+  }
+
+  /// \return true if S is the active state
+  template <typename S>
+  bool isActive() const
+  {
+    return active_ == detail::IndexOf<S, States...>::value;
+  }
+
+  /// \return Position of the active state in the States list
+  std::size_t getActiveIndex() const
+  {
+    return active_;
+  }
+
+  /// \return Reference to a state object
+  template <typename S>
+  S& get()
+  {
+    return std::get<detail::IndexOf<S, States...>::value>(states_);
+  }
+
+  /// \return Reference to a state object
+  template <typename S>
+  const S& get() const
+  {
+    return std::get<detail::IndexOf<S, States...>::value>(states_);
+  }
+
+  /// \return true if the FSM is running
+  bool isRunning() const
+  {
+    return active_ != NOT_STARTED;
+  }
+
+private:
+  static constexpr std::size_t NOT_STARTED = sizeof...(States);
+
+  template <typename S, typename E>
+  bool handle(const E& event)
+  {
+    return tryRows<S>(event, TransitionTable<Rows...>());
+  }
+
+  template <typename S, typename E>
+  bool tryRows(const E& /*event*/, TransitionTable<> /*rows*/)
+  {
+    return false;
+  }
+
+  template <typename S, typename E, typename R, typename... Rs>
+  bool tryRows(const E& event, TransitionTable<R, Rs...> /*rows*/)
+  {
+    using Matches = std::integral_constant<bool, std::is_same<typename R::FromState, S>::value &&
+                                                     std::is_same<typename R::EventType, E>::value>;
+    return tryRow<S, R>(event, Matches()) || tryRows<S>(event, TransitionTable<Rs...>());
+  }
+
+  template <typename S, typename R, typename E>
+  bool tryRow(const E& /*event*/, std::false_type /*matches*/)
+  {
+    return false;
+  }
+
+  template <typename S, typename R, typename E>
+  bool tryRow(const E& event, std::true_type /*matches*/)
+  {
+    using To = typename R::ToState;
+    static_assert(detail::Contains<To, States...>::value, "Transition into a state that is not in this machine");
+    auto& from = get<S>();
+    if (!typename R::GuardType()(from, event))
+    {
+      return false;
+    }
+    from.onExit();
+    active_ = detail::IndexOf<To, States...>::value;
+    get<To>().onEntry();
+    return true;
+  }
+
+private:
+  std::tuple<States...> states_;
+  std::size_t active_{ NOT_STARTED };
+  bool dispatching_{ false };
+};
+
+template <typename... Rows, typename... States>
+constexpr std::size_t StaticFsm<TransitionTable<Rows...>, States...>::NOT_STARTED;
+
+}  // namespace fsm
+
+#endif  // FSM_STATIC_FSM_H
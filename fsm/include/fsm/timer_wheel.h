@@ -0,0 +1,181 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_TIMER_WHEEL_H
+#define FSM_TIMER_WHEEL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fsm
+{
+//======================================================================================================================
+/// Where a TimerWheel takes the time from
+enum class TimeSource
+{
+  Steady,  //!< std::chrono::steady_clock. Timers fire on a thread of the wheel
+  Virtual  //!< A clock that only moves when the owner advances it. Timers fire on the owner's thread. See Simulation
+};
+
+//======================================================================================================================
+/// Hierarchical timer wheel that runs the timers of many Fsm instances on one thread. See Fsm::raiseAfter() and
+/// Fsm::addStateTimeout().
+///
+/// Timers are counted in ticks of a fixed resolution and kept in four levels of 64 slots, each level 64 times
+/// coarser than the one below, with timers further out than the top level parked in its last slot. Scheduling and
+/// cancelling a timer are constant time. As time passes, the slots of a level are redistributed into the level below
+/// when the level below wraps around. A timer never fires early, and fires at most one tick late plus scheduling
+/// latency. The timer thread is started on first use. A wheel on a virtual clock has no thread, and fires its timers
+/// as its owner advances the clock.
+class TimerWheel
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// Receives expired timers
+  class Target
+  {
+  public:
+    /// Called on the timer thread when a timer expires
+    /// \param tag Value given to TimerWheel::schedule()
+    virtual void onTimer(std::uint64_t tag) = 0;
+
+  protected:
+    Target() = default;
+    ~Target() = default;
+
+  private:
+    friend class TimerWheel;
+    std::uint32_t timers_{ UINT32_MAX };  //!< first of the target's timers, managed by the wheel
+  };
+
+  /// Identifies a scheduled timer. See cancel(). A default constructed id refers to no timer.
+  struct TimerId
+  {
+    std::uint32_t index = 0;
+    std::uint32_t generation = 0;
+  };
+
+public:
+  /// \param resolution Length of a tick
+  /// \param source Clock of the wheel
+  explicit TimerWheel(std::chrono::nanoseconds resolution = std::chrono::milliseconds(1),
+                      TimeSource source = TimeSource::Steady);
+
+  /// Discards pending timers and stops the timer thread
+  ~TimerWheel();
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel(TimerWheel&&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+  TimerWheel& operator=(TimerWheel&&) = delete;
+
+  /// Start a timer
+  /// \param target Receiver of the timer. Must call cancelAll() before it is destroyed.
+  /// \param delay Time from now until the timer expires
+  /// \param tag Value passed to Target::onTimer()
+  /// \return Id of the timer
+  TimerId schedule(Target& target, std::chrono::nanoseconds delay, std::uint64_t tag);
+
+  /// Stop a timer
+  /// \return true if the timer was pending, false if it had already expired or been cancelled
+  bool cancel(TimerId id);
+
+  /// \return true if the timer has neither expired nor been cancelled
+  bool isPending(TimerId id) const;
+
+  /// Cancel all timers of a target and wait for a call to its Target::onTimer() in progress on another thread to
+  /// return
+  void cancelAll(Target& target);
+
+  /// \return Number of pending timers
+  std::size_t getPendingCount() const;
+
+  /// \return Time since the wheel was created, as told by its clock
+  std::chrono::nanoseconds getTime() const;
+
+  /// Move a virtual clock forward to the earliest expiry of the pending timers, and fire the timers that expire then,
+  /// in the order they were scheduled, on the calling thread. If no timer expires by a time limit, move the clock to
+  /// the limit instead. Only for TimeSource::Virtual. Not to be called from Target::onTimer()
+  /// \param limit Time since the wheel was created not to move the clock beyond
+  /// \return Number of timers fired
+  std::size_t advanceToNextExpiry(std::chrono::nanoseconds limit);
+
+  /// Move a virtual clock forward, firing the timers that expire on the way in order of expiry. See
+  /// advanceToNextExpiry()
+  /// \param time Time since the wheel was created to move the clock to
+  /// \return Number of timers fired
+  std::size_t advanceTo(std::chrono::nanoseconds time);
+
+  /// \return A process-wide timer wheel with a resolution of one millisecond, created on first use
+  static std::shared_ptr<TimerWheel> getDefault();
+
+private:
+  static constexpr unsigned SLOT_BITS = 6;
+  static constexpr std::uint32_t SLOTS = 1U << SLOT_BITS;
+  static constexpr unsigned LEVELS = 4;
+  static constexpr std::uint32_t EXPIRED_LIST = LEVELS * SLOTS;  //!< timers due to be fired
+  static constexpr std::uint32_t NUM_LISTS = EXPIRED_LIST + 1;
+  static constexpr std::uint32_t NIL = UINT32_MAX;
+
+  struct Node
+  {
+    std::uint64_t expiry;       //!< tick
+    std::uint64_t sequence;     //!< order of scheduling
+    std::uint64_t tag;
+    Target* target;
+    std::uint32_t prev;         //!< in the list of a slot
+    std::uint32_t next;         //!< in the list of a slot, or the free list
+    std::uint32_t target_prev;  //!< in the list of the target's timers
+    std::uint32_t target_next;
+    std::uint32_t generation;   //!< changes each time the node is released
+    std::uint32_t list;         //!< list the node is in. NIL if free
+  };
+
+  void run();
+  bool fireExpired(std::unique_lock<std::mutex>& lk);
+  std::chrono::nanoseconds elapsed() const;
+  std::uint64_t currentTick() const;
+  Clock::time_point timeOf(std::uint64_t tick) const;
+  void place(std::uint32_t index);
+  void link(std::uint32_t list, std::uint32_t index);
+  void expire(std::uint32_t index);
+  void unlink(std::uint32_t index);
+  void release(std::uint32_t index);
+  void advance(std::uint64_t now_tick);
+  std::uint64_t nextWakeTick() const;
+  std::uint64_t earliestExpiry() const;
+  void jumpTo(std::uint64_t tick);
+
+private:
+  std::chrono::nanoseconds resolution_;
+  TimeSource source_;
+  Clock::time_point epoch_;                //!< time of tick 0
+  std::chrono::nanoseconds virtual_time_;  //!< since epoch_, for TimeSource::Virtual
+  mutable std::mutex guard_;
+  std::condition_variable wakeup_;    //!< signals the timer thread
+  std::condition_variable fired_;     //!< signals the end of a Target::onTimer() call
+  std::vector<Node> nodes_;
+  std::vector<std::uint32_t> heads_;  //!< by list
+  std::vector<std::uint32_t> tails_;  //!< by list
+  std::uint32_t free_;                //!< first free node
+  std::size_t pending_;
+  std::uint64_t next_sequence_;
+  std::uint64_t current_tick_;  //!< next tick to process
+  std::uint64_t wake_tick_;     //!< tick the timer thread sleeps until
+  const Target* firing_;        //!< target whose callback is running
+  std::thread::id timer_thread_id_;
+  bool exit_flag_;
+  std::thread thread_;
+};
+
+}  // namespace fsm
+
+#endif  // FSM_TIMER_WHEEL_H
@@ -0,0 +1,142 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_TRACE_H
+#define FSM_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fsm
+{
+class Fsm;
+
+//======================================================================================================================
+/// What processing an event did. See TraceRecord
+enum class TraceOutcome : std::uint8_t
+{
+  Transition = 0,     //!< the machine changed state
+  Ignored = 1,        //!< no transition rule for the event in the active state
+  InvalidTarget = 2,  //!< the transition function returned a state that does not exist
+};
+
+//======================================================================================================================
+/// One processed event, as stored by TraceRecorder. Handles index into the names in Trace.
+struct TraceRecord
+{
+  std::uint64_t timestamp_ns;  //!< system clock, nanoseconds since epoch, at dispatch
+  std::uint32_t event;         //!< event handle
+  std::uint32_t from_state;    //!< state handle active when the event was dispatched
+  std::uint32_t to_state;      //!< state handle active afterwards
+  TraceOutcome outcome;
+  std::uint8_t reserved[3];
+};
+static_assert(sizeof(TraceRecord) == 24, "TraceRecord is part of the trace file format");
+
+//======================================================================================================================
+/// A decoded trace. See TraceRecorder::capture() and readTraceFile()
+struct Trace
+{
+  std::vector<std::string> states;   //!< state names, by handle
+  std::vector<std::string> events;   //!< event names, by handle
+  std::vector<TraceRecord> records;  //!< oldest first
+  std::uint64_t lost_records = 0;    //!< records overwritten before the capture
+};
+
+//======================================================================================================================
+/// Per-machine flight recorder of processed events (see Fsm::Config::trace_recorder).
+///
+/// Records are written into a fixed-size ring by the dispatching thread with a timestamp read and a 24 byte store,
+/// and the ring can be captured from any other thread without stopping the machine. The ring can live in a
+/// memory-mapped file so the most recent history survives a crash. Decode the file with readTraceFile() or the
+/// fsm_trace tool.
+class TraceRecorder
+{
+public:
+  /// Record into memory
+  /// \param capacity Number of most recent records kept
+  explicit TraceRecorder(std::size_t capacity);
+
+  /// Record into a memory-mapped file, which is created or truncated
+  /// \param path File path
+  /// \param capacity Number of most recent records kept
+  TraceRecorder(const std::string& path, std::size_t capacity);
+
+  ~TraceRecorder();
+
+  TraceRecorder(const TraceRecorder&) = delete;
+  TraceRecorder(TraceRecorder&&) = delete;
+  TraceRecorder& operator=(const TraceRecorder&) = delete;
+  TraceRecorder& operator=(TraceRecorder&&) = delete;
+
+  /// Store the state and event names that record handles refer to. Called by Fsm::start().
+  void setDictionary(const std::vector<std::string>& states, const std::vector<std::string>& events);
+
+  /// Append a record. Only one thread may record at a time.
+  void record(std::uint32_t event, std::uint32_t from_state, std::uint32_t to_state, TraceOutcome outcome) noexcept
+  {
+    const auto head = head_->load(std::memory_order_relaxed);
+    auto& r = records_[head % (capacity_ + 1)];
+    r.timestamp_ns = timestamp();
+    r.event = event;
+    r.from_state = from_state;
+    r.to_state = to_state;
+    r.outcome = outcome;
+    head_->store(head + 1, std::memory_order_release);
+  }
+
+  /// \return Copy of the most recent records. Safe to call while recording.
+  Trace capture() const;
+
+  /// \return Number of records the ring holds
+  std::size_t getCapacity() const;
+
+private:
+  static std::uint64_t timestamp() noexcept;
+
+private:
+  std::size_t capacity_;
+  TraceRecord* records_;              //!< capacity_ + 1 slots
+  std::atomic<std::uint64_t>* head_;  //!< number of records ever written
+  std::unique_ptr<TraceRecord[]> memory_;
+  std::atomic<std::uint64_t> memory_head_;
+  int fd_;
+  void* map_;
+  std::size_t map_size_;
+  mutable std::mutex dictionary_guard_;
+  std::vector<std::string> states_;
+  std::vector<std::string> events_;
+};
+
+/// Decode a trace file written by TraceRecorder
+Trace readTraceFile(const std::string& path);
+
+//======================================================================================================================
+/// Result of replayTrace()
+struct ReplayResult
+{
+  std::size_t replayed = 0;                //!< records replayed
+  std::size_t mismatches = 0;              //!< records whose outcome the machine did not reproduce
+  std::size_t first_mismatch = SIZE_MAX;   //!< index into Trace::records of the first mismatch
+  std::string first_mismatch_description;  //!< human readable account of the first mismatch
+};
+
+/// Replay a trace against a machine definition and check that it takes the same transitions.
+///
+/// The machine must be defined but not started, and use DispatchMode::Manual. It is started in the from-state of the
+/// first record and fed the recorded events one at a time, matching names rather than handles. Events raised by its
+/// state callbacks are processed in place of the recorded events that follow, as they were when recording.
+/// Transitions that depend on payloads or external data may legitimately diverge. Only the main region is replayed; a
+/// machine with other regions records a transition for each region an event moves, and so does not replay faithfully.
+ReplayResult replayTrace(const Trace& trace, Fsm& fsm);
+
+}  // namespace fsm
+
+#endif  // FSM_TRACE_H
@@ -0,0 +1,21 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_VERSION_H
+#define FSM_VERSION_H
+
+#include <cinttypes>
+
+namespace fsm
+{
+
+// version numbers autogenerated by the build system from version.in
+static constexpr uint32_t FSM_VERSION_MAJOR = 0;
+static constexpr uint32_t FSM_VERSION_MINOR = 5;
+static constexpr uint32_t FSM_VERSION_PATCH = 0;
+static constexpr char FSM_BUILD_TIMESTAMP[] = "2026-10-16 19:25:39 UTC";
+} // namespace fsm
+
+#endif // FSM_VERSION_H
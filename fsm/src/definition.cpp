@@ -0,0 +1,234 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/definition.h"
+
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace fsm
+{
+namespace
+{
+/// Stands in for the states of a machine that is only built to be compiled
+class PlaceholderState : public State
+{
+public:
+  PlaceholderState(Fsm& fsm, const Id& id) : State(fsm, id)
+  {
+  }
+  void onEntry() override
+  {
+  }
+  void onExit() override
+  {
+  }
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+std::chrono::nanoseconds parseDelay(const std::string& word)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::size_t digits = 0;
+  while ((digits < word.size()) && (word[digits] >= '0') && (word[digits] <= '9'))
+  {
+    ++digits;
+  }
+  const auto unit = word.substr(digits);
+  if ((digits == 0) || (digits > 18) || ((unit != "ns") && (unit != "us") && (unit != "ms") && (unit != "s")))
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] \"" << word << "\" is not a delay such as 250ms";  // NOLINT
+    throw FsmException(str.str());
+  }
+  const auto count = std::stoll(word.substr(0, digits));
+  if (unit == "ns")
+  {
+    return std::chrono::nanoseconds(count);
+  }
+  if (unit == "us")
+  {
+    return std::chrono::microseconds(count);
+  }
+  if (unit == "ms")
+  {
+    return std::chrono::milliseconds(count);
+  }
+  return std::chrono::seconds(count);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+EventPriority parsePriority(const std::string& word)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (word == "urgent")
+  {
+    return EventPriority::Urgent;
+  }
+  if (word == "low")
+  {
+    return EventPriority::Low;
+  }
+  if (word != "normal")
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] \"" << word << "\" is not a priority: urgent, normal or low";  // NOLINT
+    throw FsmException(str.str());
+  }
+  return EventPriority::Normal;
+}
+}  // namespace
+
+//======================================================================================================================
+Definition::Definition(const std::string& text)
+//======================================================================================================================
+{
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Manual;
+  machine_.reset(new Fsm(config));
+  auto& machine = *machine_;
+
+  std::unordered_map<std::string, Fsm::RegionHandle> regions;
+  std::unordered_set<State::Id> declared;
+  std::string initial_state;
+  std::istringstream lines(text);
+  std::string line;
+  std::size_t line_number = 0;
+  while (std::getline(lines, line))
+  {
+    ++line_number;
+    std::vector<std::string> words;
+    std::istringstream in(line.substr(0, line.find('#')));
+    for (std::string word; in >> word;)
+    {
+      words.push_back(word);
+    }
+    if (words.empty())
+    {
+      continue;
+    }
+
+    try
+    {
+      const auto& keyword = words[0];
+      const auto add_state = [this, &machine, &declared](const std::string& id) {
+        if (!declared.insert(id).second)
+        {
+          throw FsmException("State \"" + id + "\" is declared twice");
+        }
+        states_.push_back(id);
+        return std::make_shared<PlaceholderState>(machine, id);
+      };
+      if ((keyword == "state") && (words.size() == 2))
+      {
+        machine.addState(add_state(words[1]));
+      }
+      else if ((keyword == "state") && (words.size() == 4) && (words[2] == "in"))
+      {
+        machine.addState(add_state(words[1]), words[3]);
+      }
+      else if ((keyword == "state") && (words.size() == 4) && (words[2] == "region"))
+      {
+        const auto region = regions.find(words[3]);
+        if (region == regions.end())
+        {
+          throw FsmException("Region \"" + words[3] + "\" is not declared");
+        }
+        machine.addState(add_state(words[1]), region->second);
+      }
+      else if ((keyword == "region") && (words.size() == 3))
+      {
+        regions.emplace(words[1], machine.addRegion(words[1], words[2]));
+      }
+      else if ((keyword == "event") && (words.size() == 3))
+      {
+        machine.setEventPriority(words[1], parsePriority(words[2]));
+      }
+      else if ((keyword == "transition") && (words.size() == 4))
+      {
+        machine.addTransitionRule(words[1], words[2], words[3]);
+      }
+      else if ((keyword == "timeout") && (words.size() == 4))
+      {
+        machine.addStateTimeout(words[1], parseDelay(words[2]), words[3]);
+      }
+      else if ((keyword == "initial") && (words.size() == 2))
+      {
+        initial_state = words[1];
+      }
+      else
+      {
+        throw FsmException("Not a declaration");
+      }
+    }
+    catch (const FsmException& ex)
+    {
+      std::stringstream str;
+      str << "[" << __FUNCTION__ << "] Line " << line_number << ": " << ex.what();  // NOLINT
+      throw FsmException(str.str());
+    }
+  }
+
+  if (initial_state.empty())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] No initial state is declared";  // NOLINT
+    throw FsmException(str.str());
+  }
+  machine.start(initial_state);
+  image_ = machine.saveImage();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Definition::~Definition() = default;
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+Definition::Definition(Definition&&) noexcept = default;
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+Definition& Definition::operator=(Definition&&) noexcept = default;
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+const std::vector<State::Id>& Definition::getStates() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return states_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+const std::vector<std::uint8_t>& Definition::getImage() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return image_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Definition::exportDot(std::ostream& out) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  machine_->exportDot(out);
+}
+
+//======================================================================================================================
+Definition readDefinitionFile(const std::string& path)
+//======================================================================================================================
+{
+  std::ifstream in(path);
+  std::stringstream text;
+  if (!in || !(text << in.rdbuf()))
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Cannot read \"" << path << "\"";  // NOLINT
+    throw FsmException(str.str());
+  }
+  return Definition(text.str());
+}
+
+}  // namespace fsm
@@ -0,0 +1,260 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/event_bus.h"
+#include "fsm/executor.h"
+#include "event_count.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <sstream>
+
+namespace fsm
+{
+namespace
+{
+/// A bus whose publication the current thread is raising the event of, and the one it is nested in, if any
+struct PublishScope
+{
+  const EventBus* bus;
+  const PublishScope* outer;
+};
+
+/// The innermost publication the current thread is raising its event for
+thread_local const PublishScope* t_publishing = nullptr;
+}  // namespace
+
+//======================================================================================================================
+/// One publish() in progress. Batches go to whoever claims them first: a task on the executor, or the publisher.
+/// Tasks that run after the publisher has returned find nothing left to claim, and only touch the counters.
+struct EventBus::Fanout
+{
+  const EventBus* bus;
+  std::uint64_t ticket;                 //!< identifies the publication. See unsubscribe()
+  std::vector<Subscriber> subscribers;  //!< copied from the topic, to be raised without holding the lock
+  std::size_t num_subscribers;
+  std::size_t batch_size;
+  std::size_t num_batches;
+  std::atomic<std::size_t> next_batch{ 0 };    //!< next batch to claim
+  std::atomic<std::size_t> batches_done{ 0 };  //!< batches raised
+  detail::EventCount done;                     //!< signals the last batch being raised
+  std::mutex error_guard;
+  std::exception_ptr error;  //!< first exception thrown by Fsm::raise(). Guarded by error_guard
+};
+
+//======================================================================================================================
+EventBus::EventBus(std::shared_ptr<Executor> executor, std::size_t batch_size)
+  : executor_(std::move(executor)), batch_size_(std::max<std::size_t>(batch_size, 1))
+//======================================================================================================================
+{
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+EventBus::~EventBus() = default;
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+void EventBus::subscribe(Fsm& fsm)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (!fsm.isRunning())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Only running machines can subscribe";  // NOLINT
+    throw FsmException(str.str());
+  }
+  const auto events = fsm.getHandledEvents();
+
+  std::lock_guard<std::shared_timed_mutex> lk(guard_);
+  const auto inserted = members_.emplace(&fsm, std::vector<Membership>());
+  if (!inserted.second)
+  {
+    return;
+  }
+  auto& memberships = inserted.first->second;
+  memberships.reserve(events.size());
+  for (const auto& event : events)
+  {
+    auto& topic = topics_[event];
+    memberships.push_back(Membership{ &topic, topic.subscribers.size() });
+    topic.subscribers.push_back(Subscriber{ &fsm, fsm.getEventHandle(event) });
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void EventBus::unsubscribe(Fsm& fsm)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::unique_lock<std::shared_timed_mutex> lk(guard_);
+  const auto it = members_.find(&fsm);
+  if (it == members_.end())
+  {
+    return;
+  }
+
+  // fill the gap with the last subscriber of the topic, and update where that one is recorded to be
+  for (const auto& membership : it->second)
+  {
+    auto& subscribers = membership.topic->subscribers;
+    const auto* const moved = subscribers.back().fsm;
+    subscribers[membership.index] = subscribers.back();
+    subscribers.pop_back();
+    if (moved != &fsm)
+    {
+      for (auto& other : members_.find(moved)->second)
+      {
+        if (other.topic == membership.topic)
+        {
+          other.index = membership.index;
+          break;
+        }
+      }
+    }
+  }
+  members_.erase(it);
+  lk.unlock();
+
+  // publications that copied the machine may still raise their event in it. From within a publication, waiting for
+  // the others could wait for one that waits for this
+  if (isPublishingOnThisThread())
+  {
+    return;
+  }
+  std::unique_lock<std::mutex> publish_lk(publish_guard_);
+  const auto last_ticket = num_publications_;
+  published_.wait(publish_lk, [this, last_ticket]() {
+    return std::all_of(publishing_.begin(), publishing_.end(),
+                       [last_ticket](std::uint64_t ticket) { return ticket > last_ticket; });
+  });
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool EventBus::isPublishingOnThisThread() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  for (const auto* scope = t_publishing; scope != nullptr; scope = scope->outer)
+  {
+    if (scope->bus == this)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t EventBus::publish(const Fsm::Event& event)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto fanout = std::make_shared<Fanout>();
+  {
+    std::shared_lock<std::shared_timed_mutex> lk(guard_);
+    const auto it = topics_.find(event);
+    if ((it == topics_.end()) || it->second.subscribers.empty())
+    {
+      return 0;
+    }
+    fanout->subscribers = it->second.subscribers;
+
+    // taken while the machines are known to be subscribed, so that unsubscribe() waits for the publication
+    std::lock_guard<std::mutex> publish_lk(publish_guard_);
+    fanout->ticket = ++num_publications_;
+    publishing_.push_back(fanout->ticket);
+  }
+  fanout->bus = this;
+  fanout->num_subscribers = fanout->subscribers.size();
+  fanout->batch_size = batch_size_;
+  fanout->num_batches = (fanout->num_subscribers + batch_size_ - 1) / batch_size_;
+  if (executor_)
+  {
+    for (std::size_t i = 1; i < fanout->num_batches; ++i)
+    {
+      executor_->post([fanout]() { raiseBatches(*fanout); });
+    }
+  }
+  raiseBatches(*fanout);
+
+  while (fanout->batches_done.load(std::memory_order_acquire) != fanout->num_batches)
+  {
+    const auto key = fanout->done.prepareWait();
+    if (fanout->batches_done.load(std::memory_order_acquire) == fanout->num_batches)
+    {
+      fanout->done.cancelWait();
+      break;
+    }
+    fanout->done.wait(key);
+  }
+  {
+    std::lock_guard<std::mutex> publish_lk(publish_guard_);
+    publishing_.erase(std::find(publishing_.begin(), publishing_.end(), fanout->ticket));
+  }
+  published_.notify_all();
+
+  if (fanout->error)
+  {
+    std::rethrow_exception(fanout->error);
+  }
+  return fanout->num_subscribers;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void EventBus::raiseBatches(Fanout& fanout)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const PublishScope scope{ fanout.bus, t_publishing };
+  t_publishing = &scope;
+  while (true)
+  {
+    const auto batch = fanout.next_batch.fetch_add(1, std::memory_order_relaxed);
+    if (batch >= fanout.num_batches)
+    {
+      t_publishing = scope.outer;
+      return;
+    }
+    const auto first = batch * fanout.batch_size;
+    const auto last = std::min(first + fanout.batch_size, fanout.num_subscribers);
+    for (auto i = first; i < last; ++i)
+    {
+      const auto& subscriber = fanout.subscribers[i];
+      try
+      {
+        subscriber.fsm->raise(subscriber.event);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lk(fanout.error_guard);
+        if (!fanout.error)
+        {
+          fanout.error = std::current_exception();
+        }
+      }
+    }
+    if (fanout.batches_done.fetch_add(1, std::memory_order_acq_rel) + 1 == fanout.num_batches)
+    {
+      fanout.done.notify();
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t EventBus::getSubscriberCount() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::shared_lock<std::shared_timed_mutex> lk(guard_);
+  return members_.size();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t EventBus::getSubscriberCount(const Fsm::Event& event) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::shared_lock<std::shared_timed_mutex> lk(guard_);
+  const auto it = topics_.find(event);
+  return (it == topics_.end()) ? 0 : it->second.subscribers.size();
+}
+
+}  // namespace fsm
@@ -0,0 +1,100 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_EVENT_COUNT_H
+#define FSM_EVENT_COUNT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace fsm
+{
+namespace detail
+{
+//=====================================================================================================================
+/// Eventcount: lets a consumer sleep on an arbitrary condition without producers taking a lock when nobody is
+/// waiting. The notifying side is a single atomic load unless a waiter has announced itself.
+///
+/// Consumer protocol:
+/// \code
+/// auto key = ec.prepareWait();
+/// if (condition) { ec.cancelWait(); } else { ec.wait(key); }
+/// \endcode
+/// Producer protocol: make the condition true, then call notify().
+class EventCount
+{
+public:
+  using Key = std::uint32_t;
+
+  /// Announce intention to wait. Re-check the condition after this call.
+  Key prepareWait()
+  {
+    return static_cast<Key>(state_.fetch_add(1, std::memory_order_seq_cst) >> EPOCH_SHIFT);
+  }
+
+  /// Withdraw from waiting after prepareWait(), because the condition became true
+  void cancelWait()
+  {
+    state_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+
+  /// Block until notify() is called after prepareWait() returned key
+  void wait(Key key)
+  {
+    {
+      std::unique_lock<std::mutex> lk(mutex_);
+      cv_.wait(lk, [this, key]() {
+        return static_cast<Key>(state_.load(std::memory_order_acquire) >> EPOCH_SHIFT) != key;
+      });
+    }
+    state_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+
+  /// Wake up all waiters. Cheap when there are none.
+  void notify()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if ((state_.load(std::memory_order_seq_cst) & WAITERS_MASK) == 0)
+    {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      state_.fetch_add(EPOCH_INCREMENT, std::memory_order_seq_cst);
+    }
+    cv_.notify_all();
+  }
+
+  /// Wake up at least one waiter. Cheap when there are none.
+  void notifyOne()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if ((state_.load(std::memory_order_seq_cst) & WAITERS_MASK) == 0)
+    {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      state_.fetch_add(EPOCH_INCREMENT, std::memory_order_seq_cst);
+    }
+    cv_.notify_one();
+  }
+
+private:
+  static constexpr unsigned EPOCH_SHIFT = 32U;
+  static constexpr std::uint64_t EPOCH_INCREMENT = 1ULL << EPOCH_SHIFT;
+  static constexpr std::uint64_t WAITERS_MASK = EPOCH_INCREMENT - 1U;
+
+  std::atomic<std::uint64_t> state_{ 0 };  //!< high word: epoch, low word: number of waiters
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+}  // namespace detail
+}  // namespace fsm
+
+#endif  // FSM_EVENT_COUNT_H
@@ -0,0 +1,339 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "event_queue.h"
+#include "event_count.h"
+#include "mpmc_ring.h"
+#include "mpsc_queue.h"
+#include "ring_buffer.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace fsm
+{
+namespace detail
+{
+//=====================================================================================================================
+/// Mutex protected event queue. Supports all overflow policies.
+class LockedEventQueue : public EventQueue
+{
+public:
+  LockedEventQueue(std::size_t capacity, OverflowPolicy policy, MemoryResource* resource)
+    : capacity_(capacity)
+    , policy_(policy)
+    , blocked_(0)
+    , queue_(capacity == 0 ? DEFAULT_CAPACITY : capacity, resource)
+    , queued_at_(resource)
+  {
+  }
+
+  std::size_t push(QueuedEvent&& item, bool can_block) final
+  {
+    std::unique_lock<std::mutex> lk(guard_);
+    return pushLocked(std::move(item), can_block, lk);
+  }
+
+  std::size_t pushBatch(QueuedEvent* items, std::size_t count, bool can_block) final
+  {
+    std::unique_lock<std::mutex> lk(guard_);
+    std::size_t discarded = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      discarded += pushLocked(std::move(items[i]), can_block, lk);
+    }
+    return discarded;
+  }
+
+  bool tryPop(QueuedEvent& item) final
+  {
+    return tryPopBatch(&item, 1) != 0;
+  }
+
+  std::size_t tryPopBatch(QueuedEvent* items, std::size_t max_count) final
+  {
+    std::unique_lock<std::mutex> lk(guard_);
+    std::size_t count = 0;
+    for (; (count < max_count) && !queue_.empty(); ++count)
+    {
+      auto& item = items[count];
+      const auto sequence = queue_.pop(item);
+      if ((policy_ == OverflowPolicy::Coalesce) && (queued_at_[item.event] == sequence + 1))
+      {
+        queued_at_[item.event] = 0;
+      }
+    }
+    const auto notify = (blocked_ != 0) && (count != 0);
+    lk.unlock();
+    if (notify && (count == 1))
+    {
+      space_.notify_one();
+    }
+    else if (notify)
+    {
+      space_.notify_all();
+    }
+    return count;
+  }
+
+  bool empty() const final
+  {
+    std::lock_guard<std::mutex> lk(guard_);
+    return queue_.empty();
+  }
+
+  void peek(std::vector<Fsm::EventHandle>& events) const final
+  {
+    std::lock_guard<std::mutex> lk(guard_);
+    queue_.forEach([&events](const QueuedEvent& item) { events.push_back(item.event); });
+  }
+
+private:
+  static constexpr std::size_t DEFAULT_CAPACITY = 64;
+
+  bool isFull() const
+  {
+    return (capacity_ != 0) && (queue_.size() >= capacity_);
+  }
+
+  std::size_t pushLocked(QueuedEvent&& item, bool can_block, std::unique_lock<std::mutex>& lk)
+  {
+    if (policy_ == OverflowPolicy::Coalesce)
+    {
+      // the newest payload replaces that of the pending event
+      if (item.event >= queued_at_.size())
+      {
+        queued_at_.resize(item.event + 1U, 0);
+      }
+      if (queued_at_[item.event] != 0)
+      {
+        queue_.at(queued_at_[item.event] - 1).payload = std::move(item.payload);
+        return 1;
+      }
+    }
+
+    std::size_t discarded = 0;
+    if (isFull())
+    {
+      switch (policy_)
+      {
+        case OverflowPolicy::Block:
+          if (!can_block)
+          {
+            return 1;
+          }
+          ++blocked_;
+          space_.wait(lk, [this]() { return !isFull(); });
+          --blocked_;
+          break;
+        case OverflowPolicy::DropOldest:
+          queue_.pop(discard_);
+          discard_.payload.reset();
+          discarded = 1;
+          break;
+        case OverflowPolicy::DropNewest:
+        case OverflowPolicy::Coalesce:
+        default:
+          return 1;
+      }
+    }
+
+    const auto event = item.event;
+    const auto sequence = queue_.push(std::move(item));
+    if (policy_ == OverflowPolicy::Coalesce)
+    {
+      queued_at_[event] = sequence + 1;
+    }
+    return discarded;
+  }
+
+private:
+  const std::size_t capacity_;
+  const OverflowPolicy policy_;
+  mutable std::mutex guard_;
+  std::condition_variable space_;
+  std::size_t blocked_;  //!< producers waiting for space
+  RingBuffer<QueuedEvent> queue_;
+  QueuedEvent discard_;  //!< scratch space for dropping events
+
+  /// Sequence number + 1 of the queued instance of each event, if coalescing
+  std::vector<std::uint64_t, Allocator<std::uint64_t>> queued_at_;
+};
+
+//=====================================================================================================================
+/// Unbounded lock-free event queue
+class LockFreeEventQueue : public EventQueue
+{
+public:
+  explicit LockFreeEventQueue(MemoryResource* resource) : queue_(resource)
+  {
+  }
+
+  std::size_t push(QueuedEvent&& item, bool /*can_block*/) final
+  {
+    queue_.push(std::move(item));
+    return 0;
+  }
+
+  std::size_t pushBatch(QueuedEvent* items, std::size_t count, bool /*can_block*/) final
+  {
+    queue_.pushBatch(items, count);
+    return 0;
+  }
+
+  bool tryPop(QueuedEvent& item) final
+  {
+    return queue_.tryPop(item);
+  }
+
+  bool empty() const final
+  {
+    return queue_.empty();
+  }
+
+  void peek(std::vector<Fsm::EventHandle>& events) const final
+  {
+    queue_.forEach([&events](const QueuedEvent& item) { events.push_back(item.event); });
+  }
+
+private:
+  MpscQueue<QueuedEvent> queue_;
+};
+
+//=====================================================================================================================
+/// Bounded lock-free event queue over a preallocated ring
+class BoundedLockFreeEventQueue : public EventQueue
+{
+public:
+  BoundedLockFreeEventQueue(std::size_t capacity, OverflowPolicy policy, MemoryResource* resource)
+    : ring_(capacity, resource), policy_(policy)
+  {
+  }
+
+  std::size_t push(QueuedEvent&& item, bool can_block) final
+  {
+    std::size_t discarded = 0;
+    while (!ring_.tryPush(item))
+    {
+      switch (policy_)
+      {
+        case OverflowPolicy::Block:
+        {
+          if (!can_block)
+          {
+            return 1;
+          }
+          const auto key = space_.prepareWait();
+          if (ring_.tryPush(item))
+          {
+            space_.cancelWait();
+            return discarded;
+          }
+          space_.wait(key);
+          break;
+        }
+        case OverflowPolicy::DropOldest:
+        {
+          QueuedEvent oldest;
+          if (ring_.tryPop(oldest))
+          {
+            ++discarded;
+          }
+          break;
+        }
+        case OverflowPolicy::DropNewest:
+        default:
+          return 1;
+      }
+    }
+    return discarded;
+  }
+
+  bool tryPop(QueuedEvent& item) final
+  {
+    if (!ring_.tryPop(item))
+    {
+      return false;
+    }
+    if (policy_ == OverflowPolicy::Block)
+    {
+      space_.notify();
+    }
+    return true;
+  }
+
+  bool empty() const final
+  {
+    return ring_.empty();
+  }
+
+  void peek(std::vector<Fsm::EventHandle>& events) const final
+  {
+    ring_.forEach([&events](const QueuedEvent& item) { events.push_back(item.event); });
+  }
+
+private:
+  MpmcRing<QueuedEvent> ring_;
+  const OverflowPolicy policy_;
+  EventCount space_;  //!< wakes up producers blocked on a full ring
+};
+
+//=====================================================================================================================
+EventQueue::~EventQueue() = default;
+//=====================================================================================================================
+
+//---------------------------------------------------------------------------------------------------------------------
+std::size_t EventQueue::pushBatch(QueuedEvent* items, std::size_t count, bool can_block)
+//---------------------------------------------------------------------------------------------------------------------
+{
+  std::size_t discarded = 0;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    discarded += push(std::move(items[i]), can_block);
+  }
+  return discarded;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+std::size_t EventQueue::tryPopBatch(QueuedEvent* items, std::size_t max_count)
+//---------------------------------------------------------------------------------------------------------------------
+{
+  std::size_t count = 0;
+  while ((count < max_count) && tryPop(items[count]))
+  {
+    ++count;
+  }
+  return count;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+std::unique_ptr<EventQueue> EventQueue::create(const Fsm::Config& config, std::size_t capacity)
+//---------------------------------------------------------------------------------------------------------------------
+{
+  auto* const resource = config.queue_memory_resource.get();
+  switch (config.queue_type)
+  {
+    case QueueType::LockFree:
+      if (config.overflow_policy == OverflowPolicy::Coalesce)
+      {
+        std::stringstream str;
+        str << "[" << __FUNCTION__ << "] Coalescing events requires a locked queue";  // NOLINT
+        throw FsmException(str.str());
+      }
+      if (capacity != 0)
+      {
+        return std::unique_ptr<EventQueue>(new BoundedLockFreeEventQueue(capacity, config.overflow_policy, resource));
+      }
+      return std::unique_ptr<EventQueue>(new LockFreeEventQueue(resource));
+    case QueueType::Locked:
+    default:
+      return std::unique_ptr<EventQueue>(new LockedEventQueue(capacity, config.overflow_policy, resource));
+  }
+}
+
+}  // namespace detail
+}  // namespace fsm
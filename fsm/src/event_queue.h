@@ -0,0 +1,128 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_EVENT_QUEUE_H
+#define FSM_EVENT_QUEUE_H
+
+#include "fsm/fsm.h"
+
+#include <vector>
+
+namespace fsm
+{
+namespace detail
+{
+//=====================================================================================================================
+/// An event waiting to be processed
+struct QueuedEvent
+{
+  Fsm::EventHandle event = 0;
+  Payload payload;
+  std::int64_t enqueued_at = 0;  //!< metricsTimestamp() at Fsm::raise(), if instrumented
+
+  /// For the event of a TimerScope::State timer, the state whose exit makes the event stale, and the epoch of that
+  /// state when the timer was started. See Fsm::onTimer()
+  Fsm::StateHandle scope_state = UINT32_MAX;
+  std::uint16_t scope_epoch = 0;
+};
+
+//=====================================================================================================================
+/// Queue of events pending dispatch. Any thread may push, only the dispatching thread may pop. Wakeup of the
+/// consumer is not the business of the queue (see EventCount).
+class EventQueue
+{
+public:
+  virtual ~EventQueue();
+
+  /// Enqueue an event, applying the overflow policy if the queue is at capacity. Safe to call from any thread.
+  /// \param can_block false if the caller must not wait for space. OverflowPolicy::Block drops the event instead.
+  /// \return Number of events discarded to respect the capacity: the new event, or older ones
+  virtual std::size_t push(QueuedEvent&& item, bool can_block) = 0;
+
+  /// Enqueue events in order, as push() does each of them, but with one synchronisation where the queue allows.
+  /// \param items Events to move from
+  /// \param count Number of events
+  /// \param can_block See push()
+  /// \return Number of events discarded to respect the capacity
+  virtual std::size_t pushBatch(QueuedEvent* items, std::size_t count, bool can_block);
+
+  /// Dequeue the oldest event. Consumer only.
+  /// \return false if there was nothing to dequeue
+  virtual bool tryPop(QueuedEvent& item) = 0;
+
+  /// Dequeue the oldest events, with one synchronisation where the queue allows. Consumer only.
+  /// \param items Where to move the events to
+  /// \param max_count Maximum number of events to dequeue
+  /// \return Number of events dequeued
+  virtual std::size_t tryPopBatch(QueuedEvent* items, std::size_t max_count);
+
+  /// Consumer only.
+  /// \return true if there are no events to dequeue
+  virtual bool empty() const = 0;
+
+  /// Append the events waiting in the queue, oldest first. Consumer only, and only when no producer discards events
+  /// concurrently (OverflowPolicy::DropOldest).
+  virtual void peek(std::vector<Fsm::EventHandle>& events) const = 0;
+
+  /// Create the queue described by the configuration
+  /// \param config Queue type and overflow policy
+  /// \param capacity Maximum number of pending events. 0 for unbounded
+  static std::unique_ptr<EventQueue> create(const Fsm::Config& config, std::size_t capacity);
+};
+
+//=====================================================================================================================
+/// Events taken off an EventQueue together, waiting to be processed. Lets the consumer dequeue a burst with one
+/// synchronisation and then process it without touching the queue. Consumer only.
+class EventBatch
+{
+public:
+  /// \param capacity Maximum number of events taken off the queue at a time
+  /// \param resource Memory for the events. nullptr for the heap
+  EventBatch(std::size_t capacity, MemoryResource* resource) : items_(capacity, resource), next_(0), size_(0)
+  {
+  }
+
+  /// Take the next event of the batch, refilling it from a queue once used up
+  /// \return false if both the batch and the queue are empty
+  bool tryPop(EventQueue& queue, QueuedEvent& item)
+  {
+    if (next_ == size_)
+    {
+      next_ = 0;
+      size_ = queue.tryPopBatch(items_.data(), items_.size());
+      if (size_ == 0)
+      {
+        return false;
+      }
+    }
+    item = std::move(items_[next_++]);
+    return true;
+  }
+
+  /// \return true if all events taken off the queue have been handed out
+  bool empty() const
+  {
+    return next_ == size_;
+  }
+
+  /// Append the events taken off the queue and not yet handed out, oldest first
+  void peek(std::vector<Fsm::EventHandle>& events) const
+  {
+    for (auto i = next_; i < size_; ++i)
+    {
+      events.push_back(items_[i].event);
+    }
+  }
+
+private:
+  std::vector<QueuedEvent, Allocator<QueuedEvent>> items_;
+  std::size_t next_;  //!< next event to hand out
+  std::size_t size_;  //!< events taken off the queue
+};
+
+}  // namespace detail
+}  // namespace fsm
+
+#endif  // FSM_EVENT_QUEUE_H
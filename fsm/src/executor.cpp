@@ -0,0 +1,165 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/executor.h"
+#include "event_count.h"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+
+namespace fsm
+{
+namespace
+{
+/// Identifies the executor and worker the current thread belongs to
+thread_local const Executor* t_executor = nullptr;
+thread_local std::size_t t_worker_index = 0;
+}  // namespace
+
+//======================================================================================================================
+/// Per-thread task queue. The owner pops from the front, thieves take from the back.
+struct Executor::Worker
+{
+  std::mutex guard;
+  std::deque<Task> tasks;
+};
+
+//======================================================================================================================
+Executor::Executor(std::size_t num_threads)
+  : work_signal_(new detail::EventCount()), queued_tasks_(0), next_worker_(0), exit_flag_(false)
+//======================================================================================================================
+{
+  if (num_threads == 0)
+  {
+    num_threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  for (std::size_t i = 0; i < num_threads; ++i)
+  {
+    workers_.emplace_back(new Worker());
+  }
+  for (std::size_t i = 0; i < num_threads; ++i)
+  {
+    threads_.emplace_back([this, i]() { run(i); });
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Executor::~Executor()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  exit_flag_ = true;
+  work_signal_->notify();
+  for (auto& th : threads_)
+  {
+    th.join();
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::shared_ptr<Executor> Executor::getDefault()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  static const auto executor = std::make_shared<Executor>();
+  return executor;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t Executor::getThreadCount() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return workers_.size();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool Executor::isWorkerThread() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return t_executor == this;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Executor::post(Task task)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto index = isWorkerThread() ? t_worker_index : (next_worker_++ % workers_.size());
+  auto& worker = *workers_[index];
+  queued_tasks_.fetch_add(1, std::memory_order_seq_cst);
+  {
+    std::lock_guard<std::mutex> lk(worker.guard);
+    worker.tasks.push_back(std::move(task));
+  }
+  work_signal_->notifyOne();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool Executor::tryPop(std::size_t index, Task& task)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  {
+    auto& own = *workers_[index];
+    std::lock_guard<std::mutex> lk(own.guard);
+    if (!own.tasks.empty())
+    {
+      task = std::move(own.tasks.front());
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+  for (std::size_t i = 1; i < workers_.size(); ++i)
+  {
+    auto& victim = *workers_[(index + i) % workers_.size()];
+    std::lock_guard<std::mutex> lk(victim.guard);
+    if (!victim.tasks.empty())
+    {
+      task = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Executor::run(std::size_t index)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  t_executor = this;
+  t_worker_index = index;
+
+  Task task;
+  while (true)
+  {
+    if (tryPop(index, task))
+    {
+      queued_tasks_.fetch_sub(1, std::memory_order_relaxed);
+      try
+      {
+        task();
+      }
+      catch (...)
+      {
+        // a task must not take the worker down with it
+      }
+      task = nullptr;
+      continue;
+    }
+
+    const auto key = work_signal_->prepareWait();
+    if (queued_tasks_.load(std::memory_order_seq_cst) != 0)
+    {
+      work_signal_->cancelWait();
+      continue;
+    }
+    if (exit_flag_)
+    {
+      work_signal_->cancelWait();
+      return;
+    }
+    work_signal_->wait(key);
+  }
+}
+
+}  // namespace fsm
@@ -4,8 +4,15 @@
 //=====================================================================================================================
 
 #include "fsm/fsm.h"
+#include "event_count.h"
+#include "event_queue.h"
+#include "fsm/executor.h"
+#include "fsm/trace.h"
+#include "metrics_recorder.h"
 #include <algorithm>
+#include <limits>
 #include <sstream>
+#include <thread>
 
 namespace fsm
 {
@@ -41,12 +48,113 @@ Fsm& State::getFsm()
   return fsm_;
 }
 
+namespace
+{
+/// Maximum number of events a machine processes per run on an executor, so that one busy machine does not starve
+/// the others sharing the worker
+constexpr std::size_t EXECUTOR_QUANTUM = 64;
+
+/// Maximum number of events moved between a queue and the machine with one synchronisation, by Fsm::raiseBatch()
+/// and when taking events off the queue to process
+constexpr std::size_t EVENT_BATCH = 32;
+
+/// Payload of events raised without one
+const Payload NO_PAYLOAD;
+
+/// The machine whose events the current thread is processing, if any
+thread_local const Fsm* t_dispatching_fsm = nullptr;
+
+/// The region of t_dispatching_fsm whose transition the current thread is running
+thread_local Fsm::RegionHandle t_dispatching_region = Fsm::MAIN_REGION;
+
+/// A timer tag packs the event and, for TimerScope::State timers, the state and its epoch. See Fsm::onTimer()
+constexpr unsigned TAG_HANDLE_BITS = 24;
+constexpr unsigned TAG_EPOCH_SHIFT = 2 * TAG_HANDLE_BITS;
+constexpr std::uint64_t TAG_HANDLE_MASK = (std::uint64_t{ 1 } << TAG_HANDLE_BITS) - 1U;
+constexpr std::uint64_t TAG_MACHINE_SCOPE = TAG_HANDLE_MASK;
+
+/// In place of the event, marks the tag of a timer that resumes an action. The action slot and its generation
+/// take the place of the state and its epoch.
+constexpr std::uint64_t TAG_ACTION = TAG_HANDLE_MASK;
+}  // namespace
+
+constexpr Fsm::RegionHandle Fsm::MAIN_REGION;
+constexpr Fsm::StateHandle Fsm::INVALID_STATE;
+constexpr std::uint32_t Fsm::NO_TRANSITION;
+constexpr Fsm::EventHandle Fsm::INVALID_EVENT;
+
 //======================================================================================================================
-Fsm::Fsm() : exit_flag_(false)
+Fsm::Fsm() : Fsm(Config())
 //======================================================================================================================
 {
 }
 
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::Fsm(const Config& config)
+  : config_(config)
+  , states_(config.memory_resource.get())
+  , parents_(config.memory_resource.get())
+  , state_handles_(config.memory_resource.get())
+  , events_(config.memory_resource.get())
+  , event_handles_(config.memory_resource.get())
+  , transitions_(config.memory_resource.get())
+  , rules_(config.memory_resource.get())
+  , transition_table_(config.memory_resource.get())
+  , table_rows_(config.memory_resource.get())
+  , event_columns_(config.memory_resource.get())
+  , compiled_(config.memory_resource.get())
+  , path_states_(config.memory_resource.get())
+  , num_events_(0)
+  , regions_(config.memory_resource.get())
+  , state_regions_(config.memory_resource.get())
+  , dispatched_regions_(config.memory_resource.get())
+  , timeouts_(config.memory_resource.get())
+  , state_epochs_(config.memory_resource.get())
+  , state_timers_(config.memory_resource.get())
+  , actions_(config.memory_resource.get())
+  , num_actions_(0)
+  , ready_actions_(config.memory_resource.get())
+  , actions_ready_(false)
+  , idle_actions_(config.memory_resource.get())
+  , resuming_actions_(config.memory_resource.get())
+  , event_payload_(&NO_PAYLOAD)
+  , state_change_handlers_(config.memory_resource.get())
+  , published_states_(new std::atomic<std::uint64_t>[1])
+  , state_waiters_(0)
+  , event_priorities_(config.memory_resource.get())
+  , event_queue_(detail::EventQueue::create(config, config.queue_capacity))
+  // events taken off the queue are out of reach of the policies that act on pending events
+  , event_batch_(new detail::EventBatch(((config.overflow_policy == OverflowPolicy::DropOldest) ||
+                                         (config.overflow_policy == OverflowPolicy::Coalesce))
+                                            ? 1
+                                            : EVENT_BATCH,
+                                        config.queue_memory_resource.get()))
+  , urgent_events_(0)
+  , low_events_(0)
+  , event_signal_(new detail::EventCount())
+  , pending_events_(0)
+  , dropped_events_(0)
+  , running_(false)
+  , exit_flag_(false)
+  , scheduled_(false)
+  , scheduled_runs_(0)
+  , concurrent_(false)
+  , region_batch_(0)
+  , regions_left_(0)
+  , regions_done_(new detail::EventCount())
+  , region_tasks_(0)
+  , tasks_done_(std::make_shared<detail::EventCount>())
+//----------------------------------------------------------------------------------------------------------------------
+{
+  regions_.push_back(Region{ "main", State::Id(), INVALID_STATE, Vector<StateHandle>(config_.memory_resource.get()),
+                             INVALID_STATE, false, nullptr });
+  published_states_[MAIN_REGION].store(INVALID_STATE, std::memory_order_relaxed);
+  if (!config_.timer_wheel)
+  {
+    config_.timer_wheel = TimerWheel::getDefault();
+  }
+}
+
 //----------------------------------------------------------------------------------------------------------------------
 Fsm::~Fsm()
 //----------------------------------------------------------------------------------------------------------------------
@@ -55,186 +163,1973 @@ Fsm::~Fsm()
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-void Fsm::addState(std::shared_ptr<State> state)
+bool Fsm::isDispatching() const
 //----------------------------------------------------------------------------------------------------------------------
 {
-  states_[state->getId()] = std::move(state);
+  return t_dispatching_fsm == this;
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-bool Fsm::hasTransitionRule(const State::Id& state_name, const Event& event)
+void Fsm::assertNotRunning(const char* caller) const
 //----------------------------------------------------------------------------------------------------------------------
 {
-  auto tr = transitions_.equal_range(state_name);
-  return tr.second != std::find_if(tr.first, tr.second, [&event](const auto& p) { return p.second.event == event; });
+  if (isRunning())
+  {
+    std::stringstream str;
+    str << "[" << caller << "] Definition cannot be modified once the FSM is running";  // NOLINT
+    throw FsmException(str.str());
+  }
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-void Fsm::addTransitionRule(const State::Id& from_state, const Event& event, const State::Id& to_state)
+Fsm::StateHandle Fsm::addState(std::shared_ptr<State> state)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  assertNotRunning(__FUNCTION__);  // NOLINT
+  const auto it = state_handles_.find(state->getId());
+  if (it != state_handles_.end())
+  {
+    states_[it->second] = std::move(state);
+    parents_[it->second] = INVALID_STATE;
+    state_regions_[it->second] = MAIN_REGION;
+    return it->second;
+  }
+  const auto handle = static_cast<StateHandle>(states_.size());
+  state_handles_.emplace(state->getId(), handle);
+  states_.push_back(std::move(state));
+  parents_.push_back(INVALID_STATE);
+  state_regions_.push_back(MAIN_REGION);
+  return handle;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::StateHandle Fsm::addState(std::shared_ptr<State> state, const State::Id& parent)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  assertNotRunning(__FUNCTION__);  // NOLINT
+  const auto parent_handle = getStateHandle(parent);
+  const auto it = state_handles_.find(state->getId());
+  if (it != state_handles_.end())
+  {
+    for (auto ancestor = parent_handle; ancestor != INVALID_STATE; ancestor = parents_[ancestor])
+    {
+      if (ancestor == it->second)
+      {
+        std::stringstream str;
+        str << "[" << __FUNCTION__ << "] State \"" << state->getId() << "\" cannot be nested in itself";  // NOLINT
+        throw FsmException(str.str());
+      }
+    }
+  }
+  const auto handle = addState(std::move(state));
+  parents_[handle] = parent_handle;
+  return handle;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::StateHandle Fsm::addState(std::shared_ptr<State> state, RegionHandle region)
 //----------------------------------------------------------------------------------------------------------------------
 {
-  if (states_.find(to_state) == states_.end())
+  assertNotRunning(__FUNCTION__);  // NOLINT
+  if (region >= regions_.size())
   {
     std::stringstream str;
-    str << "[" << __FUNCTION__ << "] State \"" << to_state << "\" does not exit";  // NOLINT
+    str << "[" << __FUNCTION__ << "] Region handle " << region << " does not exist";  // NOLINT
     throw FsmException(str.str());
   }
-  addTransitionRule(from_state, event, [to_state]() -> State::Id { return to_state; });
+  const auto handle = addState(std::move(state));
+  state_regions_[handle] = region;
+  return handle;
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-void Fsm::addTransitionRule(const State::Id& from_state, const Event& event, TransitionFunction&& func)
+Fsm::RegionHandle Fsm::addRegion(const std::string& name, const State::Id& initial_state)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  assertNotRunning(__FUNCTION__);  // NOLINT
+  for (const auto& region : regions_)
+  {
+    if (region.name == name)
+    {
+      std::stringstream str;
+      str << "[" << __FUNCTION__ << "] Region \"" << name << "\" already exists";  // NOLINT
+      throw FsmException(str.str());
+    }
+  }
+  const auto handle = static_cast<RegionHandle>(regions_.size());
+  regions_.push_back(Region{ name, initial_state, INVALID_STATE, Vector<StateHandle>(config_.memory_resource.get()),
+                             INVALID_STATE, false, nullptr });
+  published_states_.reset(new std::atomic<std::uint64_t>[regions_.size()]);
+  for (std::size_t i = 0; i < regions_.size(); ++i)
+  {
+    published_states_[i].store(INVALID_STATE, std::memory_order_relaxed);
+  }
+  return handle;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::EventHandle Fsm::addEvent(const Event& event)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto it = event_handles_.find(event);
+  if (it != event_handles_.end())
+  {
+    return it->second;
+  }
+  assertNotRunning(__FUNCTION__);  // NOLINT
+  const auto handle = static_cast<EventHandle>(events_.size());
+  event_handles_.emplace(event, handle);
+  events_.push_back(event);
+  return handle;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::setEventPriority(const Event& event, EventPriority priority)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  assertNotRunning(__FUNCTION__);  // NOLINT
+  const auto handle = addEvent(event);
+  if (handle >= event_priorities_.size())
+  {
+    event_priorities_.resize(handle + 1U, EventPriority::Normal);
+  }
+  event_priorities_[handle] = priority;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::StateHandle Fsm::getStateHandle(const State::Id& state) const
 //----------------------------------------------------------------------------------------------------------------------
 {
-  if (states_.find(from_state) == states_.end())
+  const auto it = state_handles_.find(state);
+  if (it == state_handles_.end())
   {
     std::stringstream str;
-    str << "[" << __FUNCTION__ << "] State \"" << from_state << "\" does not exit";  // NOLINT
+    str << "[" << __FUNCTION__ << "] State \"" << state << "\" does not exist";  // NOLINT
     throw FsmException(str.str());
   }
-  /*
-  if (states_.find(to_state) == states_.end())
+  return it->second;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::EventHandle Fsm::getEventHandle(const Event& event) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto it = event_handles_.find(event);
+  if (it == event_handles_.end())
   {
     std::stringstream str;
-    str << "[" << __FUNCTION__ << "] State \"" << to_state << "\" does not exit";  // NOLINT
+    str << "[" << __FUNCTION__ << "] Event \"" << event << "\" is not known";  // NOLINT
     throw FsmException(str.str());
-  }*/
-  if (hasTransitionRule(from_state, event))
+  }
+  return it->second;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::vector<Fsm::Event> Fsm::getHandledEvents() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::vector<bool> handled(events_.size(), false);
+  for (const auto& tr : transitions_)
+  {
+    handled[tr.event] = true;
+  }
+  std::vector<Event> events;
+  for (EventHandle event = 0; event < events_.size(); ++event)
+  {
+    if (handled[event])
+    {
+      events.push_back(events_[event]);
+    }
+  }
+  return events;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool Fsm::hasTransitionRule(StateHandle state, EventHandle event) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return rules_.find((static_cast<std::uint64_t>(state) << 32U) | event) != rules_.end();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::addTransitionRule(const State::Id& from_state, const Event& event, const State::Id& to_state)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto to_state_it = state_handles_.find(to_state);
+  if (to_state_it == state_handles_.end())
   {
     std::stringstream str;
-    str << "[" << __FUNCTION__ << "] Transition rule already exists";  // NOLINT
+    str << "[" << __FUNCTION__ << "] State \"" << to_state << "\" does not exist";  // NOLINT
+    throw FsmException(str.str());
+  }
+  const auto from_state_it = state_handles_.find(from_state);
+  if (from_state_it == state_handles_.end())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] State \"" << from_state << "\" does not exist";  // NOLINT
     throw FsmException(str.str());
   }
-  transitions_.emplace(
-      std::make_pair(State::Id(from_state), Transition{ from_state, event, std::forward<TransitionFunction>(func) }));
+  addRule(from_state_it->second, addEvent(event), to_state_it->second, nullptr, nullptr);
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-void Fsm::start(const State::Id& state)
+void Fsm::addTransitionRule(const State::Id& from_state, const Event& event, TransitionFunction&& func)
 //----------------------------------------------------------------------------------------------------------------------
 {
-  if (isRunning())
+  const auto from_state_it = state_handles_.find(from_state);
+  if (from_state_it == state_handles_.end())
   {
     std::stringstream str;
-    str << "[" << __FUNCTION__ << "] Re-initialisation is forbidden";  // NOLINT
+    str << "[" << __FUNCTION__ << "] State \"" << from_state << "\" does not exist";  // NOLINT
     throw FsmException(str.str());
   }
+  addTransitionRule(from_state_it->second, addEvent(event), std::forward<TransitionFunction>(func));
+}
 
-  auto it = states_.find(state);
-  if (it == states_.end())
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::addTransitionRule(StateHandle from_state, EventHandle event, StateHandle to_state)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (to_state >= states_.size())
   {
     std::stringstream str;
-    str << "[" << __FUNCTION__ << "] State \"" << state << "\" does not exist";  // NOLINT
+    str << "[" << __FUNCTION__ << "] State handle " << to_state << " does not exist";  // NOLINT
     throw FsmException(str.str());
   }
-  active_state_ = it->second;
-  active_state_->onEntry();
+  addRule(from_state, event, to_state, nullptr, nullptr);
+}
 
-  exit_flag_ = false;
-  event_handler_ = std::async(std::launch::async, [this]() { this->eventHandler(); });
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::addTransitionRule(StateHandle from_state, EventHandle event, TransitionFunction&& func)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // resolve the name returned by the function here, so that transit() only deals in handles
+  addRule(from_state, event, INVALID_STATE,
+          TransitionDelegate([this, f = std::move(func)]() {
+            const auto it = state_handles_.find(f());
+            return (it == state_handles_.end()) ? INVALID_STATE : it->second;
+          }),
+          nullptr);
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-void Fsm::stop()
+void Fsm::addTransitionRule(StateHandle from_state, EventHandle event, TransitionDelegate&& func)
 //----------------------------------------------------------------------------------------------------------------------
 {
-  exit_flag_ = true;
-  event_condition_.notify_all();
-  if (event_handler_.valid())
+  addRule(from_state, event, INVALID_STATE, std::move(func), nullptr);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::addTransitionRule(const State::Id& from_state, const Event& event, const State::Id& to_state,
+                            GuardDelegate&& guard)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto to_state_it = state_handles_.find(to_state);
+  if (to_state_it == state_handles_.end())
   {
-    event_handler_.wait();
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] State \"" << to_state << "\" does not exist";  // NOLINT
+    throw FsmException(str.str());
+  }
+  const auto from_state_it = state_handles_.find(from_state);
+  if (from_state_it == state_handles_.end())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] State \"" << from_state << "\" does not exist";  // NOLINT
+    throw FsmException(str.str());
   }
+  addTransitionRule(from_state_it->second, addEvent(event), to_state_it->second, std::move(guard));
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-const std::shared_ptr<State>& Fsm::getActiveState() const
+void Fsm::addTransitionRule(StateHandle from_state, EventHandle event, StateHandle to_state, GuardDelegate&& guard)
 //----------------------------------------------------------------------------------------------------------------------
 {
-  if (active_state_ == nullptr)
+  if (to_state >= states_.size())
   {
     std::stringstream str;
-    str << "[" << __FUNCTION__ << "] FSM not initialised";  // NOLINT
+    str << "[" << __FUNCTION__ << "] State handle " << to_state << " does not exist";  // NOLINT
     throw FsmException(str.str());
   }
-  return active_state_;
+  addRule(from_state, event, to_state, nullptr, std::move(guard));
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-void Fsm::raise(const Event& event)
+void Fsm::addRule(StateHandle from_state, EventHandle event, StateHandle to_state, TransitionDelegate&& func,
+                  GuardDelegate&& guard)
 //----------------------------------------------------------------------------------------------------------------------
 {
-  if (!event_handler_.valid())
+  assertNotRunning(__FUNCTION__);  // NOLINT
+  if (from_state >= states_.size())
   {
     std::stringstream str;
-    str << "[" << __FUNCTION__ << "] Got event \"" << event << "\" when FSM is not running";  // NOLINT
+    str << "[" << __FUNCTION__ << "] State handle " << from_state << " does not exist";  // NOLINT
+    throw FsmException(str.str());
+  }
+  if (event >= events_.size())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Event handle " << event << " is not known";  // NOLINT
     throw FsmException(str.str());
   }
-  std::lock_guard<std::recursive_mutex> lk(event_guard_);
-  event_queue_.push(event);
-  event_condition_.notify_one();
+  if (hasTransitionRule(from_state, event))
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Transition rule already exists";  // NOLINT
+    throw FsmException(str.str());
+  }
+  rules_.emplace((static_cast<std::uint64_t>(from_state) << 32U) | event,
+                 static_cast<std::uint32_t>(transitions_.size()));
+  transitions_.push_back(Transition{ from_state, event, to_state, std::move(func), std::move(guard) });
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-bool Fsm::isRunning() const
+void Fsm::addStateTimeout(const State::Id& state, std::chrono::nanoseconds timeout, const Event& event)
 //----------------------------------------------------------------------------------------------------------------------
 {
-  return event_handler_.valid();
+  assertNotRunning(__FUNCTION__);  // NOLINT
+  const auto state_handle = getStateHandle(state);
+  const auto event_handle = addEvent(event);
+  timeouts_.resize(states_.size(), StateTimeout{ std::chrono::nanoseconds(0), INVALID_EVENT });
+  timeouts_[state_handle] = StateTimeout{ timeout, event_handle };
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-bool Fsm::hasPendingEvents() const
+void Fsm::compile(Vector<StateHandle>& initial_states)
 //----------------------------------------------------------------------------------------------------------------------
 {
-  std::lock_guard<std::recursive_mutex> lk(event_guard_);
-  return !event_queue_.empty();
+  const auto num_states = states_.size();
+  num_events_ = events_.size();
+  event_priorities_.resize(num_events_, EventPriority::Normal);
+  timeouts_.resize(num_states, StateTimeout{ std::chrono::nanoseconds(0), INVALID_EVENT });
+  state_epochs_.assign(num_states, 0);
+
+  // nested states belong to the region of their top-level ancestor
+  for (StateHandle state = 0; state < num_states; ++state)
+  {
+    auto root = state;
+    while (parents_[root] != INVALID_STATE)
+    {
+      root = parents_[root];
+    }
+    state_regions_[state] = state_regions_[root];
+  }
+  for (const auto& tr : transitions_)
+  {
+    if ((tr.to_state != INVALID_STATE) && (state_regions_[tr.from_state] != state_regions_[tr.to_state]))
+    {
+      std::stringstream str;
+      str << "[" << __FUNCTION__ << "] Transition from \"" << states_[tr.from_state]->getId() << "\" to \""  // NOLINT
+          << states_[tr.to_state]->getId() << "\" crosses regions";
+      throw FsmException(str.str());
+    }
+  }
+  initial_states.clear();
+  for (RegionHandle region = 0; region < regions_.size(); ++region)
+  {
+    const auto initial = state_handles_.find(regions_[region].initial_state);
+    if ((initial == state_handles_.end()) || (state_regions_[initial->second] != region))
+    {
+      std::stringstream str;
+      str << "[" << __FUNCTION__ << "] Initial state \"" << regions_[region].initial_state  // NOLINT
+          << "\" is not a state of region \"" << regions_[region].name << "\"";
+      throw FsmException(str.str());
+    }
+    initial_states.push_back(initial->second);
+  }
+
+  Vector<std::uint32_t> own_rules(num_states * num_events_, NO_TRANSITION, config_.memory_resource.get());
+  for (std::size_t i = 0; i < transitions_.size(); ++i)
+  {
+    const auto& tr = transitions_[i];
+    own_rules[tr.from_state * num_events_ + tr.event] = static_cast<std::uint32_t>(i);
+  }
+  // Event bubbling: each state takes the rule of the innermost of itself and its ancestors that has one
+  const auto rule_source = [&](StateHandle state, EventHandle event) {
+    auto source = state;
+    while ((source != INVALID_STATE) && (own_rules[source * num_events_ + event] == NO_TRANSITION))
+    {
+      source = parents_[source];
+    }
+    return source;
+  };
+
+  // States that can become active: the initial states, and the targets of the rules taken from states that can.
+  // The target of a transition function is only known when it is called, so it may be any state of its region
+  Vector<std::uint8_t> can_be_active(num_states, 0, config_.memory_resource.get());
+  Vector<std::uint8_t> handled(num_events_, 0, config_.memory_resource.get());
+  Vector<std::uint8_t> region_open(regions_.size(), 0, config_.memory_resource.get());
+  Vector<StateHandle> pending(initial_states.begin(), initial_states.end(), config_.memory_resource.get());
+  for (const auto state : initial_states)
+  {
+    can_be_active[state] = 1;
+  }
+  while (!pending.empty())
+  {
+    const auto state = pending.back();
+    pending.pop_back();
+    for (EventHandle event = 0; event < num_events_; ++event)
+    {
+      const auto source = rule_source(state, event);
+      if (source == INVALID_STATE)
+      {
+        continue;
+      }
+      handled[event] = 1;
+      const auto& tr = transitions_[own_rules[source * num_events_ + event]];
+      if (!tr.transit)
+      {
+        if (can_be_active[tr.to_state] == 0)
+        {
+          can_be_active[tr.to_state] = 1;
+          pending.push_back(tr.to_state);
+        }
+        continue;
+      }
+      const auto region = state_regions_[state];
+      if (region_open[region] != 0)
+      {
+        continue;
+      }
+      region_open[region] = 1;
+      for (StateHandle target = 0; target < num_states; ++target)
+      {
+        if ((state_regions_[target] == region) && (can_be_active[target] == 0))
+        {
+          can_be_active[target] = 1;
+          pending.push_back(target);
+        }
+      }
+    }
+  }
+
+  // Rows for the states that can become active, and columns for the events they handle. Row 0 and column 0 have
+  // no transitions, and stand for the rest, so that a state or an event that is dropped is simply ignored
+  std::uint32_t num_columns = 1;
+  event_columns_.assign(num_events_, 0);
+  for (EventHandle event = 0; event < num_events_; ++event)
+  {
+    if (handled[event] != 0)
+    {
+      event_columns_[event] = num_columns++;
+    }
+  }
+  std::uint32_t num_rows = 1;
+  table_rows_.assign(num_states, 0);
+  for (StateHandle state = 0; state < num_states; ++state)
+  {
+    if (can_be_active[state] != 0)
+    {
+      table_rows_[state] = num_rows++ * num_columns;
+    }
+  }
+
+  // Fold event bubbling into the table, together with the states each rule exits and enters from the active state
+  transition_table_.assign(std::size_t{ num_rows } * num_columns, NO_TRANSITION);
+  compiled_.clear();
+  path_states_.clear();
+  for (StateHandle state = 0; state < num_states; ++state)
+  {
+    if (table_rows_[state] == 0)
+    {
+      continue;
+    }
+    for (EventHandle event = 0; event < num_events_; ++event)
+    {
+      const auto source = rule_source(state, event);
+      if (source == INVALID_STATE)
+      {
+        continue;
+      }
+      CompiledTransition ct{ own_rules[source * num_events_ + event], static_cast<std::uint32_t>(path_states_.size()),
+                             0, 0 };
+      if (!transitions_[ct.rule].transit)
+      {
+        const auto exits = appendPath(state, source, transitions_[ct.rule].to_state, path_states_);
+        ct.num_exits = static_cast<std::uint16_t>(exits);
+        ct.num_entries = static_cast<std::uint16_t>(path_states_.size() - ct.path - exits);
+      }
+      transition_table_[table_rows_[state] + event_columns_[event]] = static_cast<std::uint32_t>(compiled_.size());
+      compiled_.push_back(ct);
+    }
+  }
+  compiled_.shrink_to_fit();
+  path_states_.shrink_to_fit();
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-void Fsm::changeState(const Event& event)
+Fsm::Analysis Fsm::getAnalysis() const
 //----------------------------------------------------------------------------------------------------------------------
 {
-  const auto all_transitions = transitions_.equal_range(active_state_->getId());
-  const auto it = std::find_if(all_transitions.first, all_transitions.second,
-                               [&event](const auto& keyval) { return keyval.second.event == event; });
+  if (table_rows_.empty())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] The machine has not been started";  // NOLINT
+    throw FsmException(str.str());
+  }
 
-  if (it == all_transitions.second)
+  // states with a row can become active, and their ancestors are entered with them
+  std::vector<bool> reachable(states_.size(), false);
+  std::size_t num_rows = 1;
+  for (StateHandle state = 0; state < states_.size(); ++state)
   {
-    return;
+    if (table_rows_[state] == 0)
+    {
+      continue;
+    }
+    ++num_rows;
+    for (auto s = state; (s != INVALID_STATE) && !reachable[s]; s = parents_[s])
+    {
+      reachable[s] = true;
+    }
   }
 
-  const auto state_id = it->second.transit();
-  if (states_.end() == states_.find(state_id))
+  Analysis analysis;
+  for (StateHandle state = 0; state < states_.size(); ++state)
   {
-    /// \todo throw exception for invalid state and have it caught in the main thread
-    return;
+    if (!reachable[state])
+    {
+      analysis.unreachable_states.push_back(states_[state]->getId());
+    }
+  }
+  for (EventHandle event = 0; event < num_events_; ++event)
+  {
+    if (event_columns_[event] == 0)
+    {
+      analysis.unhandled_events.push_back(events_[event]);
+    }
+  }
+  analysis.num_active_states = num_rows - 1;
+  analysis.num_handled_events = num_events_ - analysis.unhandled_events.size();
+  analysis.num_compiled_transitions = compiled_.size();
+  analysis.table_size = transition_table_.size();
+  return analysis;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t Fsm::appendPath(StateHandle active, StateHandle source, StateHandle target,
+                            Vector<StateHandle>& path) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto is_proper_ancestor = [this](StateHandle ancestor, StateHandle state) {
+    for (auto s = parents_[state]; s != INVALID_STATE; s = parents_[s])
+    {
+      if (s == ancestor)
+      {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // least common proper ancestor of source and target, which the transition neither exits nor enters
+  auto lcpa = parents_[source];
+  while ((lcpa != INVALID_STATE) && !is_proper_ancestor(lcpa, target))
+  {
+    lcpa = parents_[lcpa];
+  }
+
+  // exit innermost first, from the active state, which is source or one of its descendants
+  const auto begin = path.size();
+  for (auto s = active; s != lcpa; s = parents_[s])
+  {
+    path.push_back(s);
   }
+  const auto exits = path.size() - begin;
 
-  // exit current state and bring up new state
-  active_state_->onExit();
-  active_state_ = states_.at(state_id);
-  active_state_->onEntry();
+  // enter outermost first
+  for (auto s = target; s != lcpa; s = parents_[s])
+  {
+    path.push_back(s);
+  }
+  std::reverse(path.begin() + static_cast<std::ptrdiff_t>(begin + exits), path.end());
+  return exits;
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-void Fsm::eventHandler()
+void Fsm::start(const State::Id& state)
 //----------------------------------------------------------------------------------------------------------------------
 {
-  while (true)
+  if (isRunning())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Re-initialisation is forbidden";  // NOLINT
+    throw FsmException(str.str());
+  }
+
+  auto it = state_handles_.find(state);
+  if (it == state_handles_.end())
   {
-    std::unique_lock<std::recursive_mutex> lk(event_guard_);
-    event_condition_.wait(lk, [this]() { return (!this->event_queue_.empty() || this->exit_flag_); });
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] State \"" << state << "\" does not exist";  // NOLINT
+    throw FsmException(str.str());
+  }
+  regions_[MAIN_REGION].initial_state = state;
+  Vector<StateHandle> initial_states(config_.memory_resource.get());
+  compile(initial_states);
+  setUpDispatch();
+  enterInitialStates(initial_states);
+  launch();
+}
 
-    while (!event_queue_.empty())
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::enterInitialStates(const Vector<StateHandle>& initial_states)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // the initial states' callbacks belong to the dispatch context. See visibleState()
+  const auto* const outer_fsm = t_dispatching_fsm;
+  const auto outer_region = t_dispatching_region;
+  t_dispatching_fsm = this;
+  try
+  {
+    for (RegionHandle region = 0; region < regions_.size(); ++region)
+    {
+      t_dispatching_region = region;
+      regions_[region].active = initial_states[region];
+      Vector<StateHandle> entries(config_.memory_resource.get());
+      for (auto s = initial_states[region]; s != INVALID_STATE; s = parents_[s])
+      {
+        entries.push_back(s);
+      }
+      for (auto s = entries.rbegin(); s != entries.rend(); ++s)
+      {
+        enterState(*s);
+      }
+    }
+    for (RegionHandle region = 0; region < regions_.size(); ++region)
     {
-      const auto sig = event_queue_.front();
-      event_queue_.pop();
-      changeState(sig);
+      publishState(region, INVALID_STATE);
     }
+  }
+  catch (...)
+  {
+    t_dispatching_fsm = outer_fsm;
+    t_dispatching_region = outer_region;
+    throw;
+  }
+  t_dispatching_fsm = outer_fsm;
+  t_dispatching_region = outer_region;
+}
 
-    if (exit_flag_)
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::setUpDispatch()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto has_priority = [this](EventPriority priority) {
+    return std::find(event_priorities_.begin(), event_priorities_.end(), priority) != event_priorities_.end();
+  };
+  if (!urgent_queue_ && has_priority(EventPriority::Urgent))
+  {
+    urgent_queue_ = detail::EventQueue::create(config_, config_.urgent_queue_capacity);
+  }
+  if (!low_queue_ && has_priority(EventPriority::Low))
+  {
+    low_queue_ = detail::EventQueue::create(config_, config_.low_queue_capacity);
+  }
+  if (regions_.size() > 1)
+  {
+    region_claims_.reset(new std::atomic<std::uint64_t>[regions_.size()]);
+    for (std::size_t i = 0; i < regions_.size(); ++i)
     {
-      return;
+      region_claims_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+  if (detail::METRICS_ENABLED && config_.collect_metrics)
+  {
+    metrics_.reset(new detail::MetricsRecorder(states_.size()));
+  }
+  if (config_.trace_recorder)
+  {
+    std::vector<std::string> state_ids;
+    state_ids.reserve(states_.size());
+    for (const auto& s : states_)
+    {
+      state_ids.push_back(s->getId());
+    }
+    config_.trace_recorder->setDictionary(state_ids, std::vector<std::string>(events_.begin(), events_.end()));
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::launch()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  exit_flag_ = false;
+  running_ = true;
+  if ((config_.dispatch_mode == DispatchMode::Background) && !config_.executor)
+  {
+    event_handler_ = std::async(std::launch::async, [this]() { this->eventHandler(); });
+  }
+  else if (hasPendingEvents())
+  {
+    notifyDispatcher();  // actions started by the initial state, or events of a restored machine
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::stop()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // no timers start from here on. Timers are cancelled once the dispatch under way has finished, so that a state
+  // entered or an action resumed in the meantime cannot arm one that outlives the machine
+  exit_flag_ = true;
+  event_signal_->notify();
+  if (event_handler_.valid())
+  {
+    event_handler_.wait();
+  }
+  waitForTasks();
+  config_.timer_wheel->cancelAll(*this);
+  waitForTasks();  // for a run posted by a timer that fired before it was cancelled
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::waitForTasks()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto busy = [this]() {
+    return (scheduled_runs_.load(std::memory_order_acquire) != 0) ||
+           (region_tasks_.load(std::memory_order_acquire) != 0);
+  };
+  while (busy())
+  {
+    const auto key = tasks_done_->prepareWait();
+    if (!busy())
+    {
+      tasks_done_->cancelWait();
+      break;
+    }
+    tasks_done_->wait(key);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+const std::shared_ptr<State>& Fsm::getActiveState() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return getActiveState(MAIN_REGION);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+const std::shared_ptr<State>& Fsm::getActiveState(RegionHandle region) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (region >= regions_.size())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Region handle " << region << " does not exist";  // NOLINT
+    throw FsmException(str.str());
+  }
+  const auto state = visibleState(region);
+  if (state == INVALID_STATE)
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] FSM not initialised";  // NOLINT
+    throw FsmException(str.str());
+  }
+  return states_[state];
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::StateVersion Fsm::getStateVersion() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return getStateVersion(MAIN_REGION);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::StateVersion Fsm::getStateVersion(RegionHandle region) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (region >= regions_.size())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Region handle " << region << " does not exist";  // NOLINT
+    throw FsmException(str.str());
+  }
+  const auto published = published_states_[region].load(std::memory_order_acquire);
+  return StateVersion{ static_cast<StateHandle>(published), static_cast<std::uint32_t>(published >> 32U) };
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+State::Id Fsm::getStateId(StateHandle state) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (state >= states_.size())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Invalid state handle " << state;  // NOLINT
+    throw FsmException(str.str());
+  }
+  return states_[state]->getId();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool Fsm::waitForState(const State::Id& state, std::chrono::nanoseconds timeout) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (isInState(state))
+  {
+    return true;
+  }
+
+  // registering before checking again under the lock pairs with publishState(), so no transition is missed
+  state_waiters_.fetch_add(1, std::memory_order_seq_cst);
+  std::unique_lock<std::mutex> lk(state_guard_);
+  const auto reached = state_changed_.wait_for(lk, timeout, [this, &state]() { return isInState(state); });
+  lk.unlock();
+  state_waiters_.fetch_sub(1, std::memory_order_relaxed);
+  return reached;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::onStateChanged(StateChangeHandler handler)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  assertNotRunning(__FUNCTION__);  // NOLINT
+  state_change_handlers_.push_back(std::move(handler));
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::StateHandle Fsm::currentState() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return regions_[(t_dispatching_fsm == this) ? t_dispatching_region : MAIN_REGION].active;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::StateHandle Fsm::visibleState(RegionHandle region) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // the dispatch context of a region sees the target of a transition under way, everyone else the last completed one
+  if ((t_dispatching_fsm == this) && (t_dispatching_region == region))
+  {
+    return regions_[region].active;
+  }
+  return static_cast<StateHandle>(published_states_[region].load(std::memory_order_acquire));
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::publishState(RegionHandle region, StateHandle from)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  auto& published = published_states_[region];
+  const auto to = regions_[region].active;
+  const auto version =
+      (from == INVALID_STATE) ? std::uint64_t{ 0 } : ((published.load(std::memory_order_relaxed) >> 32U) + 1U);
+  published.store(((version & UINT32_MAX) << 32U) | to, std::memory_order_seq_cst);
+  if (state_waiters_.load(std::memory_order_seq_cst) != 0)
+  {
+    // taking the lock ensures that a waiter is either already waiting or yet to check the state
+    {
+      std::lock_guard<std::mutex> lk(state_guard_);
+    }
+    state_changed_.notify_all();
+  }
+  for (const auto& handler : state_change_handlers_)
+  {
+    handler(from, to);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::raise(const Event& event)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  raise(event, Payload());
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::raise(const Event& event, Payload payload)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (!isRunning())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Got event \"" << event << "\" when FSM is not running";  // NOLINT
+    throw FsmException(str.str());
+  }
+  const auto it = event_handles_.find(event);
+  if (it == event_handles_.end())
+  {
+    if (detail::METRICS_ENABLED && metrics_)
+    {
+      metrics_->ignored_events.fetch_add(1, std::memory_order_relaxed);
+    }
+    return;  // no rule can match an unknown event
+  }
+  raise(it->second, std::move(payload));
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::raise(EventHandle event)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  raise(event, Payload());
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::raise(EventHandle event, Payload payload)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (!isRunning())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Got event " << event << " when FSM is not running";  // NOLINT
+    throw FsmException(str.str());
+  }
+  if (event >= num_events_)
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Event handle " << event << " is not known";  // NOLINT
+    throw FsmException(str.str());
+  }
+  detail::QueuedEvent item;
+  item.event = event;
+  item.payload = std::move(payload);
+  enqueue(std::move(item), t_dispatching_fsm != this, true);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::raiseBatch(const std::vector<Event>& events)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::vector<EventHandle> handles;
+  handles.reserve(events.size());
+  for (const auto& event : events)
+  {
+    const auto it = event_handles_.find(event);
+    if (it != event_handles_.end())
+    {
+      handles.push_back(it->second);
+    }
+    else if (detail::METRICS_ENABLED && metrics_)
+    {
+      metrics_->ignored_events.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  raiseBatch(handles.data(), handles.data() + handles.size());
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::raiseBatch(const EventHandle* first, const EventHandle* last)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (!isRunning())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Got events when FSM is not running";  // NOLINT
+    throw FsmException(str.str());
+  }
+  for (const auto* it = first; it != last; ++it)
+  {
+    if (*it >= num_events_)
+    {
+      std::stringstream str;
+      str << "[" << __FUNCTION__ << "] Event handle " << *it << " is not known";  // NOLINT
+      throw FsmException(str.str());
+    }
+  }
+
+  enqueueEvents(first, last, t_dispatching_fsm != this, true);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::enqueueEvents(const EventHandle* first, const EventHandle* last, bool can_block, bool notify)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // consecutive events of the same priority go to their queue together. A chunk never exceeds the capacity of the
+  // queue, so that OverflowPolicy::Block waits only for events the dispatch context has been told about
+  detail::QueuedEvent chunk[EVENT_BATCH];
+  while (first != last)
+  {
+    const auto priority = event_priorities_[*first];
+    auto capacity = config_.queue_capacity;
+    if (priority == EventPriority::Urgent)
+    {
+      capacity = config_.urgent_queue_capacity;
+    }
+    else if (priority == EventPriority::Low)
+    {
+      capacity = config_.low_queue_capacity;
+    }
+    const auto max_count = (capacity == 0) ? EVENT_BATCH : std::min(capacity, EVENT_BATCH);
+    std::size_t count = 0;
+    while ((first != last) && (count < max_count) && (event_priorities_[*first] == priority))
+    {
+      chunk[count++].event = *first++;
+    }
+    enqueueBatch(chunk, count, can_block);
+    if (notify)
+    {
+      notifyDispatcher();
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::TimerId Fsm::raiseAfter(const Event& event, std::chrono::nanoseconds delay, TimerScope scope)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto it = event_handles_.find(event);
+  if (it == event_handles_.end())
+  {
+    return TimerId{};
+  }
+  return raiseAfter(it->second, delay, scope);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::TimerId Fsm::raiseAfter(EventHandle event, std::chrono::nanoseconds delay, TimerScope scope)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (currentState() == INVALID_STATE)
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Got event " << event << " when FSM is not running";  // NOLINT
+    throw FsmException(str.str());
+  }
+  if (event >= num_events_)
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Event handle " << event << " is not known";  // NOLINT
+    throw FsmException(str.str());
+  }
+  return startTimer(event, (scope == TimerScope::State) ? currentState() : INVALID_STATE, delay);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool Fsm::cancelTimer(TimerId id)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return config_.timer_wheel->cancel(id);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::enqueue(detail::QueuedEvent&& item, bool can_block, bool notify)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto depth = pending_events_.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (detail::METRICS_ENABLED && metrics_)
+  {
+    item.enqueued_at = detail::metricsTimestamp();
+  }
+  std::size_t discarded = 0;
+  switch (event_priorities_[item.event])
+  {
+    case EventPriority::Urgent:
+      urgent_events_.fetch_add(1, std::memory_order_relaxed);
+      discarded = urgent_queue_->push(std::move(item), can_block);
+      urgent_events_.fetch_sub(discarded, std::memory_order_relaxed);
+      break;
+    case EventPriority::Low:
+      low_events_.fetch_add(1, std::memory_order_relaxed);
+      discarded = low_queue_->push(std::move(item), can_block);
+      low_events_.fetch_sub(discarded, std::memory_order_relaxed);
+      break;
+    case EventPriority::Normal:
+    default:
+      discarded = event_queue_->push(std::move(item), can_block);
+      break;
+  }
+  if (discarded != 0)
+  {
+    pending_events_.fetch_sub(discarded, std::memory_order_release);
+    dropped_events_.fetch_add(discarded, std::memory_order_relaxed);
+  }
+  if (detail::METRICS_ENABLED && metrics_)
+  {
+    // an event discarded at capacity was never pending together with the others
+    metrics_->events_raised.fetch_add(1, std::memory_order_relaxed);
+    metrics_->updateHighWater(depth - discarded);
+  }
+  if (notify)
+  {
+    notifyDispatcher();
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::enqueueBatch(detail::QueuedEvent* items, std::size_t count, bool can_block)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // all events of a batch have the same priority
+  const auto depth = pending_events_.fetch_add(count, std::memory_order_relaxed) + count;
+  if (detail::METRICS_ENABLED && metrics_)
+  {
+    const auto now = detail::metricsTimestamp();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      items[i].enqueued_at = now;
+    }
+  }
+  std::size_t discarded = 0;
+  switch (event_priorities_[items[0].event])
+  {
+    case EventPriority::Urgent:
+      urgent_events_.fetch_add(count, std::memory_order_relaxed);
+      discarded = urgent_queue_->pushBatch(items, count, can_block);
+      urgent_events_.fetch_sub(discarded, std::memory_order_relaxed);
+      break;
+    case EventPriority::Low:
+      low_events_.fetch_add(count, std::memory_order_relaxed);
+      discarded = low_queue_->pushBatch(items, count, can_block);
+      low_events_.fetch_sub(discarded, std::memory_order_relaxed);
+      break;
+    case EventPriority::Normal:
+    default:
+      discarded = event_queue_->pushBatch(items, count, can_block);
+      break;
+  }
+  if (discarded != 0)
+  {
+    pending_events_.fetch_sub(discarded, std::memory_order_release);
+    dropped_events_.fetch_add(discarded, std::memory_order_relaxed);
+  }
+  if (detail::METRICS_ENABLED && metrics_)
+  {
+    metrics_->events_raised.fetch_add(count, std::memory_order_relaxed);
+    metrics_->updateHighWater(depth - discarded);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::notifyDispatcher()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  switch (config_.dispatch_mode)
+  {
+    case DispatchMode::Inline:
+      dispatchInline(std::numeric_limits<std::size_t>::max());
+      break;
+    case DispatchMode::Manual:
+      break;
+    case DispatchMode::Background:
+    default:
+      if (config_.executor)
+      {
+        schedule();
+      }
+      else
+      {
+        event_signal_->notify();
+      }
+      break;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::startAction(Action action)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (currentState() == INVALID_STATE)
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] FSM not initialised";  // NOLINT
+    throw FsmException(str.str());
+  }
+  if (!action)
+  {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lk(concurrent_guard_, std::defer_lock);
+  if (concurrent_)
+  {
+    lk.lock();
+  }
+  std::uint32_t index = 0;
+  while ((index < actions_.size()) && (actions_[index].state != INVALID_STATE))
+  {
+    ++index;
+  }
+  if (index == actions_.size())
+  {
+    if (index >= TAG_HANDLE_MASK)
+    {
+      std::stringstream str;
+      str << "[" << __FUNCTION__ << "] Too many actions in progress";  // NOLINT
+      throw FsmException(str.str());
+    }
+    actions_.push_back(RunningAction{ Action(), INVALID_STATE, 0, TimerId() });
+  }
+  auto& slot = actions_[index];
+  slot.step = std::move(action);
+  slot.state = currentState();
+  slot.timer = TimerId();
+  ++num_actions_;
+  resumeAction(index, slot.generation, true);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::resumeAction(std::uint32_t index, std::uint16_t generation, bool notify)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // counts as a pending event, so that every dispatch mode comes round to run it
+  pending_events_.fetch_add(1, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lk(ready_guard_);
+    ready_actions_.emplace_back(index, generation);
+    actions_ready_.store(true, std::memory_order_release);
+  }
+  if (running_ && notify)
+  {
+    notifyDispatcher();
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t Fsm::runActions()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // swapping keeps the capacity of both lists, so that resuming does not allocate once warmed up
+  auto& ready = resuming_actions_;
+  ready.clear();
+  {
+    std::lock_guard<std::mutex> lk(ready_guard_);
+    ready.swap(ready_actions_);
+    actions_ready_.store(false, std::memory_order_relaxed);
+  }
+
+  for (std::size_t i = 0; i < ready.size(); ++i)
+  {
+    const auto index = ready[i].first;
+    const auto generation = ready[i].second;
+
+    // resumption of an action that was cancelled after it became ready is stale
+    if ((actions_[index].state == INVALID_STATE) || (actions_[index].generation != generation))
+    {
+      pending_events_.fetch_sub(1, std::memory_order_release);
+      continue;
+    }
+
+    // the step may start other actions and reallocate the slots
+    auto step = std::move(actions_[index].step);
+    t_dispatching_region = state_regions_[actions_[index].state];
+    ActionResult result = ActionResult::done();
+    try
+    {
+      result = step();
+    }
+    catch (...)
+    {
+      actions_[index].state = INVALID_STATE;
+      actions_[index].generation++;
+      --num_actions_;
+      std::lock_guard<std::mutex> lk(ready_guard_);
+      pending_events_.fetch_sub(1, std::memory_order_release);
+      ready_actions_.insert(ready_actions_.begin(), ready.begin() + static_cast<std::ptrdiff_t>(i) + 1, ready.end());
+      actions_ready_.store(!ready_actions_.empty(), std::memory_order_release);
+      throw;
+    }
+
+    auto& slot = actions_[index];
+    switch (result.getKind())
+    {
+      case ActionResult::Kind::ResumeAfter:
+      {
+        slot.step = std::move(step);
+        if (exit_flag_.load(std::memory_order_acquire))
+        {
+          break;  // the machine is being destroyed, and the action is not resumed
+        }
+        const auto tag = TAG_ACTION | (static_cast<std::uint64_t>(index) << TAG_HANDLE_BITS) |
+                         (static_cast<std::uint64_t>(slot.generation) << TAG_EPOCH_SHIFT);
+        slot.timer = config_.timer_wheel->schedule(*this, result.getDelay(), tag);
+        break;
+      }
+      case ActionResult::Kind::ResumeWhenIdle:
+        // remains a pending event until processEvents() finds the queue empty
+        slot.step = std::move(step);
+        idle_actions_.emplace_back(index, slot.generation);
+        continue;
+      case ActionResult::Kind::Done:
+      default:
+        slot.state = INVALID_STATE;
+        slot.generation++;
+        --num_actions_;
+        break;
+    }
+    pending_events_.fetch_sub(1, std::memory_order_release);
+  }
+  return ready.size();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::cancelActions(StateHandle state)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // resumptions that are already due are discarded by the generation check in runActions()
+  for (auto& slot : actions_)
+  {
+    if (slot.state == state)
+    {
+      config_.timer_wheel->cancel(slot.timer);
+      slot.step = Action();
+      slot.state = INVALID_STATE;
+      slot.generation++;
+      --num_actions_;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t Fsm::processPending(std::size_t max_events)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (config_.dispatch_mode == DispatchMode::Background)
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Events are processed in the background for this FSM";  // NOLINT
+    throw FsmException(str.str());
+  }
+  return dispatchInline(max_events);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+FsmMetrics Fsm::getMetrics() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  FsmMetrics m;
+  m.dropped_events = getDroppedEventCount();
+  if (!detail::METRICS_ENABLED || !metrics_)
+  {
+    return m;
+  }
+  m.events_raised = metrics_->events_raised.load(std::memory_order_relaxed);
+  m.events_processed = metrics_->events_processed.load(std::memory_order_relaxed);
+  m.transitions = metrics_->transitions.load(std::memory_order_relaxed);
+  m.ignored_events = metrics_->ignored_events.load(std::memory_order_relaxed);
+  m.queue_high_water = metrics_->queue_high_water.load(std::memory_order_relaxed);
+  const auto elapsed_ns = detail::metricsTimestamp() - metrics_->start_time;
+  if (elapsed_ns > 0)
+  {
+    m.transitions_per_second = static_cast<double>(m.transitions) * 1e9 / static_cast<double>(elapsed_ns);
+  }
+  m.queue_latency = metrics_->queue_latency.snapshot();
+  m.transition_function = metrics_->transition_function.snapshot();
+  m.states.resize(states_.size());
+  for (std::size_t i = 0; i < states_.size(); ++i)
+  {
+    m.states[i].id = states_[i]->getId();
+    m.states[i].on_entry = metrics_->on_entry[i].snapshot();
+    m.states[i].on_exit = metrics_->on_exit[i].snapshot();
+  }
+  return m;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+const Payload& Fsm::getEventPayload() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return *event_payload_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool Fsm::isInState(const State::Id& state) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto handle = getStateHandle(state);
+  for (auto s = visibleState(state_regions_[handle]); s != INVALID_STATE; s = parents_[s])
+  {
+    if (s == handle)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool Fsm::isRunning() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return running_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+const Fsm::Config& Fsm::getConfig() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return config_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool Fsm::hasPendingEvents() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return pending_events_.load(std::memory_order_acquire) != 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::uint64_t Fsm::getDroppedEventCount() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return dropped_events_.load(std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::changeState(EventHandle event)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  dispatched_regions_.clear();
+  const auto column = event_columns_[event];
+  for (RegionHandle region = 0; region < regions_.size(); ++region)
+  {
+    if (transition_table_[table_rows_[regions_[region].active] + column] != NO_TRANSITION)
+    {
+      dispatched_regions_.push_back(region);
+    }
+  }
+  if (dispatched_regions_.empty())
+  {
+    if (detail::METRICS_ENABLED && metrics_)
+    {
+      metrics_->ignored_events.fetch_add(1, std::memory_order_relaxed);
+    }
+    const auto active = regions_[MAIN_REGION].active;
+    recordTrace(event, active, active, TraceOutcome::Ignored);
+    return;
+  }
+
+  if ((dispatched_regions_.size() > 1) && config_.region_executor)
+  {
+    transitConcurrently(event);
+  }
+  else
+  {
+    for (const auto region : dispatched_regions_)
+    {
+      t_dispatching_region = region;
+      transit(region, event);
+    }
+    t_dispatching_region = MAIN_REGION;
+  }
+
+  // other threads see the transitions of all regions once the event has been processed
+  for (const auto region : dispatched_regions_)
+  {
+    if (regions_[region].transitioned)
+    {
+      publishState(region, regions_[region].from);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::transit(RegionHandle region_handle, EventHandle event)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  auto& region = regions_[region_handle];
+  const bool instrumented = detail::METRICS_ENABLED && metrics_;
+  region.from = region.active;
+  region.transitioned = false;
+
+  const auto& ct = compiled_[transition_table_[table_rows_[region.active] + event_columns_[event]]];
+  const auto& tr = transitions_[ct.rule];
+  auto next_state = tr.to_state;
+  const StateHandle* path = path_states_.data() + ct.path;
+  std::size_t num_exits = ct.num_exits;
+  std::size_t num_entries = ct.num_entries;
+  if (tr.guard)
+  {
+    const auto t0 = instrumented ? detail::metricsTimestamp() : 0;
+    const auto allowed = tr.guard();
+    if (instrumented)
+    {
+      metrics_->transition_function.record(detail::metricsTimestamp() - t0);
+    }
+    if (!allowed)
+    {
+      if (instrumented)
+      {
+        metrics_->ignored_events.fetch_add(1, std::memory_order_relaxed);
+      }
+      recordTrace(event, region.active, region.active, TraceOutcome::Ignored);
+      return;
+    }
+  }
+  else if (tr.transit)
+  {
+    const auto t0 = instrumented ? detail::metricsTimestamp() : 0;
+    next_state = tr.transit();
+    if (instrumented)
+    {
+      metrics_->transition_function.record(detail::metricsTimestamp() - t0);
+    }
+    if ((next_state >= states_.size()) || (state_regions_[next_state] != region_handle))
+    {
+      /// \todo throw exception for invalid state and have it caught in the main thread
+      if (instrumented)
+      {
+        metrics_->ignored_events.fetch_add(1, std::memory_order_relaxed);
+      }
+      recordTrace(event, region.active, region.active, TraceOutcome::InvalidTarget);
+      return;
+    }
+    region.dynamic_path.clear();
+    num_exits = appendPath(region.active, tr.from_state, next_state, region.dynamic_path);
+    num_entries = region.dynamic_path.size() - num_exits;
+    path = region.dynamic_path.data();
+  }
+  recordTrace(event, region.active, next_state, TraceOutcome::Transition);
+
+  // exit states up to the common ancestor of the rule and the target, then enter states down to the target
+  for (std::size_t i = 0; i < num_exits; ++i)
+  {
+    exitState(path[i]);
+  }
+  region.active = next_state;
+  for (std::size_t i = num_exits; i < num_exits + num_entries; ++i)
+  {
+    enterState(path[i]);
+  }
+  region.transitioned = true;
+  if (instrumented)
+  {
+    metrics_->transitions.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::transitConcurrently(EventHandle event)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // each transition goes to whoever claims it first: a worker, or this thread once it has posted the others. So a
+  // busy executor, or the executor this thread belongs to, cannot hold up the event
+  const auto batch = ++region_batch_;
+  concurrent_ = true;
+  regions_left_.store(dispatched_regions_.size(), std::memory_order_relaxed);
+  for (const auto region : dispatched_regions_)
+  {
+    regions_[region].error = nullptr;
+    region_claims_[region].store(batch, std::memory_order_relaxed);
+  }
+  for (std::size_t i = 1; i < dispatched_regions_.size(); ++i)
+  {
+    const auto region = dispatched_regions_[i];
+    region_tasks_.fetch_add(1, std::memory_order_relaxed);
+    config_.region_executor->post([this, region, batch, event, done = tasks_done_]() {
+      transitClaimed(region, batch, event);
+      region_tasks_.fetch_sub(1, std::memory_order_release);  // must be the last access to this object
+      done->notify();
+    });
+  }
+  for (const auto region : dispatched_regions_)
+  {
+    transitClaimed(region, batch, event);
+  }
+
+  while (regions_left_.load(std::memory_order_acquire) != 0)
+  {
+    const auto key = regions_done_->prepareWait();
+    if (regions_left_.load(std::memory_order_acquire) == 0)
+    {
+      regions_done_->cancelWait();
+      break;
+    }
+    regions_done_->wait(key);
+  }
+  concurrent_ = false;
+
+  for (const auto region : dispatched_regions_)
+  {
+    if (regions_[region].error)
+    {
+      std::rethrow_exception(regions_[region].error);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::transitClaimed(RegionHandle region, std::uint64_t batch, EventHandle event)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // a task that runs late finds its batch gone
+  auto expected = batch;
+  if (!region_claims_[region].compare_exchange_strong(expected, 0, std::memory_order_acq_rel))
+  {
+    return;
+  }
+
+  const auto* const outer_fsm = t_dispatching_fsm;
+  const auto outer_region = t_dispatching_region;
+  t_dispatching_fsm = this;
+  t_dispatching_region = region;
+  try
+  {
+    transit(region, event);
+  }
+  catch (...)
+  {
+    regions_[region].error = std::current_exception();
+  }
+  t_dispatching_fsm = outer_fsm;
+  t_dispatching_region = outer_region;
+
+  if (regions_left_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    regions_done_->notify();
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::recordTrace(EventHandle event, StateHandle from, StateHandle to, TraceOutcome outcome)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  auto* const trace = config_.trace_recorder.get();
+  if (trace == nullptr)
+  {
+    return;
+  }
+  if (concurrent_)
+  {
+    std::lock_guard<std::mutex> lk(concurrent_guard_);  // the recorder takes one writer at a time
+    trace->record(event, from, to, outcome);
+  }
+  else
+  {
+    trace->record(event, from, to, outcome);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::enterState(StateHandle state)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (detail::METRICS_ENABLED && metrics_)
+  {
+    const auto t0 = detail::metricsTimestamp();
+    states_[state]->onEntry();
+    metrics_->on_entry[state].record(detail::metricsTimestamp() - t0);
+  }
+  else
+  {
+    states_[state]->onEntry();
+  }
+  const auto& timeout = timeouts_[state];
+  if (timeout.event != INVALID_EVENT)
+  {
+    startTimer(timeout.event, state, timeout.delay);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::exitState(StateHandle state)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (detail::METRICS_ENABLED && metrics_)
+  {
+    const auto t0 = detail::metricsTimestamp();
+    states_[state]->onExit();
+    metrics_->on_exit[state].record(detail::metricsTimestamp() - t0);
+  }
+  else
+  {
+    states_[state]->onExit();
+  }
+
+  // timer events of the state that are already queued are discarded by the epoch check in processEvents()
+  ++state_epochs_[state];
+  std::unique_lock<std::mutex> lk(concurrent_guard_, std::defer_lock);
+  if (concurrent_)
+  {
+    lk.lock();
+  }
+  if (!state_timers_.empty())
+  {
+    const auto expired = std::remove_if(state_timers_.begin(), state_timers_.end(),
+                                        [this, state](const std::pair<StateHandle, TimerId>& timer) {
+                                          if (timer.first != state)
+                                          {
+                                            return false;
+                                          }
+                                          config_.timer_wheel->cancel(timer.second);
+                                          return true;
+                                        });
+    state_timers_.erase(expired, state_timers_.end());
+  }
+  if (num_actions_ != 0)
+  {
+    cancelActions(state);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::TimerId Fsm::startTimer(EventHandle event, StateHandle scope, std::chrono::nanoseconds delay)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if ((event >= TAG_HANDLE_MASK) || ((scope != INVALID_STATE) && (scope >= TAG_MACHINE_SCOPE)))
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Timers support up to " << TAG_HANDLE_MASK << " states and events";  // NOLINT
+    throw FsmException(str.str());
+  }
+  if (exit_flag_.load(std::memory_order_acquire))
+  {
+    return TimerId{};  // the machine is being destroyed. See stop()
+  }
+  auto tag = static_cast<std::uint64_t>(event);
+  if (scope == INVALID_STATE)
+  {
+    tag |= TAG_MACHINE_SCOPE << TAG_HANDLE_BITS;
+  }
+  else
+  {
+    tag |= (static_cast<std::uint64_t>(scope) << TAG_HANDLE_BITS) |
+           (static_cast<std::uint64_t>(state_epochs_[scope]) << TAG_EPOCH_SHIFT);
+  }
+  const auto id = config_.timer_wheel->schedule(*this, delay, tag);
+  if (scope != INVALID_STATE)
+  {
+    std::unique_lock<std::mutex> lk(concurrent_guard_, std::defer_lock);
+    if (concurrent_)
+    {
+      lk.lock();
+    }
+
+    // forget timers that have fired before the list reallocates, so that a state that keeps restarting timers
+    // does not grow it without bound
+    if (state_timers_.size() == state_timers_.capacity())
+    {
+      const auto done = std::remove_if(state_timers_.begin(), state_timers_.end(),
+                                       [this](const std::pair<StateHandle, TimerId>& timer) {
+                                         return !config_.timer_wheel->isPending(timer.second);
+                                       });
+      state_timers_.erase(done, state_timers_.end());
+    }
+    state_timers_.emplace_back(scope, id);
+  }
+  return id;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::onTimer(std::uint64_t tag)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // the timer thread serves every machine, and must not run the callbacks of one. Work for an inline machine waits
+  // for its owner's next Fsm::raise() or Fsm::processPending()
+  const bool notify = (config_.dispatch_mode != DispatchMode::Inline);
+  const auto scope = (tag >> TAG_HANDLE_BITS) & TAG_HANDLE_MASK;
+  if ((tag & TAG_HANDLE_MASK) == TAG_ACTION)
+  {
+    resumeAction(static_cast<std::uint32_t>(scope), static_cast<std::uint16_t>(tag >> TAG_EPOCH_SHIFT), notify);
+    return;
+  }
+
+  detail::QueuedEvent item;
+  item.event = static_cast<EventHandle>(tag & TAG_HANDLE_MASK);
+  if (scope != TAG_MACHINE_SCOPE)
+  {
+    item.scope_state = static_cast<StateHandle>(scope);
+    item.scope_epoch = static_cast<std::uint16_t>(tag >> TAG_EPOCH_SHIFT);
+  }
+  enqueue(std::move(item), false, notify);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t Fsm::processEvents(std::size_t max_events)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto* const outer_fsm = t_dispatching_fsm;
+  const auto outer_region = t_dispatching_region;
+  t_dispatching_fsm = this;
+  t_dispatching_region = MAIN_REGION;
+
+  std::size_t count = 0;
+  bool idle = false;
+  detail::QueuedEvent item;
+  while (count < max_events)
+  {
+    if (actions_ready_.load(std::memory_order_acquire))
+    {
+      try
+      {
+        count += runActions();
+      }
+      catch (...)
+      {
+        t_dispatching_fsm = outer_fsm;
+        t_dispatching_region = outer_region;
+        throw;
+      }
+      t_dispatching_region = MAIN_REGION;
+      continue;
+    }
+    if (!popEvent(item))
+    {
+      // idle steps run once per call, so that the caller gets control back
+      if (idle || idle_actions_.empty())
+      {
+        break;
+      }
+      idle = true;
+      std::lock_guard<std::mutex> lk(ready_guard_);
+      ready_actions_.insert(ready_actions_.end(), idle_actions_.begin(), idle_actions_.end());
+      actions_ready_.store(true, std::memory_order_relaxed);
+      idle_actions_.clear();
+      continue;
+    }
+    ++count;
+    if (detail::METRICS_ENABLED && metrics_)
+    {
+      metrics_->events_processed.fetch_add(1, std::memory_order_relaxed);
+      metrics_->queue_latency.record(detail::metricsTimestamp() - item.enqueued_at);
+    }
+    event_payload_ = &item.payload;
+    try
+    {
+      // the event of a state scoped timer that fired just before its state was exited is stale
+      if ((item.scope_state == INVALID_STATE) || (state_epochs_[item.scope_state] == item.scope_epoch))
+      {
+        changeState(item.event);
+      }
+    }
+    catch (...)
+    {
+      event_payload_ = &NO_PAYLOAD;
+      pending_events_.fetch_sub(1, std::memory_order_release);
+      t_dispatching_fsm = outer_fsm;
+      t_dispatching_region = outer_region;
+      throw;
+    }
+    event_payload_ = &NO_PAYLOAD;
+    item.payload.reset();
+    pending_events_.fetch_sub(1, std::memory_order_release);
+  }
+
+  t_dispatching_fsm = outer_fsm;
+  t_dispatching_region = outer_region;
+  return count;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool Fsm::popEvent(detail::QueuedEvent& item)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // the counts spare the queues of other priorities a look on every event. An event counted but not yet pushed is
+  // picked up on a later call
+  if ((urgent_events_.load(std::memory_order_acquire) != 0) && urgent_queue_->tryPop(item))
+  {
+    urgent_events_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  if (event_batch_->tryPop(*event_queue_, item))
+  {
+    return true;
+  }
+  if ((low_events_.load(std::memory_order_acquire) != 0) && low_queue_->tryPop(item))
+  {
+    low_events_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool Fsm::hasQueuedEvents() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return (urgent_events_.load(std::memory_order_acquire) != 0) || !event_batch_->empty() ||
+         !event_queue_->empty() || (low_events_.load(std::memory_order_acquire) != 0);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t Fsm::dispatchInline(std::size_t max_events)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // whoever sets the scheduled_ flag owns the queue. Everyone else leaves their events to the owner
+  std::size_t count = 0;
+  while ((count < max_events) && !scheduled_.exchange(true, std::memory_order_acq_rel))
+  {
+    try
+    {
+      count += processEvents(max_events - count);
+    }
+    catch (...)
+    {
+      scheduled_.exchange(false, std::memory_order_acq_rel);
+      throw;
+    }
+    const auto idle_actions = idle_actions_.size();
+    scheduled_.exchange(false, std::memory_order_acq_rel);
+
+    // events raised by other threads while we owned the queue are ours to process. Idle action steps wait for the
+    // next call
+    if (pending_events_.load(std::memory_order_seq_cst) <= idle_actions)
+    {
+      break;
+    }
+  }
+  return count;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::schedule()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (!scheduled_.exchange(true, std::memory_order_acq_rel))
+  {
+    if (dispatch_error_)
+    {
+      return;  // dispatch has ended. The flag stays set, so that nobody posts another run
+    }
+    scheduled_runs_.fetch_add(1, std::memory_order_relaxed);
+    config_.executor->post([this, done = tasks_done_]() {
+      runScheduled();
+      done->notify();
+    });
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::runScheduled()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // the executor swallows exceptions, and the run must be accounted for whatever happens, or stop() waits forever
+  try
+  {
+    processEvents(EXECUTOR_QUANTUM);
+  }
+  catch (...)
+  {
+    // dispatch ends, as it does when an exception ends the event handler thread
+    dispatch_error_ = std::current_exception();
+  }
+  scheduled_.exchange(false, std::memory_order_acq_rel);  // synchronises with a schedule() that saw us busy
+
+  // pick up events raised while we were busy, or left over from the quantum. Once the machine is stopping, the queue
+  // is drained as by the event handler thread, and actions waiting for idle time are not run again
+  const bool more = exit_flag_.load(std::memory_order_acquire)
+                        ? hasQueuedEvents()
+                        : (pending_events_.load(std::memory_order_seq_cst) != 0);
+  if (!dispatch_error_ && more)
+  {
+    schedule();
+  }
+  scheduled_runs_.fetch_sub(1, std::memory_order_release);  // must be the last access to this object
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::eventHandler()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  while (true)
+  {
+    processEvents(std::numeric_limits<std::size_t>::max());
+
+    if (exit_flag_)
+    {
+      return;
+    }
+
+    const auto key = event_signal_->prepareWait();
+    if (hasQueuedEvents() || actions_ready_.load(std::memory_order_acquire) || !idle_actions_.empty() || exit_flag_)
+    {
+      event_signal_->cancelWait();
+      continue;
     }
+    event_signal_->wait(key);
   }
 }
 }  // namespace fsm
@@ -0,0 +1,202 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/fsm.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace fsm
+{
+namespace
+{
+/// Quote a string for the DOT language
+//----------------------------------------------------------------------------------------------------------------------
+std::string quote(const std::string& text)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::string quoted = "\"";
+  for (const auto c : text)
+  {
+    if (c == '\n')
+    {
+      quoted += "\\n";
+      continue;
+    }
+    if ((c == '"') || (c == '\\'))
+    {
+      quoted += '\\';
+    }
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+/// Write a delay in the largest unit that keeps it exact
+//----------------------------------------------------------------------------------------------------------------------
+std::string formatDelay(std::chrono::nanoseconds delay)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto ns = delay.count();
+  if ((ns != 0) && (ns % 1000000000 == 0))
+  {
+    return std::to_string(ns / 1000000000) + "s";
+  }
+  if ((ns != 0) && (ns % 1000000 == 0))
+  {
+    return std::to_string(ns / 1000000) + "ms";
+  }
+  if ((ns != 0) && (ns % 1000 == 0))
+  {
+    return std::to_string(ns / 1000) + "us";
+  }
+  return std::to_string(ns) + "ns";
+}
+}  // namespace
+
+//======================================================================================================================
+void Fsm::exportDot(std::ostream& out) const
+//======================================================================================================================
+{
+  const auto num_states = static_cast<StateHandle>(states_.size());
+  std::vector<std::vector<StateHandle>> children(num_states);
+  std::vector<std::vector<StateHandle>> region_roots(regions_.size());
+  for (StateHandle state = 0; state < num_states; ++state)
+  {
+    if (parents_[state] != INVALID_STATE)
+    {
+      children[parents_[state]].push_back(state);
+    }
+    else
+    {
+      region_roots[state_regions_[state]].push_back(state);
+    }
+  }
+
+  std::vector<bool> active(num_states, false);
+  if (isRunning())
+  {
+    for (RegionHandle region = 0; region < regions_.size(); ++region)
+    {
+      for (auto state = visibleState(region); state != INVALID_STATE; state = parents_[state])
+      {
+        active[state] = true;
+      }
+    }
+  }
+
+  const auto label = [this](StateHandle state) {
+    auto text = states_[state]->getId();
+    if ((state < timeouts_.size()) && (timeouts_[state].event != INVALID_EVENT))
+    {
+      text += "\nafter " + formatDelay(timeouts_[state].delay) + " / " + events_[timeouts_[state].event];
+    }
+    return quote(text);
+  };
+
+  const auto is_within = [this](StateHandle state, StateHandle ancestor) {
+    for (; state != INVALID_STATE; state = parents_[state])
+    {
+      if (state == ancestor)
+      {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // composite states are clusters, with an invisible point for edges to attach to
+  std::vector<StateHandle> stack;
+  const auto write_state = [&](StateHandle root, const std::string& root_indent) {
+    stack.push_back(root);
+    std::vector<std::string> indents{ root_indent };
+    while (!stack.empty())
+    {
+      const auto state = stack.back();
+      const auto& indent = indents.back();
+      if (state == INVALID_STATE)
+      {
+        stack.pop_back();
+        indents.pop_back();
+        out << indents.back() << "}\n";
+        continue;
+      }
+      stack.pop_back();
+      if (children[state].empty())
+      {
+        out << indent << "s" << state << " [label=" << label(state) << (active[state] ? ", style=\"rounded,bold\"" : "")
+            << "];\n";
+        continue;
+      }
+      out << indent << "subgraph cluster_s" << state << " {\n";
+      out << indent << "  label=" << label(state) << ";\n";
+      out << indent << "  style=" << (active[state] ? "\"rounded,bold\"" : "rounded") << ";\n";
+      out << indent << "  s" << state << " [shape=point, style=invis];\n";
+      stack.push_back(INVALID_STATE);
+      for (auto it = children[state].rbegin(); it != children[state].rend(); ++it)
+      {
+        stack.push_back(*it);
+      }
+      indents.push_back(indent + "  ");
+    }
+  };
+
+  out << "digraph fsm {\n";
+  out << "  compound=true;\n";
+  out << "  node [shape=box, style=rounded];\n";
+  for (RegionHandle region = 0; region < regions_.size(); ++region)
+  {
+    std::string indent = "  ";
+    if (regions_.size() > 1)
+    {
+      out << "  subgraph cluster_region" << region << " {\n";
+      out << "    label=" << quote(regions_[region].name) << ";\n";
+      out << "    style=dashed;\n";
+      indent += "  ";
+    }
+    for (const auto root : region_roots[region])
+    {
+      write_state(root, indent);
+    }
+    const auto initial = state_handles_.find(regions_[region].initial_state);
+    if (initial != state_handles_.end())
+    {
+      out << indent << "init" << region << " [shape=point];\n";
+      out << indent << "init" << region << " -> s" << initial->second
+          << (children[initial->second].empty() ? "" : " [lhead=cluster_s" + std::to_string(initial->second) + "]")
+          << ";\n";
+    }
+    if (regions_.size() > 1)
+    {
+      out << "  }\n";
+    }
+  }
+
+  for (std::size_t rule = 0; rule < transitions_.size(); ++rule)
+  {
+    const auto& transition = transitions_[rule];
+    std::string attributes = "label=" + quote(events_[transition.event] + (transition.guard ? " [guard]" : ""));
+    if (!children[transition.from_state].empty() &&
+        (transition.transit || !is_within(transition.to_state, transition.from_state)))
+    {
+      attributes += ", ltail=cluster_s" + std::to_string(transition.from_state);
+    }
+    if (transition.transit)
+    {
+      out << "  f" << rule << " [shape=point, label=\"\"];\n";
+      out << "  s" << transition.from_state << " -> f" << rule << " [" << attributes << ", style=dashed];\n";
+      continue;
+    }
+    if (!children[transition.to_state].empty() && !is_within(transition.from_state, transition.to_state))
+    {
+      attributes += ", lhead=cluster_s" + std::to_string(transition.to_state);
+    }
+    out << "  s" << transition.from_state << " -> s" << transition.to_state << " [" << attributes << "];\n";
+  }
+  out << "}\n";
+}
+
+}  // namespace fsm
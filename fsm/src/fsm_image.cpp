@@ -0,0 +1,574 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/fsm.h"
+#include "event_queue.h"
+#include "fsm/definition.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <sstream>
+
+namespace fsm
+{
+namespace
+{
+constexpr char IMAGE_MAGIC[8] = { 'F', 'S', 'M', 'I', 'M', 'A', 'G', 'E' };
+constexpr std::uint32_t IMAGE_VERSION = 2;
+constexpr std::uint32_t IMAGE_BYTE_ORDER = 0x01020304;
+constexpr std::size_t IMAGE_ALIGNMENT = 8;
+
+/// Start of a machine image. Followed by these sections, each starting at a multiple of 8 bytes:
+/// - timeout delays in nanoseconds, 64 bit, by state
+/// - parents, regions and timeout events, 32 bit, by state
+/// - offsets of the rows of the transition table by state, then columns by event, 32 bit
+/// - the transition table, 32 bit, by row and column
+/// - rules, as 32 bit triplets of source state, event and target state
+/// - compiled transitions, as 32 bit rule and path, and 16 bit exit and entry counts
+/// - exit and entry paths, 32 bit
+/// - regions, as 32 bit pairs of initial and active state
+/// - pending events, 32 bit
+/// - event priorities, 8 bit
+/// - names of the states, events and regions, each a 32 bit length followed by the characters
+struct ImageHeader
+{
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;  //!< IMAGE_BYTE_ORDER, as laid out by the platform that saved the image
+  std::uint32_t num_states;
+  std::uint32_t num_events;
+  std::uint32_t num_regions;
+  std::uint32_t num_rules;
+  std::uint32_t num_compiled;
+  std::uint32_t num_path_states;
+  std::uint32_t num_pending;
+  std::uint32_t table_size;  //!< entries of the transition table
+  std::uint64_t size;  //!< of the whole image in bytes
+};
+static_assert(sizeof(ImageHeader) == 56, "ImageHeader is part of the image format");
+
+//======================================================================================================================
+/// Appends sections to an image
+class ImageWriter
+{
+public:
+  explicit ImageWriter(std::vector<std::uint8_t>& image) : image_(image)
+  {
+  }
+
+  /// Start a section at the next multiple of IMAGE_ALIGNMENT
+  void align()
+  {
+    image_.resize((image_.size() + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT, 0);
+  }
+
+  template <typename T>
+  void write(const T& value)
+  {
+    write(&value, 1);
+  }
+
+  template <typename T>
+  void write(const T* values, std::size_t count)
+  {
+    const auto offset = image_.size();
+    image_.resize(offset + count * sizeof(T));
+    if (count != 0)
+    {
+      std::memcpy(&image_[offset], values, count * sizeof(T));
+    }
+  }
+
+  void writeName(const std::string& name)
+  {
+    write(static_cast<std::uint32_t>(name.size()));
+    image_.insert(image_.end(), name.begin(), name.end());
+  }
+
+private:
+  std::vector<std::uint8_t>& image_;
+};
+
+//======================================================================================================================
+/// Reads sections of an image, which need not be aligned, checking that they stay within it
+class ImageReader
+{
+public:
+  ImageReader(const void* image, std::size_t size) : image_(static_cast<const std::uint8_t*>(image)), size_(size)
+  {
+  }
+
+  void align()
+  {
+    offset_ = (offset_ + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+  }
+
+  template <typename T>
+  T read()
+  {
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  std::string readName()
+  {
+    const auto length = read<std::uint32_t>();
+    const auto* const chars = reinterpret_cast<const char*>(take(length));  // NOLINT
+    return std::string(chars, length);
+  }
+
+private:
+  const std::uint8_t* take(std::size_t bytes)
+  {
+    if ((offset_ > size_) || (bytes > size_ - offset_))
+    {
+      std::stringstream str;
+      str << "[" << __FUNCTION__ << "] Machine image is truncated";  // NOLINT
+      throw FsmException(str.str());
+    }
+    const auto* const data = image_ + offset_;  // NOLINT
+    offset_ += bytes;
+    return data;
+  }
+
+private:
+  const std::uint8_t* image_;
+  std::size_t size_;
+  std::size_t offset_{ 0 };
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+[[noreturn]] void throwCorrupt(const char* function, const char* what)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::stringstream str;
+  str << "[" << function << "] Machine image is corrupt: " << what;  // NOLINT
+  throw FsmException(str.str());
+}
+}  // namespace
+
+//======================================================================================================================
+std::vector<std::uint8_t> Fsm::saveImage() const
+//======================================================================================================================
+{
+  if (!isRunning())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Only running machines can be saved";  // NOLINT
+    throw FsmException(str.str());
+  }
+  if (isDispatching() || ((config_.dispatch_mode != DispatchMode::Manual) && hasPendingEvents()))
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Machine must be between events to be saved";  // NOLINT
+    throw FsmException(str.str());
+  }
+  for (const auto& tr : transitions_)
+  {
+    if (tr.transit || tr.guard)
+    {
+      std::stringstream str;
+      str << "[" << __FUNCTION__ << "] Rule for event \"" << events_[tr.event] << "\" in state \""  // NOLINT
+          << states_[tr.from_state]->getId() << "\" has a function, which cannot be saved";
+      throw FsmException(str.str());
+    }
+  }
+
+  std::vector<EventHandle> pending;
+  if (config_.dispatch_mode == DispatchMode::Manual)
+  {
+    if (urgent_queue_)
+    {
+      urgent_queue_->peek(pending);
+    }
+    event_batch_->peek(pending);
+    event_queue_->peek(pending);
+    if (low_queue_)
+    {
+      low_queue_->peek(pending);
+    }
+  }
+
+  const auto num_states = states_.size();
+  ImageHeader header{};
+  std::memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+  header.version = IMAGE_VERSION;
+  header.byte_order = IMAGE_BYTE_ORDER;
+  header.num_states = static_cast<std::uint32_t>(num_states);
+  header.num_events = static_cast<std::uint32_t>(num_events_);
+  header.num_regions = static_cast<std::uint32_t>(regions_.size());
+  header.num_rules = static_cast<std::uint32_t>(transitions_.size());
+  header.num_compiled = static_cast<std::uint32_t>(compiled_.size());
+  header.num_path_states = static_cast<std::uint32_t>(path_states_.size());
+  header.num_pending = static_cast<std::uint32_t>(pending.size());
+  header.table_size = static_cast<std::uint32_t>(transition_table_.size());
+
+  std::size_t names_size = 0;
+  for (const auto& state : states_)
+  {
+    names_size += sizeof(std::uint32_t) + state->getId().size();
+  }
+  for (const auto& event : events_)
+  {
+    names_size += sizeof(std::uint32_t) + event.size();
+  }
+  std::vector<std::uint8_t> image;
+  image.reserve(sizeof(ImageHeader) + num_states * 24 + num_events_ * 5 + transition_table_.size() * 4 +
+                transitions_.size() * 12 + compiled_.size() * 12 + path_states_.size() * 4 + regions_.size() * 64 +
+                pending.size() * 4 + names_size + 9 * IMAGE_ALIGNMENT);
+  ImageWriter out(image);
+  out.write(header);
+  out.align();
+  for (const auto& timeout : timeouts_)
+  {
+    out.write(static_cast<std::int64_t>(timeout.delay.count()));
+  }
+  out.align();
+  out.write(parents_.data(), parents_.size());
+  out.write(state_regions_.data(), state_regions_.size());
+  for (const auto& timeout : timeouts_)
+  {
+    out.write(timeout.event);
+  }
+  out.align();
+  out.write(table_rows_.data(), table_rows_.size());
+  out.write(event_columns_.data(), event_columns_.size());
+  out.align();
+  out.write(transition_table_.data(), transition_table_.size());
+  out.align();
+  for (const auto& tr : transitions_)
+  {
+    out.write(tr.from_state);
+    out.write(tr.event);
+    out.write(tr.to_state);
+  }
+  out.align();
+  for (const auto& ct : compiled_)
+  {
+    out.write(ct.rule);
+    out.write(ct.path);
+    out.write(ct.num_exits);
+    out.write(ct.num_entries);
+  }
+  out.align();
+  out.write(path_states_.data(), path_states_.size());
+  out.align();
+  for (RegionHandle region = 0; region < regions_.size(); ++region)
+  {
+    out.write(state_handles_.find(regions_[region].initial_state)->second);
+    out.write(visibleState(region));
+  }
+  out.align();
+  out.write(pending.data(), pending.size());
+  out.align();
+  for (const auto priority : event_priorities_)
+  {
+    out.write(static_cast<std::uint8_t>(priority));
+  }
+  out.align();
+  for (const auto& state : states_)
+  {
+    out.writeName(state->getId());
+  }
+  for (const auto& event : events_)
+  {
+    out.writeName(event);
+  }
+  for (const auto& region : regions_)
+  {
+    out.writeName(region.name);
+  }
+  out.align();
+
+  header.size = image.size();
+  std::memcpy(image.data(), &header, sizeof(header));
+  return image;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::restore(const void* image, std::size_t size, const StateFactory& make_state)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  Vector<StateHandle> active_states(config_.memory_resource.get());
+  std::vector<EventHandle> pending;
+  loadImage(image, size, make_state, active_states, pending);
+
+  // resume where the saved machine was
+  setUpDispatch();
+  for (RegionHandle region = 0; region < regions_.size(); ++region)
+  {
+    publishState(region, INVALID_STATE);
+    for (auto state = active_states[region]; state != INVALID_STATE; state = parents_[state])
+    {
+      if (timeouts_[state].event != INVALID_EVENT)
+      {
+        startTimer(timeouts_[state].event, state, timeouts_[state].delay);
+      }
+    }
+  }
+  enqueueEvents(pending.data(), pending.data() + pending.size(), false, false);
+  launch();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::start(const Definition& definition, const StateFactory& make_state)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto& image = definition.getImage();
+  Vector<StateHandle> active_states(config_.memory_resource.get());
+  std::vector<EventHandle> pending;
+  loadImage(image.data(), image.size(), make_state, active_states, pending);
+
+  Vector<StateHandle> initial_states(config_.memory_resource.get());
+  for (const auto& region : regions_)
+  {
+    initial_states.push_back(state_handles_.find(region.initial_state)->second);
+  }
+  setUpDispatch();
+  enterInitialStates(initial_states);
+  launch();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Fsm::loadImage(const void* image, std::size_t size, const StateFactory& make_state,
+                    Vector<StateHandle>& active_states, std::vector<EventHandle>& pending)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (isRunning() || !states_.empty() || !events_.empty() || (regions_.size() > 1))
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Only a machine with nothing defined can be restored";  // NOLINT
+    throw FsmException(str.str());
+  }
+
+  ImageReader in(image, size);
+  const auto header = in.read<ImageHeader>();
+  if ((std::memcmp(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0) || (header.version != IMAGE_VERSION) ||
+      (header.byte_order != IMAGE_BYTE_ORDER))
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Not a machine image of a supported version and platform";  // NOLINT
+    throw FsmException(str.str());
+  }
+  if (header.size > size)
+  {
+    throwCorrupt(__FUNCTION__, "truncated");  // NOLINT
+  }
+  // every element takes at least 4 bytes of the image, which bounds what the counts can make us allocate
+  const std::size_t num_states = header.num_states;
+  const std::size_t num_events = header.num_events;
+  const std::size_t num_regions = header.num_regions;
+  const auto max_elements = size / sizeof(std::uint32_t);
+  if ((num_regions == 0) || (num_states < num_regions) || (num_states > max_elements) ||
+      ((num_events != 0) && (num_states > max_elements / num_events)) || (num_events > max_elements) ||
+      (header.num_rules > max_elements) || (header.num_compiled > max_elements) ||
+      (header.num_path_states > max_elements) || (header.num_pending > max_elements) ||
+      (header.table_size == 0) || (header.table_size > max_elements))
+  {
+    throwCorrupt(__FUNCTION__, "inconsistent sizes");  // NOLINT
+  }
+  const auto check = [](bool valid, const char* what) {
+    if (!valid)
+    {
+      throwCorrupt("restore", what);
+    }
+  };
+
+  // read into these first, so that a damaged image leaves the machine as it was
+  auto* const resource = config_.memory_resource.get();
+  Vector<StateTimeout> timeouts(resource);
+  Vector<StateHandle> parents(resource);
+  Vector<RegionHandle> state_regions(resource);
+  Vector<std::uint32_t> table_rows(resource);
+  Vector<std::uint32_t> event_columns(resource);
+  Vector<std::uint32_t> transition_table(resource);
+  Vector<Transition> transitions(resource);
+  Vector<CompiledTransition> compiled(resource);
+  Vector<StateHandle> path_states(resource);
+  Vector<EventPriority> event_priorities(resource);
+  Vector<std::shared_ptr<State>> states(resource);
+  Map<State::Id, StateHandle> state_handles(resource);
+  Vector<Event> events(resource);
+  Map<Event, EventHandle> event_handles(resource);
+  Vector<Region> regions(resource);
+
+  // the definition, with each handle checked to be in range instead of rules being validated one by one
+  in.align();
+  timeouts.resize(num_states);
+  for (auto& timeout : timeouts)
+  {
+    timeout.delay = std::chrono::nanoseconds(in.read<std::int64_t>());
+  }
+  in.align();
+  parents.resize(num_states);
+  for (auto& parent : parents)
+  {
+    parent = in.read<StateHandle>();
+    check((parent < num_states) || (parent == INVALID_STATE), "parent state");
+  }
+  {
+    // ancestors are walked up to the root, which a cycle would never reach
+    std::vector<std::uint8_t> reaches_root(num_states, 0);
+    for (StateHandle state = 0; state < num_states; ++state)
+    {
+      std::size_t depth = 0;
+      for (auto s = state; (s != INVALID_STATE) && (reaches_root[s] == 0); s = parents[s])
+      {
+        check(++depth <= num_states, "parent states form a cycle");
+      }
+      for (auto s = state; (s != INVALID_STATE) && (reaches_root[s] == 0); s = parents[s])
+      {
+        reaches_root[s] = 1;
+      }
+    }
+  }
+  state_regions.resize(num_states);
+  for (auto& region : state_regions)
+  {
+    region = in.read<RegionHandle>();
+    check(region < num_regions, "region of state");
+  }
+  for (auto& timeout : timeouts)
+  {
+    timeout.event = in.read<EventHandle>();
+    check((timeout.event < num_events) || (timeout.event == INVALID_EVENT), "timeout event");
+  }
+  // every row has room for every column
+  in.align();
+  table_rows.resize(num_states);
+  for (auto& row : table_rows)
+  {
+    row = in.read<std::uint32_t>();
+  }
+  std::uint32_t max_column = 0;
+  event_columns.resize(num_events);
+  for (auto& column : event_columns)
+  {
+    column = in.read<std::uint32_t>();
+    check(column < header.table_size, "transition table column");
+    max_column = std::max(max_column, column);
+  }
+  for (const auto row : table_rows)
+  {
+    check(row < header.table_size - max_column, "transition table row");
+  }
+  in.align();
+  transition_table.resize(header.table_size);
+  for (auto& entry : transition_table)
+  {
+    entry = in.read<std::uint32_t>();
+    check((entry < header.num_compiled) || (entry == NO_TRANSITION), "transition table");
+  }
+  in.align();
+  transitions.reserve(header.num_rules);
+  for (std::uint32_t i = 0; i < header.num_rules; ++i)
+  {
+    const auto from_state = in.read<StateHandle>();
+    const auto event = in.read<EventHandle>();
+    const auto to_state = in.read<StateHandle>();
+    check((from_state < num_states) && (event < num_events) && (to_state < num_states), "rule");
+    transitions.push_back(Transition{ from_state, event, to_state, TransitionDelegate(), GuardDelegate() });
+  }
+  in.align();
+  compiled.resize(header.num_compiled);
+  for (auto& ct : compiled)
+  {
+    ct.rule = in.read<std::uint32_t>();
+    ct.path = in.read<std::uint32_t>();
+    ct.num_exits = in.read<std::uint16_t>();
+    ct.num_entries = in.read<std::uint16_t>();
+    check((ct.rule < header.num_rules) &&
+              (std::size_t{ ct.path } + ct.num_exits + ct.num_entries <= header.num_path_states),
+          "compiled transition");
+  }
+  in.align();
+  path_states.resize(header.num_path_states);
+  for (auto& state : path_states)
+  {
+    state = in.read<StateHandle>();
+    check(state < num_states, "transition path");
+  }
+  in.align();
+  std::vector<StateHandle> initial_states(num_regions);
+  active_states.resize(num_regions);
+  for (std::size_t region = 0; region < num_regions; ++region)
+  {
+    initial_states[region] = in.read<StateHandle>();
+    active_states[region] = in.read<StateHandle>();
+    check((initial_states[region] < num_states) && (active_states[region] < num_states) &&
+              (state_regions[active_states[region]] == region),
+          "region");
+  }
+  in.align();
+  pending.resize(header.num_pending);
+  for (auto& event : pending)
+  {
+    event = in.read<EventHandle>();
+    check(event < num_events, "pending event");
+  }
+  in.align();
+  event_priorities.resize(num_events);
+  for (auto& priority : event_priorities)
+  {
+    const auto value = in.read<std::uint8_t>();
+    check(value <= static_cast<std::uint8_t>(EventPriority::Low), "event priority");
+    priority = static_cast<EventPriority>(value);
+  }
+
+  // names, and the objects behind them
+  in.align();
+  states.reserve(num_states);
+  state_handles.reserve(num_states);
+  for (StateHandle handle = 0; handle < num_states; ++handle)
+  {
+    auto id = in.readName();
+    auto state = make_state(*this, id);
+    if (!state || (state->getId() != id))
+    {
+      std::stringstream str;
+      str << "[" << __FUNCTION__ << "] State factory did not create state \"" << id << "\"";  // NOLINT
+      throw FsmException(str.str());
+    }
+    check(state_handles.emplace(std::move(id), handle).second, "duplicate state name");
+    states.push_back(std::move(state));
+  }
+  events.reserve(num_events);
+  event_handles.reserve(num_events);
+  for (EventHandle handle = 0; handle < num_events; ++handle)
+  {
+    events.push_back(in.readName());
+    check(event_handles.emplace(events.back(), handle).second, "duplicate event name");
+  }
+  for (std::size_t region = 0; region < num_regions; ++region)
+  {
+    regions.push_back(Region{ in.readName(), states[initial_states[region]]->getId(), active_states[region],
+                               Vector<StateHandle>(resource), INVALID_STATE, false, nullptr });
+  }
+
+  // the image is sound
+  timeouts_.swap(timeouts);
+  parents_.swap(parents);
+  state_regions_.swap(state_regions);
+  table_rows_.swap(table_rows);
+  event_columns_.swap(event_columns);
+  transition_table_.swap(transition_table);
+  transitions_.swap(transitions);
+  compiled_.swap(compiled);
+  path_states_.swap(path_states);
+  event_priorities_.swap(event_priorities);
+  states_.swap(states);
+  state_handles_.swap(state_handles);
+  events_.swap(events);
+  event_handles_.swap(event_handles);
+  regions_.swap(regions);
+  published_states_.reset(new std::atomic<std::uint64_t>[num_regions]);
+  num_events_ = num_events;
+  state_epochs_.assign(num_states, 0);
+  // rules_ only serves to reject duplicate rules while the machine is defined, and stays empty
+}
+
+}  // namespace fsm
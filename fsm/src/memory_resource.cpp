@@ -0,0 +1,300 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/memory_resource.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace fsm
+{
+constexpr std::size_t MemoryResource::MAX_ALIGNMENT;
+constexpr std::size_t PoolResource::MIN_BLOCK_SIZE;
+
+namespace
+{
+/// Bytes to skip from ptr to the next address aligned to alignment, a power of two
+std::size_t alignmentPadding(const void* ptr, std::size_t alignment)
+{
+  return (alignment - (reinterpret_cast<std::uintptr_t>(ptr) & (alignment - 1U))) & (alignment - 1U);  // NOLINT
+}
+
+//======================================================================================================================
+/// Allocates with operator new. Over-aligned requests are padded, with the address returned by operator new kept
+/// just before the aligned address
+class HeapResource : public MemoryResource
+{
+protected:
+  void* doAllocate(std::size_t bytes, std::size_t alignment) override
+  {
+    if (alignment <= MAX_ALIGNMENT)
+    {
+      return ::operator new(bytes);
+    }
+    auto* raw = static_cast<char*>(::operator new(bytes + alignment + sizeof(void*)));
+    auto* aligned = raw + sizeof(void*);
+    aligned += alignmentPadding(aligned, alignment);
+    reinterpret_cast<void**>(aligned)[-1] = raw;  // NOLINT
+    return aligned;
+  }
+
+  void doDeallocate(void* ptr, std::size_t /*bytes*/, std::size_t alignment) override
+  {
+    if (alignment <= MAX_ALIGNMENT)
+    {
+      ::operator delete(ptr);
+      return;
+    }
+    ::operator delete(static_cast<void**>(ptr)[-1]);  // NOLINT
+  }
+};
+}  // namespace
+
+//======================================================================================================================
+MemoryResource::~MemoryResource() = default;
+//======================================================================================================================
+
+//----------------------------------------------------------------------------------------------------------------------
+std::shared_ptr<MemoryResource> MemoryResource::getDefault()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  static const std::shared_ptr<MemoryResource> heap = std::make_shared<HeapResource>();
+  return heap;
+}
+
+//======================================================================================================================
+/// Header of a block obtained from upstream, followed by the memory handed out
+struct MonotonicArena::Block
+{
+  Block* next;
+  std::size_t size;  //!< including the header
+};
+
+//======================================================================================================================
+MonotonicArena::MonotonicArena(void* buffer, std::size_t size, std::shared_ptr<MemoryResource> upstream)
+  : buffer_(static_cast<char*>(buffer))
+  , buffer_size_(size)
+  , upstream_(std::move(upstream))
+  , blocks_(nullptr)
+  , cursor_(buffer_)
+  , remaining_(size)
+  , next_block_size_(std::max<std::size_t>(size, 1024))
+  , used_(0)
+//======================================================================================================================
+{
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+MonotonicArena::MonotonicArena(std::size_t initial_size, std::shared_ptr<MemoryResource> upstream)
+  : MonotonicArena(nullptr, 0, std::move(upstream))
+//----------------------------------------------------------------------------------------------------------------------
+{
+  next_block_size_ = std::max<std::size_t>(initial_size, sizeof(Block) + MAX_ALIGNMENT);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+MonotonicArena::~MonotonicArena()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  release();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void MonotonicArena::release()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lk(guard_);
+  while (blocks_ != nullptr)
+  {
+    auto* const block = blocks_;
+    blocks_ = block->next;
+    upstream_->deallocate(block, block->size, MAX_ALIGNMENT);
+  }
+  cursor_ = buffer_;
+  remaining_ = buffer_size_;
+  used_ = 0;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t MonotonicArena::getBytesUsed() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lk(guard_);
+  return used_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void* MonotonicArena::doAllocate(std::size_t bytes, std::size_t alignment)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lk(guard_);
+  bytes = std::max<std::size_t>(bytes, 1);
+  auto padding = alignmentPadding(cursor_, alignment);
+  if (padding + bytes > remaining_)
+  {
+    addBlock(bytes + alignment);
+    padding = alignmentPadding(cursor_, alignment);
+  }
+  auto* const ptr = cursor_ + padding;
+  cursor_ += padding + bytes;
+  remaining_ -= padding + bytes;
+  used_ += padding + bytes;
+  return ptr;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void MonotonicArena::doDeallocate(void* /*ptr*/, std::size_t /*bytes*/, std::size_t /*alignment*/)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // reclaimed by release()
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void MonotonicArena::addBlock(std::size_t min_size)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (!upstream_)
+  {
+    throw std::bad_alloc();
+  }
+  const auto size = std::max(next_block_size_, min_size + sizeof(Block));
+  auto* const block = static_cast<Block*>(upstream_->allocate(size, MAX_ALIGNMENT));
+  block->next = blocks_;
+  block->size = size;
+  blocks_ = block;
+  cursor_ = reinterpret_cast<char*>(block) + sizeof(Block);  // NOLINT
+  remaining_ = size - sizeof(Block);
+  next_block_size_ = size * 2;
+}
+
+//======================================================================================================================
+/// A block on the free list of a pool
+struct PoolResource::FreeBlock
+{
+  FreeBlock* next;
+};
+
+//======================================================================================================================
+/// Header of a chunk obtained from upstream, followed by its blocks
+struct PoolResource::Chunk
+{
+  Chunk* next;
+  std::size_t size;  //!< including the header
+};
+
+//======================================================================================================================
+PoolResource::PoolResource(std::size_t largest_block, std::shared_ptr<MemoryResource> upstream)
+  : upstream_(std::move(upstream)), chunks_(nullptr)
+//======================================================================================================================
+{
+  for (std::size_t size = MIN_BLOCK_SIZE; size / 2 < std::max(largest_block, MIN_BLOCK_SIZE); size *= 2)
+  {
+    free_lists_.push_back(nullptr);
+    chunk_blocks_.push_back(std::max<std::size_t>(4096 / size, 1));
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+PoolResource::~PoolResource()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  while (chunks_ != nullptr)
+  {
+    auto* const chunk = chunks_;
+    chunks_ = chunk->next;
+    upstream_->deallocate(chunk, chunk->size, MAX_ALIGNMENT);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void PoolResource::reserve(std::size_t bytes, std::size_t count)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto pool = poolIndex(bytes, 1);
+  if ((pool < free_lists_.size()) && (count != 0))
+  {
+    std::lock_guard<std::mutex> lk(guard_);
+    addChunk(pool, count);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void* PoolResource::doAllocate(std::size_t bytes, std::size_t alignment)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto pool = poolIndex(bytes, alignment);
+  if (pool >= free_lists_.size())
+  {
+    return upstream_->allocate(bytes, alignment);
+  }
+  std::lock_guard<std::mutex> lk(guard_);
+  if (free_lists_[pool] == nullptr)
+  {
+    // chunks grow with demand, up to a megabyte
+    const auto num_blocks = chunk_blocks_[pool];
+    addChunk(pool, num_blocks);
+    chunk_blocks_[pool] = std::max<std::size_t>(std::min(num_blocks * 2, (1U << 20U) / (MIN_BLOCK_SIZE << pool)), 1);
+  }
+  auto* const block = free_lists_[pool];
+  free_lists_[pool] = block->next;
+  return block;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void PoolResource::doDeallocate(void* ptr, std::size_t bytes, std::size_t alignment)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto pool = poolIndex(bytes, alignment);
+  if (pool >= free_lists_.size())
+  {
+    upstream_->deallocate(ptr, bytes, alignment);
+    return;
+  }
+  std::lock_guard<std::mutex> lk(guard_);
+  auto* const block = static_cast<FreeBlock*>(ptr);
+  block->next = free_lists_[pool];
+  free_lists_[pool] = block;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t PoolResource::poolIndex(std::size_t bytes, std::size_t alignment) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (alignment > MAX_ALIGNMENT)
+  {
+    return free_lists_.size();
+  }
+  const auto size = std::max(bytes, alignment);
+  std::size_t pool = 0;
+  while ((pool < free_lists_.size()) && ((MIN_BLOCK_SIZE << pool) < size))
+  {
+    ++pool;
+  }
+  return pool;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void PoolResource::addChunk(std::size_t pool, std::size_t num_blocks)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // blocks start at a multiple of MAX_ALIGNMENT
+  const auto header = (sizeof(Chunk) + MAX_ALIGNMENT - 1) / MAX_ALIGNMENT * MAX_ALIGNMENT;
+  const auto block_size = MIN_BLOCK_SIZE << pool;
+  const auto size = header + block_size * num_blocks;
+  auto* const chunk = static_cast<Chunk*>(upstream_->allocate(size, MAX_ALIGNMENT));
+  chunk->next = chunks_;
+  chunk->size = size;
+  chunks_ = chunk;
+
+  auto* const blocks = reinterpret_cast<char*>(chunk) + header;  // NOLINT
+  for (std::size_t i = num_blocks; i-- > 0;)
+  {
+    auto* const block = reinterpret_cast<FreeBlock*>(blocks + i * block_size);  // NOLINT
+    block->next = free_lists_[pool];
+    free_lists_[pool] = block;
+  }
+}
+
+}  // namespace fsm
@@ -0,0 +1,141 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/metrics.h"
+#include "metrics_recorder.h"
+
+#include <algorithm>
+
+namespace fsm
+{
+constexpr unsigned Histogram::SUB_BUCKET_BITS;
+constexpr std::size_t Histogram::NUM_BUCKETS;
+
+//======================================================================================================================
+std::size_t Histogram::bucketOf(std::uint64_t value)
+//======================================================================================================================
+{
+  constexpr std::uint64_t SUB_BUCKETS = 1U << SUB_BUCKET_BITS;
+  if (value < SUB_BUCKETS)
+  {
+    return static_cast<std::size_t>(value);
+  }
+  const auto magnitude = 63U - static_cast<unsigned>(__builtin_clzll(value));
+  const auto sub_bucket = (value >> (magnitude - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1U);
+  return static_cast<std::size_t>(((magnitude - SUB_BUCKET_BITS + 1U) << SUB_BUCKET_BITS) | sub_bucket);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::uint64_t Histogram::bucketUpperBound(std::size_t bucket)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  constexpr std::uint64_t SUB_BUCKETS = 1U << SUB_BUCKET_BITS;
+  if (bucket < SUB_BUCKETS)
+  {
+    return bucket;
+  }
+  const auto magnitude = static_cast<unsigned>(bucket >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1U;
+  const auto width = std::uint64_t{ 1 } << (magnitude - SUB_BUCKET_BITS);
+  const auto lower = (SUB_BUCKETS | (bucket & (SUB_BUCKETS - 1U))) * width;
+  return lower + (width - 1U);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::uint64_t Histogram::percentile(double p) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (count == 0)
+  {
+    return 0;
+  }
+  const auto rank = static_cast<std::uint64_t>(p * static_cast<double>(count));
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < buckets.size(); ++i)
+  {
+    seen += buckets[i];
+    if ((seen > rank) || (seen == count))
+    {
+      return std::min(bucketUpperBound(i), max);
+    }
+  }
+  return max;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+double Histogram::mean() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return (count == 0) ? 0.0 : static_cast<double>(sum) / static_cast<double>(count);
+}
+
+namespace detail
+{
+//======================================================================================================================
+AtomicHistogram::AtomicHistogram()
+  : buckets_(new std::atomic<std::uint64_t>[Histogram::NUM_BUCKETS]), count_(0), sum_(0), max_(0)
+//======================================================================================================================
+{
+  for (std::size_t i = 0; i < Histogram::NUM_BUCKETS; ++i)
+  {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void AtomicHistogram::record(std::int64_t value)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto v = static_cast<std::uint64_t>(std::max<std::int64_t>(value, 0));
+  buckets_[Histogram::bucketOf(v)].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(v, std::memory_order_relaxed);
+  auto current_max = max_.load(std::memory_order_relaxed);
+  while ((v > current_max) && !max_.compare_exchange_weak(current_max, v, std::memory_order_relaxed))
+  {
+  }
+  count_.fetch_add(1, std::memory_order_release);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Histogram AtomicHistogram::snapshot() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  Histogram h;
+  h.count = count_.load(std::memory_order_acquire);
+  if (h.count == 0)
+  {
+    return h;
+  }
+  h.sum = sum_.load(std::memory_order_relaxed);
+  h.max = max_.load(std::memory_order_relaxed);
+  h.buckets.resize(Histogram::NUM_BUCKETS);
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < Histogram::NUM_BUCKETS; ++i)
+  {
+    h.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += h.buckets[i];
+  }
+  h.count = total;  // consistent with the buckets if records landed while copying
+  return h;
+}
+
+//======================================================================================================================
+MetricsRecorder::MetricsRecorder(std::size_t num_states)
+  : start_time(metricsTimestamp()), on_entry(new AtomicHistogram[num_states]), on_exit(new AtomicHistogram[num_states])
+//======================================================================================================================
+{
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void MetricsRecorder::updateHighWater(std::size_t depth)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  auto current = queue_high_water.load(std::memory_order_relaxed);
+  while ((depth > current) && !queue_high_water.compare_exchange_weak(current, depth, std::memory_order_relaxed))
+  {
+  }
+}
+
+}  // namespace detail
+}  // namespace fsm
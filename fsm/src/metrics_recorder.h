@@ -0,0 +1,79 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_METRICS_RECORDER_H
+#define FSM_METRICS_RECORDER_H
+
+#include "fsm/metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+namespace fsm
+{
+namespace detail
+{
+/// Whether the library is built with instrumentation. When false, the optimiser removes every use of the recorder.
+#ifdef FSM_ENABLE_METRICS
+constexpr bool METRICS_ENABLED = true;
+#else
+constexpr bool METRICS_ENABLED = false;
+#endif
+
+/// \return Monotonic timestamp in nanoseconds, or 0 if instrumentation is compiled out
+inline std::int64_t metricsTimestamp()
+{
+  if (!METRICS_ENABLED)
+  {
+    return 0;
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+//=====================================================================================================================
+/// Histogram that can be recorded into and snapshotted from different threads without locks
+class AtomicHistogram
+{
+public:
+  AtomicHistogram();
+
+  void record(std::int64_t value);
+  Histogram snapshot() const;
+
+private:
+  std::unique_ptr<std::atomic<std::uint64_t>[]> buckets_;
+  std::atomic<std::uint64_t> count_;
+  std::atomic<std::uint64_t> sum_;
+  std::atomic<std::uint64_t> max_;
+};
+
+//=====================================================================================================================
+/// Counters and histograms of one Fsm
+struct MetricsRecorder
+{
+  explicit MetricsRecorder(std::size_t num_states);
+
+  /// Raise the queue high water mark to depth if it is higher
+  void updateHighWater(std::size_t depth);
+
+  std::atomic<std::uint64_t> events_raised{ 0 };
+  std::atomic<std::uint64_t> events_processed{ 0 };
+  std::atomic<std::uint64_t> transitions{ 0 };
+  std::atomic<std::uint64_t> ignored_events{ 0 };
+  std::atomic<std::size_t> queue_high_water{ 0 };
+  std::int64_t start_time;  //!< metricsTimestamp() at Fsm::start()
+
+  AtomicHistogram queue_latency;
+  AtomicHistogram transition_function;
+  std::unique_ptr<AtomicHistogram[]> on_entry;  //!< by state handle
+  std::unique_ptr<AtomicHistogram[]> on_exit;   //!< by state handle
+};
+
+}  // namespace detail
+}  // namespace fsm
+
+#endif  // FSM_METRICS_RECORDER_H
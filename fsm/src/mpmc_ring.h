@@ -0,0 +1,178 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_MPMC_RING_H
+#define FSM_MPMC_RING_H
+
+#include "fsm/memory_resource.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace fsm
+{
+namespace detail
+{
+//=====================================================================================================================
+/// Bounded lock-free multi-producer multi-consumer ring (D. Vyukov's sequence numbered cells). Storage is allocated
+/// once at construction. The capacity is rounded up to a power of two.
+template <typename T>
+class MpmcRing
+{
+public:
+  /// \param capacity Number of elements the ring must hold
+  /// \param resource Memory to allocate the ring from. nullptr for the heap
+  explicit MpmcRing(std::size_t capacity, MemoryResource* resource = nullptr)
+    : mask_(roundUp(capacity) - 1)
+    , allocator_(resource)
+    , cells_(allocator_.allocate(mask_ + 1))
+    , enqueue_pos_(0)
+    , padding_()
+    , dequeue_pos_(0)
+  {
+    for (std::size_t i = 0; i <= mask_; ++i)
+    {
+      new (&cells_[i]) Cell();
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~MpmcRing()
+  {
+    for (std::size_t i = 0; i <= mask_; ++i)
+    {
+      cells_[i].~Cell();
+    }
+    allocator_.deallocate(cells_, mask_ + 1);
+  }
+
+  MpmcRing(const MpmcRing&) = delete;
+  MpmcRing(MpmcRing&&) = delete;
+  MpmcRing& operator=(const MpmcRing&) = delete;
+  MpmcRing& operator=(MpmcRing&&) = delete;
+
+  /// \return Number of elements the ring can hold
+  std::size_t capacity() const
+  {
+    return mask_ + 1;
+  }
+
+  /// Enqueue. value is only moved from if it was enqueued.
+  /// \return false if the ring is full
+  bool tryPush(T& value)
+  {
+    Cell* cell = nullptr;
+    auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      cell = &cells_[pos & mask_];
+      const auto seq = cell->sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+      if (diff == 0)
+      {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Dequeue the oldest element
+  /// \return false if the ring is empty
+  bool tryPop(T& value)
+  {
+    Cell* cell = nullptr;
+    auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      cell = &cells_[pos & mask_];
+      const auto seq = cell->sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+      if (diff == 0)
+      {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    value = std::move(cell->value);
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Visit the queued elements, oldest first, without dequeuing them. Only when no other thread dequeues
+  template <typename F>
+  void forEach(F&& visit) const
+  {
+    for (auto pos = dequeue_pos_.load(std::memory_order_acquire);; ++pos)
+    {
+      const auto& cell = cells_[pos & mask_];
+      if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+      {
+        return;
+      }
+      visit(cell.value);
+    }
+  }
+
+  /// \return true if no element is queued or being queued. Only a snapshot when other threads are active.
+  bool empty() const
+  {
+    return dequeue_pos_.load(std::memory_order_acquire) == enqueue_pos_.load(std::memory_order_acquire);
+  }
+
+private:
+  static std::size_t roundUp(std::size_t capacity)
+  {
+    std::size_t size = 1;
+    while (size < capacity)
+    {
+      size <<= 1U;
+    }
+    return size;
+  }
+
+  struct Cell
+  {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+private:
+  const std::size_t mask_;
+  Allocator<Cell> allocator_;
+  Cell* cells_;
+  std::atomic<std::size_t> enqueue_pos_;
+  char padding_[64];  //!< keep producer and consumer cursors on separate cache lines
+  std::atomic<std::size_t> dequeue_pos_;
+};
+
+}  // namespace detail
+}  // namespace fsm
+
+#endif  // FSM_MPMC_RING_H
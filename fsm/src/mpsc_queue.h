@@ -0,0 +1,167 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_MPSC_QUEUE_H
+#define FSM_MPSC_QUEUE_H
+
+#include "node_pool.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace fsm
+{
+namespace detail
+{
+//=====================================================================================================================
+/// Unbounded multi-producer single-consumer queue (D. Vyukov's intrusive node based design).
+///
+/// push() links the node in with a single atomic exchange. Nodes are recycled through a lock-free NodePool, so the
+/// queue stops allocating once it has grown to its working set. tryPop() and empty() must only be called by the
+/// single consumer. A producer pre-empted between its exchange and link makes the queue transiently appear
+/// non-empty to empty() while tryPop() still fails; the consumer simply retries.
+template <typename T>
+class MpscQueue
+{
+public:
+  /// \param resource Memory to allocate nodes from. nullptr for the heap
+  explicit MpscQueue(MemoryResource* resource = nullptr) : pool_(resource), head_(&stub_), tail_(&stub_)
+  {
+  }
+
+  ~MpscQueue()
+  {
+    T value;
+    while (tryPop(value))
+    {
+    }
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue(MpscQueue&&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+  MpscQueue& operator=(MpscQueue&&) = delete;
+
+  /// Enqueue. Safe to call from any thread.
+  void push(T value)
+  {
+    Node* node = pool_.acquire();
+    node->value = std::move(value);
+    link(node);
+  }
+
+  /// Enqueue values in order, linking them in with a single atomic exchange. Safe to call from any thread.
+  /// \param values Values to move from
+  /// \param count Number of values
+  void pushBatch(T* values, std::size_t count)
+  {
+    if (count == 0)
+    {
+      return;
+    }
+    Node* const first = pool_.acquire();
+    first->value = std::move(values[0]);
+    Node* last = first;
+    for (std::size_t i = 1; i < count; ++i)
+    {
+      Node* const node = pool_.acquire();
+      node->value = std::move(values[i]);
+      last->next.store(node, std::memory_order_relaxed);
+      last = node;
+    }
+    last->next.store(nullptr, std::memory_order_relaxed);
+    Node* prev = head_.exchange(last, std::memory_order_acq_rel);
+    prev->next.store(first, std::memory_order_release);
+  }
+
+  /// Dequeue. Consumer only.
+  /// \return false if nothing could be dequeued
+  bool tryPop(T& value)
+  {
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_)
+    {
+      if (next == nullptr)
+      {
+        return false;
+      }
+      tail_ = next;
+      tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next == nullptr)
+    {
+      if (tail != head_.load(std::memory_order_acquire))
+      {
+        return false;  // a producer is half way through push()
+      }
+      link(&stub_);
+      next = tail->next.load(std::memory_order_acquire);
+      if (next == nullptr)
+      {
+        return false;
+      }
+    }
+    tail_ = next;
+    value = std::move(tail->value);
+    pool_.release(tail);
+    return true;
+  }
+
+  /// Visit the queued values, oldest first, without dequeuing them. Consumer only. Values a producer is half way
+  /// through pushing, and those pushed after them, are not visited.
+  template <typename F>
+  void forEach(F&& visit) const
+  {
+    for (const Node* node = tail_; node != nullptr; node = node->next.load(std::memory_order_acquire))
+    {
+      if (node != &stub_)
+      {
+        visit(node->value);
+      }
+    }
+  }
+
+  /// Consumer only.
+  /// \return true if there is nothing to dequeue
+  bool empty() const
+  {
+    return (tail_ == &stub_) && (stub_.next.load(std::memory_order_acquire) == nullptr) &&
+           (head_.load(std::memory_order_acquire) == &stub_);
+  }
+
+private:
+  struct Node
+  {
+    Node() : next(nullptr), free_next(0), index(0), value()
+    {
+    }
+    std::atomic<Node*> next;
+    std::atomic<std::uint32_t> free_next;  //!< owned by NodePool
+    std::uint32_t index;                   //!< owned by NodePool
+    T value;
+  };
+
+  void link(Node* node)
+  {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+private:
+  NodePool<Node> pool_;
+  std::atomic<Node*> head_;  //!< most recently pushed node. Shared by producers
+  Node* tail_;               //!< oldest node. Consumer only
+  Node stub_;
+};
+
+}  // namespace detail
+}  // namespace fsm
+
+#endif  // FSM_MPSC_QUEUE_H
@@ -0,0 +1,156 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_NODE_POOL_H
+#define FSM_NODE_POOL_H
+
+#include "fsm/memory_resource.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+namespace fsm
+{
+namespace detail
+{
+//=====================================================================================================================
+/// Lock-free free list of recycled nodes for node based queues. Nodes are allocated in chunks of doubling size
+/// and never returned to the memory resource until the pool is destroyed, so acquire() and release() do not allocate
+/// once the pool has grown to the working set.
+///
+/// The free list is a stack of node indices with an ABA tag. Node must be default constructible and have the
+/// members `std::atomic<std::uint32_t> free_next` and `std::uint32_t index`, which belong to the pool.
+template <typename Node>
+class NodePool
+{
+public:
+  /// \param resource Memory to allocate chunks from. nullptr for the heap
+  explicit NodePool(MemoryResource* resource = nullptr) : free_head_(0), allocator_(resource), num_chunks_(0)
+  {
+    for (auto& chunk : chunks_)
+    {
+      chunk.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~NodePool()
+  {
+    for (unsigned k = 0; k < num_chunks_; ++k)
+    {
+      Node* chunk = chunks_[k].load(std::memory_order_relaxed);
+      const std::uint32_t size = BASE_CHUNK_SIZE << k;
+      for (std::uint32_t i = 0; i < size; ++i)
+      {
+        chunk[i].~Node();
+      }
+      allocator_.deallocate(chunk, size);
+    }
+  }
+
+  NodePool(const NodePool&) = delete;
+  NodePool(NodePool&&) = delete;
+  NodePool& operator=(const NodePool&) = delete;
+  NodePool& operator=(NodePool&&) = delete;
+
+  /// Take a node from the free list, growing the pool if it is empty. Safe to call from any thread.
+  Node* acquire()
+  {
+    auto head = free_head_.load(std::memory_order_acquire);
+    while (true)
+    {
+      const auto link = static_cast<std::uint32_t>(head & LINK_MASK);
+      if (link == 0)
+      {
+        return grow();
+      }
+      Node* node = at(link - 1);
+      const auto next = nextTag(head) | node->free_next.load(std::memory_order_relaxed);
+      if (free_head_.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire))
+      {
+        return node;
+      }
+    }
+  }
+
+  /// Return a node to the free list. Safe to call from any thread.
+  void release(Node* node)
+  {
+    push(node, node);
+  }
+
+private:
+  static constexpr std::uint32_t BASE_CHUNK_SIZE = 64;
+  static constexpr unsigned MAX_CHUNKS = 25;  //!< keeps node indices within 31 bits
+  static constexpr std::uint64_t LINK_MASK = 0xFFFFFFFFULL;
+
+  static std::uint64_t nextTag(std::uint64_t head)
+  {
+    return ((head >> 32U) + 1U) << 32U;
+  }
+
+  /// Chunk k holds BASE_CHUNK_SIZE * 2^k nodes, starting at index BASE_CHUNK_SIZE * (2^k - 1)
+  Node* at(std::uint32_t index) const
+  {
+    const std::uint32_t n = index / BASE_CHUNK_SIZE + 1U;
+    unsigned k = 0;
+    while ((n >> (k + 1U)) != 0)
+    {
+      ++k;
+    }
+    const auto first = BASE_CHUNK_SIZE * ((1U << k) - 1U);
+    return chunks_[k].load(std::memory_order_acquire) + (index - first);
+  }
+
+  /// Push the chain of nodes first..last, already linked through free_next
+  void push(Node* first, Node* last)
+  {
+    auto head = free_head_.load(std::memory_order_relaxed);
+    std::uint64_t next = 0;
+    do
+    {
+      last->free_next.store(static_cast<std::uint32_t>(head & LINK_MASK), std::memory_order_relaxed);
+      next = nextTag(head) | (first->index + 1U);
+    } while (!free_head_.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  Node* grow()
+  {
+    std::lock_guard<std::mutex> lk(grow_guard_);
+    const auto k = num_chunks_;
+    if (k == MAX_CHUNKS)
+    {
+      throw std::bad_alloc();
+    }
+    const std::uint32_t size = BASE_CHUNK_SIZE << k;
+    const std::uint32_t first = BASE_CHUNK_SIZE * ((1U << k) - 1U);
+    Node* chunk = allocator_.allocate(size);
+    for (std::uint32_t i = 0; i < size; ++i)
+    {
+      new (&chunk[i]) Node();
+      chunk[i].index = first + i;
+      chunk[i].free_next.store(first + i + 2U, std::memory_order_relaxed);  // links are index + 1
+    }
+    chunks_[k].store(chunk, std::memory_order_release);
+    ++num_chunks_;
+
+    // keep the first node for the caller, make the rest available to everyone
+    push(&chunk[1], &chunk[size - 1]);
+    return &chunk[0];
+  }
+
+private:
+  std::atomic<std::uint64_t> free_head_;  //!< high word: ABA tag, low word: index + 1 of top node, 0 if empty
+  std::atomic<Node*> chunks_[MAX_CHUNKS];
+  Allocator<Node> allocator_;
+  std::mutex grow_guard_;
+  unsigned num_chunks_;
+};
+
+}  // namespace detail
+}  // namespace fsm
+
+#endif  // FSM_NODE_POOL_H
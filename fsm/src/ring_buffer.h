@@ -0,0 +1,106 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_RING_BUFFER_H
+#define FSM_RING_BUFFER_H
+
+#include "fsm/memory_resource.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace fsm
+{
+namespace detail
+{
+//=====================================================================================================================
+/// FIFO over a circular buffer that grows by doubling and never shrinks, so that a queue in steady state does not
+/// allocate. Not thread-safe. Elements are addressed by a sequence number that counts pushes since construction.
+template <typename T>
+class RingBuffer
+{
+public:
+  /// \param initial_capacity Number of elements to make room for
+  /// \param resource Memory to allocate from. nullptr for the heap
+  explicit RingBuffer(std::size_t initial_capacity = 16, MemoryResource* resource = nullptr)
+    : buffer_(std::max<std::size_t>(initial_capacity, 1), Allocator<T>(resource))
+  {
+  }
+
+  bool empty() const
+  {
+    return size_ == 0;
+  }
+
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+  /// Append to the back
+  /// \return Sequence number of the new element
+  std::uint64_t push(T value)
+  {
+    if (size_ == buffer_.size())
+    {
+      grow();
+    }
+    buffer_[(head_ + size_) % buffer_.size()] = std::move(value);
+    ++size_;
+    return popped_ + size_ - 1;
+  }
+
+  /// Remove the front element
+  /// \return Sequence number of the removed element
+  std::uint64_t pop(T& value)
+  {
+    value = std::move(buffer_[head_]);
+    head_ = (head_ + 1) % buffer_.size();
+    --size_;
+    return popped_++;
+  }
+
+  /// \return Element with the given sequence number, which must still be in the buffer
+  T& at(std::uint64_t sequence)
+  {
+    return buffer_[(head_ + static_cast<std::size_t>(sequence - popped_)) % buffer_.size()];
+  }
+
+  /// Visit the elements, front first
+  template <typename F>
+  void forEach(F&& visit) const
+  {
+    for (std::size_t i = 0; i < size_; ++i)
+    {
+      visit(buffer_[(head_ + i) % buffer_.size()]);
+    }
+  }
+
+private:
+  void grow()
+  {
+    std::vector<T, Allocator<T>> bigger(buffer_.size() * 2, buffer_.get_allocator());
+    for (std::size_t i = 0; i < size_; ++i)
+    {
+      bigger[i] = std::move(buffer_[(head_ + i) % buffer_.size()]);
+    }
+    buffer_.swap(bigger);
+    head_ = 0;
+  }
+
+private:
+  std::vector<T, Allocator<T>> buffer_;
+  std::size_t head_{ 0 };
+  std::size_t size_{ 0 };
+  std::uint64_t popped_{ 0 };  //!< sequence number of the front element
+};
+
+}  // namespace detail
+}  // namespace fsm
+
+#endif  // FSM_RING_BUFFER_H
@@ -0,0 +1,558 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/shared_event_queue.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <sstream>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+namespace fsm
+{
+namespace detail
+{
+namespace
+{
+constexpr char SHARED_QUEUE_MAGIC[8] = { 'F', 'S', 'M', 'Q', 'U', 'E', 'U', 'E' };
+constexpr std::uint32_t SHARED_QUEUE_VERSION = 2;
+constexpr std::uint32_t MAX_CAPACITY = 1U << 30U;
+constexpr std::size_t CACHE_LINE = 64;
+
+// the atomics below are shared between processes, which only works if they need no lock
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64 bit atomics must be lock-free");
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "32 bit atomics must be lock-free");
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex word must be 32 bit");
+
+/// Poll interval of a queue that sleeps without a futex
+constexpr std::chrono::microseconds POLL_INTERVAL(100);
+
+/// Events taken off the ring and raised at a time
+constexpr std::size_t FORWARD_BATCH = 64;
+
+/// A slot of the ring. Free for the producer that claims position p while sequence is p, filled while it is p + 1
+struct SharedCell
+{
+  std::atomic<std::uint64_t> sequence;
+  std::uint32_t event;
+  std::uint32_t reserved;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+[[noreturn]] void throwSystemError(const char* function, const std::string& what)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::stringstream str;
+  str << "[" << function << "] " << what << ": " << std::strerror(errno);  // NOLINT
+  throw FsmException(str.str());
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+[[noreturn]] void throwInvalid(const char* function, const std::string& name)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::stringstream str;
+  str << "[" << function << "] \"" << name << "\" is not the shared memory of a SharedEventQueue";  // NOLINT
+  throw FsmException(str.str());
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t alignUp(std::size_t offset)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return (offset + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+}
+}  // namespace
+
+//======================================================================================================================
+/// Start of the shared memory object. Followed by the names of the events, each a 32 bit length followed by the
+/// characters, then by the cells of the ring
+struct SharedQueueHeader
+{
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t capacity;  //!< number of cells, a power of two
+  std::uint32_t num_events;
+  std::uint32_t names_offset;
+  std::uint32_t names_size;
+  std::uint32_t cells_offset;
+  std::int32_t owner;                //!< process id of the queue
+  std::atomic<std::uint32_t> ready;  //!< set once the rest is written
+
+  alignas(CACHE_LINE) std::atomic<std::uint64_t> enqueue_pos;  //!< next position for producers to claim
+  alignas(CACHE_LINE) std::atomic<std::uint64_t> dequeue_pos;  //!< next position for the queue to take
+  alignas(CACHE_LINE) std::atomic<std::uint32_t> epoch;        //!< futex word. Changes to wake the queue up
+  std::atomic<std::uint32_t> waiters;                          //!< set while the queue is going to sleep
+};
+
+namespace
+{
+//----------------------------------------------------------------------------------------------------------------------
+bool isStale(const std::string& name)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // only a queue of this version whose process is gone is known to be stale. Anything else may be in use
+  const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat status = {};
+  void* address = MAP_FAILED;
+  if ((::fstat(fd, &status) == 0) && (static_cast<std::size_t>(status.st_size) >= sizeof(SharedQueueHeader)))
+  {
+    address = ::mmap(nullptr, sizeof(SharedQueueHeader), PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (address == MAP_FAILED)
+  {
+    return false;
+  }
+  const auto& header = *static_cast<const SharedQueueHeader*>(address);
+  const bool stale = (std::memcmp(header.magic, SHARED_QUEUE_MAGIC, sizeof(header.magic)) == 0) &&
+                     (header.version == SHARED_QUEUE_VERSION) &&
+                     (header.ready.load(std::memory_order_acquire) == 1) && (header.owner > 0) &&
+                     (::kill(header.owner, 0) != 0) && (errno == ESRCH);
+  ::munmap(address, sizeof(SharedQueueHeader));
+  return stale;
+}
+}  // namespace
+
+//======================================================================================================================
+/// A mapped shared memory object. Addresses of the ring are taken from the mapping, so that a producer that
+/// scribbles over the header cannot make the other side access memory outside it
+class SharedSegment
+{
+public:
+  SharedSegment(void* address, std::size_t size, std::uint32_t capacity, std::uint32_t cells_offset)
+    : address_(address)
+    , size_(size)
+    , header_(*static_cast<SharedQueueHeader*>(address))
+    , cells_(reinterpret_cast<SharedCell*>(static_cast<char*>(address) + cells_offset))
+    , mask_(capacity - 1U)
+    , take_pos_(header_.dequeue_pos.load(std::memory_order_relaxed))
+  {
+  }
+
+  ~SharedSegment()
+  {
+    ::munmap(address_, size_);
+  }
+
+  SharedSegment(const SharedSegment&) = delete;
+  SharedSegment(SharedSegment&&) = delete;
+  SharedSegment& operator=(const SharedSegment&) = delete;
+  SharedSegment& operator=(SharedSegment&&) = delete;
+
+  /// Claim up to count consecutive cells and fill them. Cells are freed in order by the one consumer, so they are all
+  /// free if the span fits between the positions
+  std::size_t push(const std::uint32_t* events, std::size_t count)
+  {
+    auto pos = header_.enqueue_pos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      // the span is worked out again for every position, as a failed exchange reloads it
+      const auto used = pos - header_.dequeue_pos.load(std::memory_order_acquire);
+      if (used > mask_ + 1)
+      {
+        pos = header_.enqueue_pos.load(std::memory_order_relaxed);  // read before a take that passed it
+        continue;
+      }
+      if (used == mask_ + 1)
+      {
+        return 0;
+      }
+      const auto claimed = std::min<std::uint64_t>(count, mask_ + 1 - used);
+      if (header_.enqueue_pos.compare_exchange_weak(pos, pos + claimed, std::memory_order_relaxed))
+      {
+        for (std::uint64_t i = 0; i < claimed; ++i)
+        {
+          auto& cell = cells_[(pos + i) & mask_];
+          cell.event = events[i];
+          cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        notify();
+        return static_cast<std::size_t>(claimed);
+      }
+    }
+  }
+
+  /// Take up to max_count events off the ring, oldest first. Only for the one consumer
+  std::size_t take(std::uint32_t* events, std::size_t max_count)
+  {
+    std::size_t count = 0;
+    for (; count < max_count; ++count)
+    {
+      auto& cell = cells_[take_pos_ & mask_];
+      if (cell.sequence.load(std::memory_order_acquire) != take_pos_ + 1)
+      {
+        break;
+      }
+      events[count] = cell.event;
+      cell.sequence.store(take_pos_ + mask_ + 1, std::memory_order_relaxed);
+      ++take_pos_;
+    }
+    if (count != 0)
+    {
+      header_.dequeue_pos.store(take_pos_, std::memory_order_release);
+    }
+    return count;
+  }
+
+  /// \return true if the next event is not there yet. Only for the one consumer
+  bool isEmpty() const
+  {
+    return cells_[take_pos_ & mask_].sequence.load(std::memory_order_acquire) != take_pos_ + 1;
+  }
+
+  /// Sleep until an event may have arrived, or wake() is called. Only for the one consumer
+  void wait(const std::atomic<bool>& exit_flag)
+  {
+    header_.waiters.store(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const auto key = header_.epoch.load(std::memory_order_seq_cst);
+    if (isEmpty() && !exit_flag.load(std::memory_order_acquire))
+    {
+#ifdef __linux__
+      ::syscall(SYS_futex, &header_.epoch, FUTEX_WAIT, key, nullptr, nullptr, 0);
+#else
+      (void)key;
+      std::this_thread::sleep_for(POLL_INTERVAL);
+#endif
+    }
+    header_.waiters.store(0, std::memory_order_relaxed);
+  }
+
+  /// Wake up the consumer if it is asleep
+  void notify()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header_.waiters.load(std::memory_order_relaxed) != 0)
+    {
+      wake();
+    }
+  }
+
+  /// Wake up the consumer
+  void wake()
+  {
+    header_.epoch.fetch_add(1, std::memory_order_seq_cst);
+#ifdef __linux__
+    ::syscall(SYS_futex, &header_.epoch, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+  }
+
+private:
+  void* address_;
+  std::size_t size_;
+  SharedQueueHeader& header_;
+  SharedCell* cells_;
+  const std::uint64_t mask_;
+  std::uint64_t take_pos_;  //!< position of the consumer. Kept here rather than trusted from the header
+};
+}  // namespace detail
+
+//======================================================================================================================
+SharedEventQueue::SharedEventQueue(Fsm& fsm, const std::string& name, std::size_t capacity,
+                                   std::chrono::nanoseconds spin, unsigned permissions, bool reclaim_stale)
+  : fsm_(fsm)
+  , name_(name)
+  , spin_((std::thread::hardware_concurrency() > 1) ? spin : std::chrono::nanoseconds(0))
+  , exit_flag_(false)
+  , forwarded_(0)
+  , rejected_(0)
+//======================================================================================================================
+{
+  if (!fsm_.isRunning())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] The machine must be running";  // NOLINT
+    throw FsmException(str.str());
+  }
+  if ((capacity == 0) || (capacity > detail::MAX_CAPACITY))
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Capacity must be between 1 and " << detail::MAX_CAPACITY;  // NOLINT
+    throw FsmException(str.str());
+  }
+  std::uint32_t cells = 1;
+  while (cells < capacity)
+  {
+    cells <<= 1U;
+  }
+
+  std::vector<char> names;
+  const auto handled = fsm_.getHandledEvents();
+  for (const auto& event : handled)
+  {
+    events_.push_back(fsm_.getEventHandle(event));
+    const auto length = static_cast<std::uint32_t>(event.size());
+    names.insert(names.end(), reinterpret_cast<const char*>(&length),
+                 reinterpret_cast<const char*>(&length) + sizeof(length));
+    names.insert(names.end(), event.begin(), event.end());
+  }
+  const auto names_offset = sizeof(detail::SharedQueueHeader);
+  const auto cells_offset = detail::alignUp(names_offset + names.size());
+  const auto size = cells_offset + cells * sizeof(detail::SharedCell);
+
+  // the name of a live queue is never taken over, as its producers would go on writing to the old object
+  int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, permissions);
+  if ((fd < 0) && (errno == EEXIST) && reclaim_stale)
+  {
+    if (detail::isStale(name_))
+    {
+      ::shm_unlink(name_.c_str());
+      fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, permissions);
+    }
+    else
+    {
+      errno = EEXIST;
+    }
+  }
+  if (fd < 0)
+  {
+    detail::throwSystemError(__FUNCTION__, "Cannot create \"" + name_ + "\"");  // NOLINT
+  }
+  void* address = MAP_FAILED;
+  if ((::fchmod(fd, permissions) == 0) && (::ftruncate(fd, static_cast<off_t>(size)) == 0))
+  {
+    address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (address == MAP_FAILED)
+  {
+    const auto error = errno;
+    ::close(fd);
+    ::shm_unlink(name_.c_str());
+    errno = error;
+    detail::throwSystemError(__FUNCTION__, "Cannot map \"" + name_ + "\"");  // NOLINT
+  }
+  ::close(fd);
+
+  auto* header = new (address) detail::SharedQueueHeader();
+  std::memcpy(header->magic, detail::SHARED_QUEUE_MAGIC, sizeof(header->magic));
+  header->version = detail::SHARED_QUEUE_VERSION;
+  header->capacity = cells;
+  header->num_events = static_cast<std::uint32_t>(handled.size());
+  header->names_offset = static_cast<std::uint32_t>(names_offset);
+  header->names_size = static_cast<std::uint32_t>(names.size());
+  header->cells_offset = static_cast<std::uint32_t>(cells_offset);
+  header->owner = static_cast<std::int32_t>(::getpid());
+  if (!names.empty())
+  {
+    std::memcpy(static_cast<char*>(address) + names_offset, names.data(), names.size());
+  }
+  auto* cell = reinterpret_cast<detail::SharedCell*>(static_cast<char*>(address) + cells_offset);
+  for (std::uint32_t i = 0; i < cells; ++i)
+  {
+    new (&cell[i]) detail::SharedCell{ { i }, 0, 0 };
+  }
+  segment_.reset(new detail::SharedSegment(address, size, cells, static_cast<std::uint32_t>(cells_offset)));
+  header->ready.store(1, std::memory_order_release);
+
+  forwarder_ = std::thread([this]() { forward(); });
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+SharedEventQueue::~SharedEventQueue()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  ::shm_unlink(name_.c_str());
+  exit_flag_.store(true, std::memory_order_release);
+  segment_->wake();
+  forwarder_.join();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+const std::string& SharedEventQueue::getName() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return name_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::uint64_t SharedEventQueue::getForwardedCount() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return forwarded_.load(std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::uint64_t SharedEventQueue::getRejectedCount() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return rejected_.load(std::memory_order_relaxed);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void SharedEventQueue::forward()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::uint32_t ids[detail::FORWARD_BATCH];
+  Fsm::EventHandle events[detail::FORWARD_BATCH];
+  while (!exit_flag_.load(std::memory_order_acquire))
+  {
+    const auto taken = segment_->take(ids, detail::FORWARD_BATCH);
+    if (taken != 0)
+    {
+      std::size_t count = 0;
+      for (std::size_t i = 0; i < taken; ++i)
+      {
+        if (ids[i] < events_.size())
+        {
+          events[count++] = events_[ids[i]];
+        }
+      }
+      rejected_.fetch_add(taken - count, std::memory_order_relaxed);
+
+      // count before raising, so that the count never lags behind the transitions the events cause
+      forwarded_.fetch_add(count, std::memory_order_relaxed);
+      try
+      {
+        fsm_.raiseBatch(events, events + count);
+      }
+      catch (...)
+      {
+        forwarded_.fetch_sub(count, std::memory_order_relaxed);
+        rejected_.fetch_add(count, std::memory_order_relaxed);
+      }
+      continue;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + spin_;
+    while (segment_->isEmpty() && !exit_flag_.load(std::memory_order_relaxed) &&
+           (std::chrono::steady_clock::now() < deadline))
+    {
+      // a producer is likely to follow soon, and a sleeping queue costs it a system call to wake
+    }
+    if (segment_->isEmpty())
+    {
+      segment_->wait(exit_flag_);
+    }
+  }
+}
+
+//======================================================================================================================
+SharedEventProducer::SharedEventProducer(const std::string& name)
+//======================================================================================================================
+{
+  const int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0)
+  {
+    detail::throwSystemError(__FUNCTION__, "Cannot open \"" + name + "\"");  // NOLINT
+  }
+  struct stat status = {};
+  void* address = MAP_FAILED;
+  if ((::fstat(fd, &status) == 0) && (static_cast<std::size_t>(status.st_size) >= sizeof(detail::SharedQueueHeader)))
+  {
+    address = ::mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (address == MAP_FAILED)
+  {
+    detail::throwInvalid(__FUNCTION__, name);  // NOLINT
+  }
+
+  // check everything the producer relies on before it takes over the mapping
+  const auto size = static_cast<std::size_t>(status.st_size);
+  const auto& header = *static_cast<const detail::SharedQueueHeader*>(address);
+  const auto capacity = header.capacity;
+  const auto cells_offset = header.cells_offset;
+  const std::uint64_t names_end = std::uint64_t(header.names_offset) + header.names_size;
+  const bool valid = (std::memcmp(header.magic, detail::SHARED_QUEUE_MAGIC, sizeof(header.magic)) == 0) &&
+                     (header.version == detail::SHARED_QUEUE_VERSION) &&
+                     (header.ready.load(std::memory_order_acquire) == 1) && (capacity != 0) &&
+                     (capacity <= detail::MAX_CAPACITY) && ((capacity & (capacity - 1)) == 0) &&
+                     (cells_offset % detail::CACHE_LINE == 0) && (cells_offset >= sizeof(detail::SharedQueueHeader)) &&
+                     (std::uint64_t(cells_offset) + std::uint64_t(capacity) * sizeof(detail::SharedCell) <= size) &&
+                     (header.names_offset >= sizeof(detail::SharedQueueHeader)) && (names_end <= cells_offset);
+  if (!valid)
+  {
+    ::munmap(address, size);
+    detail::throwInvalid(__FUNCTION__, name);  // NOLINT
+  }
+  segment_.reset(new detail::SharedSegment(address, size, capacity, cells_offset));
+
+  const auto* names = static_cast<const char*>(address) + header.names_offset;
+  std::size_t offset = 0;
+  for (std::uint32_t id = 0; id < header.num_events; ++id)
+  {
+    std::uint32_t length = 0;
+    if (header.names_size - offset < sizeof(length))
+    {
+      detail::throwInvalid(__FUNCTION__, name);  // NOLINT
+    }
+    std::memcpy(&length, names + offset, sizeof(length));
+    offset += sizeof(length);
+    if (header.names_size - offset < length)
+    {
+      detail::throwInvalid(__FUNCTION__, name);  // NOLINT
+    }
+    event_ids_.emplace(Fsm::Event(names + offset, length), id);
+    offset += length;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+SharedEventProducer::~SharedEventProducer() = default;
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+SharedEventProducer::EventId SharedEventProducer::getEventId(const Fsm::Event& event) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto it = event_ids_.find(event);
+  if (it == event_ids_.end())
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Event \"" << event << "\" is not handled by the machine";  // NOLINT
+    throw FsmException(str.str());
+  }
+  return it->second;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool SharedEventProducer::raise(EventId event)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return segment_->push(&event, 1) == 1;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool SharedEventProducer::raise(const Fsm::Event& event)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return raise(getEventId(event));
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t SharedEventProducer::raiseBatch(const EventId* first, const EventId* last)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::size_t raised = 0;
+  while (first + raised < last)
+  {
+    const auto pushed = segment_->push(first + raised, static_cast<std::size_t>(last - first) - raised);
+    if (pushed == 0)
+    {
+      break;
+    }
+    raised += pushed;
+  }
+  return raised;
+}
+
+}  // namespace fsm
@@ -0,0 +1,129 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/simulation.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace fsm
+{
+//======================================================================================================================
+Simulation::Simulation(std::chrono::nanoseconds resolution)
+  : timer_wheel_(std::make_shared<TimerWheel>(resolution, TimeSource::Virtual))
+//======================================================================================================================
+{
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Fsm::Config Simulation::makeConfig() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Manual;
+  config.timer_wheel = timer_wheel_;
+  return config;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Simulation::add(Fsm& fsm)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto& config = fsm.getConfig();
+  if ((config.timer_wheel != timer_wheel_) || (config.dispatch_mode == DispatchMode::Background) ||
+      config.executor || config.region_executor)
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] The machine is not configured for the simulation. See makeConfig()";  // NOLINT
+    throw FsmException(str.str());
+  }
+  if (std::find(machines_.begin(), machines_.end(), &fsm) == machines_.end())
+  {
+    machines_.push_back(&fsm);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void Simulation::remove(Fsm& fsm)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  machines_.erase(std::remove(machines_.begin(), machines_.end(), &fsm), machines_.end());
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::chrono::nanoseconds Simulation::getTime() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return timer_wheel_->getTime();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+const std::shared_ptr<TimerWheel>& Simulation::getTimerWheel() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return timer_wheel_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t Simulation::processPending()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // machines raise events in each other, so go round until a round finds nothing to do
+  std::size_t total = 0;
+  while (true)
+  {
+    std::size_t count = 0;
+    for (auto* fsm : machines_)
+    {
+      if (fsm->hasPendingEvents())
+      {
+        count += fsm->processPending();
+      }
+    }
+    if (count == 0)
+    {
+      return total;
+    }
+    total += count;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t Simulation::advance(std::chrono::nanoseconds duration)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return advanceTo(getTime() + std::max(duration, std::chrono::nanoseconds(0)));
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t Simulation::step()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  auto count = processPending();
+  if (timer_wheel_->getPendingCount() != 0)
+  {
+    timer_wheel_->advanceToNextExpiry(std::chrono::nanoseconds::max());
+    count += processPending();
+  }
+  return count;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t Simulation::advanceTo(std::chrono::nanoseconds time)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  auto count = processPending();
+  while (true)
+  {
+    const auto fired = timer_wheel_->advanceToNextExpiry(time);
+    count += processPending();
+    if (fired == 0)
+    {
+      return count;
+    }
+  }
+}
+
+}  // namespace fsm
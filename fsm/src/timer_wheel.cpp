@@ -0,0 +1,550 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/timer_wheel.h"
+#include "fsm/fsm.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace fsm
+{
+constexpr unsigned TimerWheel::SLOT_BITS;
+constexpr std::uint32_t TimerWheel::SLOTS;
+constexpr unsigned TimerWheel::LEVELS;
+constexpr std::uint32_t TimerWheel::EXPIRED_LIST;
+constexpr std::uint32_t TimerWheel::NUM_LISTS;
+constexpr std::uint32_t TimerWheel::NIL;
+
+//======================================================================================================================
+TimerWheel::TimerWheel(std::chrono::nanoseconds resolution, TimeSource source)
+  : resolution_(std::max(resolution, std::chrono::nanoseconds(1)))
+  , source_(source)
+  , epoch_(Clock::now())
+  , virtual_time_(0)
+  , heads_(NUM_LISTS, NIL)
+  , tails_(NUM_LISTS, NIL)
+  , free_(NIL)
+  , pending_(0)
+  , next_sequence_(0)
+  , current_tick_(0)
+  , wake_tick_(0)
+  , firing_(nullptr)
+  , exit_flag_(false)
+//======================================================================================================================
+{
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+TimerWheel::~TimerWheel()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  {
+    std::lock_guard<std::mutex> lk(guard_);
+    exit_flag_ = true;
+  }
+  wakeup_.notify_all();
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::shared_ptr<TimerWheel> TimerWheel::getDefault()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  static const auto wheel = std::make_shared<TimerWheel>();
+  return wheel;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+TimerWheel::TimerId TimerWheel::schedule(Target& target, std::chrono::nanoseconds delay, std::uint64_t tag)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lk(guard_);
+  const auto since_epoch = elapsed() + std::max(delay, std::chrono::nanoseconds(0));
+  if ((source_ == TimeSource::Steady) && !thread_.joinable())
+  {
+    thread_ = std::thread([this]() { run(); });
+  }
+
+  std::uint32_t index = free_;
+  if (index != NIL)
+  {
+    free_ = nodes_[index].next;
+  }
+  else
+  {
+    index = static_cast<std::uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+    nodes_.back().generation = 1;
+  }
+  auto& node = nodes_[index];
+
+  // round up, so that the timer never fires early
+  const auto ticks =
+      static_cast<std::uint64_t>((since_epoch + resolution_ - std::chrono::nanoseconds(1)) / resolution_);
+  node.expiry = std::max(ticks, current_tick_);
+  node.sequence = next_sequence_++;
+  node.tag = tag;
+  node.target = &target;
+  node.target_prev = NIL;
+  node.target_next = target.timers_;
+  if (target.timers_ != NIL)
+  {
+    nodes_[target.timers_].target_prev = index;
+  }
+  target.timers_ = index;
+  place(index);
+  ++pending_;
+
+  if (node.expiry < wake_tick_)
+  {
+    wakeup_.notify_one();
+  }
+  return TimerId{ index, node.generation };
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool TimerWheel::cancel(TimerId id)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lk(guard_);
+  if ((id.index >= nodes_.size()) || (nodes_[id.index].generation != id.generation) ||
+      (nodes_[id.index].list == NIL))
+  {
+    return false;
+  }
+  release(id.index);
+  return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool TimerWheel::isPending(TimerId id) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lk(guard_);
+  return (id.index < nodes_.size()) && (nodes_[id.index].generation == id.generation) &&
+         (nodes_[id.index].list != NIL);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void TimerWheel::cancelAll(Target& target)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::unique_lock<std::mutex> lk(guard_);
+  while (target.timers_ != NIL)
+  {
+    release(target.timers_);
+  }
+  if (std::this_thread::get_id() != timer_thread_id_)
+  {
+    fired_.wait(lk, [this, &target]() { return firing_ != &target; });
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t TimerWheel::getPendingCount() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lk(guard_);
+  return pending_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::chrono::nanoseconds TimerWheel::getTime() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lk(guard_);
+  return elapsed();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t TimerWheel::advanceToNextExpiry(std::chrono::nanoseconds limit)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::unique_lock<std::mutex> lk(guard_);
+  if (source_ != TimeSource::Virtual)
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Only a virtual clock can be advanced";  // NOLINT
+    throw FsmException(str.str());
+  }
+  timer_thread_id_ = std::this_thread::get_id();
+
+  const auto limit_tick = static_cast<std::uint64_t>(std::max(limit, std::chrono::nanoseconds(0)) / resolution_);
+  const auto next_tick = (heads_[EXPIRED_LIST] == NIL) ? earliestExpiry() : current_tick_;
+  if ((heads_[EXPIRED_LIST] == NIL) && (next_tick <= limit_tick))
+  {
+    // a long way off, placing the timers again is cheaper than turning the wheel tick by tick
+    if (next_tick - current_tick_ > SLOTS)
+    {
+      jumpTo(next_tick);
+    }
+    advance(next_tick);
+    virtual_time_ = std::max(virtual_time_, resolution_ * static_cast<std::int64_t>(next_tick));
+  }
+  if (heads_[EXPIRED_LIST] == NIL)
+  {
+    if (pending_ == 0)
+    {
+      advance(limit_tick);
+    }
+    virtual_time_ = std::max(virtual_time_, limit);
+    return 0;
+  }
+
+  std::size_t fired = 0;
+  while (fireExpired(lk))
+  {
+    ++fired;
+  }
+  return fired;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::uint64_t TimerWheel::earliestExpiry() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // timers of higher levels expire after the lowest level wraps around, which is also when it is refilled
+  constexpr std::uint64_t MASK = SLOTS - 1;
+  if ((current_tick_ & MASK) != 0)
+  {
+    for (auto tick = current_tick_; (tick & MASK) != 0; ++tick)
+    {
+      if (heads_[static_cast<std::uint32_t>(tick & MASK)] != NIL)
+      {
+        return tick;
+      }
+    }
+  }
+
+  auto earliest = UINT64_MAX;
+  for (const auto& node : nodes_)
+  {
+    if ((node.list != NIL) && (node.list != EXPIRED_LIST))
+    {
+      earliest = std::min(earliest, node.expiry);
+    }
+  }
+  return earliest;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void TimerWheel::jumpTo(std::uint64_t tick)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::vector<std::uint32_t> timers;
+  timers.reserve(pending_);
+  for (std::uint32_t list = 0; list < EXPIRED_LIST; ++list)
+  {
+    for (auto index = heads_[list]; index != NIL; index = nodes_[index].next)
+    {
+      timers.push_back(index);
+    }
+    heads_[list] = NIL;
+    tails_[list] = NIL;
+  }
+  // timers that expire on the same tick fire in the order they were scheduled
+  std::sort(timers.begin(), timers.end(),
+            [this](std::uint32_t a, std::uint32_t b) { return nodes_[a].sequence < nodes_[b].sequence; });
+  current_tick_ = tick;
+  for (const auto index : timers)
+  {
+    place(index);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t TimerWheel::advanceTo(std::chrono::nanoseconds time)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::size_t fired = 0;
+  while (true)
+  {
+    const auto count = advanceToNextExpiry(time);
+    if (count == 0)
+    {
+      return fired;
+    }
+    fired += count;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::chrono::nanoseconds TimerWheel::elapsed() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (source_ == TimeSource::Virtual)
+  {
+    return virtual_time_;
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch_);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::uint64_t TimerWheel::currentTick() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return static_cast<std::uint64_t>(elapsed() / resolution_);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+TimerWheel::Clock::time_point TimerWheel::timeOf(std::uint64_t tick) const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return epoch_ + std::chrono::duration_cast<Clock::duration>(resolution_ * tick);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void TimerWheel::place(std::uint32_t index)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  constexpr std::uint64_t MASK = SLOTS - 1;
+  const auto expiry = nodes_[index].expiry;
+  const auto delta = expiry - current_tick_;
+  for (unsigned level = 0; level < LEVELS; ++level)
+  {
+    const auto shift = SLOT_BITS * level;
+    if ((delta >> shift) < SLOTS)
+    {
+      link(level * SLOTS + static_cast<std::uint32_t>((expiry >> shift) & MASK), index);
+      return;
+    }
+  }
+
+  // beyond the range of the wheel: park in the furthest slot, from where it is placed again when that cascades
+  const auto shift = SLOT_BITS * (LEVELS - 1);
+  const auto furthest = current_tick_ + (std::uint64_t{ 1 } << (SLOT_BITS * LEVELS)) - 1;
+  link((LEVELS - 1) * SLOTS + static_cast<std::uint32_t>((furthest >> shift) & MASK), index);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void TimerWheel::link(std::uint32_t list, std::uint32_t index)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  auto& node = nodes_[index];
+  node.list = list;
+  node.next = NIL;
+  node.prev = tails_[list];
+  if (tails_[list] != NIL)
+  {
+    nodes_[tails_[list]].next = index;
+  }
+  else
+  {
+    heads_[list] = index;
+  }
+  tails_[list] = index;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void TimerWheel::expire(std::uint32_t index)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // timers fire in order of expiry, then in the order they were scheduled. A slot holds its timers in the order they
+  // arrived, and a timer cascaded from a higher level arrives after those scheduled into the slot directly
+  auto& node = nodes_[index];
+  auto prev = tails_[EXPIRED_LIST];
+  while ((prev != NIL) && ((nodes_[prev].expiry > node.expiry) ||
+                           ((nodes_[prev].expiry == node.expiry) && (nodes_[prev].sequence > node.sequence))))
+  {
+    prev = nodes_[prev].prev;
+  }
+  node.list = EXPIRED_LIST;
+  node.prev = prev;
+  node.next = (prev != NIL) ? nodes_[prev].next : heads_[EXPIRED_LIST];
+  if (node.next != NIL)
+  {
+    nodes_[node.next].prev = index;
+  }
+  else
+  {
+    tails_[EXPIRED_LIST] = index;
+  }
+  if (prev != NIL)
+  {
+    nodes_[prev].next = index;
+  }
+  else
+  {
+    heads_[EXPIRED_LIST] = index;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void TimerWheel::unlink(std::uint32_t index)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  auto& node = nodes_[index];
+  if (node.prev != NIL)
+  {
+    nodes_[node.prev].next = node.next;
+  }
+  else
+  {
+    heads_[node.list] = node.next;
+  }
+  if (node.next != NIL)
+  {
+    nodes_[node.next].prev = node.prev;
+  }
+  else
+  {
+    tails_[node.list] = node.prev;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void TimerWheel::release(std::uint32_t index)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  unlink(index);
+  auto& node = nodes_[index];
+  if (node.target_prev != NIL)
+  {
+    nodes_[node.target_prev].target_next = node.target_next;
+  }
+  else
+  {
+    node.target->timers_ = node.target_next;
+  }
+  if (node.target_next != NIL)
+  {
+    nodes_[node.target_next].target_prev = node.target_prev;
+  }
+  node.list = NIL;
+  node.target = nullptr;
+  node.generation = (node.generation == UINT32_MAX) ? 1 : node.generation + 1;
+  node.next = free_;
+  free_ = index;
+  --pending_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void TimerWheel::advance(std::uint64_t now_tick)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  constexpr std::uint64_t MASK = SLOTS - 1;
+  if (pending_ == 0)
+  {
+    current_tick_ = std::max(current_tick_, now_tick + 1);
+    return;
+  }
+  while (current_tick_ <= now_tick)
+  {
+    // when a level wraps around, redistribute the next slot of the level above into it
+    for (unsigned level = 1; (level < LEVELS) && ((current_tick_ >> (SLOT_BITS * (level - 1))) & MASK) == 0; ++level)
+    {
+      const auto list = level * SLOTS + static_cast<std::uint32_t>((current_tick_ >> (SLOT_BITS * level)) & MASK);
+      auto index = heads_[list];
+      heads_[list] = NIL;
+      tails_[list] = NIL;
+      while (index != NIL)
+      {
+        const auto next = nodes_[index].next;
+        place(index);
+        index = next;
+      }
+    }
+
+    // move the timers of this tick to the expired list
+    const auto list = static_cast<std::uint32_t>(current_tick_ & MASK);
+    auto index = heads_[list];
+    heads_[list] = NIL;
+    tails_[list] = NIL;
+    while (index != NIL)
+    {
+      const auto next = nodes_[index].next;
+      expire(index);
+      index = next;
+    }
+    ++current_tick_;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::uint64_t TimerWheel::nextWakeTick() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  constexpr std::uint64_t MASK = SLOTS - 1;
+  if (pending_ == 0)
+  {
+    return UINT64_MAX;
+  }
+  if ((heads_[EXPIRED_LIST] != NIL) || ((current_tick_ & MASK) == 0))
+  {
+    return current_tick_;
+  }
+
+  // the first occupied slot of the lowest level, or the next cascade
+  const auto wrap = (current_tick_ | MASK) + 1;
+  for (auto tick = current_tick_; tick < wrap; ++tick)
+  {
+    if (heads_[static_cast<std::uint32_t>(tick & MASK)] != NIL)
+    {
+      return tick;
+    }
+  }
+  return wrap;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void TimerWheel::run()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::unique_lock<std::mutex> lk(guard_);
+  timer_thread_id_ = std::this_thread::get_id();
+  while (!exit_flag_)
+  {
+    advance(currentTick());
+    if (fireExpired(lk))
+    {
+      continue;
+    }
+
+    wake_tick_ = nextWakeTick();
+    if (wake_tick_ == UINT64_MAX)
+    {
+      wakeup_.wait(lk);
+    }
+    else if (wake_tick_ > currentTick())
+    {
+      wakeup_.wait_until(lk, timeOf(wake_tick_));
+    }
+    wake_tick_ = 0;
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool TimerWheel::fireExpired(std::unique_lock<std::mutex>& lk)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // fire one timer at a time, so that it can be cancelled until the moment it fires
+  const auto expired = heads_[EXPIRED_LIST];
+  if (expired == NIL)
+  {
+    return false;
+  }
+  auto* const target = nodes_[expired].target;
+  const auto tag = nodes_[expired].tag;
+  release(expired);
+  firing_ = target;
+  lk.unlock();
+  try
+  {
+    target->onTimer(tag);
+  }
+  catch (...)
+  {
+  }
+  lk.lock();
+  firing_ = nullptr;
+  fired_.notify_all();
+  return true;
+}
+
+}  // namespace fsm
@@ -0,0 +1,365 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/trace.h"
+#include "fsm/fsm.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace fsm
+{
+namespace
+{
+constexpr char TRACE_MAGIC[8] = { 'F', 'S', 'M', 'T', 'R', 'A', 'C', 'E' };
+constexpr std::uint32_t TRACE_VERSION = 1;
+
+/// Start of a trace file. Followed by the ring of records and then the dictionary of state and event names. Each
+/// name list in the dictionary is a 32 bit count followed by that many 32 bit lengths and characters.
+struct FileHeader
+{
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t record_size;
+  std::uint64_t slots;  //!< capacity of the recorder + 1
+  std::atomic<std::uint64_t> head;  //!< number of records ever written
+  std::uint64_t dictionary_offset;  //!< 0 until the recorded machine is started
+  std::uint64_t dictionary_size;
+  std::uint8_t reserved[16];
+};
+static_assert(sizeof(FileHeader) == 64, "FileHeader is part of the trace file format");
+static_assert(sizeof(std::atomic<std::uint64_t>) == sizeof(std::uint64_t), "Unexpected atomic layout");
+
+//----------------------------------------------------------------------------------------------------------------------
+void appendNames(std::string& out, const std::vector<std::string>& names)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  const auto append_u32 = [&out](std::uint32_t v) { out.append(reinterpret_cast<const char*>(&v), sizeof(v)); };
+  append_u32(static_cast<std::uint32_t>(names.size()));
+  for (const auto& name : names)
+  {
+    append_u32(static_cast<std::uint32_t>(name.size()));
+    out.append(name);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool readNames(std::istream& in, std::vector<std::string>& names)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::uint32_t count = 0;
+  if (!in.read(reinterpret_cast<char*>(&count), sizeof(count)))
+  {
+    return false;
+  }
+  names.clear();
+  for (std::uint32_t i = 0; i < count; ++i)
+  {
+    std::uint32_t length = 0;
+    if (!in.read(reinterpret_cast<char*>(&length), sizeof(length)))
+    {
+      return false;
+    }
+    std::string name(length, '\0');
+    if ((length > 0) && !in.read(&name[0], length))
+    {
+      return false;
+    }
+    names.push_back(std::move(name));
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+[[noreturn]] void throwSystemError(const char* function, const std::string& what)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::stringstream str;
+  str << "[" << function << "] " << what << ": " << std::strerror(errno);  // NOLINT
+  throw FsmException(str.str());
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void copyRing(const TraceRecord* ring, std::size_t slots, const std::atomic<std::uint64_t>& head, Trace& trace)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  // The ring has one slot more than it reports, which the writer fills before publishing the record in it. Only the
+  // other slots are copied
+  const auto capacity = slots - 1;
+  const auto end = head.load(std::memory_order_acquire);
+  auto begin = (end > capacity) ? end - capacity : 0;
+  trace.records.resize(static_cast<std::size_t>(end - begin));
+  for (auto seq = begin; seq < end; ++seq)
+  {
+    trace.records[static_cast<std::size_t>(seq - begin)] = ring[seq % slots];
+  }
+
+  // Drop records the writer may have overwritten while they were copied
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const auto latest = head.load(std::memory_order_relaxed);
+  const auto valid_begin = (latest > capacity) ? latest - capacity : 0;
+  if (valid_begin > begin)
+  {
+    const auto torn = std::min<std::uint64_t>(valid_begin - begin, trace.records.size());
+    trace.records.erase(trace.records.begin(), trace.records.begin() + static_cast<std::ptrdiff_t>(torn));
+    begin += torn;
+  }
+  trace.lost_records = begin;
+}
+}  // namespace
+
+//======================================================================================================================
+TraceRecorder::TraceRecorder(std::size_t capacity)
+  : capacity_(std::max<std::size_t>(capacity, 1))
+  , records_(nullptr)
+  , head_(&memory_head_)
+  , memory_(new TraceRecord[capacity_ + 1]())
+  , memory_head_(0)
+  , fd_(-1)
+  , map_(nullptr)
+  , map_size_(0)
+//======================================================================================================================
+{
+  records_ = memory_.get();
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+TraceRecorder::TraceRecorder(const std::string& path, std::size_t capacity)
+  : capacity_(std::max<std::size_t>(capacity, 1))
+  , records_(nullptr)
+  , head_(nullptr)
+  , memory_head_(0)
+  , fd_(-1)
+  , map_(nullptr)
+  , map_size_(sizeof(FileHeader) + (capacity_ + 1) * sizeof(TraceRecord))
+//----------------------------------------------------------------------------------------------------------------------
+{
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);  // NOLINT
+  if (fd_ < 0)
+  {
+    throwSystemError(__FUNCTION__, "Cannot open \"" + path + "\"");
+  }
+  if (::ftruncate(fd_, static_cast<off_t>(map_size_)) != 0)
+  {
+    ::close(fd_);
+    throwSystemError(__FUNCTION__, "Cannot size \"" + path + "\"");
+  }
+  map_ = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map_ == MAP_FAILED)  // NOLINT
+  {
+    ::close(fd_);
+    throwSystemError(__FUNCTION__, "Cannot map \"" + path + "\"");
+  }
+
+  // The file is zero filled, which is a valid empty header apart from the constants
+  auto* header = static_cast<FileHeader*>(map_);
+  std::memcpy(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  header->version = TRACE_VERSION;
+  header->record_size = sizeof(TraceRecord);
+  header->slots = capacity_ + 1;
+  head_ = new (&header->head) std::atomic<std::uint64_t>(0);
+  records_ = reinterpret_cast<TraceRecord*>(header + 1);  // NOLINT
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+TraceRecorder::~TraceRecorder()
+//----------------------------------------------------------------------------------------------------------------------
+{
+  if (map_ != nullptr)
+  {
+    ::munmap(map_, map_size_);
+  }
+  if (fd_ >= 0)
+  {
+    ::close(fd_);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void TraceRecorder::setDictionary(const std::vector<std::string>& states, const std::vector<std::string>& events)
+//----------------------------------------------------------------------------------------------------------------------
+{
+  std::lock_guard<std::mutex> lk(dictionary_guard_);
+  states_ = states;
+  events_ = events;
+  if (fd_ < 0)
+  {
+    return;
+  }
+
+  std::string dictionary;
+  appendNames(dictionary, states_);
+  appendNames(dictionary, events_);
+  if (::ftruncate(fd_, static_cast<off_t>(map_size_ + dictionary.size())) != 0)
+  {
+    throwSystemError(__FUNCTION__, "Cannot size trace file");
+  }
+  if (::pwrite(fd_, dictionary.data(), dictionary.size(), static_cast<off_t>(map_size_)) !=
+      static_cast<ssize_t>(dictionary.size()))
+  {
+    throwSystemError(__FUNCTION__, "Cannot write trace dictionary");
+  }
+  auto* header = static_cast<FileHeader*>(map_);
+  header->dictionary_size = dictionary.size();
+  header->dictionary_offset = map_size_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+Trace TraceRecorder::capture() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  Trace trace;
+  {
+    std::lock_guard<std::mutex> lk(dictionary_guard_);
+    trace.states = states_;
+    trace.events = events_;
+  }
+  copyRing(records_, capacity_ + 1, *head_, trace);
+  return trace;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::size_t TraceRecorder::getCapacity() const
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return capacity_;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+std::uint64_t TraceRecorder::timestamp() noexcept
+//----------------------------------------------------------------------------------------------------------------------
+{
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+          .count());
+}
+
+//======================================================================================================================
+Trace readTraceFile(const std::string& path)
+//======================================================================================================================
+{
+  std::ifstream in(path, std::ios::binary);
+  std::vector<char> header_bytes(sizeof(FileHeader));
+  if (!in || !in.read(header_bytes.data(), static_cast<std::streamsize>(header_bytes.size())))
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Cannot read \"" << path << "\"";  // NOLINT
+    throw FsmException(str.str());
+  }
+
+  std::uint32_t version = 0;
+  std::uint32_t record_size = 0;
+  std::uint64_t slots = 0;
+  std::uint64_t head = 0;
+  std::uint64_t dictionary_offset = 0;
+  std::memcpy(&version, &header_bytes[offsetof(FileHeader, version)], sizeof(version));
+  std::memcpy(&record_size, &header_bytes[offsetof(FileHeader, record_size)], sizeof(record_size));
+  std::memcpy(&slots, &header_bytes[offsetof(FileHeader, slots)], sizeof(slots));
+  std::memcpy(&head, &header_bytes[offsetof(FileHeader, head)], sizeof(head));
+  std::memcpy(&dictionary_offset, &header_bytes[offsetof(FileHeader, dictionary_offset)], sizeof(dictionary_offset));
+  if ((std::memcmp(header_bytes.data(), TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) || (version != TRACE_VERSION) ||
+      (record_size != sizeof(TraceRecord)) || (slots < 2))
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] \"" << path << "\" is not a trace file of a supported version";  // NOLINT
+    throw FsmException(str.str());
+  }
+
+  std::vector<TraceRecord> ring(static_cast<std::size_t>(slots));
+  if (!in.read(reinterpret_cast<char*>(ring.data()), static_cast<std::streamsize>(ring.size() * sizeof(TraceRecord))))
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] \"" << path << "\" is truncated";  // NOLINT
+    throw FsmException(str.str());
+  }
+
+  Trace trace;
+  const std::atomic<std::uint64_t> published(head);
+  copyRing(ring.data(), ring.size(), published, trace);
+  if (dictionary_offset != 0)
+  {
+    in.seekg(static_cast<std::streamoff>(dictionary_offset));
+    if (!readNames(in, trace.states) || !readNames(in, trace.events))
+    {
+      std::stringstream str;
+      str << "[" << __FUNCTION__ << "] \"" << path << "\" has a corrupt dictionary";  // NOLINT
+      throw FsmException(str.str());
+    }
+  }
+  return trace;
+}
+
+//======================================================================================================================
+ReplayResult replayTrace(const Trace& trace, Fsm& fsm)
+//======================================================================================================================
+{
+  if (fsm.isRunning() || (fsm.getConfig().dispatch_mode != DispatchMode::Manual))
+  {
+    std::stringstream str;
+    str << "[" << __FUNCTION__ << "] Replay needs a machine that is not started and uses "  // NOLINT
+        << "DispatchMode::Manual";
+    throw FsmException(str.str());
+  }
+
+  const auto name_of = [](const std::vector<std::string>& names, std::uint32_t handle) -> const std::string& {
+    if (handle >= names.size())
+    {
+      std::stringstream str;
+      str << "[replayTrace] Trace has no name for handle " << handle;  // NOLINT
+      throw FsmException(str.str());
+    }
+    return names[handle];
+  };
+
+  ReplayResult result;
+  if (trace.records.empty())
+  {
+    return result;
+  }
+  fsm.start(name_of(trace.states, trace.records.front().from_state));
+
+  for (std::size_t i = 0; i < trace.records.size(); ++i)
+  {
+    const auto& record = trace.records[i];
+    const auto& from = name_of(trace.states, record.from_state);
+    const auto& event = name_of(trace.events, record.event);
+    const auto before = fsm.getActiveState()->getId();
+
+    // Events raised by state callbacks during the replay stand in for the recorded ones that follow
+    if (!fsm.hasPendingEvents())
+    {
+      fsm.raise(event);
+    }
+    fsm.processPending(1);
+    ++result.replayed;
+
+    const auto after = fsm.getActiveState()->getId();
+    const auto& expected = (record.outcome == TraceOutcome::Transition) ? name_of(trace.states, record.to_state) : from;
+    if ((before != from) || (after != expected))
+    {
+      if (result.mismatches == 0)
+      {
+        std::stringstream str;
+        str << "record " << i << ": event \"" << event << "\" recorded as \"" << from << "\" -> \"" << expected
+            << "\", replayed as \"" << before << "\" -> \"" << after << "\"";
+        result.first_mismatch = i;
+        result.first_mismatch_description = str.str();
+      }
+      ++result.mismatches;
+    }
+  }
+  return result;
+}
+
+}  // namespace fsm
@@ -0,0 +1,192 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+namespace
+{
+//=====================================================================================================================
+/// Homes an axis in three steps: waits 10ms, then waits for the machine to be idle, then reports completion
+class HomingState : public LoggedState
+{
+public:
+  HomingState(Fsm& fsm, CallLog& log) : LoggedState(fsm, "homing", log), log_(log)
+  {
+  }
+
+  void onEntry() override
+  {
+    LoggedState::onEntry();
+    auto step = std::make_shared<int>(0);
+    getFsm().startAction([this, step]() {
+      switch (++*step)
+      {
+        case 1:
+          log_.add("step1");
+          return ActionResult::resumeAfter(10ms);
+        case 2:
+          log_.add("step2");
+          return ActionResult::resumeWhenIdle();
+        default:
+          log_.add("step3");
+          getFsm().raise("homed");
+          return ActionResult::done();
+      }
+    });
+  }
+
+private:
+  CallLog& log_;
+};
+
+//=====================================================================================================================
+/// Counts in steps that give way to events
+class CountingState : public LoggedState
+{
+public:
+  CountingState(Fsm& fsm, CallLog& log) : LoggedState(fsm, "counting", log)
+  {
+  }
+
+  void onEntry() override
+  {
+    LoggedState::onEntry();
+    getFsm().startAction([this]() {
+      ++count;
+      return ActionResult::resumeWhenIdle();
+    });
+  }
+
+  int count = 0;
+};
+
+}  // namespace
+
+//=====================================================================================================================
+class ActionTest : public ::testing::Test
+{
+protected:
+  ActionTest() : wheel_(std::make_shared<TimerWheel>(1ms, TimeSource::Virtual)), fsm_(makeConfig(wheel_))
+  {
+  }
+
+  static Fsm::Config makeConfig(const std::shared_ptr<TimerWheel>& wheel)
+  {
+    Fsm::Config config;
+    config.dispatch_mode = DispatchMode::Manual;
+    config.timer_wheel = wheel;
+    return config;
+  }
+
+  void SetUp() override
+  {
+    fsm_.addState(std::make_shared<LoggedState>(fsm_, "idle", log_));
+    fsm_.addState(std::make_shared<HomingState>(fsm_, log_));
+    fsm_.addState(std::make_shared<LoggedState>(fsm_, "ready", log_));
+    fsm_.addTransitionRule("idle", "home", "homing");
+    fsm_.addTransitionRule("homing", "homed", "ready");
+    fsm_.addTransitionRule("homing", "abort", "idle");
+    fsm_.start("idle");
+    log_.clear();
+  }
+
+  void advanceTo(std::chrono::nanoseconds time)
+  {
+    wheel_->advanceTo(time);
+    fsm_.processPending();
+  }
+
+  CallLog log_;
+  std::shared_ptr<TimerWheel> wheel_;
+  Fsm fsm_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(ActionTest, RunsStepsInOrderWithEvents)
+{
+  fsm_.raise("home");
+  fsm_.processPending();
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "-idle", "+homing", "step1" }));
+
+  advanceTo(9ms);
+  EXPECT_EQ(log_.get().size(), 3u);
+
+  // the idle step runs once nothing is pending, and its event is processed in the same call
+  advanceTo(10ms);
+  EXPECT_EQ(log_.get(),
+            (std::vector<std::string>{ "-idle", "+homing", "step1", "step2", "step3", "-homing", "+ready" }));
+  EXPECT_EQ(fsm_.getActiveState()->getId(), "ready");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(ActionTest, FirstStepRunsAheadOfPendingEvents)
+{
+  fsm_.raise("home");
+  fsm_.raise("abort");
+  fsm_.processPending();
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "-idle", "+homing", "step1", "-homing", "+idle" }));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(ActionTest, ExitCancelsAction)
+{
+  fsm_.raise("home");
+  fsm_.processPending();
+  fsm_.raise("abort");
+  fsm_.processPending();
+  advanceTo(1s);
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "-idle", "+homing", "step1", "-homing", "+idle" }));
+
+  // a new entry starts the action over
+  fsm_.raise("home");
+  fsm_.processPending();
+  advanceTo(2s);
+  EXPECT_EQ(fsm_.getActiveState()->getId(), "ready");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(IdleActionTest, RunsOneStepPerCall)
+{
+  CallLog log;
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Manual;
+  Fsm fsm(config);
+  auto counting = std::make_shared<CountingState>(fsm, log);
+  fsm.addState(counting);
+  fsm.addState(std::make_shared<LoggedState>(fsm, "stopped", log));
+  fsm.addTransitionRule("counting", "tick", "counting", Fsm::GuardDelegate([]() { return false; }));
+  fsm.addTransitionRule("counting", "stop", "stopped");
+  fsm.start("counting");
+
+  // the first step runs as soon as events are processed, then one idle step per call
+  fsm.processPending();
+  EXPECT_EQ(counting->count, 2);
+  fsm.processPending();
+  fsm.processPending();
+  EXPECT_EQ(counting->count, 4);
+
+  // events go first, then one step
+  fsm.raise("tick");
+  fsm.raise("tick");
+  fsm.processPending();
+  EXPECT_EQ(counting->count, 5);
+
+  fsm.raise("stop");
+  fsm.processPending();
+  fsm.processPending();
+  EXPECT_EQ(counting->count, 5);
+  EXPECT_EQ(fsm.getActiveState()->getId(), "stopped");
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,144 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+class AnalysisTest : public ::testing::Test
+{
+protected:
+  static Fsm::Config makeConfig()
+  {
+    Fsm::Config config;
+    config.dispatch_mode = DispatchMode::Manual;
+    return config;
+  }
+
+  void SetUp() override
+  {
+    fsm_.addState(std::make_shared<PlainState>(fsm_, "idle"));
+    fsm_.addState(std::make_shared<PlainState>(fsm_, "running"));
+    fsm_.addState(std::make_shared<PlainState>(fsm_, "stalled"));
+    fsm_.addState(std::make_shared<PlainState>(fsm_, "orphan"));
+    fsm_.addTransitionRule("idle", "start", "running");
+    fsm_.addTransitionRule("running", "stop", "idle");
+    fsm_.addTransitionRule("stalled", "recover", "running");
+    fsm_.addEvent("unused");
+  }
+
+  std::string active() const
+  {
+    return fsm_.getActiveState()->getId();
+  }
+
+  Fsm fsm_{ makeConfig() };
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(AnalysisTest, RequiresStartedMachine)
+{
+  EXPECT_THROW(fsm_.getAnalysis(), FsmException);
+  fsm_.start("idle");
+  EXPECT_NO_THROW(fsm_.getAnalysis());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(AnalysisTest, PrunesUnreachableStatesAndUnhandledEvents)
+{
+  fsm_.start("idle");
+  const auto analysis = fsm_.getAnalysis();
+  EXPECT_EQ(analysis.unreachable_states, (std::vector<State::Id>{ "stalled", "orphan" }));
+  EXPECT_EQ(analysis.unhandled_events, (std::vector<Fsm::Event>{ "recover", "unused" }));
+  EXPECT_EQ(analysis.num_active_states, 2u);
+  EXPECT_EQ(analysis.num_handled_events, 2u);
+  EXPECT_EQ(analysis.num_compiled_transitions, 2u);
+
+  // a row and a column for no rule, besides those of the live states and events
+  EXPECT_EQ(analysis.table_size, 3u * 3u);
+
+  // pruned events are ignored, the rest dispatch as before
+  fsm_.raise("recover");
+  fsm_.raise("unused");
+  fsm_.processPending();
+  EXPECT_EQ(active(), "idle");
+  fsm_.raise("start");
+  fsm_.processPending();
+  EXPECT_EQ(active(), "running");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(AnalysisTest, StartingElsewhereChangesWhatIsReachable)
+{
+  fsm_.start("stalled");
+  const auto analysis = fsm_.getAnalysis();
+  EXPECT_EQ(analysis.unreachable_states, (std::vector<State::Id>{ "orphan" }));
+  EXPECT_EQ(analysis.unhandled_events, (std::vector<Fsm::Event>{ "unused" }));
+  EXPECT_EQ(analysis.num_active_states, 3u);
+  EXPECT_EQ(analysis.table_size, 4u * 4u);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(AnalysisTest, EnteringStateEntersItsAncestors)
+{
+  fsm_.addState(std::make_shared<PlainState>(fsm_, "powered"));
+  fsm_.addState(std::make_shared<PlainState>(fsm_, "spinning"), "powered");
+  fsm_.addTransitionRule("running", "spin", "spinning");
+  fsm_.addTransitionRule("powered", "halt", "idle");
+  fsm_.start("idle");
+  const auto analysis = fsm_.getAnalysis();
+  EXPECT_EQ(analysis.unreachable_states, (std::vector<State::Id>{ "stalled", "orphan" }));
+  EXPECT_EQ(analysis.unhandled_events, (std::vector<Fsm::Event>{ "recover", "unused" }));
+
+  // the rule of the parent is taken in the child
+  fsm_.raise("start");
+  fsm_.raise("spin");
+  fsm_.processPending();
+  EXPECT_EQ(active(), "spinning");
+  fsm_.raise("halt");
+  fsm_.processPending();
+  EXPECT_EQ(active(), "idle");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(AnalysisTest, TransitionFunctionsKeepTheirRegionLive)
+{
+  // the target of a function is not known until it runs, so any state may follow
+  fsm_.addTransitionRule("running", "fault", []() -> State::Id { return "stalled"; });
+  fsm_.start("idle");
+  const auto analysis = fsm_.getAnalysis();
+  EXPECT_TRUE(analysis.unreachable_states.empty());
+  EXPECT_EQ(analysis.unhandled_events, (std::vector<Fsm::Event>{ "unused" }));
+  EXPECT_EQ(analysis.num_active_states, 4u);
+
+  fsm_.raise("start");
+  fsm_.raise("fault");
+  fsm_.raise("recover");
+  fsm_.processPending();
+  EXPECT_EQ(active(), "running");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(AnalysisTest, TransitionFunctionsStayInTheirRegion)
+{
+  const auto fan = fsm_.addRegion("fan", "fan_off");
+  fsm_.addState(std::make_shared<PlainState>(fsm_, "fan_off"), fan);
+  fsm_.addState(std::make_shared<PlainState>(fsm_, "fan_on"), fan);
+  fsm_.addState(std::make_shared<PlainState>(fsm_, "fan_broken"), fan);
+  fsm_.addTransitionRule("fan_off", "cool", "fan_on");
+  fsm_.addTransitionRule("running", "fault", []() -> State::Id { return "stalled"; });
+  fsm_.start("idle");
+  const auto analysis = fsm_.getAnalysis();
+  EXPECT_EQ(analysis.unreachable_states, (std::vector<State::Id>{ "fan_broken" }));
+  EXPECT_EQ(analysis.num_active_states, 6u);
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,131 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+/// Machine whose single state logs the events it processes
+class BatchTest : public ::testing::TestWithParam<QueueType>
+{
+protected:
+  void create(DispatchMode mode, std::size_t capacity = 0)
+  {
+    Fsm::Config config;
+    config.queue_type = GetParam();
+    config.dispatch_mode = mode;
+    config.queue_capacity = capacity;
+    config.overflow_policy = OverflowPolicy::DropNewest;
+    fsm_.reset(new Fsm(config));
+    fsm_->addState(std::make_shared<PlainState>(*fsm_, "s"));
+    for (int i = 0; i < 8; ++i)
+    {
+      const auto event = "e" + std::to_string(i);
+      handles_.push_back(fsm_->addEvent(event));
+      fsm_->addTransitionRule("s", event, [this, event]() -> State::Id {
+        log_.add(event);
+        return "s";
+      });
+    }
+  }
+
+  CallLog log_;
+  std::unique_ptr<Fsm> fsm_;
+  std::vector<Fsm::EventHandle> handles_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_P(BatchTest, RaisesInOrder)
+{
+  create(DispatchMode::Manual);
+  fsm_->start("s");
+  const std::vector<Fsm::EventHandle> batch = { handles_[3], handles_[1], handles_[4], handles_[1], handles_[5] };
+  fsm_->raise(handles_[0]);
+  fsm_->raiseBatch(batch.data(), batch.data() + batch.size());
+  fsm_->raiseBatch({ "e6", "unknown", "e7" });
+  EXPECT_EQ(fsm_->processPending(), 8u);
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "e0", "e3", "e1", "e4", "e1", "e5", "e6", "e7" }));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_P(BatchTest, RejectsUnknownHandlesUpFront)
+{
+  create(DispatchMode::Manual);
+  EXPECT_THROW(fsm_->raiseBatch(handles_.data(), handles_.data() + 1), FsmException);
+  fsm_->start("s");
+  const std::vector<Fsm::EventHandle> batch = { handles_[0], 1000, handles_[1] };
+  EXPECT_THROW(fsm_->raiseBatch(batch.data(), batch.data() + batch.size()), FsmException);
+  EXPECT_FALSE(fsm_->hasPendingEvents());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_P(BatchTest, DropsWhatDoesNotFit)
+{
+  create(DispatchMode::Manual, 4);
+  fsm_->start("s");
+  fsm_->raiseBatch(handles_.data(), handles_.data() + handles_.size());
+  EXPECT_EQ(fsm_->getDroppedEventCount(), 4u);
+  EXPECT_EQ(fsm_->processPending(), 4u);
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "e0", "e1", "e2", "e3" }));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_P(BatchTest, KeepsOrderOfConcurrentProducers)
+{
+  // each producer raises its own pair of events, alternately
+  create(DispatchMode::Background);
+  fsm_->start("s");
+  constexpr int NUM_PRODUCERS = 4;
+  constexpr int NUM_BATCHES = 500;
+  std::vector<std::thread> producers;
+  for (int p = 0; p < NUM_PRODUCERS; ++p)
+  {
+    producers.emplace_back([this, p]() {
+      std::vector<Fsm::EventHandle> batch;
+      for (int i = 0; i < 17; ++i)
+      {
+        batch.push_back(handles_[static_cast<std::size_t>(2 * p + (i % 2))]);
+      }
+      for (int b = 0; b < NUM_BATCHES; ++b)
+      {
+        fsm_->raiseBatch(batch.data(), batch.data() + batch.size());
+      }
+    });
+  }
+  for (auto& t : producers)
+  {
+    t.join();
+  }
+  ASSERT_TRUE(log_.waitForSize(NUM_PRODUCERS * NUM_BATCHES * 17, 10s));
+
+  std::vector<std::vector<char>> per_producer(NUM_PRODUCERS);
+  for (const auto& event : log_.get())
+  {
+    const auto index = event[1] - '0';
+    per_producer[static_cast<std::size_t>(index / 2)].push_back(static_cast<char>('0' + index % 2));
+  }
+  for (const auto& sequence : per_producer)
+  {
+    ASSERT_EQ(sequence.size(), static_cast<std::size_t>(NUM_BATCHES * 17));
+    for (std::size_t i = 0; i < sequence.size(); ++i)
+    {
+      ASSERT_EQ(sequence[i], ((i % 17) % 2 == 0) ? '0' : '1') << i;
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(QueueTypes, BatchTest, ::testing::Values(QueueType::Locked, QueueType::LockFree));
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,259 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "mpmc_ring.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+/// Runs a manually dispatched machine whose single state logs the events it processes
+class BoundedQueueTest : public ::testing::TestWithParam<QueueType>
+{
+protected:
+  void create(std::size_t capacity, OverflowPolicy policy)
+  {
+    Fsm::Config config;
+    config.queue_type = GetParam();
+    config.dispatch_mode = DispatchMode::Manual;
+    config.queue_capacity = capacity;
+    config.overflow_policy = policy;
+    fsm_.reset(new Fsm(config));
+    fsm_->addState(std::make_shared<PlainState>(*fsm_, "s"));
+    for (int i = 0; i < 8; ++i)
+    {
+      const auto event = "e" + std::to_string(i);
+      fsm_->addTransitionRule("s", event, [this, event]() -> State::Id {
+        log_.add(event);
+        return "s";
+      });
+    }
+    fsm_->start("s");
+  }
+
+  void raise(const std::vector<Fsm::Event>& events)
+  {
+    for (const auto& event : events)
+    {
+      fsm_->raise(event);
+    }
+  }
+
+  CallLog log_;
+  std::unique_ptr<Fsm> fsm_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_P(BoundedQueueTest, DropNewestDiscardsRaisedEvent)
+{
+  create(4, OverflowPolicy::DropNewest);
+  raise({ "e0", "e1", "e2", "e3", "e4", "e5" });
+  EXPECT_EQ(fsm_->getDroppedEventCount(), 2u);
+  EXPECT_EQ(fsm_->processPending(), 4u);
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "e0", "e1", "e2", "e3" }));
+
+  // there is room again once the queue is drained
+  raise({ "e6" });
+  EXPECT_EQ(fsm_->processPending(), 1u);
+  EXPECT_EQ(fsm_->getDroppedEventCount(), 2u);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_P(BoundedQueueTest, DropOldestDiscardsPendingEvent)
+{
+  create(4, OverflowPolicy::DropOldest);
+  raise({ "e0", "e1", "e2", "e3", "e4", "e5" });
+  EXPECT_EQ(fsm_->getDroppedEventCount(), 2u);
+  EXPECT_EQ(fsm_->processPending(), 4u);
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "e2", "e3", "e4", "e5" }));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_P(BoundedQueueTest, BlockWaitsForSpace)
+{
+  create(2, OverflowPolicy::Block);
+  std::atomic<int> raised{ 0 };
+  std::thread producer([this, &raised]() {
+    for (int i = 0; i < 6; ++i)
+    {
+      fsm_->raise("e" + std::to_string(i));
+      ++raised;
+    }
+  });
+
+  // the producer fills the queue, then waits
+  const auto deadline = std::chrono::steady_clock::now() + 5s;
+  while (raised.load() < 2 && std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(1ms);
+  }
+  std::this_thread::sleep_for(20ms);
+  EXPECT_EQ(raised.load(), 2);
+
+  while (log_.get().size() < 6 && std::chrono::steady_clock::now() < deadline)
+  {
+    fsm_->processPending();
+    std::this_thread::sleep_for(1ms);
+  }
+  producer.join();
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "e0", "e1", "e2", "e3", "e4", "e5" }));
+  EXPECT_EQ(fsm_->getDroppedEventCount(), 0u);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_P(BoundedQueueTest, EventsTakenOffQueueLeaveRoom)
+{
+  Fsm::Config config;
+  config.queue_type = GetParam();
+  config.dispatch_mode = DispatchMode::Manual;
+  config.queue_capacity = 4;
+  config.overflow_policy = OverflowPolicy::DropNewest;
+  Fsm fsm(config);
+  fsm.addState(std::make_shared<PlainState>(fsm, "s"));
+  fsm.addTransitionRule("s", "fill", [&fsm]() -> State::Id {
+    for (int i = 0; i < 10; ++i)
+    {
+      fsm.raise("e0");
+    }
+    return "s";
+  });
+  fsm.addTransitionRule("s", "e0", "s");
+  fsm.start("s");
+  fsm.raise("fill");
+  fsm.raise("e0");
+  fsm.raise("e0");
+  fsm.raise("e0");
+
+  // the three events behind "fill" were taken off the queue with it, so the queue has room for four more
+  EXPECT_EQ(fsm.processPending(), 8u);
+  EXPECT_EQ(fsm.getDroppedEventCount(), 6u);
+}
+
+INSTANTIATE_TEST_SUITE_P(QueueTypes, BoundedQueueTest, ::testing::Values(QueueType::Locked, QueueType::LockFree));
+
+//=====================================================================================================================
+TEST(CoalesceTest, MergesIdenticalPendingEvents)
+{
+  CallLog log;
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Manual;
+  config.queue_capacity = 4;
+  config.overflow_policy = OverflowPolicy::Coalesce;
+  Fsm fsm(config);
+  fsm.addState(std::make_shared<PlainState>(fsm, "s"));
+  for (const auto* event : { "e0", "e1", "e2", "e3", "e4" })
+  {
+    const std::string name = event;
+    fsm.addTransitionRule("s", name, [&log, name]() -> State::Id {
+      log.add(name);
+      return "s";
+    });
+  }
+  fsm.start("s");
+
+  // e0 and e1 merge with their pending instances, e4 finds the queue full
+  for (const auto* event : { "e0", "e1", "e0", "e2", "e1", "e3", "e4" })
+  {
+    fsm.raise(event);
+  }
+  EXPECT_EQ(fsm.getDroppedEventCount(), 3u);
+  EXPECT_EQ(fsm.processPending(), 4u);
+  EXPECT_EQ(log.get(), (std::vector<std::string>{ "e0", "e1", "e2", "e3" }));
+
+  // a processed event no longer merges
+  fsm.raise("e0");
+  EXPECT_EQ(fsm.processPending(), 1u);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(CoalesceTest, RequiresLockedQueue)
+{
+  Fsm::Config config;
+  config.queue_type = QueueType::LockFree;
+  config.overflow_policy = OverflowPolicy::Coalesce;
+  EXPECT_THROW(Fsm fsm(config), FsmException);
+}
+
+//=====================================================================================================================
+TEST(MpmcRingTest, HoldsCapacityRoundedUp)
+{
+  detail::MpmcRing<int> ring(5);
+  EXPECT_EQ(ring.capacity(), 8u);
+  EXPECT_TRUE(ring.empty());
+  for (int i = 0; i < 8; ++i)
+  {
+    int value = i;
+    EXPECT_TRUE(ring.tryPush(value));
+  }
+  int extra = 8;
+  EXPECT_FALSE(ring.tryPush(extra));
+  for (int i = 0; i < 8; ++i)
+  {
+    int value = -1;
+    EXPECT_TRUE(ring.tryPop(value));
+    EXPECT_EQ(value, i);
+  }
+  int value = -1;
+  EXPECT_FALSE(ring.tryPop(value));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(MpmcRingTest, HandsEachValueToOneConsumer)
+{
+  constexpr int NUM_THREADS = 3;
+  constexpr int NUM_VALUES = 20000;
+  detail::MpmcRing<int> ring(16);
+  std::vector<std::atomic<int>> seen(NUM_THREADS * NUM_VALUES);
+  std::atomic<int> consumed{ 0 };
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < NUM_THREADS; ++p)
+  {
+    threads.emplace_back([&ring, p]() {
+      for (int i = 0; i < NUM_VALUES; ++i)
+      {
+        int value = p * NUM_VALUES + i;
+        while (!ring.tryPush(value))
+        {
+          std::this_thread::yield();
+        }
+      }
+    });
+    threads.emplace_back([&ring, &seen, &consumed]() {
+      while (consumed.load() < NUM_THREADS * NUM_VALUES)
+      {
+        int value = 0;
+        if (ring.tryPop(value))
+        {
+          ++seen[static_cast<std::size_t>(value)];
+          ++consumed;
+        }
+        else
+        {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto& t : threads)
+  {
+    t.join();
+  }
+  for (const auto& count : seen)
+  {
+    ASSERT_EQ(count.load(), 1);
+  }
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,161 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/definition.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+namespace
+{
+const char* const MOTOR = R"(
+# a motor with a cooling fan
+state idle
+state powered
+state power_up in powered
+state speed_control in powered
+region fan fan_off
+state fan_off region fan
+state fan_on region fan
+
+event emergency urgent
+transition idle start power_up
+transition power_up ready speed_control
+transition powered stop idle
+transition powered emergency idle
+transition fan_off hot fan_on
+transition fan_on cool fan_off
+timeout power_up 50ms ready
+initial idle
+)";
+
+//---------------------------------------------------------------------------------------------------------------------
+Fsm::Config makeConfig()
+{
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Manual;
+  config.timer_wheel = std::make_shared<TimerWheel>(std::chrono::milliseconds(1), TimeSource::Virtual);
+  return config;
+}
+
+}  // namespace
+
+//=====================================================================================================================
+TEST(DefinitionTest, BuildsMachines)
+{
+  const Definition definition(MOTOR);
+  EXPECT_EQ(definition.getStates(), (std::vector<State::Id>{ "idle", "powered", "power_up", "speed_control",
+                                                             "fan_off", "fan_on" }));
+
+  CallLog log;
+  const auto factory = [&log](Fsm& fsm, const State::Id& id) { return std::make_shared<LoggedState>(fsm, id, log); };
+  const auto config = makeConfig();
+  Fsm first(config);
+  Fsm second(config);
+  first.start(definition, factory);
+  second.start(definition, factory);
+  EXPECT_EQ(log.get(), (std::vector<std::string>{ "+idle", "+fan_off", "+idle", "+fan_off" }));
+
+  first.raise("start");
+  first.raise("hot");
+  first.processPending();
+  EXPECT_EQ(first.getActiveState()->getId(), "power_up");
+  EXPECT_TRUE(first.isInState("powered"));
+  EXPECT_TRUE(first.isInState("fan_on"));
+  EXPECT_EQ(second.getActiveState()->getId(), "idle");
+
+  // the timeout of the definition
+  config.timer_wheel->advanceTo(50ms);
+  first.processPending();
+  EXPECT_EQ(first.getActiveState()->getId(), "speed_control");
+
+  // priorities of the definition
+  first.raise("stop");
+  first.raise("emergency");
+  first.raise("start");
+  first.processPending(1);
+  EXPECT_EQ(first.getActiveState()->getId(), "idle");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(DefinitionTest, ReportsOffendingLine)
+{
+  const std::vector<std::pair<std::string, std::string>> cases = {
+    { "state a\nstate a\ninitial a", "Line 2" },
+    { "state a\ntransition a go b\ninitial a", "Line 2" },
+    { "state a in b\ninitial a", "Line 1" },
+    { "state a\nevent go sometimes\ninitial a", "Line 2" },
+    { "state a\ntimeout a 10 go\ninitial a", "Line 2" },
+    { "state a\nfly away\ninitial a", "Line 2" },
+    { "state a", "initial" },
+  };
+  for (const auto& c : cases)
+  {
+    try
+    {
+      Definition definition(c.first);
+      ADD_FAILURE() << "accepted: " << c.first;
+    }
+    catch (const FsmException& e)
+    {
+      EXPECT_NE(std::string(e.what()).find(c.second), std::string::npos) << e.what();
+    }
+  }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(DefinitionTest, MatchesMachineDefinedInCode)
+{
+  const Definition definition("state a\nstate b\ntransition a go b\ntransition b go a\ninitial a\n");
+  Fsm from_text(makeConfig());
+  from_text.start(definition, [](Fsm& fsm, const State::Id& id) { return std::make_shared<PlainState>(fsm, id); });
+
+  Fsm in_code(makeConfig());
+  in_code.addState(std::make_shared<PlainState>(in_code, "a"));
+  in_code.addState(std::make_shared<PlainState>(in_code, "b"));
+  in_code.addTransitionRule("a", "go", "b");
+  in_code.addTransitionRule("b", "go", "a");
+  in_code.start("a");
+  EXPECT_EQ(from_text.saveImage(), in_code.saveImage());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(DefinitionTest, ExportsDot)
+{
+  const Definition definition(MOTOR);
+  std::ostringstream from_definition;
+  definition.exportDot(from_definition);
+  const auto dot = from_definition.str();
+  EXPECT_EQ(dot.find("digraph"), 0u);
+  EXPECT_NE(dot.find("subgraph cluster"), std::string::npos);
+  for (const auto& state : definition.getStates())
+  {
+    EXPECT_NE(dot.find("label=\"" + state), std::string::npos) << state;
+  }
+  EXPECT_NE(dot.find("[label=\"ready\"]"), std::string::npos);
+  EXPECT_NE(dot.find("power_up\\nafter 50ms / ready"), std::string::npos);
+  EXPECT_NE(dot.find("label=\"idle\", style=\"rounded,bold\""), std::string::npos);
+
+  // a running machine draws its active states in bold
+  Fsm fsm(makeConfig());
+  fsm.start(definition, [](Fsm& f, const State::Id& id) { return std::make_shared<PlainState>(f, id); });
+  fsm.raise("start");
+  fsm.processPending();
+  std::ostringstream from_machine;
+  fsm.exportDot(from_machine);
+  EXPECT_NE(from_machine.str().find("ready\", style=\"rounded,bold\""), std::string::npos);
+  EXPECT_EQ(from_machine.str().find("label=\"idle\", style=\"rounded,bold\""), std::string::npos);
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,129 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/delegate.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+TEST(DelegateTest, CallsCallable)
+{
+  Delegate<int(int, int)> empty;
+  EXPECT_FALSE(empty);
+  Delegate<int(int, int)> null(nullptr);
+  EXPECT_FALSE(null);
+
+  int offset = 10;
+  Delegate<int(int, int)> add([&offset](int a, int b) { return a + b + offset; });
+  ASSERT_TRUE(add);
+  EXPECT_EQ(add(1, 2), 13);
+  offset = 20;
+  EXPECT_EQ(add(1, 2), 23);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(DelegateTest, HoldsMoveOnlyCallables)
+{
+  auto resource = std::make_shared<int>(5);
+  std::weak_ptr<int> watch = resource;
+  std::unique_ptr<int> owned(new int(7));
+  Delegate<int()> first([owned = std::move(owned), resource]() { return *owned + *resource; });
+  resource.reset();
+  EXPECT_EQ(first(), 12);
+
+  Delegate<int()> second(std::move(first));
+  EXPECT_FALSE(first);  // NOLINT: checking moved-from state
+  EXPECT_EQ(second(), 12);
+
+  Delegate<int()> third([]() { return 0; });
+  third = std::move(second);
+  EXPECT_EQ(third(), 12);
+  EXPECT_FALSE(watch.expired());
+  third.reset();
+  EXPECT_FALSE(third);
+  EXPECT_TRUE(watch.expired());
+}
+
+//=====================================================================================================================
+class DelegateRuleTest : public ::testing::Test
+{
+protected:
+  DelegateRuleTest() : fsm_(makeConfig())
+  {
+  }
+
+  static Fsm::Config makeConfig()
+  {
+    Fsm::Config config;
+    config.dispatch_mode = DispatchMode::Inline;
+    return config;
+  }
+
+  void SetUp() override
+  {
+    low_ = fsm_.addState(std::make_shared<LoggedState>(fsm_, "low", log_));
+    high_ = fsm_.addState(std::make_shared<LoggedState>(fsm_, "high", log_));
+    set_ = fsm_.addEvent("set");
+  }
+
+  CallLog log_;
+  Fsm fsm_;
+  Fsm::StateHandle low_ = 0;
+  Fsm::StateHandle high_ = 0;
+  Fsm::EventHandle set_ = 0;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(DelegateRuleTest, TransitionDelegatePicksTarget)
+{
+  int level = 0;
+  fsm_.addTransitionRule(low_, set_, Fsm::TransitionDelegate([this, &level]() { return level > 5 ? high_ : low_; }));
+  fsm_.addTransitionRule(high_, set_, Fsm::TransitionDelegate([this, &level]() { return level > 5 ? high_ : low_; }));
+  fsm_.start("low");
+
+  level = 3;
+  fsm_.raise(set_);
+  EXPECT_EQ(fsm_.getActiveState()->getId(), "low");
+  level = 8;
+  fsm_.raise(set_);
+  EXPECT_EQ(fsm_.getActiveState()->getId(), "high");
+  level = 1;
+  fsm_.raise(set_);
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "+low", "-low", "+low", "-low", "+high", "-high", "+low" }));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(DelegateRuleTest, GuardVetoesTransition)
+{
+  bool allowed = false;
+  int calls = 0;
+  fsm_.addTransitionRule("low", "set", "high", Fsm::GuardDelegate([&allowed, &calls]() {
+                           ++calls;
+                           return allowed;
+                         }));
+  fsm_.start("low");
+  log_.clear();
+
+  // a vetoed transition exits nothing
+  fsm_.raise(set_);
+  EXPECT_EQ(calls, 1);
+  EXPECT_TRUE(log_.get().empty());
+  EXPECT_EQ(fsm_.getActiveState()->getId(), "low");
+
+  allowed = true;
+  fsm_.raise(set_);
+  EXPECT_EQ(calls, 2);
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "-low", "+high" }));
+}
+
+}  // namespace test
+}  // namespace fsm
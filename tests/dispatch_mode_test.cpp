@@ -0,0 +1,139 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace fsm
+{
+namespace test
+{
+namespace
+{
+//=====================================================================================================================
+/// State that raises an event into its own machine on entry
+class ChainingState : public LoggedState
+{
+public:
+  ChainingState(Fsm& fsm, const State::Id& id, CallLog& log, Fsm::Event next)
+    : LoggedState(fsm, id, log), next_(std::move(next))
+  {
+  }
+
+  void onEntry() override
+  {
+    LoggedState::onEntry();
+    getFsm().raise(next_);
+  }
+
+private:
+  Fsm::Event next_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+Fsm::Config makeConfig(DispatchMode mode)
+{
+  Fsm::Config config;
+  config.dispatch_mode = mode;
+  return config;
+}
+
+}  // namespace
+
+//=====================================================================================================================
+TEST(DispatchModeTest, InlineProcessesOnCaller)
+{
+  CallLog log;
+  Fsm fsm(makeConfig(DispatchMode::Inline));
+  fsm.addState(std::make_shared<LoggedState>(fsm, "a", log));
+  fsm.addState(std::make_shared<LoggedState>(fsm, "b", log));
+  fsm.addTransitionRule("a", "go", "b");
+  std::thread::id processed_on;
+  fsm.onStateChanged(
+      [&processed_on](Fsm::StateHandle, Fsm::StateHandle) { processed_on = std::this_thread::get_id(); });
+  fsm.start("a");
+
+  fsm.raise("go");
+  EXPECT_EQ(fsm.getActiveState()->getId(), "b");
+  EXPECT_EQ(processed_on, std::this_thread::get_id());
+  EXPECT_FALSE(fsm.hasPendingEvents());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(DispatchModeTest, InlineRunsEachTransitionToCompletion)
+{
+  CallLog log;
+  Fsm fsm(makeConfig(DispatchMode::Inline));
+  fsm.addState(std::make_shared<LoggedState>(fsm, "a", log));
+  fsm.addState(std::make_shared<ChainingState>(fsm, "b", log, "next"));
+  fsm.addState(std::make_shared<LoggedState>(fsm, "c", log));
+  fsm.addTransitionRule("a", "go", "b");
+  fsm.addTransitionRule("b", "next", "c");
+  fsm.start("a");
+
+  // the event raised by b's entry is processed after the transition into b, by the same raise()
+  fsm.raise("go");
+  const std::vector<std::string> expected = { "+a", "-a", "+b", "-b", "+c" };
+  EXPECT_EQ(log.get(), expected);
+  EXPECT_EQ(fsm.getActiveState()->getId(), "c");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(DispatchModeTest, ManualWaitsForOwner)
+{
+  CallLog log;
+  Fsm fsm(makeConfig(DispatchMode::Manual));
+  fsm.addState(std::make_shared<LoggedState>(fsm, "a", log));
+  fsm.addState(std::make_shared<LoggedState>(fsm, "b", log));
+  fsm.addTransitionRule("a", "go", "b");
+  fsm.addTransitionRule("b", "go", "a");
+  fsm.start("a");
+
+  fsm.raise("go");
+  fsm.raise("go");
+  fsm.raise("go");
+  EXPECT_TRUE(fsm.hasPendingEvents());
+  EXPECT_EQ(fsm.getActiveState()->getId(), "a");
+
+  EXPECT_EQ(fsm.processPending(2), 2u);
+  EXPECT_EQ(fsm.getActiveState()->getId(), "a");
+  EXPECT_TRUE(fsm.hasPendingEvents());
+  EXPECT_EQ(fsm.processPending(), 1u);
+  EXPECT_EQ(fsm.getActiveState()->getId(), "b");
+  EXPECT_FALSE(fsm.hasPendingEvents());
+  EXPECT_EQ(fsm.processPending(), 0u);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(DispatchModeTest, ManualProcessesEventsRaisedWhileProcessing)
+{
+  CallLog log;
+  Fsm fsm(makeConfig(DispatchMode::Manual));
+  fsm.addState(std::make_shared<LoggedState>(fsm, "a", log));
+  fsm.addState(std::make_shared<ChainingState>(fsm, "b", log, "next"));
+  fsm.addState(std::make_shared<LoggedState>(fsm, "c", log));
+  fsm.addTransitionRule("a", "go", "b");
+  fsm.addTransitionRule("b", "next", "c");
+  fsm.start("a");
+
+  fsm.raise("go");
+  EXPECT_EQ(fsm.processPending(), 2u);
+  EXPECT_EQ(fsm.getActiveState()->getId(), "c");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(DispatchModeTest, BackgroundRejectsProcessPending)
+{
+  Fsm fsm;
+  fsm.addState(std::make_shared<PlainState>(fsm, "a"));
+  fsm.start("a");
+  EXPECT_THROW(fsm.processPending(), FsmException);
+}
+
+}  // namespace test
+}  // namespace fsm
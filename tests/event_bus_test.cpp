@@ -0,0 +1,245 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/event_bus.h"
+#include "fsm/executor.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+namespace
+{
+//=====================================================================================================================
+/// State whose entry fails
+class FailingState : public State
+{
+public:
+  FailingState(Fsm& fsm, const State::Id& id) : State(fsm, id)
+  {
+  }
+
+  void onEntry() override
+  {
+    throw std::runtime_error("failed");
+  }
+
+  void onExit() override
+  {
+  }
+};
+
+//=====================================================================================================================
+/// State whose entry waits until it is released
+class GateState : public State
+{
+public:
+  GateState(Fsm& fsm, const State::Id& id, std::atomic<bool>& entered, std::shared_future<void> release)
+    : State(fsm, id), entered_(entered), release_(std::move(release))
+  {
+  }
+
+  void onEntry() override
+  {
+    entered_ = true;
+    release_.wait();
+  }
+
+  void onExit() override
+  {
+  }
+
+private:
+  std::atomic<bool>& entered_;
+  std::shared_future<void> release_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+/// A lamp that switches on "on" and off on "off". Dimmable lamps also handle "dim"
+std::unique_ptr<Fsm> makeLamp(bool dimmable, DispatchMode mode = DispatchMode::Manual)
+{
+  Fsm::Config config;
+  config.dispatch_mode = mode;
+  std::unique_ptr<Fsm> fsm(new Fsm(config));
+  fsm->addState(std::make_shared<PlainState>(*fsm, "off"));
+  fsm->addState(std::make_shared<PlainState>(*fsm, "on"));
+  fsm->addTransitionRule("off", "on", "on");
+  fsm->addTransitionRule("on", "off", "off");
+  if (dimmable)
+  {
+    fsm->addState(std::make_shared<PlainState>(*fsm, "dimmed"));
+    fsm->addTransitionRule("on", "dim", "dimmed");
+    fsm->addTransitionRule("dimmed", "off", "off");
+  }
+  fsm->start("off");
+  return fsm;
+}
+
+}  // namespace
+
+//=====================================================================================================================
+TEST(EventBusTest, PublishesToMachinesThatHandleEvent)
+{
+  EventBus bus;
+  auto plain = makeLamp(false);
+  auto dimmable = makeLamp(true);
+  bus.subscribe(*plain);
+  bus.subscribe(*dimmable);
+  bus.subscribe(*plain);
+  EXPECT_EQ(bus.getSubscriberCount(), 2u);
+  EXPECT_EQ(bus.getSubscriberCount("on"), 2u);
+  EXPECT_EQ(bus.getSubscriberCount("dim"), 1u);
+  EXPECT_EQ(bus.getSubscriberCount("unknown"), 0u);
+
+  EXPECT_EQ(bus.publish("on"), 2u);
+  EXPECT_EQ(bus.publish("dim"), 1u);
+  EXPECT_EQ(bus.publish("unknown"), 0u);
+  plain->processPending();
+  dimmable->processPending();
+  EXPECT_EQ(plain->getActiveState()->getId(), "on");
+  EXPECT_EQ(dimmable->getActiveState()->getId(), "dimmed");
+
+  bus.unsubscribe(*dimmable);
+  bus.unsubscribe(*dimmable);
+  EXPECT_EQ(bus.getSubscriberCount(), 1u);
+  EXPECT_EQ(bus.publish("off"), 1u);
+  EXPECT_FALSE(dimmable->hasPendingEvents());
+  bus.unsubscribe(*plain);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(EventBusTest, FansOutInBatchesInOrder)
+{
+  EventBus bus(std::make_shared<Executor>(2), 8);
+  std::vector<std::unique_ptr<Fsm>> lamps;
+  for (int i = 0; i < 100; ++i)
+  {
+    lamps.push_back(makeLamp(i % 2 == 0));
+    bus.subscribe(*lamps.back());
+  }
+  EXPECT_EQ(bus.publish("on"), 100u);
+  EXPECT_EQ(bus.publish("dim"), 50u);
+  for (std::size_t i = 0; i < lamps.size(); ++i)
+  {
+    lamps[i]->processPending();
+    EXPECT_EQ(lamps[i]->getActiveState()->getId(), (i % 2 == 0) ? "dimmed" : "on");
+  }
+  for (auto& lamp : lamps)
+  {
+    bus.unsubscribe(*lamp);
+  }
+  EXPECT_EQ(bus.getSubscriberCount(), 0u);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(EventBusTest, RaisesInAllMachinesBeforeRethrowing)
+{
+  EventBus bus;
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Inline;
+  Fsm failing(config);
+  failing.addState(std::make_shared<PlainState>(failing, "off"));
+  failing.addState(std::make_shared<FailingState>(failing, "on"));
+  failing.addTransitionRule("off", "on", "on");
+  failing.start("off");
+  auto lamp = makeLamp(false);
+  bus.subscribe(failing);
+  bus.subscribe(*lamp);
+
+  EXPECT_THROW(bus.publish("on"), std::runtime_error);
+  EXPECT_TRUE(lamp->hasPendingEvents());
+  bus.unsubscribe(failing);
+  bus.unsubscribe(*lamp);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(EventBusTest, InlineSubscribersCanChangeSubscriptions)
+{
+  // a lamp that hands over to another when switched on, from within the publication
+  EventBus bus;
+  auto second = makeLamp(false, DispatchMode::Inline);
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Inline;
+  Fsm first(config);
+  first.addState(std::make_shared<PlainState>(first, "off"));
+  first.addState(std::make_shared<PlainState>(first, "on"));
+  first.addTransitionRule("off", "on", "on");
+  first.onStateChanged([&](Fsm::StateHandle, Fsm::StateHandle to) {
+    if (first.getStateId(to) == "on")
+    {
+      bus.unsubscribe(first);
+      bus.subscribe(*second);
+    }
+  });
+  first.start("off");
+  bus.subscribe(first);
+
+  EXPECT_EQ(bus.publish("on"), 1u);
+  EXPECT_EQ(first.getActiveState()->getId(), "on");
+  EXPECT_EQ(second->getActiveState()->getId(), "off");
+  EXPECT_EQ(bus.getSubscriberCount(), 1u);
+  EXPECT_EQ(bus.publish("on"), 1u);
+  EXPECT_EQ(second->getActiveState()->getId(), "on");
+  bus.unsubscribe(*second);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(EventBusTest, UnsubscribeWaitsForPublications)
+{
+  EventBus bus;
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Inline;
+  std::unique_ptr<Fsm> fsm(new Fsm(config));
+  std::atomic<bool> entered{ false };
+  std::promise<void> release;
+  fsm->addState(std::make_shared<PlainState>(*fsm, "off"));
+  fsm->addState(std::make_shared<GateState>(*fsm, "on", entered, release.get_future().share()));
+  fsm->addTransitionRule("off", "on", "on");
+  fsm->start("off");
+  bus.subscribe(*fsm);
+
+  std::thread publisher([&bus]() { bus.publish("on"); });
+  while (!entered)
+  {
+    std::this_thread::yield();
+  }
+
+  // the publication holds no lock while it raises, but the machine is not let go until it has returned
+  EXPECT_EQ(bus.getSubscriberCount(), 1u);
+  std::atomic<bool> unsubscribed{ false };
+  std::thread unsubscriber([&]() {
+    bus.unsubscribe(*fsm);
+    unsubscribed = true;
+  });
+  std::this_thread::sleep_for(20ms);
+  EXPECT_FALSE(unsubscribed);
+  release.set_value();
+  publisher.join();
+  unsubscriber.join();
+  EXPECT_TRUE(unsubscribed);
+  fsm.reset();
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(EventBusTest, OnlyTakesRunningMachines)
+{
+  EventBus bus;
+  Fsm fsm;
+  fsm.addState(std::make_shared<PlainState>(fsm, "a"));
+  EXPECT_THROW(bus.subscribe(fsm), FsmException);
+}
+
+}  // namespace test
+}  // namespace fsm
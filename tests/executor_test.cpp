@@ -0,0 +1,238 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/executor.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+namespace
+{
+//=====================================================================================================================
+/// State that checks its machine is never run by two workers at once, and counts its entries
+class ExclusiveState : public State
+{
+public:
+  ExclusiveState(Fsm& fsm, const State::Id& id, std::atomic<int>& busy, std::atomic<int>& entries)
+    : State(fsm, id), busy_(busy), entries_(entries)
+  {
+  }
+
+  void onEntry() override
+  {
+    if (busy_.fetch_add(1) != 0)
+    {
+      overlapped = true;
+    }
+    ++entries_;
+    busy_.fetch_sub(1);
+  }
+
+  void onExit() override
+  {
+  }
+
+  bool overlapped = false;
+
+private:
+  std::atomic<int>& busy_;
+  std::atomic<int>& entries_;
+};
+
+//=====================================================================================================================
+/// State whose entry fails
+class FailingState : public State
+{
+public:
+  FailingState(Fsm& fsm, const State::Id& id) : State(fsm, id)
+  {
+  }
+
+  void onEntry() override
+  {
+    throw std::runtime_error("failed");
+  }
+
+  void onExit() override
+  {
+  }
+};
+
+}  // namespace
+
+//=====================================================================================================================
+TEST(ExecutorTest, RunsPostedTasksBeforeStopping)
+{
+  std::atomic<int> count{ 0 };
+  std::atomic<bool> on_worker{ true };
+  {
+    Executor executor(2);
+    EXPECT_EQ(executor.getThreadCount(), 2u);
+    EXPECT_FALSE(executor.isWorkerThread());
+    for (int i = 0; i < 1000; ++i)
+    {
+      executor.post([&count, &on_worker, &executor]() {
+        if (!executor.isWorkerThread())
+        {
+          on_worker = false;
+        }
+        ++count;
+      });
+    }
+  }
+  EXPECT_EQ(count.load(), 1000);
+  EXPECT_TRUE(on_worker.load());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(ExecutorTest, DiscardsExceptionsOfTasks)
+{
+  std::atomic<int> count{ 0 };
+  {
+    Executor executor(1);
+    executor.post([]() { throw std::runtime_error("discarded"); });
+    executor.post([&count]() { ++count; });
+  }
+  EXPECT_EQ(count.load(), 1);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(ExecutorTest, RunsEachMachineOnOneWorkerAtATime)
+{
+  constexpr int NUM_MACHINES = 8;
+  constexpr int NUM_EVENTS = 2000;
+  Fsm::Config config;
+  config.executor = std::make_shared<Executor>(3);
+
+  std::vector<std::unique_ptr<Fsm>> machines;
+  std::vector<std::shared_ptr<ExclusiveState>> states;
+  std::vector<std::unique_ptr<std::atomic<int>>> busy;
+  std::vector<std::unique_ptr<std::atomic<int>>> entries;
+  for (int m = 0; m < NUM_MACHINES; ++m)
+  {
+    machines.emplace_back(new Fsm(config));
+    busy.emplace_back(new std::atomic<int>(0));
+    entries.emplace_back(new std::atomic<int>(0));
+    auto& fsm = *machines.back();
+    for (const auto* id : { "a", "b" })
+    {
+      states.push_back(std::make_shared<ExclusiveState>(fsm, id, *busy.back(), *entries.back()));
+      fsm.addState(states.back());
+    }
+    fsm.addTransitionRule("a", "flip", "b");
+    fsm.addTransitionRule("b", "flip", "a");
+    fsm.start("a");
+  }
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < 2; ++p)
+  {
+    producers.emplace_back([&machines]() {
+      for (int i = 0; i < NUM_EVENTS; ++i)
+      {
+        for (auto& fsm : machines)
+        {
+          fsm->raise("flip");
+        }
+      }
+    });
+  }
+  for (auto& t : producers)
+  {
+    t.join();
+  }
+
+  for (int m = 0; m < NUM_MACHINES; ++m)
+  {
+    const auto deadline = std::chrono::steady_clock::now() + 10s;
+    while (entries[static_cast<std::size_t>(m)]->load() < 2 * NUM_EVENTS + 1 &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+      std::this_thread::sleep_for(1ms);
+    }
+    EXPECT_EQ(entries[static_cast<std::size_t>(m)]->load(), 2 * NUM_EVENTS + 1);
+    EXPECT_EQ(machines[static_cast<std::size_t>(m)]->getActiveState()->getId(), "a");
+  }
+  for (const auto& state : states)
+  {
+    EXPECT_FALSE(state->overlapped);
+  }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(ExecutorTest, ProcessesQueuedEventsOfDestroyedMachine)
+{
+  // the only worker is held up until the machine is being destroyed
+  auto executor = std::make_shared<Executor>(1);
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  executor->post([released]() { released.wait(); });
+
+  Fsm::Config config;
+  config.executor = executor;
+  std::atomic<int> busy{ 0 };
+  std::atomic<int> entries{ 0 };
+  std::unique_ptr<Fsm> fsm(new Fsm(config));
+  fsm->addState(std::make_shared<ExclusiveState>(*fsm, "a", busy, entries));
+  fsm->addState(std::make_shared<ExclusiveState>(*fsm, "b", busy, entries));
+  fsm->addTransitionRule("a", "flip", "b");
+  fsm->addTransitionRule("b", "flip", "a");
+  fsm->start("a");
+  for (int i = 0; i < 100; ++i)
+  {
+    fsm->raise("flip");
+  }
+
+  std::thread destroyer([&fsm]() { fsm.reset(); });
+  std::this_thread::sleep_for(20ms);
+  release.set_value();
+  destroyer.join();
+  EXPECT_EQ(entries.load(), 101);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(ExecutorTest, EndsDispatchOfMachineThatThrows)
+{
+  Fsm::Config config;
+  config.executor = std::make_shared<Executor>(1);
+
+  auto failing = std::unique_ptr<Fsm>(new Fsm(config));
+  failing->addState(std::make_shared<PlainState>(*failing, "ok"));
+  failing->addState(std::make_shared<FailingState>(*failing, "broken"));
+  failing->addTransitionRule("ok", "break", "broken");
+  failing->start("ok");
+
+  Fsm healthy(config);
+  healthy.addState(std::make_shared<PlainState>(healthy, "a"));
+  healthy.addState(std::make_shared<PlainState>(healthy, "b"));
+  healthy.addTransitionRule("a", "go", "b");
+  healthy.start("a");
+
+  failing->raise("break");
+  healthy.raise("go");
+  EXPECT_TRUE(healthy.waitForState("b", 5s));
+
+  // the failed machine takes no more events, and can still be destroyed
+  for (int i = 0; i < 100; ++i)
+  {
+    failing->raise("break");
+  }
+  std::this_thread::sleep_for(10ms);
+  EXPECT_TRUE(failing->hasPendingEvents());
+  failing.reset();
+}
+
+}  // namespace test
+}  // namespace fsm
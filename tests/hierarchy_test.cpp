@@ -0,0 +1,118 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+/// idle, and powered with the nested states power_up and speed_control
+class HierarchyTest : public ::testing::Test
+{
+protected:
+  HierarchyTest() : fsm_(makeConfig())
+  {
+  }
+
+  static Fsm::Config makeConfig()
+  {
+    Fsm::Config config;
+    config.dispatch_mode = DispatchMode::Inline;
+    return config;
+  }
+
+  void SetUp() override
+  {
+    fsm_.addState(std::make_shared<LoggedState>(fsm_, "idle", log_));
+    fsm_.addState(std::make_shared<LoggedState>(fsm_, "powered", log_));
+    fsm_.addState(std::make_shared<LoggedState>(fsm_, "power_up", log_), "powered");
+    fsm_.addState(std::make_shared<LoggedState>(fsm_, "speed_control", log_), "powered");
+    fsm_.addTransitionRule("idle", "on", "power_up");
+    fsm_.addTransitionRule("power_up", "ready", "speed_control");
+    fsm_.addTransitionRule("powered", "off", "idle");
+    fsm_.addTransitionRule("powered", "reset", "idle");
+    fsm_.addTransitionRule("speed_control", "reset", "power_up");
+  }
+
+  std::vector<std::string> take()
+  {
+    const auto entries = log_.get();
+    log_.clear();
+    return entries;
+  }
+
+  CallLog log_;
+  Fsm fsm_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(HierarchyTest, EntersAndExitsThroughCommonAncestor)
+{
+  fsm_.start("idle");
+  EXPECT_EQ(take(), (std::vector<std::string>{ "+idle" }));
+
+  fsm_.raise("on");
+  EXPECT_EQ(take(), (std::vector<std::string>{ "-idle", "+powered", "+power_up" }));
+
+  // powered stays active between its children
+  fsm_.raise("ready");
+  EXPECT_EQ(take(), (std::vector<std::string>{ "-power_up", "+speed_control" }));
+
+  // the parent's rule handles an event the child has no rule for
+  fsm_.raise("off");
+  EXPECT_EQ(take(), (std::vector<std::string>{ "-speed_control", "-powered", "+idle" }));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(HierarchyTest, ChildRulesOverrideParentRules)
+{
+  fsm_.start("idle");
+  fsm_.raise("on");
+  fsm_.raise("ready");
+  take();
+
+  fsm_.raise("reset");
+  EXPECT_EQ(take(), (std::vector<std::string>{ "-speed_control", "+power_up" }));
+  fsm_.raise("reset");
+  EXPECT_EQ(take(), (std::vector<std::string>{ "-power_up", "-powered", "+idle" }));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(HierarchyTest, ReportsAncestorsAsActive)
+{
+  fsm_.start("power_up");
+  EXPECT_EQ(take(), (std::vector<std::string>{ "+powered", "+power_up" }));
+  EXPECT_EQ(fsm_.getActiveState()->getId(), "power_up");
+  EXPECT_TRUE(fsm_.isInState("power_up"));
+  EXPECT_TRUE(fsm_.isInState("powered"));
+  EXPECT_FALSE(fsm_.isInState("speed_control"));
+  EXPECT_FALSE(fsm_.isInState("idle"));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(HierarchyTest, ParentCanBeTarget)
+{
+  fsm_.addTransitionRule("idle", "wake", "powered");
+  fsm_.start("idle");
+  fsm_.raise("wake");
+  EXPECT_EQ(take(), (std::vector<std::string>{ "+idle", "-idle", "+powered" }));
+  EXPECT_EQ(fsm_.getActiveState()->getId(), "powered");
+  fsm_.raise("off");
+  EXPECT_EQ(fsm_.getActiveState()->getId(), "idle");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(HierarchyTest, RejectsInvalidNesting)
+{
+  EXPECT_THROW(fsm_.addState(std::make_shared<PlainState>(fsm_, "orphan"), "nowhere"), FsmException);
+  EXPECT_THROW(fsm_.addState(std::make_shared<PlainState>(fsm_, "powered"), "power_up"), FsmException);
+}
+
+}  // namespace test
+}  // namespace fsm
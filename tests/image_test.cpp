@@ -0,0 +1,216 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+/// A pump with nested running states and a valve in a region of its own, dispatched manually
+class ImageTest : public ::testing::Test
+{
+protected:
+  static Fsm::Config makeConfig()
+  {
+    Fsm::Config config;
+    config.dispatch_mode = DispatchMode::Manual;
+    return config;
+  }
+
+  void define(Fsm& fsm)
+  {
+    fsm.addState(std::make_shared<LoggedState>(fsm, "stopped", log_));
+    fsm.addState(std::make_shared<LoggedState>(fsm, "running", log_));
+    fsm.addState(std::make_shared<LoggedState>(fsm, "slow", log_), "running");
+    fsm.addState(std::make_shared<LoggedState>(fsm, "fast", log_), "running");
+    const auto valve = fsm.addRegion("valve", "closed");
+    fsm.addState(std::make_shared<LoggedState>(fsm, "closed", log_), valve);
+    fsm.addState(std::make_shared<LoggedState>(fsm, "open", log_), valve);
+    fsm.addTransitionRule("stopped", "start", "slow");
+    fsm.addTransitionRule("slow", "faster", "fast");
+    fsm.addTransitionRule("fast", "slower", "slow");
+    fsm.addTransitionRule("running", "stop", "stopped");
+    fsm.addTransitionRule("closed", "open", "open");
+    fsm.addTransitionRule("open", "close", "closed");
+    fsm.setEventPriority("stop", EventPriority::Urgent);
+  }
+
+  Fsm::StateFactory factory()
+  {
+    return [this](Fsm& fsm, const State::Id& id) { return std::make_shared<LoggedState>(fsm, id, log_); };
+  }
+
+  CallLog log_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(ImageTest, RestoresActiveStatesAndPendingEvents)
+{
+  std::vector<std::uint8_t> image;
+  Fsm::Analysis analysis;
+  {
+    Fsm original(makeConfig());
+    define(original);
+    original.start("stopped");
+    original.raise("start");
+    original.raise("faster");
+    original.raise("open");
+    original.processPending();
+    original.raise("slower");
+    original.raise("close");
+    image = original.saveImage();
+    analysis = original.getAnalysis();
+  }
+  log_.clear();
+
+  Fsm restored(makeConfig());
+  restored.restore(image.data(), image.size(), factory());
+  EXPECT_TRUE(log_.get().empty());  // resumed without entering
+  EXPECT_EQ(restored.getActiveState()->getId(), "fast");
+  EXPECT_TRUE(restored.isInState("running"));
+  EXPECT_EQ(restored.getActiveState(1)->getId(), "open");
+  EXPECT_EQ(restored.getAnalysis().table_size, analysis.table_size);
+  EXPECT_EQ(restored.getAnalysis().num_compiled_transitions, analysis.num_compiled_transitions);
+
+  // the saved events are processed first, then the machine goes on as the original would have
+  EXPECT_TRUE(restored.hasPendingEvents());
+  EXPECT_EQ(restored.processPending(), 2u);
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "-fast", "+slow", "-open", "+closed" }));
+  restored.raise("faster");
+  restored.raise("stop");
+  restored.processPending();
+  EXPECT_EQ(restored.getActiveState()->getId(), "stopped");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(ImageTest, RoundTripsImage)
+{
+  Fsm original(makeConfig());
+  define(original);
+  original.start("stopped");
+  original.raise("start");
+  original.processPending();
+  const auto image = original.saveImage();
+
+  Fsm restored(makeConfig());
+  restored.restore(image.data(), image.size(), factory());
+  EXPECT_EQ(restored.saveImage(), image);
+
+  // the image need not be aligned
+  std::vector<std::uint8_t> shifted(image.size() + 1);
+  std::copy(image.begin(), image.end(), shifted.begin() + 1);
+  Fsm unaligned(makeConfig());
+  unaligned.restore(shifted.data() + 1, image.size(), factory());
+  EXPECT_EQ(unaligned.getActiveState()->getId(), "slow");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(ImageTest, RejectsDamagedImages)
+{
+  Fsm original(makeConfig());
+  define(original);
+  original.start("stopped");
+  const auto image = original.saveImage();
+
+  Fsm truncated(makeConfig());
+  EXPECT_THROW(truncated.restore(image.data(), image.size() / 2, factory()), FsmException);
+
+  auto bad_magic = image;
+  bad_magic[0] ^= 0xFFU;
+  Fsm wrong(makeConfig());
+  EXPECT_THROW(wrong.restore(bad_magic.data(), bad_magic.size(), factory()), FsmException);
+
+  // flipping any byte of the tables must not let the machine out of bounds
+  for (std::size_t i = 0; i < image.size(); ++i)
+  {
+    auto damaged = image;
+    damaged[i] ^= 0x80U;
+    Fsm fsm(makeConfig());
+    try
+    {
+      fsm.restore(damaged.data(), damaged.size(), factory());
+      fsm.raise("start");
+      fsm.raise("open");
+      fsm.processPending();
+    }
+    catch (const FsmException&)
+    {
+    }
+  }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(ImageTest, RejectsDuplicateNames)
+{
+  Fsm original(makeConfig());
+  define(original);
+  original.start("stopped");
+  const auto image = original.saveImage();
+
+  // a name is stored as its length followed by its characters
+  const auto rename = [&image](const std::string& from, const std::string& to) {
+    std::vector<std::uint8_t> name(sizeof(std::uint32_t), 0);
+    name[0] = static_cast<std::uint8_t>(from.size());
+    name.insert(name.end(), from.begin(), from.end());
+    auto renamed = image;
+    const auto at = std::search(renamed.begin(), renamed.end(), name.begin(), name.end());
+    EXPECT_NE(at, renamed.end());
+    std::copy(to.begin(), to.end(), at + sizeof(std::uint32_t));
+    return renamed;
+  };
+
+  // rejected after the tables are read, and the machine can still be restored from a sound image
+  const auto duplicate_state = rename("fast", "slow");
+  const auto duplicate_event = rename("slower", "faster");
+  Fsm fsm(makeConfig());
+  EXPECT_THROW(fsm.restore(duplicate_state.data(), duplicate_state.size(), factory()), FsmException);
+  EXPECT_THROW(fsm.restore(duplicate_event.data(), duplicate_event.size(), factory()), FsmException);
+  fsm.restore(image.data(), image.size(), factory());
+  EXPECT_EQ(fsm.saveImage(), image);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(ImageTest, RefusesWhatItCannotSave)
+{
+  Fsm original(makeConfig());
+  define(original);
+  original.start("stopped");
+  const auto image = original.saveImage();
+
+  // only into an empty machine
+  Fsm defined(makeConfig());
+  define(defined);
+  EXPECT_THROW(defined.restore(image.data(), image.size(), factory()), FsmException);
+
+  // not before start, nor with transition functions
+  Fsm unstarted(makeConfig());
+  define(unstarted);
+  EXPECT_THROW(unstarted.saveImage(), FsmException);
+  Fsm functional(makeConfig());
+  define(functional);
+  functional.addTransitionRule("stopped", "auto", []() -> State::Id { return "slow"; });
+  functional.start("stopped");
+  EXPECT_THROW(functional.saveImage(), FsmException);
+
+  // pending events only in manual mode
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Inline;
+  Fsm inline_fsm(config);
+  define(inline_fsm);
+  inline_fsm.start("stopped");
+  inline_fsm.raise("start");
+  EXPECT_NO_THROW(inline_fsm.saveImage());
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,202 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/memory_resource.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <new>
+
+namespace fsm
+{
+namespace test
+{
+namespace
+{
+//=====================================================================================================================
+/// Heap resource that keeps count of what it hands out
+class CountingResource : public MemoryResource
+{
+public:
+  ~CountingResource() override
+  {
+    if (outstanding_at_destruction != nullptr)
+    {
+      *outstanding_at_destruction = outstanding_bytes;
+    }
+  }
+
+  std::size_t allocations = 0;
+  std::size_t outstanding_bytes = 0;
+  std::size_t* outstanding_at_destruction = nullptr;  //!< reports memory still held when the resource is destroyed
+
+private:
+  void* doAllocate(std::size_t bytes, std::size_t alignment) override
+  {
+    ++allocations;
+    outstanding_bytes += bytes;
+    return getDefault()->allocate(bytes, alignment);
+  }
+
+  void doDeallocate(void* ptr, std::size_t bytes, std::size_t alignment) override
+  {
+    outstanding_bytes -= bytes;
+    getDefault()->deallocate(ptr, bytes, alignment);
+  }
+};
+
+}  // namespace
+
+//=====================================================================================================================
+TEST(MonotonicArenaTest, AllocatesFromBuffer)
+{
+  alignas(64) unsigned char buffer[256];
+  MonotonicArena arena(buffer, sizeof(buffer));
+  auto* const first = static_cast<unsigned char*>(arena.allocate(10, 1));
+  auto* const second = static_cast<unsigned char*>(arena.allocate(16, 16));
+  EXPECT_GE(first, buffer);
+  EXPECT_LT(second, buffer + sizeof(buffer));
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(second) % 16, 0u);
+  EXPECT_GE(second, first + 10);
+  EXPECT_GE(arena.getBytesUsed(), 26u);
+
+  // deallocation is a no-op, and without upstream running out throws
+  arena.deallocate(first, 10, 1);
+  EXPECT_THROW(arena.allocate(512), std::bad_alloc);
+
+  arena.release();
+  EXPECT_EQ(arena.getBytesUsed(), 0u);
+  EXPECT_EQ(arena.allocate(10, 1), first);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(MonotonicArenaTest, GrowsFromUpstream)
+{
+  auto upstream = std::make_shared<CountingResource>();
+  {
+    MonotonicArena arena(128, upstream);
+    for (int i = 0; i < 100; ++i)
+    {
+      std::memset(arena.allocate(64), 0xAB, 64);
+    }
+    EXPECT_GT(upstream->allocations, 1u);
+    EXPECT_LT(upstream->allocations, 10u);  // blocks double in size
+    arena.release();
+    EXPECT_EQ(arena.getBytesUsed(), 0u);
+  }
+  EXPECT_EQ(upstream->outstanding_bytes, 0u);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(PoolResourceTest, ReusesBlocks)
+{
+  auto upstream = std::make_shared<CountingResource>();
+  {
+    PoolResource pool(1024, upstream);
+    void* const first = pool.allocate(40);
+    pool.deallocate(first, 40);
+    EXPECT_EQ(pool.allocate(40), first);  // same pool, last block returned
+    const auto after_first = upstream->allocations;
+
+    pool.reserve(100, 32);
+    const auto after_reserve = upstream->allocations;
+    std::vector<void*> blocks;
+    for (int i = 0; i < 32; ++i)
+    {
+      blocks.push_back(pool.allocate(100));
+    }
+    EXPECT_EQ(upstream->allocations, after_reserve);
+    EXPECT_GE(after_reserve, after_first);
+    for (auto* block : blocks)
+    {
+      pool.deallocate(block, 100);
+    }
+
+    // larger requests go straight upstream
+    void* const large = pool.allocate(4096);
+    EXPECT_EQ(upstream->allocations, after_reserve + 1);
+    pool.deallocate(large, 4096);
+  }
+  EXPECT_EQ(upstream->outstanding_bytes, 0u);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(AllocatorTest, ComparesByResource)
+{
+  auto arena = std::make_shared<MonotonicArena>(1024);
+  Allocator<int> heap;
+  Allocator<int> from_arena(arena.get());
+  Allocator<double> rebound(from_arena);
+  EXPECT_TRUE(heap == Allocator<int>(nullptr));
+  EXPECT_TRUE(from_arena == rebound);
+  EXPECT_TRUE(heap != from_arena);
+
+  std::vector<int, Allocator<int>> values(from_arena);
+  values.assign(100, 7);
+  EXPECT_GE(arena->getBytesUsed(), 100 * sizeof(int));
+}
+
+//=====================================================================================================================
+TEST(MachineMemoryTest, DrawsOnConfiguredResources)
+{
+  auto tables = std::make_shared<CountingResource>();
+  auto queues = std::make_shared<CountingResource>();
+  for (const auto type : { QueueType::Locked, QueueType::LockFree })
+  {
+    {
+      Fsm::Config config;
+      config.queue_type = type;
+      config.dispatch_mode = DispatchMode::Manual;
+      config.memory_resource = tables;
+      config.queue_memory_resource = queues;
+      Fsm fsm(config);
+      fsm.addState(std::make_shared<PlainState>(fsm, "a"));
+      fsm.addState(std::make_shared<PlainState>(fsm, "b"));
+      fsm.addTransitionRule("a", "go", "b");
+      fsm.addTransitionRule("b", "go", "a");
+      fsm.start("a");
+      for (int i = 0; i < 1000; ++i)
+      {
+        fsm.raise("go");
+      }
+      EXPECT_EQ(fsm.processPending(), 1000u);
+      EXPECT_GT(tables->allocations, 0u);
+      EXPECT_GT(queues->allocations, 0u);
+    }
+    EXPECT_EQ(tables->outstanding_bytes, 0u);
+    EXPECT_EQ(queues->outstanding_bytes, 0u);
+  }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(MachineMemoryTest, OutlivesResourcesItOwns)
+{
+  std::size_t tables_left = 1;
+  std::size_t queues_left = 1;
+  {
+    // the machine holds the only references to its resources
+    Fsm::Config config;
+    config.dispatch_mode = DispatchMode::Manual;
+    config.memory_resource = std::make_shared<CountingResource>();
+    config.queue_memory_resource = std::make_shared<CountingResource>();
+    static_cast<CountingResource&>(*config.memory_resource).outstanding_at_destruction = &tables_left;
+    static_cast<CountingResource&>(*config.queue_memory_resource).outstanding_at_destruction = &queues_left;
+    Fsm fsm(config);
+    config = Fsm::Config();
+    fsm.addState(std::make_shared<PlainState>(fsm, "a"));
+    fsm.addState(std::make_shared<PlainState>(fsm, "b"));
+    fsm.addTransitionRule("a", "go", "b");
+    fsm.start("a");
+    fsm.raise("go");
+    fsm.raise("go");
+  }
+  EXPECT_EQ(tables_left, 0u);
+  EXPECT_EQ(queues_left, 0u);
+}
+
+}  // namespace test
+}  // namespace fsm
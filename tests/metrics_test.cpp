@@ -0,0 +1,126 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "metrics_recorder.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+TEST(HistogramTest, BucketsAreContiguous)
+{
+  std::size_t last_bucket = 0;
+  for (std::uint64_t value = 0; value < 100000; ++value)
+  {
+    const auto bucket = Histogram::bucketOf(value);
+    ASSERT_TRUE((bucket == last_bucket) || (bucket == last_bucket + 1)) << value;
+    ASSERT_LE(value, Histogram::bucketUpperBound(bucket));
+    if (bucket > 0)
+    {
+      ASSERT_GT(value, Histogram::bucketUpperBound(bucket - 1));
+    }
+    last_bucket = bucket;
+  }
+  EXPECT_LT(Histogram::bucketOf(UINT64_MAX), Histogram::NUM_BUCKETS);
+  EXPECT_EQ(Histogram::bucketUpperBound(Histogram::bucketOf(UINT64_MAX)), UINT64_MAX);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(HistogramTest, BoundsErrorOfValues)
+{
+  for (std::uint64_t value = 4; value < (1ULL << 40); value = value * 3 + 1)
+  {
+    const auto upper = Histogram::bucketUpperBound(Histogram::bucketOf(value));
+    EXPECT_LE(static_cast<double>(upper - value), 0.25 * static_cast<double>(value)) << value;
+  }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(HistogramTest, ReportsPercentiles)
+{
+  detail::AtomicHistogram recorder;
+  EXPECT_EQ(recorder.snapshot().percentile(0.5), 0u);
+  for (std::int64_t value = 1; value <= 1000; ++value)
+  {
+    recorder.record(value);
+  }
+  recorder.record(-5);  // counted as 0
+
+  const auto histogram = recorder.snapshot();
+  EXPECT_EQ(histogram.count, 1001u);
+  EXPECT_EQ(histogram.sum, 500500u);
+  EXPECT_EQ(histogram.max, 1000u);
+  EXPECT_NEAR(histogram.mean(), 500.0, 1.0);
+  EXPECT_NEAR(static_cast<double>(histogram.percentile(0.5)), 500.0, 125.0);
+  EXPECT_NEAR(static_cast<double>(histogram.percentile(0.99)), 990.0, 10.0);
+  EXPECT_EQ(histogram.percentile(1.0), 1000u);
+}
+
+//=====================================================================================================================
+TEST(MetricsTest, CountsDispatchedEvents)
+{
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Manual;
+  config.collect_metrics = true;
+  config.queue_capacity = 4;
+  config.overflow_policy = OverflowPolicy::DropNewest;
+  Fsm fsm(config);
+  fsm.addState(std::make_shared<PlainState>(fsm, "a"));
+  fsm.addState(std::make_shared<PlainState>(fsm, "b"));
+  fsm.addTransitionRule("a", "go", "b");
+  fsm.addTransitionRule("b", "go", "a");
+  fsm.addEvent("noop");
+  fsm.start("a");
+
+  for (const auto* event : { "go", "noop", "go", "go", "go", "go" })
+  {
+    fsm.raise(event);
+  }
+  fsm.processPending();
+
+  const auto metrics = fsm.getMetrics();
+#ifdef FSM_ENABLE_METRICS
+  EXPECT_EQ(metrics.events_raised, 6u);
+  EXPECT_EQ(metrics.events_processed, 4u);
+  EXPECT_EQ(metrics.transitions, 3u);
+  EXPECT_EQ(metrics.ignored_events, 1u);
+  EXPECT_EQ(metrics.dropped_events, 2u);
+  EXPECT_EQ(metrics.queue_high_water, 4u);
+  EXPECT_EQ(metrics.queue_latency.count, 4u);
+  ASSERT_EQ(metrics.states.size(), 2u);
+  EXPECT_EQ(metrics.states[0].id, "a");
+  EXPECT_EQ(metrics.states[0].on_exit.count, 2u);
+  EXPECT_EQ(metrics.states[1].on_entry.count, 2u);
+#else
+  EXPECT_EQ(metrics.events_raised, 0u);
+  EXPECT_EQ(metrics.events_processed, 0u);
+  EXPECT_EQ(metrics.transitions, 0u);
+  EXPECT_EQ(metrics.queue_latency.count, 0u);
+#endif
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(MetricsTest, StaysZeroUnlessRequested)
+{
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Inline;
+  Fsm fsm(config);
+  fsm.addState(std::make_shared<PlainState>(fsm, "a"));
+  fsm.addTransitionRule("a", "go", "a");
+  fsm.start("a");
+  fsm.raise("go");
+
+  const auto metrics = fsm.getMetrics();
+  EXPECT_EQ(metrics.events_raised, 0u);
+  EXPECT_EQ(metrics.events_processed, 0u);
+  EXPECT_EQ(metrics.transitions, 0u);
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,184 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "event_count.h"
+#include "mpsc_queue.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+TEST(MpscQueueTest, IsFifo)
+{
+  detail::MpscQueue<int> queue;
+  int value = 0;
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.tryPop(value));
+
+  for (int i = 0; i < 1000; ++i)
+  {
+    queue.push(i);
+  }
+  EXPECT_FALSE(queue.empty());
+  for (int i = 0; i < 1000; ++i)
+  {
+    ASSERT_TRUE(queue.tryPop(value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.tryPop(value));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(MpscQueueTest, PushesBatchesInOrder)
+{
+  detail::MpscQueue<int> queue;
+  queue.push(0);
+  int batch[] = { 1, 2, 3, 4 };
+  queue.pushBatch(batch, 4);
+  queue.push(5);
+
+  std::vector<int> visited;
+  queue.forEach([&visited](const int& v) { visited.push_back(v); });
+  EXPECT_EQ(visited, (std::vector<int>{ 0, 1, 2, 3, 4, 5 }));
+
+  int value = 0;
+  for (int i = 0; i <= 5; ++i)
+  {
+    ASSERT_TRUE(queue.tryPop(value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(MpscQueueTest, KeepsOrderOfEachProducer)
+{
+  constexpr int NUM_PRODUCERS = 4;
+  constexpr int NUM_VALUES = 50000;
+  detail::MpscQueue<int> queue;
+  detail::EventCount ready;
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < NUM_PRODUCERS; ++p)
+  {
+    producers.emplace_back([&queue, &ready, p]() {
+      for (int i = 0; i < NUM_VALUES; ++i)
+      {
+        queue.push(p * NUM_VALUES + i);
+        ready.notify();
+      }
+    });
+  }
+
+  // consume while producing, sleeping on the eventcount when the queue is drained
+  std::vector<int> next(NUM_PRODUCERS, 0);
+  int received = 0;
+  while (received < NUM_PRODUCERS * NUM_VALUES)
+  {
+    int value = 0;
+    if (queue.tryPop(value))
+    {
+      const int producer = value / NUM_VALUES;
+      ASSERT_EQ(value % NUM_VALUES, next[static_cast<std::size_t>(producer)]);
+      ++next[static_cast<std::size_t>(producer)];
+      ++received;
+      continue;
+    }
+    const auto key = ready.prepareWait();
+    if (!queue.empty())
+    {
+      ready.cancelWait();
+    }
+    else
+    {
+      ready.wait(key);
+    }
+  }
+  for (auto& t : producers)
+  {
+    t.join();
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(EventCountTest, WakesWaiter)
+{
+  detail::EventCount ec;
+  std::atomic<bool> flag{ false };
+  std::thread waiter([&ec, &flag]() {
+    while (!flag.load())
+    {
+      const auto key = ec.prepareWait();
+      if (flag.load())
+      {
+        ec.cancelWait();
+        break;
+      }
+      ec.wait(key);
+    }
+  });
+  std::this_thread::sleep_for(10ms);
+  flag.store(true);
+  ec.notify();
+  waiter.join();
+  EXPECT_TRUE(flag.load());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(MpscQueueTest, DeliversAllEventsOfConcurrentProducers)
+{
+  constexpr int NUM_PRODUCERS = 4;
+  constexpr int NUM_EVENTS = 10000;
+
+  Fsm::Config config;
+  config.queue_type = QueueType::LockFree;
+  Fsm fsm(config);
+  fsm.addState(std::make_shared<PlainState>(fsm, "ping"));
+  fsm.addState(std::make_shared<PlainState>(fsm, "pong"));
+  fsm.addTransitionRule("ping", "flip", "pong");
+  fsm.addTransitionRule("pong", "flip", "ping");
+  std::atomic<int> transitions{ 0 };
+  fsm.onStateChanged([&transitions](Fsm::StateHandle, Fsm::StateHandle) { ++transitions; });
+  fsm.start("ping");
+
+  const auto flip = fsm.getEventHandle("flip");
+  std::vector<std::thread> producers;
+  for (int p = 0; p < NUM_PRODUCERS; ++p)
+  {
+    producers.emplace_back([&fsm, flip]() {
+      for (int i = 0; i < NUM_EVENTS; ++i)
+      {
+        fsm.raise(flip);
+      }
+    });
+  }
+  for (auto& t : producers)
+  {
+    t.join();
+  }
+
+  // the initial state counts as a change too
+  const auto deadline = std::chrono::steady_clock::now() + 10s;
+  while (transitions.load() < NUM_PRODUCERS * NUM_EVENTS + 1 && std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(1ms);
+  }
+  EXPECT_EQ(transitions.load(), NUM_PRODUCERS * NUM_EVENTS + 1);
+  EXPECT_EQ(fsm.getStateVersion().state, fsm.getStateHandle("ping"));
+  EXPECT_EQ(fsm.getDroppedEventCount(), 0u);
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,175 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/payload.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+namespace fsm
+{
+namespace test
+{
+namespace
+{
+//=====================================================================================================================
+/// Counts live instances
+struct Tracked
+{
+  static int live;
+
+  explicit Tracked(int v) : value(v)
+  {
+    ++live;
+  }
+  Tracked(Tracked&& other) noexcept : value(other.value)
+  {
+    ++live;
+  }
+  ~Tracked()
+  {
+    --live;
+  }
+  Tracked(const Tracked&) = delete;
+  Tracked& operator=(const Tracked&) = delete;
+  Tracked& operator=(Tracked&&) = delete;
+
+  int value;
+};
+int Tracked::live = 0;
+
+struct Setpoint
+{
+  double speed;
+  int gear;
+};
+
+//=====================================================================================================================
+/// State that keeps the payload it sees on entry
+class PayloadState : public State
+{
+public:
+  PayloadState(Fsm& fsm, const State::Id& id) : State(fsm, id)
+  {
+  }
+
+  void onEntry() override
+  {
+    const auto* setpoint = getFsm().getEventPayload().get<Setpoint>();
+    seen_on_entry = (setpoint != nullptr) ? setpoint->speed : -1.0;
+  }
+
+  void onExit() override
+  {
+  }
+
+  double seen_on_entry = 0;
+};
+
+}  // namespace
+
+//=====================================================================================================================
+TEST(PayloadTest, HoldsOneTypedValue)
+{
+  Payload empty;
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(empty.get<int>(), nullptr);
+
+  Payload payload(Setpoint{ 12.5, 3 });
+  EXPECT_FALSE(payload.empty());
+  EXPECT_TRUE(payload.holds<Setpoint>());
+  EXPECT_FALSE(payload.holds<int>());
+  EXPECT_EQ(payload.get<int>(), nullptr);
+  ASSERT_NE(payload.get<Setpoint>(), nullptr);
+  EXPECT_EQ(payload.get<Setpoint>()->gear, 3);
+
+  payload.get<Setpoint>()->gear = 4;
+  EXPECT_EQ(payload.get<Setpoint>()->gear, 4);
+  payload.reset();
+  EXPECT_TRUE(payload.empty());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(PayloadTest, MovesWithoutCopying)
+{
+  Tracked::live = 0;
+  {
+    Payload first(Tracked(7));
+    EXPECT_EQ(Tracked::live, 1);
+    Payload second(std::move(first));
+    EXPECT_TRUE(first.empty());  // NOLINT: checking moved-from state
+    EXPECT_EQ(Tracked::live, 1);
+    ASSERT_TRUE(second.holds<Tracked>());
+    EXPECT_EQ(second.get<Tracked>()->value, 7);
+
+    Payload third(Tracked(8));
+    third = std::move(second);
+    EXPECT_EQ(Tracked::live, 1);
+    EXPECT_EQ(third.get<Tracked>()->value, 7);
+  }
+  EXPECT_EQ(Tracked::live, 0);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(PayloadTest, ReachesTransitionAndStates)
+{
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Manual;
+  Fsm fsm(config);
+  auto idle = std::make_shared<PayloadState>(fsm, "idle");
+  auto moving = std::make_shared<PayloadState>(fsm, "moving");
+  fsm.addState(idle);
+  fsm.addState(moving);
+  fsm.addTransitionRule("idle", "move", "moving");
+  int gear_in_transition = 0;
+  fsm.addTransitionRule("moving", "shift", [&fsm, &gear_in_transition]() -> State::Id {
+    const auto* setpoint = fsm.getEventPayload().get<Setpoint>();
+    gear_in_transition = (setpoint != nullptr) ? setpoint->gear : -1;
+    return "moving";
+  });
+  fsm.start("idle");
+
+  fsm.raise("move", Setpoint{ 2.5, 1 });
+  fsm.raise("shift", Setpoint{ 4.0, 2 });
+  EXPECT_EQ(fsm.processPending(), 2u);
+  EXPECT_EQ(gear_in_transition, 2);
+  EXPECT_EQ(moving->seen_on_entry, 4.0);
+  EXPECT_TRUE(fsm.getEventPayload().empty());
+
+  // events without payload see none
+  fsm.raise("shift");
+  fsm.processPending();
+  EXPECT_EQ(gear_in_transition, -1);
+  EXPECT_EQ(moving->seen_on_entry, -1.0);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(PayloadTest, DestroysPayloadsOfDroppedEvents)
+{
+  Tracked::live = 0;
+  {
+    Fsm::Config config;
+    config.dispatch_mode = DispatchMode::Manual;
+    config.queue_capacity = 2;
+    config.overflow_policy = OverflowPolicy::DropOldest;
+    Fsm fsm(config);
+    fsm.addState(std::make_shared<PlainState>(fsm, "s"));
+    fsm.addTransitionRule("s", "tick", "s");
+    fsm.start("s");
+    for (int i = 0; i < 5; ++i)
+    {
+      fsm.raise("tick", Tracked(i));
+    }
+    EXPECT_EQ(Tracked::live, 2);
+    fsm.raise("tick", Tracked(5));
+    EXPECT_EQ(Tracked::live, 2);
+    fsm.processPending();
+    EXPECT_EQ(Tracked::live, 0);
+  }
+  EXPECT_EQ(Tracked::live, 0);
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,106 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+/// Manually dispatched machine whose single state logs the events it processes
+class PriorityTest : public ::testing::TestWithParam<QueueType>
+{
+protected:
+  void create(std::size_t capacity)
+  {
+    Fsm::Config config;
+    config.queue_type = GetParam();
+    config.dispatch_mode = DispatchMode::Manual;
+    config.urgent_queue_capacity = capacity;
+    config.low_queue_capacity = capacity;
+    config.overflow_policy = OverflowPolicy::DropNewest;
+    fsm_.reset(new Fsm(config));
+    fsm_->addState(std::make_shared<PlainState>(*fsm_, "s"));
+    for (const auto* event : { "u1", "u2", "n1", "n2", "l1", "l2", "l3" })
+    {
+      const std::string name = event;
+      fsm_->addTransitionRule("s", name, [this, name]() -> State::Id {
+        log_.add(name);
+        return "s";
+      });
+    }
+    for (const auto* event : { "u1", "u2" })
+    {
+      fsm_->setEventPriority(event, EventPriority::Urgent);
+    }
+    for (const auto* event : { "l1", "l2", "l3" })
+    {
+      fsm_->setEventPriority(event, EventPriority::Low);
+    }
+    fsm_->start("s");
+  }
+
+  void raise(const std::vector<Fsm::Event>& events)
+  {
+    for (const auto& event : events)
+    {
+      fsm_->raise(event);
+    }
+  }
+
+  CallLog log_;
+  std::unique_ptr<Fsm> fsm_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_P(PriorityTest, ServesQueuesInOrderOfPriority)
+{
+  create(0);
+  raise({ "l1", "n1", "u1", "l2", "n2", "u2" });
+  EXPECT_EQ(fsm_->processPending(), 6u);
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "u1", "u2", "n1", "n2", "l1", "l2" }));
+  EXPECT_THROW(fsm_->setEventPriority("n1", EventPriority::Urgent), FsmException);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_P(PriorityTest, UrgentEventsOvertakeBacklog)
+{
+  create(0);
+  for (int i = 0; i < 100; ++i)
+  {
+    raise({ "n1", "l1" });
+  }
+  EXPECT_EQ(fsm_->processPending(10), 10u);
+  raise({ "u1" });
+  EXPECT_EQ(fsm_->processPending(1), 1u);
+  const auto processed = log_.get();
+  ASSERT_EQ(processed.size(), 11u);
+  EXPECT_EQ(processed.back(), "u1");
+
+  // low priority events wait for the normal backlog
+  fsm_->processPending(90);
+  EXPECT_EQ(log_.get().back(), "n1");
+  fsm_->processPending();
+  EXPECT_EQ(log_.get().back(), "l1");
+  EXPECT_EQ(log_.get().size(), 201u);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_P(PriorityTest, BoundsQueuesSeparately)
+{
+  create(2);
+  raise({ "l1", "l2", "l3", "n1", "n2", "u1", "u2", "u1" });
+  EXPECT_EQ(fsm_->getDroppedEventCount(), 2u);
+  fsm_->processPending();
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "u1", "u2", "n1", "n2", "l1", "l2" }));
+}
+
+INSTANTIATE_TEST_SUITE_P(QueueTypes, PriorityTest, ::testing::Values(QueueType::Locked, QueueType::LockFree));
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,136 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/executor.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+/// A motor in the main region and a fan in a region of its own. Both react to "off"
+class RegionTest : public ::testing::Test
+{
+protected:
+  void define(Fsm& fsm)
+  {
+    fsm.addState(std::make_shared<LoggedState>(fsm, "stopped", log_));
+    fsm.addState(std::make_shared<LoggedState>(fsm, "running", log_));
+    fan_ = fsm.addRegion("fan", "fan_off");
+    fsm.addState(std::make_shared<LoggedState>(fsm, "fan_off", log_), fan_);
+    fsm.addState(std::make_shared<LoggedState>(fsm, "fan_on", log_), fan_);
+    fsm.addTransitionRule("stopped", "start", "running");
+    fsm.addTransitionRule("running", "off", "stopped");
+    fsm.addTransitionRule("fan_off", "hot", "fan_on");
+    fsm.addTransitionRule("fan_on", "off", "fan_off");
+  }
+
+  static Fsm::Config makeConfig(DispatchMode mode)
+  {
+    Fsm::Config config;
+    config.dispatch_mode = mode;
+    return config;
+  }
+
+  CallLog log_;
+  Fsm::RegionHandle fan_ = 0;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(RegionTest, RegionsHaveTheirOwnActiveState)
+{
+  Fsm fsm(makeConfig(DispatchMode::Inline));
+  define(fsm);
+  fsm.start("stopped");
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "+stopped", "+fan_off" }));
+  EXPECT_EQ(fsm.getActiveState()->getId(), "stopped");
+  EXPECT_EQ(fsm.getActiveState(Fsm::MAIN_REGION)->getId(), "stopped");
+  EXPECT_EQ(fsm.getActiveState(fan_)->getId(), "fan_off");
+
+  fsm.raise("start");
+  fsm.raise("hot");
+  EXPECT_EQ(fsm.getActiveState()->getId(), "running");
+  EXPECT_EQ(fsm.getActiveState(fan_)->getId(), "fan_on");
+  EXPECT_TRUE(fsm.isInState("running"));
+  EXPECT_TRUE(fsm.isInState("fan_on"));
+  EXPECT_EQ(fsm.getStateVersion(fan_).state, fsm.getStateHandle("fan_on"));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(RegionTest, EventReachesEveryRegionMainFirst)
+{
+  Fsm fsm(makeConfig(DispatchMode::Inline));
+  define(fsm);
+  fsm.start("stopped");
+  fsm.raise("start");
+  fsm.raise("hot");
+  log_.clear();
+
+  fsm.raise("off");
+  EXPECT_EQ(log_.get(), (std::vector<std::string>{ "-running", "+stopped", "-fan_on", "+fan_off" }));
+
+  // a region without a rule for the event stays where it is
+  fsm.raise("hot");
+  fsm.raise("off");
+  EXPECT_EQ(fsm.getActiveState()->getId(), "stopped");
+  EXPECT_EQ(fsm.getActiveState(fan_)->getId(), "fan_off");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(RegionTest, RulesCannotCrossRegions)
+{
+  Fsm fsm(makeConfig(DispatchMode::Inline));
+  define(fsm);
+  fsm.addTransitionRule("stopped", "blow", "fan_on");
+  EXPECT_THROW(fsm.start("stopped"), FsmException);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(RegionTest, RejectsInvalidRegions)
+{
+  Fsm fsm(makeConfig(DispatchMode::Inline));
+  define(fsm);
+  EXPECT_THROW(fsm.addRegion("fan", "fan_off"), FsmException);
+  EXPECT_THROW(fsm.addState(std::make_shared<PlainState>(fsm, "x"), Fsm::RegionHandle(42)), FsmException);
+  fsm.addRegion("empty", "stopped");
+  EXPECT_THROW(fsm.start("stopped"), FsmException);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(RegionTest, RunsRegionsOnExecutor)
+{
+  Fsm::Config config;
+  config.region_executor = std::make_shared<Executor>(2);
+  for (int round = 0; round < 50; ++round)
+  {
+    log_.clear();
+    Fsm fsm(config);
+    define(fsm);
+    fsm.start("stopped");
+    fsm.raise("start");
+    fsm.raise("hot");
+    fsm.raise("off");
+    fsm.raise("start");
+    ASSERT_TRUE(fsm.waitForState("running", 5s));
+    ASSERT_TRUE(log_.waitForSize(12, 5s));
+    EXPECT_EQ(fsm.getActiveState(fan_)->getId(), "fan_off");
+
+    // the transitions of "off" in both regions completed before "start" was processed
+    const auto entries = log_.get();
+    const auto start = std::find(entries.rbegin(), entries.rend(), "-stopped");
+    const auto fan_off = std::find(entries.rbegin(), entries.rend(), "+fan_off");
+    EXPECT_LT(start - entries.rbegin(), fan_off - entries.rbegin());
+  }
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,168 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/shared_event_queue.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+/// A machine that flips between two states, and a name for its queue that is unique to the test
+class SharedEventQueueTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    name_ = "/fsm_test_" + std::to_string(::getpid()) + "_" +
+            ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    fsm_.addState(std::make_shared<PlainState>(fsm_, "a"));
+    fsm_.addState(std::make_shared<PlainState>(fsm_, "b"));
+    fsm_.addTransitionRule("a", "flip", "b");
+    fsm_.addTransitionRule("b", "flip", "a");
+    fsm_.addTransitionRule("a", "go_b", "b");
+    fsm_.onStateChanged([this](Fsm::StateHandle, Fsm::StateHandle) { ++changes_; });
+    fsm_.start("a");
+  }
+
+  bool waitForChanges(long count)
+  {
+    const auto deadline = std::chrono::steady_clock::now() + 20s;
+    while ((changes_.load() < count) && (std::chrono::steady_clock::now() < deadline))
+    {
+      std::this_thread::sleep_for(1ms);
+    }
+    return changes_.load() == count;
+  }
+
+  std::string name_;
+  std::atomic<long> changes_{ 0 };  //!< including the initial state
+  Fsm fsm_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(SharedEventQueueTest, ReclaimsOnlyStaleObjects)
+{
+  // a queue left behind by a process that died without cleaning up
+  const auto pid = ::fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0)
+  {
+    new SharedEventQueue(fsm_, name_);  // NOLINT: leaked on purpose
+    ::_exit(0);
+  }
+  ::waitpid(pid, nullptr, 0);
+
+  EXPECT_THROW(SharedEventQueue(fsm_, name_, 16), FsmException);
+  {
+    SharedEventQueue queue(fsm_, name_, 16, 0ns, 0600, true);
+
+    // a live queue is never taken over
+    EXPECT_THROW(SharedEventQueue(fsm_, name_, 16), FsmException);
+    EXPECT_THROW(SharedEventQueue(fsm_, name_, 16, 0ns, 0600, true), FsmException);
+  }
+  SharedEventQueue again(fsm_, name_);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(SharedEventQueueTest, ForwardsEvents)
+{
+  SharedEventQueue queue(fsm_, name_);
+  EXPECT_EQ(queue.getName(), name_);
+  SharedEventProducer producer(name_);
+  EXPECT_THROW(producer.getEventId("unknown"), FsmException);
+  EXPECT_THROW(producer.raise("unknown"), FsmException);
+
+  EXPECT_TRUE(producer.raise("go_b"));
+  EXPECT_TRUE(fsm_.waitForState("b", 5s));
+  const auto flip = producer.getEventId("flip");
+  const std::vector<SharedEventProducer::EventId> batch = { flip, flip, flip };
+  EXPECT_EQ(producer.raiseBatch(batch.data(), batch.data() + batch.size()), 3u);
+  EXPECT_TRUE(waitForChanges(5));
+  EXPECT_EQ(fsm_.getActiveState()->getId(), "a");
+  EXPECT_EQ(queue.getForwardedCount(), 4u);
+
+  // ids the machine does not know are discarded
+  EXPECT_TRUE(producer.raise(SharedEventProducer::EventId(1000)));
+  EXPECT_TRUE(producer.raise(flip));
+  EXPECT_TRUE(waitForChanges(6));
+  EXPECT_EQ(queue.getRejectedCount(), 1u);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(SharedEventQueueTest, ProducersStopAtFullRing)
+{
+  std::unique_ptr<SharedEventQueue> queue(new SharedEventQueue(fsm_, name_, 3));
+  SharedEventProducer producer(name_);
+  queue.reset();
+
+  // the ring is rounded up to 4, and no longer drained
+  const auto flip = producer.getEventId("flip");
+  EXPECT_TRUE(producer.raise(flip));
+  const std::vector<SharedEventProducer::EventId> batch = { flip, flip, flip, flip };
+  EXPECT_EQ(producer.raiseBatch(batch.data(), batch.data() + batch.size()), 3u);
+  EXPECT_FALSE(producer.raise(flip));
+  EXPECT_EQ(producer.raiseBatch(batch.data(), batch.data() + batch.size()), 0u);
+  EXPECT_THROW(SharedEventProducer{ name_ }, FsmException);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(SharedEventQueueTest, DeliversEveryEventOfConcurrentProducers)
+{
+  // a small ring keeps the producers contending for the last free slots
+  constexpr int NUM_PRODUCERS = 4;
+  constexpr int NUM_EVENTS = 20000;
+  SharedEventQueue queue(fsm_, name_, 4, 0ns);
+  std::vector<std::thread> producers;
+  for (int p = 0; p < NUM_PRODUCERS; ++p)
+  {
+    producers.emplace_back([this, p]() {
+      SharedEventProducer producer(name_);
+      const auto flip = producer.getEventId("flip");
+      const SharedEventProducer::EventId batch[3] = { flip, flip, flip };
+      for (int i = 0; i < NUM_EVENTS;)
+      {
+        std::size_t raised = 0;
+        if (p % 2 == 0)
+        {
+          raised = producer.raise(flip) ? 1 : 0;
+        }
+        else
+        {
+          raised = producer.raiseBatch(batch, batch + std::min(3, NUM_EVENTS - i));
+        }
+        i += static_cast<int>(raised);
+        if (raised == 0)
+        {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto& t : producers)
+  {
+    t.join();
+  }
+  EXPECT_TRUE(waitForChanges(NUM_PRODUCERS * NUM_EVENTS + 1));
+  EXPECT_EQ(queue.getForwardedCount(), static_cast<std::uint64_t>(NUM_PRODUCERS * NUM_EVENTS));
+  EXPECT_EQ(queue.getRejectedCount(), 0u);
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,137 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/simulation.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+namespace
+{
+//=====================================================================================================================
+/// Adds states idle and busy, where busy times out back to idle
+void addWorker(Fsm& fsm, std::chrono::nanoseconds timeout)
+{
+  fsm.addState(std::make_shared<PlainState>(fsm, "idle"));
+  fsm.addState(std::make_shared<PlainState>(fsm, "busy"));
+  fsm.addTransitionRule("idle", "work", "busy");
+  fsm.addTransitionRule("busy", "timeout", "idle");
+  fsm.addStateTimeout("busy", timeout, "timeout");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+/// Two workers that hand work to each other when they become idle
+/// \return The states they visited, with the virtual time of each visit
+std::vector<std::string> runRelay()
+{
+  std::vector<std::string> log;
+  Simulation sim;
+  Fsm a(sim.makeConfig());
+  Fsm b(sim.makeConfig());
+  addWorker(a, 25ms);
+  addWorker(b, 40ms);
+  const auto record = [&sim, &log](const std::string& name, Fsm& from, Fsm& to, Fsm::StateHandle state) {
+    const auto id = from.getStateId(state);
+    log.push_back(name + ":" + id + "@" +
+                  std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(sim.getTime()).count()));
+    if ((id == "idle") && (sim.getTime() != 0ms))
+    {
+      to.raise("work");
+    }
+  };
+  a.onStateChanged([&](Fsm::StateHandle, Fsm::StateHandle to) { record("a", a, b, to); });
+  b.onStateChanged([&](Fsm::StateHandle, Fsm::StateHandle to) { record("b", b, a, to); });
+  sim.add(a);
+  sim.add(b);
+  a.start("idle");
+  b.start("idle");
+  a.raiseAfter("work", 10ms);
+  b.raiseAfter("work", 10ms);
+  sim.advance(200ms);
+  sim.remove(a);
+  sim.remove(b);
+  return log;
+}
+
+}  // namespace
+
+//=====================================================================================================================
+TEST(SimulationTest, RejectsMachinesNotOnItsClock)
+{
+  Simulation sim;
+  Fsm other;
+  EXPECT_THROW(sim.add(other), FsmException);
+
+  auto config = sim.makeConfig();
+  EXPECT_EQ(config.dispatch_mode, DispatchMode::Manual);
+  EXPECT_EQ(config.timer_wheel, sim.getTimerWheel());
+  config.dispatch_mode = DispatchMode::Background;
+  Fsm background(config);
+  EXPECT_THROW(sim.add(background), FsmException);
+
+  // adding twice and removing strangers are harmless
+  Fsm fsm(sim.makeConfig());
+  sim.add(fsm);
+  sim.add(fsm);
+  sim.remove(other);
+  sim.remove(fsm);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(SimulationTest, TimeoutsTakeNoRealTime)
+{
+  Simulation sim;
+  Fsm fsm(sim.makeConfig());
+  addWorker(fsm, 1h);
+  sim.add(fsm);
+  fsm.start("idle");
+  fsm.raise("work");
+
+  const auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(sim.processPending(), 1u);
+  EXPECT_EQ(fsm.getActiveState()->getId(), "busy");
+  sim.advance(59min);
+  EXPECT_EQ(fsm.getActiveState()->getId(), "busy");
+  EXPECT_EQ(sim.step(), 1u);
+  EXPECT_EQ(fsm.getActiveState()->getId(), "idle");
+  EXPECT_EQ(sim.getTime(), 1h);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, 1s);
+
+  // nothing pending: the clock stands still
+  EXPECT_EQ(sim.step(), 0u);
+  EXPECT_EQ(sim.getTime(), 1h);
+  sim.remove(fsm);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(SimulationTest, ProcessesEachTickBeforeMovingOn)
+{
+  const std::vector<std::string> expected = { "a:idle@0",   "b:idle@0",   "a:busy@10",  "b:busy@10",  "a:idle@35",
+                                              "b:idle@50",  "a:busy@50",  "a:idle@75",  "b:busy@75",  "b:idle@115",
+                                              "a:busy@115", "a:idle@140", "b:busy@140", "b:idle@180", "a:busy@180" };
+  EXPECT_EQ(runRelay(), expected);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(SimulationTest, RunsAreRepeatable)
+{
+  const auto first = runRelay();
+  for (int i = 0; i < 10; ++i)
+  {
+    EXPECT_EQ(runRelay(), first);
+  }
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,178 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+namespace
+{
+//=====================================================================================================================
+/// Records the active state as seen from its own entry
+class SelfAwareState : public State
+{
+public:
+  SelfAwareState(Fsm& fsm, const State::Id& id) : State(fsm, id)
+  {
+  }
+
+  void onEntry() override
+  {
+    seen_on_entry = getFsm().getActiveState()->getId();
+  }
+
+  void onExit() override
+  {
+  }
+
+  std::string seen_on_entry;
+};
+
+}  // namespace
+
+//=====================================================================================================================
+TEST(StatePublicationTest, CountsTransitions)
+{
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Inline;
+  Fsm fsm(config);
+  fsm.addState(std::make_shared<PlainState>(fsm, "a"));
+  fsm.addState(std::make_shared<PlainState>(fsm, "b"));
+  fsm.addTransitionRule("a", "go", "b");
+  fsm.addTransitionRule("b", "again", "b");
+  fsm.addEvent("noop");
+  fsm.start("a");
+
+  const auto a = fsm.getStateHandle("a");
+  const auto b = fsm.getStateHandle("b");
+  const auto start = fsm.getStateVersion();
+  EXPECT_EQ(start.state, a);
+
+  fsm.raise("go");
+  auto version = fsm.getStateVersion();
+  EXPECT_EQ(version.state, b);
+  EXPECT_EQ(version.version, start.version + 1);
+
+  // a transition back into the same state is told apart by its version, an ignored event is not a transition
+  fsm.raise("again");
+  fsm.raise("noop");
+  version = fsm.getStateVersion();
+  EXPECT_EQ(version.state, b);
+  EXPECT_EQ(version.version, start.version + 2);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(StatePublicationTest, NotifiesStateChanges)
+{
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Manual;
+  Fsm fsm(config);
+  fsm.addState(std::make_shared<PlainState>(fsm, "a"));
+  fsm.addState(std::make_shared<PlainState>(fsm, "b"));
+  fsm.addTransitionRule("a", "go", "b");
+  fsm.addTransitionRule("b", "go", "a");
+
+  std::vector<std::pair<Fsm::StateHandle, Fsm::StateHandle>> changes;
+  fsm.onStateChanged([&changes](Fsm::StateHandle from, Fsm::StateHandle to) { changes.emplace_back(from, to); });
+  fsm.start("a");
+  ASSERT_EQ(changes.size(), 1u);
+  EXPECT_EQ(changes[0].second, fsm.getStateHandle("a"));
+  EXPECT_THROW(fsm.getStateId(changes[0].first), FsmException);
+
+  fsm.raise("go");
+  fsm.raise("go");
+  fsm.processPending();
+  const auto a = fsm.getStateHandle("a");
+  const auto b = fsm.getStateHandle("b");
+  ASSERT_EQ(changes.size(), 3u);
+  EXPECT_EQ(changes[1], std::make_pair(a, b));
+  EXPECT_EQ(changes[2], std::make_pair(b, a));
+  EXPECT_THROW(fsm.onStateChanged([](Fsm::StateHandle, Fsm::StateHandle) {}), FsmException);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(StatePublicationTest, CallbacksSeeTransitionUnderWay)
+{
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Inline;
+  Fsm fsm(config);
+  fsm.addState(std::make_shared<SelfAwareState>(fsm, "a"));
+  auto b = std::make_shared<SelfAwareState>(fsm, "b");
+  fsm.addState(b);
+  fsm.addTransitionRule("a", "go", "b");
+  fsm.start("a");
+  fsm.raise("go");
+  EXPECT_EQ(b->seen_on_entry, "b");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(StatePublicationTest, WaitersWakeOnTransition)
+{
+  Fsm fsm;
+  fsm.addState(std::make_shared<PlainState>(fsm, "a"));
+  fsm.addState(std::make_shared<PlainState>(fsm, "b"));
+  fsm.addTransitionRule("a", "go", "b");
+  fsm.start("a");
+
+  EXPECT_TRUE(fsm.waitForState("a", 0s));
+  EXPECT_FALSE(fsm.waitForState("b", 10ms));
+
+  std::thread waiter([&fsm]() { EXPECT_TRUE(fsm.waitForState("b", 5s)); });
+  std::this_thread::sleep_for(10ms);
+  fsm.raise("go");
+  waiter.join();
+  EXPECT_THROW(fsm.waitForState("nowhere", 0s), FsmException);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(StatePublicationTest, ReadersSeeCompletedTransitions)
+{
+  Fsm fsm;
+  fsm.addState(std::make_shared<PlainState>(fsm, "a"));
+  fsm.addState(std::make_shared<PlainState>(fsm, "b"));
+  fsm.addTransitionRule("a", "go", "b");
+  fsm.addTransitionRule("b", "go", "a");
+  fsm.start("a");
+  const auto a = fsm.getStateHandle("a");
+  const auto b = fsm.getStateHandle("b");
+
+  std::atomic<bool> done{ false };
+  std::thread reader([&]() {
+    std::uint32_t last_version = 0;
+    while (!done.load())
+    {
+      const auto version = fsm.getStateVersion();
+      // the machine alternates, so the state follows from the number of transitions
+      ASSERT_EQ(version.state, (version.version % 2 == 0) ? a : b);
+      ASSERT_GE(version.version, last_version);
+      last_version = version.version;
+      const auto& id = fsm.getActiveState()->getId();
+      ASSERT_TRUE((id == "a") || (id == "b"));
+    }
+  });
+  for (int i = 0; i < 20000; ++i)
+  {
+    fsm.raise("go");
+  }
+  EXPECT_TRUE(fsm.waitForState("a", 5s));
+  while (fsm.hasPendingEvents())
+  {
+    std::this_thread::sleep_for(1ms);
+  }
+  done = true;
+  reader.join();
+  EXPECT_EQ(fsm.getStateVersion().version % 2, 0u);
+}
+
+}  // namespace test
+}  // namespace fsm
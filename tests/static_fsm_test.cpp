@@ -0,0 +1,167 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/static_fsm.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace fsm
+{
+namespace test
+{
+namespace
+{
+std::vector<std::string> g_log;
+
+struct Idle
+{
+  void onEntry()
+  {
+    g_log.push_back("+idle");
+  }
+  void onExit()
+  {
+    g_log.push_back("-idle");
+  }
+};
+
+struct Heating
+{
+  int target = 0;
+  void onEntry()
+  {
+    g_log.push_back("+heating");
+  }
+  void onExit()
+  {
+    g_log.push_back("-heating");
+  }
+};
+
+struct Fault
+{
+  void onEntry()
+  {
+    g_log.push_back("+fault");
+  }
+  void onExit()
+  {
+    g_log.push_back("-fault");
+  }
+};
+
+struct On
+{
+  int target;
+};
+struct Off
+{
+};
+struct Reset
+{
+};
+
+/// Guards that pick the target of On by the requested temperature
+struct InRange
+{
+  bool operator()(Idle& /*state*/, const On& event) const
+  {
+    return event.target <= 100;
+  }
+};
+
+struct OutOfRange
+{
+  bool operator()(Idle& /*state*/, const On& event) const
+  {
+    return event.target > 100;
+  }
+};
+
+using Table = TransitionTable<Row<Idle, On, Heating, InRange>,     //
+                              Row<Idle, On, Fault, OutOfRange>,    //
+                              Row<Heating, Off, Idle>,             //
+                              Row<Fault, Reset, Idle>>;
+using Machine = StaticFsm<Table, Idle, Heating, Fault>;
+
+}  // namespace
+
+//=====================================================================================================================
+class StaticFsmTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    g_log.clear();
+  }
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(StaticFsmTest, RunsTransitionsOnCaller)
+{
+  Machine machine;
+  EXPECT_FALSE(machine.isRunning());
+  machine.start<Idle>();
+  EXPECT_TRUE(machine.isRunning());
+  EXPECT_TRUE(machine.isActive<Idle>());
+  EXPECT_EQ(machine.getActiveIndex(), 0u);
+
+  EXPECT_TRUE(machine.raise(On{ 50 }));
+  EXPECT_TRUE(machine.isActive<Heating>());
+  EXPECT_TRUE(machine.raise(Off{}));
+  EXPECT_TRUE(machine.isActive<Idle>());
+  const std::vector<std::string> expected = { "+idle", "-idle", "+heating", "-heating", "+idle" };
+  EXPECT_EQ(g_log, expected);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(StaticFsmTest, TakesFirstRowWhoseGuardPasses)
+{
+  Machine machine;
+  machine.start<Idle>();
+  EXPECT_TRUE(machine.raise(On{ 500 }));
+  EXPECT_TRUE(machine.isActive<Fault>());
+  EXPECT_TRUE(machine.raise(Reset{}));
+  EXPECT_TRUE(machine.raise(On{ 100 }));
+  EXPECT_TRUE(machine.isActive<Heating>());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(StaticFsmTest, IgnoresEventsWithoutRule)
+{
+  Machine machine;
+  machine.start<Idle>();
+  g_log.clear();
+  EXPECT_FALSE(machine.raise(Off{}));
+  EXPECT_FALSE(machine.raise(Reset{}));
+  EXPECT_TRUE(machine.isActive<Idle>());
+  EXPECT_TRUE(g_log.empty());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(StaticFsmTest, KeepsStateObjects)
+{
+  Heating heating;
+  heating.target = 42;
+  Machine machine(Idle{}, heating, Fault{});
+  machine.start<Idle>();
+  machine.raise(On{ 10 });
+  EXPECT_EQ(machine.get<Heating>().target, 42);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(StaticFsmTest, RejectsMisuse)
+{
+  Machine machine;
+  EXPECT_THROW(machine.raise(Off{}), FsmException);
+  machine.start<Idle>();
+  EXPECT_THROW(machine.start<Idle>(), FsmException);
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,105 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#ifndef FSM_TEST_STATES_H
+#define FSM_TEST_STATES_H
+
+#include "fsm/fsm.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+/// Thread-safe record of the state callbacks, in the order they were called
+class CallLog
+{
+public:
+  void add(const std::string& entry)
+  {
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      entries_.push_back(entry);
+    }
+    cv_.notify_all();
+  }
+
+  /// Block until the log has at least the given number of entries
+  /// \return false on timeout
+  bool waitForSize(std::size_t size, std::chrono::nanoseconds timeout) const
+  {
+    std::unique_lock<std::mutex> lk(mutex_);
+    return cv_.wait_for(lk, timeout, [this, size]() { return entries_.size() >= size; });
+  }
+
+  std::vector<std::string> get() const
+  {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return entries_;
+  }
+
+  void clear()
+  {
+    std::lock_guard<std::mutex> lk(mutex_);
+    entries_.clear();
+  }
+
+private:
+  mutable std::mutex mutex_;
+  mutable std::condition_variable cv_;
+  std::vector<std::string> entries_;
+};
+
+//=====================================================================================================================
+/// State that records its entry as "+id" and its exit as "-id"
+class LoggedState : public State
+{
+public:
+  LoggedState(Fsm& fsm, const State::Id& id, CallLog& log) : State(fsm, id), log_(log)
+  {
+  }
+
+  void onEntry() override
+  {
+    log_.add("+" + id_);
+  }
+
+  void onExit() override
+  {
+    log_.add("-" + id_);
+  }
+
+private:
+  CallLog& log_;
+};
+
+//=====================================================================================================================
+/// State that does nothing
+class PlainState : public State
+{
+public:
+  PlainState(Fsm& fsm, const State::Id& id) : State(fsm, id)
+  {
+  }
+
+  void onEntry() override
+  {
+  }
+
+  void onExit() override
+  {
+  }
+};
+
+}  // namespace test
+}  // namespace fsm
+
+#endif  // FSM_TEST_STATES_H
@@ -0,0 +1,391 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+namespace
+{
+//=====================================================================================================================
+/// Records the tags of expired timers, and the wheel's time when they fired
+class Recorder : public TimerWheel::Target
+{
+public:
+  explicit Recorder(const TimerWheel& wheel) : wheel_(wheel)
+  {
+  }
+
+  void onTimer(std::uint64_t tag) override
+  {
+    std::lock_guard<std::mutex> lk(mutex);
+    tags.push_back(tag);
+    times.push_back(wheel_.getTime());
+  }
+
+  std::mutex mutex;
+  std::vector<std::uint64_t> tags;
+  std::vector<std::chrono::nanoseconds> times;
+
+private:
+  const TimerWheel& wheel_;
+};
+
+//=====================================================================================================================
+/// State whose entry takes a while, and tells when it has begun
+class SlowEntryState : public State
+{
+public:
+  SlowEntryState(Fsm& fsm, const State::Id& id, std::atomic<bool>& entering) : State(fsm, id), entering_(entering)
+  {
+  }
+
+  void onEntry() override
+  {
+    entering_ = true;
+    std::this_thread::sleep_for(50ms);
+  }
+
+  void onExit() override
+  {
+  }
+
+private:
+  std::atomic<bool>& entering_;
+};
+
+}  // namespace
+
+//=====================================================================================================================
+TEST(TimerWheelTest, FiresAtExpiryInOrder)
+{
+  TimerWheel wheel(1ms, TimeSource::Virtual);
+  Recorder recorder(wheel);
+  wheel.schedule(recorder, 30ms, 3);
+  wheel.schedule(recorder, 10ms, 1);
+  wheel.schedule(recorder, 20ms, 2);
+  EXPECT_EQ(wheel.getPendingCount(), 3u);
+
+  EXPECT_EQ(wheel.advanceTo(9ms), 0u);
+  EXPECT_TRUE(recorder.tags.empty());
+  EXPECT_EQ(wheel.advanceTo(25ms), 2u);
+  EXPECT_EQ(recorder.tags, (std::vector<std::uint64_t>{ 1, 2 }));
+  EXPECT_EQ(wheel.getTime(), 25ms);
+  EXPECT_EQ(wheel.advanceToNextExpiry(1s), 1u);
+  EXPECT_EQ(wheel.getTime(), 30ms);
+  EXPECT_EQ(recorder.tags, (std::vector<std::uint64_t>{ 1, 2, 3 }));
+  EXPECT_EQ(recorder.times, (std::vector<std::chrono::nanoseconds>{ 10ms, 20ms, 30ms }));
+  EXPECT_EQ(wheel.getPendingCount(), 0u);
+
+  // nothing pending: the clock moves to the limit
+  EXPECT_EQ(wheel.advanceToNextExpiry(1s), 0u);
+  EXPECT_EQ(wheel.getTime(), 1s);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(TimerWheelTest, FiresDistantTimersOnTime)
+{
+  TimerWheel wheel(1ms, TimeSource::Virtual);
+  Recorder recorder(wheel);
+  const std::vector<std::chrono::nanoseconds> delays = { 70ms, 5s, 5min, 3h, 10h };
+  for (std::size_t i = 0; i < delays.size(); ++i)
+  {
+    wheel.schedule(recorder, delays[i], i);
+  }
+  while (wheel.getPendingCount() != 0)
+  {
+    wheel.advanceToNextExpiry(24h);
+  }
+  EXPECT_EQ(recorder.tags, (std::vector<std::uint64_t>{ 0, 1, 2, 3, 4 }));
+  EXPECT_EQ(recorder.times, delays);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(TimerWheelTest, FiresTimersOfSameTickInSchedulingOrder)
+{
+  // the first timer waits on a higher level, and arrives in its slot after the second was scheduled straight into it.
+  // The timers at 60ms and 70ms turn the wheel tick by tick, instead of letting it jump ahead
+  TimerWheel wheel(1ms, TimeSource::Virtual);
+  Recorder recorder(wheel);
+  wheel.schedule(recorder, 130ms, 1);
+  wheel.schedule(recorder, 60ms, 10);
+  wheel.schedule(recorder, 70ms, 11);
+  wheel.advanceTo(70ms);
+  wheel.schedule(recorder, 60ms, 2);
+  wheel.advanceTo(200ms);
+  EXPECT_EQ(recorder.tags, (std::vector<std::uint64_t>{ 10, 11, 1, 2 }));
+  EXPECT_EQ(recorder.times, (std::vector<std::chrono::nanoseconds>{ 60ms, 70ms, 130ms, 130ms }));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(TimerWheelTest, NeverFiresEarlyNorOutOfOrder)
+{
+  TimerWheel wheel(1ms, TimeSource::Virtual);
+  Recorder recorder(wheel);
+  std::mt19937 random(42);
+  std::uniform_int_distribution<int> delay_ms(0, 300000);
+  std::uniform_int_distribution<int> step_ms(1, 5000);
+
+  std::vector<std::chrono::nanoseconds> expiry;
+  std::vector<TimerWheel::TimerId> ids;
+  for (std::uint64_t tag = 0; tag < 3000; ++tag)
+  {
+    const auto delay = std::chrono::milliseconds(delay_ms(random));
+    expiry.push_back(wheel.getTime() + delay);
+    ids.push_back(wheel.schedule(recorder, delay, tag));
+    if (tag % 10 == 0)
+    {
+      wheel.advanceTo(wheel.getTime() + std::chrono::milliseconds(step_ms(random)));
+    }
+  }
+
+  // cancel some of those still pending
+  std::vector<bool> cancelled(ids.size(), false);
+  for (std::size_t i = 0; i < ids.size(); i += 7)
+  {
+    cancelled[i] = wheel.cancel(ids[i]);
+    EXPECT_FALSE(wheel.isPending(ids[i]));
+  }
+  wheel.advanceTo(wheel.getTime() + 1h);
+  EXPECT_EQ(wheel.getPendingCount(), 0u);
+
+  std::vector<bool> fired(ids.size(), false);
+  for (std::size_t i = 0; i < recorder.tags.size(); ++i)
+  {
+    const auto tag = static_cast<std::size_t>(recorder.tags[i]);
+    ASSERT_FALSE(fired[tag]) << "fired twice: " << tag;
+    ASSERT_FALSE(cancelled[tag]) << "fired after cancel: " << tag;
+    fired[tag] = true;
+    EXPECT_EQ(recorder.times[i], expiry[tag]) << tag;
+    if (i > 0)
+    {
+      const auto previous = static_cast<std::size_t>(recorder.tags[i - 1]);
+      ASSERT_TRUE((expiry[previous] < expiry[tag]) || ((expiry[previous] == expiry[tag]) && (previous < tag)))
+          << previous << " before " << tag;
+    }
+  }
+  for (std::size_t i = 0; i < ids.size(); ++i)
+  {
+    EXPECT_TRUE(fired[i] || cancelled[i]) << "lost: " << i;
+  }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(TimerWheelTest, CancelsTimers)
+{
+  TimerWheel wheel(1ms, TimeSource::Virtual);
+  Recorder first(wheel);
+  Recorder second(wheel);
+  const auto a = wheel.schedule(first, 10ms, 1);
+  const auto b = wheel.schedule(first, 20ms, 2);
+  wheel.schedule(second, 30ms, 3);
+  EXPECT_FALSE(wheel.isPending(TimerWheel::TimerId{}));
+
+  EXPECT_TRUE(wheel.isPending(a));
+  EXPECT_TRUE(wheel.cancel(a));
+  EXPECT_FALSE(wheel.cancel(a));
+  EXPECT_FALSE(wheel.isPending(a));
+
+  // the slot of a cancelled timer is reused without reviving its id
+  const auto c = wheel.schedule(first, 15ms, 4);
+  EXPECT_FALSE(wheel.isPending(a));
+  EXPECT_TRUE(wheel.isPending(c));
+
+  wheel.cancelAll(first);
+  EXPECT_FALSE(wheel.isPending(b));
+  EXPECT_FALSE(wheel.isPending(c));
+  EXPECT_EQ(wheel.getPendingCount(), 1u);
+  wheel.advanceTo(1s);
+  EXPECT_TRUE(first.tags.empty());
+  EXPECT_EQ(second.tags, (std::vector<std::uint64_t>{ 3 }));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(TimerWheelTest, FiresOnTimerThread)
+{
+  auto wheel = std::make_shared<TimerWheel>(1ms);
+  Recorder recorder(*wheel);
+  const auto start = TimerWheel::Clock::now();
+  wheel->schedule(recorder, 20ms, 1);
+  while (wheel->getPendingCount() != 0 && TimerWheel::Clock::now() - start < 5s)
+  {
+    std::this_thread::sleep_for(1ms);
+  }
+  const auto elapsed = TimerWheel::Clock::now() - start;
+  wheel->cancelAll(recorder);
+  std::lock_guard<std::mutex> lk(recorder.mutex);
+  EXPECT_EQ(recorder.tags, (std::vector<std::uint64_t>{ 1 }));
+  EXPECT_GE(elapsed, 20ms);
+}
+
+//=====================================================================================================================
+/// Timeouts and delayed events of a machine on a virtual clock, processed manually
+class MachineTimerTest : public ::testing::Test
+{
+protected:
+  MachineTimerTest() : wheel_(std::make_shared<TimerWheel>(1ms, TimeSource::Virtual)), fsm_(makeConfig(wheel_))
+  {
+  }
+
+  static Fsm::Config makeConfig(const std::shared_ptr<TimerWheel>& wheel)
+  {
+    Fsm::Config config;
+    config.dispatch_mode = DispatchMode::Manual;
+    config.timer_wheel = wheel;
+    return config;
+  }
+
+  void SetUp() override
+  {
+    fsm_.addState(std::make_shared<PlainState>(fsm_, "idle"));
+    fsm_.addState(std::make_shared<PlainState>(fsm_, "busy"));
+    fsm_.addTransitionRule("idle", "work", "busy");
+    fsm_.addTransitionRule("busy", "done", "idle");
+    fsm_.addTransitionRule("busy", "timeout", "idle");
+    fsm_.addStateTimeout("busy", 100ms, "timeout");
+  }
+
+  void advanceTo(std::chrono::nanoseconds time)
+  {
+    wheel_->advanceTo(time);
+    fsm_.processPending();
+  }
+
+  std::string active() const
+  {
+    return fsm_.getActiveState()->getId();
+  }
+
+  std::shared_ptr<TimerWheel> wheel_;
+  Fsm fsm_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(MachineTimerTest, StateTimeoutFires)
+{
+  fsm_.start("idle");
+  fsm_.raise("work");
+  fsm_.processPending();
+  advanceTo(99ms);
+  EXPECT_EQ(active(), "busy");
+  advanceTo(100ms);
+  EXPECT_EQ(active(), "idle");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(MachineTimerTest, StateTimeoutIsCancelledOnExit)
+{
+  fsm_.start("idle");
+  fsm_.raise("work");
+  fsm_.processPending();
+  advanceTo(50ms);
+  fsm_.raise("done");
+  fsm_.raise("work");
+  fsm_.processPending();
+
+  // the timeout restarted on re-entry at 50ms
+  advanceTo(120ms);
+  EXPECT_EQ(active(), "busy");
+  advanceTo(150ms);
+  EXPECT_EQ(active(), "idle");
+  EXPECT_EQ(wheel_->getPendingCount(), 0u);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(MachineTimerTest, DelayedEventsCanBeCancelled)
+{
+  fsm_.start("idle");
+  const auto id = fsm_.raiseAfter("work", 10ms);
+  const auto cancelled = fsm_.raiseAfter("work", 5ms);
+  EXPECT_TRUE(fsm_.cancelTimer(cancelled));
+  EXPECT_FALSE(fsm_.cancelTimer(cancelled));
+  advanceTo(9ms);
+  EXPECT_EQ(active(), "idle");
+  advanceTo(10ms);
+  EXPECT_EQ(active(), "busy");
+  EXPECT_FALSE(fsm_.cancelTimer(id));
+
+  const auto unknown = fsm_.raiseAfter("unknown", 1ms);
+  EXPECT_FALSE(fsm_.cancelTimer(unknown));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(MachineTimerTest, StateScopedTimersEndWithState)
+{
+  fsm_.start("idle");
+  fsm_.raise("work");
+  fsm_.processPending();
+  fsm_.raiseAfter("done", 50ms, TimerScope::State);
+  fsm_.raiseAfter("work", 60ms, TimerScope::Machine);
+  fsm_.raise("done");
+  fsm_.processPending();
+
+  // "done" was cancelled with busy, the machine scoped "work" still fires
+  advanceTo(55ms);
+  EXPECT_EQ(active(), "idle");
+  advanceTo(60ms);
+  EXPECT_EQ(active(), "busy");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(BackgroundTimerTest, DestroyingMachineDuringEntryLeavesNoTimer)
+{
+  auto wheel = std::make_shared<TimerWheel>(1ms);
+  std::atomic<bool> entering{ false };
+  Fsm::Config config;
+  config.timer_wheel = wheel;
+  std::unique_ptr<Fsm> fsm(new Fsm(config));
+  fsm->addState(std::make_shared<PlainState>(*fsm, "idle"));
+  fsm->addState(std::make_shared<SlowEntryState>(*fsm, "slow", entering));
+  fsm->addTransitionRule("idle", "go", "slow");
+  fsm->addStateTimeout("slow", 100ms, "go");
+  fsm->start("idle");
+  fsm->raise("go");
+  while (!entering)
+  {
+    std::this_thread::yield();
+  }
+
+  // the timeout of the state being entered is not armed behind the machine's back
+  fsm.reset();
+  EXPECT_EQ(wheel->getPendingCount(), 0u);
+  std::this_thread::sleep_for(150ms);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(InlineTimerTest, WaitsForOwnerThread)
+{
+  auto wheel = std::make_shared<TimerWheel>(1ms, TimeSource::Virtual);
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Inline;
+  config.timer_wheel = wheel;
+  Fsm fsm(config);
+  fsm.addState(std::make_shared<PlainState>(fsm, "a"));
+  fsm.addState(std::make_shared<PlainState>(fsm, "b"));
+  fsm.addTransitionRule("a", "go", "b");
+  fsm.start("a");
+
+  // an inline machine is not dispatched from the thread that fires its timers
+  fsm.raiseAfter("go", 10ms);
+  wheel->advanceTo(20ms);
+  EXPECT_EQ(fsm.getActiveState()->getId(), "a");
+  EXPECT_TRUE(fsm.hasPendingEvents());
+  EXPECT_EQ(fsm.processPending(), 1u);
+  EXPECT_EQ(fsm.getActiveState()->getId(), "b");
+}
+
+}  // namespace test
+}  // namespace fsm
@@ -0,0 +1,161 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "fsm/trace.h"
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+
+namespace fsm
+{
+namespace test
+{
+namespace
+{
+//---------------------------------------------------------------------------------------------------------------------
+/// Define a door. A broken door cannot be locked
+void defineDoor(Fsm& fsm, bool broken = false)
+{
+  fsm.addState(std::make_shared<PlainState>(fsm, "closed"));
+  fsm.addState(std::make_shared<PlainState>(fsm, "open"));
+  fsm.addState(std::make_shared<PlainState>(fsm, "locked"));
+  fsm.addTransitionRule("closed", "open", "open");
+  fsm.addTransitionRule("open", "close", "closed");
+  if (!broken)
+  {
+    fsm.addTransitionRule("closed", "lock", "locked");
+  }
+  fsm.addTransitionRule("locked", "unlock", "closed");
+  fsm.addTransitionRule("open", "slam", []() -> State::Id { return "nowhere"; });
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+Fsm::Config makeConfig(const std::shared_ptr<TraceRecorder>& recorder)
+{
+  Fsm::Config config;
+  config.dispatch_mode = DispatchMode::Manual;
+  config.trace_recorder = recorder;
+  return config;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+void run(Fsm& fsm, const std::vector<Fsm::Event>& events)
+{
+  for (const auto& event : events)
+  {
+    fsm.raise(event);
+  }
+  fsm.processPending();
+}
+
+}  // namespace
+
+//=====================================================================================================================
+TEST(TraceTest, RecordsOutcomeOfEachEvent)
+{
+  auto recorder = std::make_shared<TraceRecorder>(16);
+  Fsm fsm(makeConfig(recorder));
+  defineDoor(fsm);
+  fsm.start("closed");
+  run(fsm, { "open", "lock", "slam", "close", "lock" });
+
+  const auto trace = recorder->capture();
+  ASSERT_EQ(trace.records.size(), 5u);
+  EXPECT_EQ(trace.lost_records, 0u);
+
+  const auto name = [&trace](const TraceRecord& r) {
+    return trace.events.at(r.event) + ":" + trace.states.at(r.from_state) + "->" + trace.states.at(r.to_state);
+  };
+  EXPECT_EQ(name(trace.records[0]), "open:closed->open");
+  EXPECT_EQ(trace.records[0].outcome, TraceOutcome::Transition);
+  EXPECT_EQ(name(trace.records[1]), "lock:open->open");
+  EXPECT_EQ(trace.records[1].outcome, TraceOutcome::Ignored);
+  EXPECT_EQ(trace.records[2].outcome, TraceOutcome::InvalidTarget);
+  EXPECT_EQ(name(trace.records[3]), "close:open->closed");
+  EXPECT_EQ(name(trace.records[4]), "lock:closed->locked");
+  for (std::size_t i = 1; i < trace.records.size(); ++i)
+  {
+    EXPECT_LE(trace.records[i - 1].timestamp_ns, trace.records[i].timestamp_ns);
+  }
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(TraceTest, KeepsMostRecentRecords)
+{
+  auto recorder = std::make_shared<TraceRecorder>(4);
+  EXPECT_EQ(recorder->getCapacity(), 4u);
+  Fsm fsm(makeConfig(recorder));
+  defineDoor(fsm);
+  fsm.start("closed");
+  run(fsm, { "open", "close", "open", "close", "lock", "unlock" });
+
+  const auto trace = recorder->capture();
+  ASSERT_EQ(trace.records.size(), 4u);
+  EXPECT_EQ(trace.lost_records, 2u);
+  EXPECT_EQ(trace.events.at(trace.records.front().event), "open");
+  EXPECT_EQ(trace.events.at(trace.records.back().event), "unlock");
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(TraceTest, ReadsBackTraceFile)
+{
+  const auto path = ::testing::TempDir() + "fsm_trace_test.bin";
+  {
+    auto recorder = std::make_shared<TraceRecorder>(path, 8);
+    Fsm fsm(makeConfig(recorder));
+    defineDoor(fsm);
+    fsm.start("closed");
+    run(fsm, { "open", "close", "lock" });
+    const auto captured = recorder->capture();
+
+    const auto trace = readTraceFile(path);
+    EXPECT_EQ(trace.states, captured.states);
+    EXPECT_EQ(trace.events, captured.events);
+    ASSERT_EQ(trace.records.size(), captured.records.size());
+    for (std::size_t i = 0; i < trace.records.size(); ++i)
+    {
+      EXPECT_EQ(trace.records[i].timestamp_ns, captured.records[i].timestamp_ns);
+      EXPECT_EQ(trace.records[i].to_state, captured.records[i].to_state);
+    }
+  }
+  std::remove(path.c_str());
+  EXPECT_THROW(readTraceFile(path), FsmException);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST(TraceTest, ReplaysAgainstDefinition)
+{
+  auto recorder = std::make_shared<TraceRecorder>(16);
+  {
+    Fsm fsm(makeConfig(recorder));
+    defineDoor(fsm);
+    fsm.start("closed");
+    run(fsm, { "open", "lock", "close", "lock", "unlock", "open" });
+  }
+  const auto trace = recorder->capture();
+
+  Fsm same(makeConfig(nullptr));
+  defineDoor(same);
+  const auto result = replayTrace(trace, same);
+  EXPECT_EQ(result.replayed, 6u);
+  EXPECT_EQ(result.mismatches, 0u);
+  EXPECT_EQ(result.first_mismatch, SIZE_MAX);
+
+  Fsm broken(makeConfig(nullptr));
+  defineDoor(broken, true);
+  const auto diverged = replayTrace(trace, broken);
+  EXPECT_GT(diverged.mismatches, 0u);
+  EXPECT_EQ(diverged.first_mismatch, 3u);
+  EXPECT_FALSE(diverged.first_mismatch_description.empty());
+
+  Fsm background;
+  defineDoor(background);
+  EXPECT_THROW(replayTrace(trace, background), FsmException);
+}
+
+}  // namespace test
+}  // namespace fsm
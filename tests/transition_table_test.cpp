@@ -0,0 +1,131 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+#include "test_states.h"
+
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+namespace fsm
+{
+namespace test
+{
+//=====================================================================================================================
+class TransitionTableTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    fsm_.addState(std::make_shared<LoggedState>(fsm_, "idle", log_));
+    fsm_.addState(std::make_shared<LoggedState>(fsm_, "running", log_));
+    fsm_.addState(std::make_shared<LoggedState>(fsm_, "stopped", log_));
+    fsm_.addTransitionRule("idle", "start", "running");
+    fsm_.addTransitionRule("running", "stop", "stopped");
+    fsm_.addTransitionRule("stopped", "reset", "idle");
+  }
+
+  CallLog log_;
+  Fsm fsm_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(TransitionTableTest, FollowsRulesInOrder)
+{
+  fsm_.start("idle");
+  fsm_.raise("start");
+  fsm_.raise("stop");
+  fsm_.raise("reset");
+  fsm_.raise("start");
+  ASSERT_TRUE(log_.waitForSize(9, 5s));
+  const std::vector<std::string> expected = { "+idle",    "-idle",    "+running", "-running", "+stopped",
+                                              "-stopped", "+idle",    "-idle",    "+running" };
+  EXPECT_EQ(log_.get(), expected);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(TransitionTableTest, IgnoresEventsWithoutRule)
+{
+  fsm_.addEvent("unused");
+  fsm_.start("idle");
+  fsm_.raise("stop");     // no rule in idle
+  fsm_.raise("unused");   // no rule anywhere
+  fsm_.raise("unknown");  // not registered
+  fsm_.raise("start");
+  ASSERT_TRUE(fsm_.waitForState("running", 5s));
+  const std::vector<std::string> expected = { "+idle", "-idle", "+running" };
+  EXPECT_EQ(log_.get(), expected);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(TransitionTableTest, RaisesByHandle)
+{
+  const auto start = fsm_.getEventHandle("start");
+  const auto stop = fsm_.getEventHandle("stop");
+  EXPECT_NE(start, stop);
+  EXPECT_EQ(fsm_.addEvent("start"), start);
+  EXPECT_EQ(fsm_.getStateId(fsm_.getStateHandle("running")), "running");
+
+  fsm_.start("idle");
+  fsm_.raise(start);
+  fsm_.raise(stop);
+  ASSERT_TRUE(fsm_.waitForState("stopped", 5s));
+  EXPECT_THROW(fsm_.raise(Fsm::EventHandle(1000)), FsmException);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(TransitionTableTest, TakesTransitionFunctions)
+{
+  bool go_back = false;
+  fsm_.addTransitionRule("running", "toggle", [&go_back]() -> State::Id { return go_back ? "idle" : "stopped"; });
+  fsm_.start("idle");
+  fsm_.raise("start");
+  fsm_.raise("toggle");
+  ASSERT_TRUE(fsm_.waitForState("stopped", 5s));
+  go_back = true;
+  fsm_.raise("reset");
+  fsm_.raise("start");
+  fsm_.raise("toggle");
+  fsm_.raise("start");
+  fsm_.raise("stop");
+  ASSERT_TRUE(log_.waitForSize(15, 5s));
+  const std::vector<std::string> expected = { "+idle",    "-idle", "+running", "-running", "+stopped",
+                                              "-stopped", "+idle", "-idle",    "+running", "-running",
+                                              "+idle",    "-idle", "+running", "-running", "+stopped" };
+  EXPECT_EQ(log_.get(), expected);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(TransitionTableTest, ListsHandledEvents)
+{
+  fsm_.addEvent("unused");
+  const std::vector<Fsm::Event> expected = { "start", "stop", "reset" };
+  EXPECT_EQ(fsm_.getHandledEvents(), expected);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(TransitionTableTest, RejectsInvalidDefinitions)
+{
+  EXPECT_THROW(fsm_.addTransitionRule("idle", "start", "stopped"), FsmException);
+  EXPECT_THROW(fsm_.addTransitionRule("nowhere", "start", "idle"), FsmException);
+  EXPECT_THROW(fsm_.addTransitionRule("idle", "start", "nowhere"), FsmException);
+  EXPECT_THROW(fsm_.getStateHandle("nowhere"), FsmException);
+  EXPECT_THROW(fsm_.getEventHandle("nothing"), FsmException);
+  EXPECT_THROW(fsm_.raise("start"), FsmException);
+  EXPECT_THROW(fsm_.start("nowhere"), FsmException);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+TEST_F(TransitionTableTest, FreezesDefinitionOnceRunning)
+{
+  fsm_.start("idle");
+  EXPECT_TRUE(fsm_.isRunning());
+  EXPECT_THROW(fsm_.addState(std::make_shared<PlainState>(fsm_, "extra")), FsmException);
+  EXPECT_THROW(fsm_.addTransitionRule("idle", "stop", "stopped"), FsmException);
+  EXPECT_THROW(fsm_.start("idle"), FsmException);
+}
+
+}  // namespace test
+}  // namespace fsm
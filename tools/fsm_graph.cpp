@@ -0,0 +1,33 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+// Reads a machine definition file and prints its transition graph in the DOT language of Graphviz. Render it with
+// e.g. fsm_graph machine.fsm | dot -Tsvg -o machine.svg
+
+#include "fsm/definition.h"
+
+#include <iostream>
+
+//=====================================================================================================================
+int main(int argc, char** argv)
+//=====================================================================================================================
+{
+  if (argc != 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " <definition file>\n";
+    return 1;
+  }
+
+  try
+  {
+    fsm::readDefinitionFile(argv[1]).exportDot(std::cout);
+  }
+  catch (const fsm::FsmException& ex)
+  {
+    std::cerr << ex.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
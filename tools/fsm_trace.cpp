@@ -0,0 +1,76 @@
+//=====================================================================================================================
+// This file is part of fsm (https://github.com/cvilas/fsm)
+// Licensed under the MIT License. See LICENSE.md
+//=====================================================================================================================
+
+// Decodes a trace file written by fsm::TraceRecorder and prints one line per processed event
+
+#include "fsm/fsm.h"
+#include "fsm/trace.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+//---------------------------------------------------------------------------------------------------------------------
+const char* outcomeName(fsm::TraceOutcome outcome)
+//---------------------------------------------------------------------------------------------------------------------
+{
+  switch (outcome)
+  {
+    case fsm::TraceOutcome::Transition:
+      return "transition";
+    case fsm::TraceOutcome::Ignored:
+      return "ignored";
+    case fsm::TraceOutcome::InvalidTarget:
+      return "invalid_target";
+  }
+  return "unknown";
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+std::string nameOf(const std::vector<std::string>& names, std::uint32_t handle)
+//---------------------------------------------------------------------------------------------------------------------
+{
+  return (handle < names.size()) ? names[handle] : ("#" + std::to_string(handle));
+}
+}  // namespace
+
+//=====================================================================================================================
+int main(int argc, char** argv)
+//=====================================================================================================================
+{
+  const bool csv = (argc == 3) && (std::strcmp(argv[1], "--csv") == 0);
+  if ((argc != 2) && !csv)
+  {
+    std::cerr << "Usage: " << argv[0] << " [--csv] <trace file>\n";
+    return 1;
+  }
+
+  try
+  {
+    const auto trace = fsm::readTraceFile(argv[argc - 1]);
+    if (csv)
+    {
+      std::cout << "timestamp_ns,event,from_state,to_state,outcome\n";
+    }
+    else
+    {
+      std::cout << trace.records.size() << " records, " << trace.lost_records << " overwritten\n";
+    }
+    for (const auto& r : trace.records)
+    {
+      const char* sep = csv ? "," : "  ";
+      std::cout << r.timestamp_ns << sep << nameOf(trace.events, r.event) << sep
+                << nameOf(trace.states, r.from_state) << sep << nameOf(trace.states, r.to_state) << sep
+                << outcomeName(r.outcome) << "\n";
+    }
+  }
+  catch (const fsm::FsmException& ex)
+  {
+    std::cerr << ex.what() << "\n";
+    return 1;
+  }
+  return 0;
+}